@@ -0,0 +1,58 @@
+/**
+ * @file bench.h
+ * @brief Helpers for benchmark programs.
+ *
+ * A benchmark program is a `main()` that times a set of operations and prints
+ * one line per measurement. Benchmarks are built and run with `make bench`.
+ *
+ *   double start = bench_now();
+ *   for (unsigned int i = 0; i < n; i++) do_something(i);
+ *   bench_report("do_something", n, bench_now() - start);
+ *
+ * Build with optimizations enabled for meaningful results, such as with
+ * `python3 scripts/build.py` (not `--debugbuild`).
+ */
+
+#ifndef BENCH_BENCH_H
+#define BENCH_BENCH_H
+
+#include <stdio.h>
+#include <time.h>
+
+/**
+ * @brief Gets a timestamp for measuring elapsed time.
+ *
+ * @return double The current time, in seconds
+ */
+static inline double bench_now(void) {
+  struct timespec ts;
+  timespec_get(&ts, TIME_UTC);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Prints a measurement of a number of operations.
+ *
+ * @param name A description of the operation
+ * @param ops The number of operations performed
+ * @param seconds The elapsed time for all operations
+ */
+static inline void bench_report(const char *name, unsigned long ops,
+                                double seconds) {
+  printf("%-48s %10.2f ns/op %14.0f ops/s\n", name, seconds * 1e9 / ops,
+         ops / seconds);
+}
+
+/**
+ * @brief Keeps the compiler from optimizing away a computed value.
+ *
+ * This is an empty asm statement that the compiler must assume reads p and
+ * any memory, so the value must be computed and stored before it.
+ *
+ * @param p The address of the value
+ */
+static inline void bench_use(void *p) {
+  __asm__ volatile("" : : "r"(p) : "memory");
+}
+
+#endif
@@ -0,0 +1,53 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench/bench.h"
+#include "datastruct/map.h"
+#include "datastruct/str.h"
+
+static const unsigned int KEY_COUNT = 10000;
+static const unsigned int ROUNDS = 100;
+static const unsigned int CHAR_COUNT = 10000000;
+
+static void bench_map_get_str(void) {
+  str *keys = malloc(sizeof(*keys) * KEY_COUNT);
+  char *key_chars = malloc(16 * KEY_COUNT);
+  for (unsigned int i = 0; i < KEY_COUNT; i++) {
+    int len = snprintf(key_chars + 16 * i, 16, "sym_%u", i);
+    keys[i] = mem_handle_from_ptr(key_chars + 16 * i, len);
+  }
+  map_handle mh = map_create(MEM_ALLOCATOR_PLAIN);
+  for (unsigned int i = 0; i < KEY_COUNT; i++) map_set(mh, keys[i], keys[i]);
+
+  unsigned long found = 0;
+  double start = bench_now();
+  for (unsigned int r = 0; r < ROUNDS; r++) {
+    for (unsigned int i = 0; i < KEY_COUNT; i++) {
+      found += mem_is_valid(map_get_str(mh, keys[i]));
+    }
+  }
+  bench_report("map_get_str", (unsigned long)KEY_COUNT * ROUNDS,
+               bench_now() - start);
+  bench_use(&found);
+
+  map_destroy(mh);
+  free(key_chars);
+  free(keys);
+}
+
+static void bench_strbuf_concatenate_char(void) {
+  strbuf_handle buf = strbuf_create(MEM_ALLOCATOR_PLAIN, 64);
+  double start = bench_now();
+  for (unsigned int i = 0; i < CHAR_COUNT; i++) {
+    if (i % 80 == 0) strbuf_reset(buf);
+    strbuf_concatenate_char(buf, 'a' + i % 26);
+  }
+  bench_report("strbuf_concatenate_char", CHAR_COUNT, bench_now() - start);
+  strbuf_destroy(buf);
+}
+
+int main(void) {
+  bench_map_get_str();
+  bench_strbuf_concatenate_char();
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,114 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "bench/bench.h"
+#include "datastruct/cmap.h"
+#include "datastruct/map.h"
+#include "datastruct/str.h"
+
+// The total number of keys, divided among the threads.
+static const unsigned int KEY_COUNT = 2000000;
+static const unsigned int KEY_SIZE = 16;
+
+static char *key_chars;
+static str *keys;
+
+static void make_keys(void) {
+  key_chars = malloc((size_t)KEY_SIZE * KEY_COUNT);
+  keys = malloc(sizeof(*keys) * KEY_COUNT);
+  for (unsigned int i = 0; i < KEY_COUNT; i++) {
+    char *p = key_chars + (size_t)KEY_SIZE * i;
+    keys[i] = mem_handle_from_ptr(p, snprintf(p, KEY_SIZE, "sym_%u", i));
+  }
+}
+
+// The keys of one thread, and whether it sets or gets them.
+typedef struct worker {
+  pthread_t thread;
+  cmap_handle ch;
+  unsigned int start;
+  unsigned int end;
+  bool set;
+  unsigned long found;
+} worker;
+
+static void *run_worker(void *arg) {
+  worker *w = arg;
+  for (unsigned int i = w->start; i < w->end; i++) {
+    if (w->set) {
+      cmap_set(w->ch, keys[i], keys[i]);
+    } else {
+      w->found += mem_is_valid(cmap_get(w->ch, keys[i]));
+    }
+  }
+  return NULL;
+}
+
+// Runs one pass over every key, divided among a number of threads.
+static double run_threads(cmap_handle ch, unsigned int thread_count,
+                          bool set) {
+  worker *workers = calloc(thread_count, sizeof(*workers));
+  double start = bench_now();
+  for (unsigned int t = 0; t < thread_count; t++) {
+    workers[t] = (worker){.ch = ch,
+                          .start = (unsigned long)KEY_COUNT * t / thread_count,
+                          .end = (unsigned long)KEY_COUNT * (t + 1) /
+                                 thread_count,
+                          .set = set};
+    pthread_create(&workers[t].thread, NULL, run_worker, &workers[t]);
+  }
+  unsigned long found = 0;
+  for (unsigned int t = 0; t < thread_count; t++) {
+    pthread_join(workers[t].thread, NULL);
+    found += workers[t].found;
+  }
+  double seconds = bench_now() - start;
+  if (!set && found != KEY_COUNT) puts("  lost keys");
+  free(workers);
+  return seconds;
+}
+
+// Fills a new map from a number of threads, then looks up every key from the
+// same number of threads. ops/s is the total throughput of all threads.
+static void bench_threads(unsigned int thread_count) {
+  cmap_handle ch = cmap_create(MEM_ALLOCATOR_PLAIN, 0);
+  char name[64];
+  double seconds = run_threads(ch, thread_count, true);
+  snprintf(name, sizeof(name), "cmap_set, %u threads", thread_count);
+  bench_report(name, KEY_COUNT, seconds);
+  seconds = run_threads(ch, thread_count, false);
+  snprintf(name, sizeof(name), "cmap_get, %u threads", thread_count);
+  bench_report(name, KEY_COUNT, seconds);
+  cmap_destroy(ch);
+}
+
+// The same work on one thread with a plain map, for comparison.
+static void bench_map(void) {
+  map_handle mh = map_create(MEM_ALLOCATOR_PLAIN);
+  double start = bench_now();
+  for (unsigned int i = 0; i < KEY_COUNT; i++) map_set(mh, keys[i], keys[i]);
+  bench_report("map_set, 1 thread", KEY_COUNT, bench_now() - start);
+  unsigned long found = 0;
+  start = bench_now();
+  for (unsigned int i = 0; i < KEY_COUNT; i++) {
+    found += mem_is_valid(map_get(mh, keys[i]));
+  }
+  bench_report("map_get, 1 thread", KEY_COUNT, bench_now() - start);
+  bench_use(&found);
+  map_destroy(mh);
+}
+
+// Usage: bench_cmap [max threads]. The default is the number of CPUs.
+int main(int argc, char **argv) {
+  long max_threads = argc > 1 ? atol(argv[1]) : sysconf(_SC_NPROCESSORS_ONLN);
+  if (max_threads < 1) max_threads = 1;
+  make_keys();
+  bench_map();
+  for (unsigned int t = 1; t < max_threads; t <<= 1) bench_threads(t);
+  bench_threads(max_threads);
+  free(keys);
+  free(key_chars);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,67 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench/bench.h"
+#include "datastruct/map.h"
+#include "datastruct/mem.h"
+#include "datastruct/str.h"
+
+static const unsigned int KEY_COUNT = 100000;
+static const unsigned int ROUNDS = 20;
+static const unsigned int TEXT_WORDS = 200000;
+
+static void bench_map_iter(void) {
+  char *keys = malloc(KEY_COUNT);
+  map_handle mh = map_create(MEM_ALLOCATOR_PLAIN);
+  for (unsigned int i = 0; i < KEY_COUNT; i++) {
+    map_set(mh, (void *)(keys + i), mem_handle_from_ptr(keys, i + 1));
+  }
+
+  unsigned long total = 0;
+  double start = bench_now();
+  for (unsigned int r = 0; r < ROUNDS; r++) {
+    map_iter it = map_first_value_iter(mh);
+    while (!map_iter_done(it)) {
+      total += mem_size(map_iter_value(it));
+      it = map_next_value_iter(it);
+    }
+  }
+  bench_report("map value iteration", (unsigned long)KEY_COUNT * ROUNDS,
+               bench_now() - start);
+  bench_use(&total);
+
+  map_destroy(mh);
+  free(keys);
+}
+
+static void bench_split_whitespace(void) {
+  strbuf_handle buf = strbuf_create(MEM_ALLOCATOR_PLAIN, 1024);
+  for (unsigned int i = 0; i < TEXT_WORDS; i++) {
+    strbuf_concatenate_printf(buf, "word%u%s", i % 1000,
+                              i % 10 == 9 ? "\n" : " \t");
+  }
+  str text = strbuf_str(buf);
+
+  unsigned long total = 0;
+  double start = bench_now();
+  for (unsigned int r = 0; r < ROUNDS; r++) {
+    str rest = text;
+    str word;
+    while (str_is_valid(rest)) {
+      rest = str_split_whitespace_pop(rest, &word);
+      total += mem_size(word);
+    }
+  }
+  bench_report("str_split_whitespace_pop", (unsigned long)TEXT_WORDS * ROUNDS,
+               bench_now() - start);
+  bench_use(&total);
+
+  strbuf_destroy(buf);
+}
+
+int main(void) {
+  printf("sizeof(mem_handle) = %zu\n", sizeof(mem_handle));
+  bench_map_iter();
+  bench_split_whitespace();
+  return EXIT_SUCCESS;
+}
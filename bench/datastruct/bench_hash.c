@@ -0,0 +1,52 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench/bench.h"
+#include "datastruct/hash.h"
+
+static const unsigned long BYTES_PER_SIZE = 256UL * 1024 * 1024;
+static const unsigned int PTR_COUNT = 100000000;
+
+// Hashes a buffer in pieces of a given size, as a map hashes its keys.
+static void bench_hash_bytes(const unsigned char *buf, size_t size) {
+  unsigned long ops = BYTES_PER_SIZE / size;
+  // Step through the buffer so that inputs differ, but stay in cache.
+  size_t offset_mask = 4095;
+  uint64_t total = 0;
+  double start = bench_now();
+  for (unsigned long i = 0; i < ops; i++) {
+    total += hash_bytes(buf + ((i * 8) & offset_mask), size, 0);
+  }
+  double seconds = bench_now() - start;
+  char name[64];
+  snprintf(name, sizeof(name), "hash_bytes, %zu bytes (%.2f GB/s)", size,
+           BYTES_PER_SIZE / seconds / 1e9);
+  bench_report(name, ops, seconds);
+  bench_use(&total);
+}
+
+static void bench_hash_ptr(void) {
+  uint64_t total = 0;
+  double start = bench_now();
+  for (unsigned int i = 0; i < PTR_COUNT; i++) {
+    total += hash_ptr((char *)&total + i * 16);
+  }
+  bench_report("hash_ptr", PTR_COUNT, bench_now() - start);
+  bench_use(&total);
+}
+
+int main(void) {
+#ifdef DATASTRUCT_HASH_FNV
+  puts("DATASTRUCT_HASH_FNV");
+#endif
+  static const size_t SIZES[] = {4, 8, 16, 32, 64, 256, 4096, 65536};
+  unsigned char *buf = malloc(4096 + 65536);
+  for (unsigned int i = 0; i < 4096 + 65536; i++) buf[i] = i * 7;
+  for (unsigned int i = 0; i < sizeof(SIZES) / sizeof(SIZES[0]); i++) {
+    bench_hash_bytes(buf, SIZES[i]);
+  }
+  bench_hash_ptr();
+  free(buf);
+  return EXIT_SUCCESS;
+}
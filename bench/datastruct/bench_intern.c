@@ -0,0 +1,81 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench/bench.h"
+#include "datastruct/intern.h"
+#include "datastruct/str.h"
+
+// Tokens drawn from a smaller set of distinct words, as in a source file.
+static const unsigned int TOKEN_COUNT = 2000000;
+static const unsigned int WORD_COUNT = 50000;
+static const unsigned int WORD_SIZE = 16;
+
+static char *word_chars;
+static str *tokens;
+
+static void make_tokens(void) {
+  word_chars = malloc((size_t)WORD_SIZE * WORD_COUNT);
+  str *words = malloc(sizeof(*words) * WORD_COUNT);
+  for (unsigned int i = 0; i < WORD_COUNT; i++) {
+    char *p = word_chars + (size_t)WORD_SIZE * i;
+    words[i] = mem_handle_from_ptr(p, snprintf(p, WORD_SIZE, "word_%u", i));
+  }
+  tokens = malloc(sizeof(*tokens) * TOKEN_COUNT);
+  srand(1);
+  for (unsigned int i = 0; i < TOKEN_COUNT; i++) {
+    tokens[i] = words[rand() % WORD_COUNT];
+  }
+  free(words);
+}
+
+static void bench_intern_str(void) {
+  intern_handle ih = intern_create(MEM_ALLOCATOR_PLAIN);
+  unsigned long total = 0;
+  double start = bench_now();
+  for (unsigned int i = 0; i < TOKEN_COUNT; i++) {
+    total += intern_str(ih, tokens[i]);
+  }
+  bench_report("intern_str", TOKEN_COUNT, bench_now() - start);
+  bench_use(&total);
+
+  intern_memory use = intern_memory_use(ih);
+  printf("  %zu atoms, %zu bytes per atom (%zu string, %zu table)\n",
+         use.atom_count, use.bytes_per_atom, use.string_bytes,
+         use.table_bytes);
+  intern_destroy(ih);
+}
+
+static void bench_intern_many(void) {
+  intern_handle ih = intern_create(MEM_ALLOCATOR_PLAIN);
+  atom *atoms = malloc(sizeof(*atoms) * TOKEN_COUNT);
+  double start = bench_now();
+  intern_many(ih, tokens, atoms, TOKEN_COUNT);
+  bench_report("intern_many", TOKEN_COUNT, bench_now() - start);
+  bench_use(atoms);
+
+  // Once interned, tokens compare as integers.
+  unsigned long matches = 0;
+  start = bench_now();
+  for (unsigned int i = 1; i < TOKEN_COUNT; i++) {
+    matches += atoms[i] == atoms[i - 1];
+  }
+  bench_report("compare atoms", TOKEN_COUNT - 1, bench_now() - start);
+  start = bench_now();
+  for (unsigned int i = 1; i < TOKEN_COUNT; i++) {
+    matches += str_compare(tokens[i], tokens[i - 1]) == 0;
+  }
+  bench_report("compare strs", TOKEN_COUNT - 1, bench_now() - start);
+  bench_use(&matches);
+
+  free(atoms);
+  intern_destroy(ih);
+}
+
+int main(void) {
+  make_tokens();
+  bench_intern_str();
+  bench_intern_many();
+  free(tokens);
+  free(word_chars);
+  return EXIT_SUCCESS;
+}
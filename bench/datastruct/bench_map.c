@@ -0,0 +1,258 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench/bench.h"
+#include "datastruct/map.h"
+#include "datastruct/str.h"
+#include "datastruct/tmap.h"
+
+// The largest key count. 900,000 keys fill a table of 2^20 slots to 86%, and
+// 400,000 keys fill it to 38%.
+static const unsigned int MAX_KEY_COUNT = 900000;
+static const unsigned int KEY_SIZE = 16;
+
+static char *key_chars;
+static str *keys;
+static str *missing_keys;
+
+// Makes keys to insert, and keys that are never inserted.
+static void make_keys(void) {
+  key_chars = malloc((size_t)KEY_SIZE * MAX_KEY_COUNT * 2);
+  keys = malloc(sizeof(*keys) * MAX_KEY_COUNT);
+  missing_keys = malloc(sizeof(*missing_keys) * MAX_KEY_COUNT);
+  for (unsigned int i = 0; i < MAX_KEY_COUNT; i++) {
+    char *p = key_chars + (size_t)KEY_SIZE * i;
+    keys[i] = mem_handle_from_ptr(p, snprintf(p, KEY_SIZE, "sym_%u", i));
+    p += (size_t)KEY_SIZE * MAX_KEY_COUNT;
+    missing_keys[i] =
+        mem_handle_from_ptr(p, snprintf(p, KEY_SIZE, "nil_%u", i));
+  }
+}
+
+static void report(const char *op, unsigned int key_count, double seconds) {
+  char name[64];
+  snprintf(name, sizeof(name), "%s, %uk keys", op, key_count / 1000);
+  bench_report(name, key_count, seconds);
+}
+
+static unsigned long get_all(map_handle mh, str *lookup_keys,
+                             unsigned int key_count) {
+  unsigned long found = 0;
+  for (unsigned int i = 0; i < key_count; i++) {
+    found += mem_is_valid(map_get_str(mh, lookup_keys[i]));
+  }
+  return found;
+}
+
+static void bench_map(unsigned int key_count) {
+  map_handle mh = map_create(MEM_ALLOCATOR_PLAIN);
+  double start = bench_now();
+  for (unsigned int i = 0; i < key_count; i++) map_set(mh, keys[i], keys[i]);
+  report("map_set_str, new", key_count, bench_now() - start);
+
+  start = bench_now();
+  unsigned long found = get_all(mh, keys, key_count);
+  report("map_get_str, hit", key_count, bench_now() - start);
+  start = bench_now();
+  found += get_all(mh, missing_keys, key_count);
+  report("map_get_str, miss", key_count, bench_now() - start);
+  bench_use(&found);
+
+  // Deletes and re-adds each key, keeping the map at the same size.
+  start = bench_now();
+  for (unsigned int i = 0; i < key_count; i++) {
+    map_delete_str(mh, keys[i]);
+    map_set(mh, keys[i], keys[i]);
+  }
+  report("map_delete_str + map_set_str", key_count, bench_now() - start);
+  if (get_all(mh, keys, key_count) != key_count) puts("  lost keys");
+
+  start = bench_now();
+  for (unsigned int i = 0; i < key_count; i++) map_delete_str(mh, keys[i]);
+  report("map_delete_str", key_count, bench_now() - start);
+  map_destroy(mh);
+}
+
+// Loads keys into a new map and looks them up, one at a time and in bulk.
+static void bench_bulk(unsigned int key_count) {
+  mem_handle *values = malloc(sizeof(*values) * key_count);
+  for (unsigned int i = 0; i < key_count; i++) values[i] = keys[i];
+
+  map_handle mh = map_create(MEM_ALLOCATOR_PLAIN);
+  double start = bench_now();
+  for (unsigned int i = 0; i < key_count; i++) map_set(mh, keys[i], values[i]);
+  report("load, map_set", key_count, bench_now() - start);
+  map_destroy(mh);
+
+  mh = map_create(MEM_ALLOCATOR_PLAIN);
+  start = bench_now();
+  map_reserve(mh, key_count);
+  for (unsigned int i = 0; i < key_count; i++) map_set(mh, keys[i], values[i]);
+  report("load, map_reserve + map_set", key_count, bench_now() - start);
+  map_destroy(mh);
+
+  mh = map_create(MEM_ALLOCATOR_PLAIN);
+  start = bench_now();
+  map_set_many(mh, keys, values, key_count);
+  report("load, map_set_many", key_count, bench_now() - start);
+
+  start = bench_now();
+  unsigned long found = get_all(mh, keys, key_count);
+  report("map_get_str, hit", key_count, bench_now() - start);
+  start = bench_now();
+  found += map_get_many(mh, keys, values, key_count);
+  report("map_get_many, hit", key_count, bench_now() - start);
+  start = bench_now();
+  found += get_all(mh, missing_keys, key_count);
+  report("map_get_str, miss", key_count, bench_now() - start);
+  start = bench_now();
+  found += map_get_many(mh, missing_keys, values, key_count);
+  report("map_get_many, miss", key_count, bench_now() - start);
+  bench_use(&found);
+  map_destroy(mh);
+  free(values);
+}
+
+static unsigned long iter_all(map_handle mh) {
+  unsigned long found = 0;
+  for (map_iter it = map_first_value_iter(mh); !map_iter_done(it);
+       it = map_next_value_iter(it)) {
+    found += map_iter_value(it).size;
+  }
+  return found;
+}
+
+// Iterates a full map, then the same map after deleting most of its keys.
+static void bench_iter(unsigned int key_count) {
+  static const unsigned int ROUNDS = 10;
+  map_handle mh = map_create(MEM_ALLOCATOR_PLAIN);
+  for (unsigned int i = 0; i < key_count; i++) map_set(mh, keys[i], keys[i]);
+  unsigned long found = 0;
+  double start = bench_now();
+  for (unsigned int r = 0; r < ROUNDS; r++) found += iter_all(mh);
+  report("map_next_value_iter, full", key_count * ROUNDS, bench_now() - start);
+
+  // Deleting 3 of every 4 keys leaves the table as large as it can be for the
+  // keys that remain.
+  for (unsigned int i = 0; i < key_count; i++) {
+    if (i % 4) map_delete_str(mh, keys[i]);
+  }
+  start = bench_now();
+  for (unsigned int r = 0; r < ROUNDS; r++) found += iter_all(mh);
+  report("map_next_value_iter, 1/4 left", key_count / 4 * ROUNDS,
+         bench_now() - start);
+  bench_use(&found);
+  map_destroy(mh);
+}
+
+// Counts each key four times, as a word counting loop does, with either
+// map_get followed by map_set or map_get_or_insert.
+static void bench_count(unsigned int key_count, bool upsert) {
+  static const unsigned int ROUNDS = 4;
+  unsigned int *counts = calloc(key_count, sizeof(*counts));
+  unsigned int next_count = 0;
+  map_handle mh = map_create(MEM_ALLOCATOR_PLAIN);
+  double start = bench_now();
+  for (unsigned int r = 0; r < ROUNDS; r++) {
+    for (unsigned int i = 0; i < key_count; i++) {
+      if (upsert) {
+        bool inserted;
+        mem_handle *slot = map_get_or_insert_str(mh, keys[i], &inserted);
+        if (inserted) {
+          *slot = mem_handle_from_ptr(&counts[next_count++], sizeof(*counts));
+        }
+        ++*(unsigned int *)mem_p(*slot);
+      } else {
+        mem_handle value = map_get_str(mh, keys[i]);
+        if (!mem_is_valid(value)) {
+          value = mem_handle_from_ptr(&counts[next_count++], sizeof(*counts));
+          map_set(mh, keys[i], value);
+        }
+        ++*(unsigned int *)mem_p(value);
+      }
+    }
+  }
+  double seconds = bench_now() - start;
+  char name[64];
+  snprintf(name, sizeof(name), "%s, %uk keys x %u",
+           upsert ? "count, map_get_or_insert" : "count, map_get + map_set",
+           key_count / 1000, ROUNDS);
+  bench_report(name, key_count * ROUNDS, seconds);
+  map_destroy(mh);
+  free(counts);
+}
+
+// Counts each key four times with a typed map, which keeps the counts inline.
+static void bench_count_inline(unsigned int key_count) {
+  static const unsigned int ROUNDS = 4;
+  map_str_u32_handle counts = map_str_u32_create(MEM_ALLOCATOR_PLAIN);
+  double start = bench_now();
+  for (unsigned int r = 0; r < ROUNDS; r++) {
+    for (unsigned int i = 0; i < key_count; i++) {
+      ++*map_str_u32_get_or_insert(counts, keys[i], (bool *)0);
+    }
+  }
+  double seconds = bench_now() - start;
+  char name[64];
+  snprintf(name, sizeof(name), "count, map_str_u32, %uk keys x %u",
+           key_count / 1000, ROUNDS);
+  bench_report(name, key_count * ROUNDS, seconds);
+  map_str_u32_destroy(counts);
+}
+
+// Sets and gets 28-bit addresses, as a table of labels by address would, with
+// a map of pointer keys and with a typed map of uint32_t keys.
+static void bench_addresses(unsigned int key_count) {
+  static const uint32_t STRIDE = 3;
+  unsigned int *values = malloc(sizeof(*values) * key_count);
+  unsigned long found = 0;
+  map_handle mh = map_create(MEM_ALLOCATOR_PLAIN);
+  double start = bench_now();
+  for (unsigned int i = 0; i < key_count; i++) {
+    values[i] = i;
+    map_set(mh, (void *)(uintptr_t)(i * STRIDE),
+            mem_handle_from_ptr(&values[i], sizeof(*values)));
+  }
+  report("map_set_ptr, address", key_count, bench_now() - start);
+  start = bench_now();
+  for (unsigned int i = 0; i < key_count; i++) {
+    mem_handle value = map_get(mh, (void *)(uintptr_t)(i * STRIDE));
+    found += *(unsigned int *)mem_p(value);
+  }
+  report("map_get_ptr, address", key_count, bench_now() - start);
+  map_destroy(mh);
+
+  map_u32_u32_handle labels = map_u32_u32_create(MEM_ALLOCATOR_PLAIN);
+  start = bench_now();
+  for (unsigned int i = 0; i < key_count; i++) {
+    map_u32_u32_set(labels, i * STRIDE, i);
+  }
+  report("map_u32_u32_set, address", key_count, bench_now() - start);
+  start = bench_now();
+  for (unsigned int i = 0; i < key_count; i++) {
+    found += *map_u32_u32_get(labels, i * STRIDE);
+  }
+  report("map_u32_u32_get, address", key_count, bench_now() - start);
+  map_u32_u32_destroy(labels);
+  bench_use(&found);
+  free(values);
+}
+
+int main(void) {
+  make_keys();
+  bench_map(400000);
+  bench_map(MAX_KEY_COUNT);
+  bench_bulk(40000);
+  bench_bulk(MAX_KEY_COUNT);
+  bench_iter(MAX_KEY_COUNT);
+  bench_count(MAX_KEY_COUNT, false);
+  bench_count(MAX_KEY_COUNT, true);
+  bench_count_inline(MAX_KEY_COUNT);
+  bench_addresses(MAX_KEY_COUNT);
+  free(missing_keys);
+  free(keys);
+  free(key_chars);
+  return EXIT_SUCCESS;
+}
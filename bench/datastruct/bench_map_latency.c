@@ -0,0 +1,77 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench/bench.h"
+#include "datastruct/map.h"
+#include "datastruct/str.h"
+
+// Enough keys that the last resizes move millions of entries.
+static const unsigned int KEY_COUNT = 3000000;
+static const unsigned int KEY_SIZE = 16;
+
+static char *key_chars;
+static str *keys;
+static double *latencies;
+
+static void make_keys(void) {
+  key_chars = malloc((size_t)KEY_SIZE * KEY_COUNT);
+  keys = malloc(sizeof(*keys) * KEY_COUNT);
+  for (unsigned int i = 0; i < KEY_COUNT; i++) {
+    char *p = key_chars + (size_t)KEY_SIZE * i;
+    keys[i] = mem_handle_from_ptr(p, snprintf(p, KEY_SIZE, "sym_%u", i));
+  }
+}
+
+static int compare_double(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+// Prints percentiles of the latencies of a set of operations.
+static void report_latencies(const char *op, bool incremental,
+                             unsigned int count) {
+  qsort(latencies, count, sizeof(*latencies), compare_double);
+  static const double PERCENTILES[] = {50, 99, 99.9, 99.99};
+  char name[64];
+  snprintf(name, sizeof(name), "%s, %s", op,
+           incremental ? "incremental" : "all at once");
+  printf("%-40s", name);
+  for (unsigned int i = 0; i < sizeof(PERCENTILES) / sizeof(*PERCENTILES);
+       i++) {
+    unsigned int index = (unsigned int)(count * PERCENTILES[i] / 100);
+    printf("  p%-5g %8.0f ns", PERCENTILES[i], latencies[index] * 1e9);
+  }
+  printf("  max %10.0f ns\n", latencies[count - 1] * 1e9);
+}
+
+// Times each map_set as a map grows, then each map_delete as it shrinks.
+static void bench_latency(bool incremental) {
+  map_handle mh = map_create(MEM_ALLOCATOR_PLAIN);
+  map_set_incremental_resize(mh, incremental);
+  for (unsigned int i = 0; i < KEY_COUNT; i++) {
+    double start = bench_now();
+    map_set(mh, keys[i], keys[i]);
+    latencies[i] = bench_now() - start;
+  }
+  report_latencies("map_set", incremental, KEY_COUNT);
+
+  for (unsigned int i = 0; i < KEY_COUNT; i++) {
+    double start = bench_now();
+    map_delete(mh, keys[i]);
+    latencies[i] = bench_now() - start;
+  }
+  report_latencies("map_delete", incremental, KEY_COUNT);
+  map_destroy(mh);
+}
+
+int main(void) {
+  make_keys();
+  latencies = malloc(sizeof(*latencies) * KEY_COUNT);
+  bench_latency(false);
+  bench_latency(true);
+  free(latencies);
+  free(keys);
+  free(key_chars);
+  return EXIT_SUCCESS;
+}
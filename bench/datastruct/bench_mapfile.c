@@ -0,0 +1,76 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench/bench.h"
+#include "datastruct/map.h"
+#include "datastruct/mapfile.h"
+#include "datastruct/str.h"
+
+static const unsigned int KEY_COUNT = 1000000;
+static const unsigned int KEY_SIZE = 16;
+static const char *BENCH_FILE = "bench_mapfile.tmp";
+
+static char *key_chars;
+static str *keys;
+static uint32_t *values;
+
+static void make_keys(void) {
+  key_chars = malloc((size_t)KEY_SIZE * KEY_COUNT);
+  keys = malloc(sizeof(*keys) * KEY_COUNT);
+  values = malloc(sizeof(*values) * KEY_COUNT);
+  for (unsigned int i = 0; i < KEY_COUNT; i++) {
+    char *p = key_chars + (size_t)KEY_SIZE * i;
+    keys[i] = mem_handle_from_ptr(p, snprintf(p, KEY_SIZE, "sym_%u", i));
+    values[i] = i;
+  }
+}
+
+// Builds a map of every key, as a program does at startup without a file.
+static map_handle build_map(void) {
+  map_handle mh = map_create(MEM_ALLOCATOR_PLAIN);
+  for (unsigned int i = 0; i < KEY_COUNT; i++) {
+    map_set(mh, keys[i], mem_handle_from_ptr(&values[i], sizeof(values[i])));
+  }
+  return mh;
+}
+
+int main(void) {
+  make_keys();
+  double start = bench_now();
+  map_handle mh = build_map();
+  bench_report("build map", KEY_COUNT, bench_now() - start);
+
+  start = bench_now();
+  if (!mapfile_write(mh, BENCH_FILE)) {
+    puts("could not write file");
+    return EXIT_FAILURE;
+  }
+  bench_report("mapfile_write", KEY_COUNT, bench_now() - start);
+
+  // The file is in the page cache, as for a program run again soon after.
+  start = bench_now();
+  mapfile_handle mfh = mapfile_open(BENCH_FILE);
+  bench_report("mapfile_open", KEY_COUNT, bench_now() - start);
+
+  unsigned long total = 0;
+  start = bench_now();
+  for (unsigned int i = 0; i < KEY_COUNT; i++) {
+    total += mem_size(map_get(mh, keys[i]));
+  }
+  bench_report("map_get", KEY_COUNT, bench_now() - start);
+  start = bench_now();
+  for (unsigned int i = 0; i < KEY_COUNT; i++) {
+    total += mem_size(mapfile_get(mfh, keys[i]));
+  }
+  bench_report("mapfile_get", KEY_COUNT, bench_now() - start);
+  bench_use(&total);
+
+  mapfile_close(mfh);
+  map_destroy(mh);
+  remove(BENCH_FILE);
+  free(values);
+  free(keys);
+  free(key_chars);
+  return EXIT_SUCCESS;
+}
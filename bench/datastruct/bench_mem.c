@@ -0,0 +1,66 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench/bench.h"
+#include "datastruct/arena.h"
+#include "datastruct/mem.h"
+#include "datastruct/memtbl.h"
+#include "datastruct/slab.h"
+
+static const unsigned int ALLOC_COUNT = 1000;
+static const unsigned int ROUNDS = 5000;
+
+static void bench_alloc_free(mem_allocator allocator, const char *name) {
+  mem_handle *handles = malloc(sizeof(*handles) * ALLOC_COUNT);
+  double start = bench_now();
+  for (unsigned int r = 0; r < ROUNDS; r++) {
+    for (unsigned int i = 0; i < ALLOC_COUNT; i++) {
+      handles[i] = mem_alloc(allocator, 16 + (i & 63));
+    }
+    for (unsigned int i = 0; i < ALLOC_COUNT; i++) {
+      mem_free(handles[ALLOC_COUNT - i - 1]);
+    }
+  }
+  bench_report(name, (unsigned long)ALLOC_COUNT * ROUNDS, bench_now() - start);
+  free(handles);
+}
+
+static void bench_malloc_free(const char *name) {
+  void **ptrs = malloc(sizeof(*ptrs) * ALLOC_COUNT);
+  double start = bench_now();
+  for (unsigned int r = 0; r < ROUNDS; r++) {
+    for (unsigned int i = 0; i < ALLOC_COUNT; i++) {
+      ptrs[i] = malloc(16 + (i & 63));
+    }
+    bench_use(ptrs);
+    for (unsigned int i = 0; i < ALLOC_COUNT; i++) {
+      free(ptrs[ALLOC_COUNT - i - 1]);
+    }
+  }
+  bench_report(name, (unsigned long)ALLOC_COUNT * ROUNDS, bench_now() - start);
+  free(ptrs);
+}
+
+int main(void) {
+  memtbl_handle mth = memtbl_create(MEM_ALLOCATOR_PLAIN);
+  arena_handle ah = arena_create(MEM_ALLOCATOR_PLAIN, 0);
+  slab_handle sh = slab_create(MEM_ALLOCATOR_PLAIN);
+  if (!memtbl_is_valid(mth) || !arena_is_valid(ah) || !slab_is_valid(sh)) {
+    puts("Error creating allocators");
+    return EXIT_FAILURE;
+  }
+
+  bench_malloc_free("malloc+free (no datastruct)");
+  bench_alloc_free(MEM_ALLOCATOR_PLAIN, "mem_alloc+mem_free, plain allocator");
+  bench_alloc_free(mem_allocator_memtbl(mth),
+                   "mem_alloc+mem_free, memtbl allocator");
+  bench_alloc_free(mem_allocator_arena(ah),
+                   "mem_alloc+mem_free, arena allocator");
+  bench_alloc_free(mem_allocator_slab(sh),
+                   "mem_alloc+mem_free, slab allocator");
+
+  slab_destroy(sh);
+  arena_destroy(ah);
+  memtbl_destroy(mth);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,88 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench/bench.h"
+#include "datastruct/map.h"
+#include "datastruct/memtbl.h"
+#include "datastruct/str.h"
+
+static const unsigned int KEY_COUNT = 100000;
+static const unsigned int ROUNDS = 10;
+
+static void bench_map_set_ptr(mem_allocator allocator, const char *name) {
+  char *keys = malloc(KEY_COUNT);
+  mem_handle value = mem_handle_from_ptr(keys, KEY_COUNT);
+  double elapsed = 0;
+  for (unsigned int r = 0; r < ROUNDS; r++) {
+    map_handle mh = map_create(allocator);
+    double start = bench_now();
+    for (unsigned int i = 0; i < KEY_COUNT; i++) {
+      map_set(mh, (void *)(keys + i), value);
+    }
+    elapsed += bench_now() - start;
+    map_destroy(mh);
+  }
+  bench_report(name, (unsigned long)KEY_COUNT * ROUNDS, elapsed);
+  free(keys);
+}
+
+static void bench_map_set_small(mem_allocator allocator, const char *name) {
+  const unsigned int small_count = 16;
+  char *keys = malloc(small_count);
+  mem_handle value = mem_handle_from_ptr(keys, small_count);
+  map_handle mh = map_create(allocator);
+  double start = bench_now();
+  for (unsigned int r = 0; r < ROUNDS * KEY_COUNT / small_count; r++) {
+    for (unsigned int i = 0; i < small_count; i++) {
+      map_set(mh, (void *)(keys + i), value);
+    }
+  }
+  bench_report(name, (unsigned long)KEY_COUNT * ROUNDS, bench_now() - start);
+  map_destroy(mh);
+  free(keys);
+}
+
+static void bench_map_get_str(mem_allocator allocator, const char *name) {
+  str *keys = malloc(sizeof(*keys) * KEY_COUNT);
+  char *key_chars = malloc(16 * KEY_COUNT);
+  for (unsigned int i = 0; i < KEY_COUNT; i++) {
+    int len = snprintf(key_chars + 16 * i, 16, "sym_%u", i);
+    keys[i] = mem_handle_from_ptr(key_chars + 16 * i, len);
+  }
+  map_handle mh = map_create(allocator);
+  for (unsigned int i = 0; i < KEY_COUNT; i++) map_set(mh, keys[i], keys[i]);
+
+  unsigned long found = 0;
+  double start = bench_now();
+  for (unsigned int r = 0; r < ROUNDS; r++) {
+    for (unsigned int i = 0; i < KEY_COUNT; i++) {
+      found += mem_is_valid(map_get(mh, keys[i]));
+    }
+  }
+  bench_report(name, (unsigned long)KEY_COUNT * ROUNDS, bench_now() - start);
+  bench_use(&found);
+
+  map_destroy(mh);
+  free(key_chars);
+  free(keys);
+}
+
+int main(void) {
+  memtbl_handle mth = memtbl_create(MEM_ALLOCATOR_PLAIN);
+  if (!memtbl_is_valid(mth)) {
+    puts("Error creating memtbl");
+    return EXIT_FAILURE;
+  }
+  mem_allocator ma = mem_allocator_memtbl(mth);
+
+  bench_map_set_ptr(MEM_ALLOCATOR_PLAIN, "map_set ptr keys, plain allocator");
+  bench_map_set_ptr(ma, "map_set ptr keys, memtbl allocator");
+  bench_map_set_small(MEM_ALLOCATOR_PLAIN,
+                      "map_set 16 ptr keys, plain allocator");
+  bench_map_set_small(ma, "map_set 16 ptr keys, memtbl allocator");
+  bench_map_get_str(MEM_ALLOCATOR_PLAIN, "map_get str keys, plain allocator");
+  bench_map_get_str(ma, "map_get str keys, memtbl allocator");
+
+  memtbl_destroy(mth);
+  return EXIT_SUCCESS;
+}
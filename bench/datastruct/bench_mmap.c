@@ -0,0 +1,61 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench/bench.h"
+#include "datastruct/mmap.h"
+#include "datastruct/str.h"
+
+static const unsigned int CHUNK_COUNT = 16384;
+static const unsigned int ROUNDS = 10;
+
+// Builds a 64 MiB strbuf from 4 KiB chunks, starting small.
+static void bench_strbuf_grow(mem_allocator allocator, const char *name) {
+  static char chunk_chars[4096];
+  for (unsigned int i = 0; i < sizeof(chunk_chars); i++) {
+    chunk_chars[i] = 'a' + i % 26;
+  }
+  str chunk = mem_handle_from_ptr(chunk_chars, sizeof(chunk_chars));
+  unsigned long total = 0;
+  double start = bench_now();
+  for (unsigned int r = 0; r < ROUNDS; r++) {
+    strbuf_handle buf = strbuf_create(allocator, 64);
+    for (unsigned int i = 0; i < CHUNK_COUNT; i++) {
+      strbuf_concatenate_str(buf, chunk);
+    }
+    total += str_length(strbuf_str(buf));
+    strbuf_destroy(buf);
+  }
+  bench_report(name, (unsigned long)CHUNK_COUNT * ROUNDS, bench_now() - start);
+  bench_use(&total);
+}
+
+// Grows one allocation a page at a time to 64 MiB.
+static void bench_realloc_pages(mem_allocator allocator, const char *name) {
+  unsigned long total = 0;
+  double start = bench_now();
+  for (unsigned int r = 0; r < ROUNDS; r++) {
+    mem_handle mh = mem_alloc(allocator, 4096);
+    for (unsigned int i = 2; i <= CHUNK_COUNT; i++) {
+      mh = mem_realloc(mh, (size_t)i * 4096);
+      ((char *)mem_p(mh))[(size_t)i * 4096 - 1] = 1;
+    }
+    total += mem_size(mh);
+    mem_free(mh);
+  }
+  bench_report(name, (unsigned long)CHUNK_COUNT * ROUNDS, bench_now() - start);
+  bench_use(&total);
+}
+
+int main(void) {
+  bench_strbuf_grow(MEM_ALLOCATOR_PLAIN,
+                    "strbuf grow to 64 MiB, per 4 KiB, plain allocator");
+  bench_strbuf_grow(MEM_ALLOCATOR_MMAP,
+                    "strbuf grow to 64 MiB, per 4 KiB, mmap allocator");
+  bench_strbuf_grow(MEM_ALLOCATOR_MMAP_HUGE,
+                    "strbuf grow to 64 MiB, per 4 KiB, mmap huge allocator");
+  bench_realloc_pages(MEM_ALLOCATOR_PLAIN,
+                      "mem_realloc +4 KiB to 64 MiB, plain allocator");
+  bench_realloc_pages(MEM_ALLOCATOR_MMAP,
+                      "mem_realloc +4 KiB to 64 MiB, mmap allocator");
+  return EXIT_SUCCESS;
+}
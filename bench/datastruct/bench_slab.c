@@ -0,0 +1,54 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench/bench.h"
+#include "datastruct/map.h"
+#include "datastruct/slab.h"
+#include "datastruct/str.h"
+
+static const unsigned int OBJECT_COUNT = 10000;
+static const unsigned int ROUNDS = 20;
+
+static void bench_many_objects(mem_allocator allocator, const char *name) {
+  map_handle *maps = malloc(sizeof(*maps) * OBJECT_COUNT);
+  strbuf_handle *bufs = malloc(sizeof(*bufs) * OBJECT_COUNT);
+  unsigned long total = 0;
+  double start = bench_now();
+  for (unsigned int r = 0; r < ROUNDS; r++) {
+    for (unsigned int i = 0; i < OBJECT_COUNT; i++) {
+      maps[i] = map_create(allocator);
+      bufs[i] = strbuf_create(allocator, 32);
+      strbuf_concatenate_cstr(bufs[i], "client");
+    }
+    for (unsigned int i = 0; i < OBJECT_COUNT; i++) {
+      map_set(maps[i], (void *)bufs, strbuf_str(bufs[i]));
+    }
+    for (unsigned int i = 0; i < OBJECT_COUNT; i++) {
+      total += str_length(map_get(maps[i], (void *)bufs));
+    }
+    for (unsigned int i = 0; i < OBJECT_COUNT; i++) {
+      strbuf_destroy(bufs[i]);
+      map_destroy(maps[i]);
+    }
+  }
+  bench_report(name, (unsigned long)OBJECT_COUNT * ROUNDS, bench_now() - start);
+  bench_use(&total);
+  free(bufs);
+  free(maps);
+}
+
+int main(void) {
+  slab_handle sh = slab_create(MEM_ALLOCATOR_PLAIN);
+  if (!slab_is_valid(sh)) {
+    puts("Error creating slab");
+    return EXIT_FAILURE;
+  }
+
+  bench_many_objects(MEM_ALLOCATOR_PLAIN,
+                     "10k live maps+strbufs, plain allocator");
+  bench_many_objects(mem_allocator_slab(sh),
+                     "10k live maps+strbufs, slab allocator");
+
+  slab_destroy(sh);
+  return EXIT_SUCCESS;
+}
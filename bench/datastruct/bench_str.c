@@ -0,0 +1,147 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench/bench.h"
+#include "datastruct/str.h"
+
+// A listing file with CRLF line endings, as from a Windows assembler.
+static const unsigned int LINE_COUNT = 500000;
+static const unsigned int LINE_SIZE = 48;
+
+static char *listing;
+static size_t listing_size;
+
+static void make_listing(void) {
+  listing = malloc((size_t)LINE_SIZE * LINE_COUNT);
+  char *p = listing;
+  for (unsigned int i = 0; i < LINE_COUNT; i++) {
+    p += sprintf(p, "%05X  A9 %02X     LDA #$%02X      ; line %u\r\n",
+                 0x2000 + i * 2, i & 0xff, i & 0xff, i % 100000);
+  }
+  listing_size = p - listing;
+}
+
+// The byte-at-a-time search that str_find used before SIMD filtering
+static int naive_find(str strval, str substring) {
+  char *h = mem_p(strval);
+  char *needle = mem_p(substring);
+  for (size_t i = 0; i + substring.size <= strval.size; i++) {
+    size_t offset = 0;
+    while (offset < substring.size && h[i + offset] == needle[offset]) offset++;
+    if (offset == substring.size) return (int)i;
+  }
+  return -1;
+}
+
+static void bench_split(void) {
+  str delim = str_from_cstr("\r\n");
+  unsigned long parts = 0;
+  double start = bench_now();
+  str rest = mem_handle_from_ptr(listing, listing_size);
+  while (str_is_valid(rest)) {
+    int pos = naive_find(rest, delim);
+    if (pos < 0) break;
+    rest = mem_handle_from_ptr((char *)mem_p(rest) + pos + 2,
+                               rest.size - pos - 2);
+    parts++;
+  }
+  bench_report("split lines, byte loop", parts, bench_now() - start);
+
+  parts = 0;
+  start = bench_now();
+  rest = mem_handle_from_ptr(listing, listing_size);
+  while (str_is_valid(rest)) {
+    str part;
+    rest = str_split_pop(rest, delim, &part);
+    parts++;
+  }
+  bench_report("split lines, str_split_pop", parts, bench_now() - start);
+
+  str_finder finder = str_finder_make(delim);
+  parts = 0;
+  start = bench_now();
+  rest = mem_handle_from_ptr(listing, listing_size);
+  while (str_is_valid(rest)) {
+    str part;
+    rest = str_split_pop_finder(rest, &finder, &part);
+    parts++;
+  }
+  bench_report("split lines, str_split_pop_finder", parts,
+               bench_now() - start);
+
+  parts = 0;
+  start = bench_now();
+  const char *p = listing;
+  const char *end = listing + listing_size;
+  while ((p = memchr(p, '\n', end - p))) {
+    p++;
+    parts++;
+  }
+  bench_report("split lines, memchr", parts, bench_now() - start);
+  bench_use(&parts);
+}
+
+static void bench_find(void) {
+  // A needle that is not in the listing searches every byte.
+  str haystack = mem_handle_from_ptr(listing, listing_size);
+  str needle = str_from_cstr("STA $D020");
+  const unsigned int reps = 10;
+  int total = 0;
+  double start = bench_now();
+  for (unsigned int i = 0; i < reps; i++) total += naive_find(haystack, needle);
+  bench_report("find absent, byte loop (per MB)",
+               reps * (listing_size >> 20), bench_now() - start);
+  start = bench_now();
+  for (unsigned int i = 0; i < reps; i++) total += str_find(haystack, needle);
+  bench_report("find absent, str_find (per MB)", reps * (listing_size >> 20),
+               bench_now() - start);
+  bench_use(&total);
+}
+
+static void bench_tokenize(void) {
+  unsigned long words = 0;
+  double start = bench_now();
+  str rest = mem_handle_from_ptr(listing, listing_size);
+  while (str_is_valid(rest)) {
+    str word;
+    rest = str_split_whitespace_pop(rest, &word);
+    words++;
+  }
+  bench_report("words, str_split_whitespace_pop", words, bench_now() - start);
+
+  str_delims whitespace = str_delims_make(str_from_cstr(STR_WHITESPACE));
+  str tokens[256];
+  words = 0;
+  start = bench_now();
+  rest = mem_handle_from_ptr(listing, listing_size);
+  while (str_is_valid(rest)) {
+    size_t count;
+    rest = str_tokenize(rest, &whitespace, tokens, 256, &count);
+    words += count;
+  }
+  bench_report("words, str_tokenize", words, bench_now() - start);
+  bench_use(tokens);
+
+  // The delimiters of an assembler source line
+  str_delims fields = str_delims_make(str_from_cstr(STR_WHITESPACE ",:;#"));
+  words = 0;
+  start = bench_now();
+  rest = mem_handle_from_ptr(listing, listing_size);
+  while (str_is_valid(rest)) {
+    size_t count;
+    rest = str_tokenize(rest, &fields, tokens, 256, &count);
+    words += count;
+  }
+  bench_report("fields, str_tokenize", words, bench_now() - start);
+  bench_use(tokens);
+}
+
+int main(void) {
+  make_listing();
+  bench_split();
+  bench_find();
+  bench_tokenize();
+  free(listing);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,75 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench/bench.h"
+#include "datastruct/str.h"
+#include "datastruct/strarena.h"
+
+// As many symbols as a large assembler listing.
+static const unsigned int SYMBOL_COUNT = 1000000;
+static const unsigned int SYMBOL_SIZE = 16;
+
+static char *symbol_chars;
+static str *symbols;
+static str *copies;
+
+static void make_symbols(void) {
+  symbol_chars = malloc((size_t)SYMBOL_SIZE * SYMBOL_COUNT);
+  symbols = malloc(sizeof(*symbols) * SYMBOL_COUNT);
+  copies = malloc(sizeof(*copies) * SYMBOL_COUNT);
+  for (unsigned int i = 0; i < SYMBOL_COUNT; i++) {
+    char *p = symbol_chars + (size_t)SYMBOL_SIZE * i;
+    symbols[i] = mem_handle_from_ptr(p, snprintf(p, SYMBOL_SIZE, "sym_%u", i));
+  }
+}
+
+static void bench_duplicate(void) {
+  double start = bench_now();
+  for (unsigned int i = 0; i < SYMBOL_COUNT; i++) {
+    copies[i] = str_duplicate_str(symbols[i]);
+  }
+  bench_report("str_duplicate_str", SYMBOL_COUNT, bench_now() - start);
+  bench_use(copies);
+
+  start = bench_now();
+  for (unsigned int i = 0; i < SYMBOL_COUNT; i++) mem_free(copies[i]);
+  bench_report("mem_free each", SYMBOL_COUNT, bench_now() - start);
+}
+
+static void bench_strarena_add(void) {
+  strarena_handle sah = strarena_create(MEM_ALLOCATOR_PLAIN, 0);
+  double start = bench_now();
+  for (unsigned int i = 0; i < SYMBOL_COUNT; i++) {
+    copies[i] = strarena_add(sah, symbols[i]);
+  }
+  bench_report("strarena_add", SYMBOL_COUNT, bench_now() - start);
+  bench_use(copies);
+  printf("  %zu string bytes in %zu bytes of chunks\n",
+         strarena_string_bytes(sah), strarena_memory_use(sah));
+
+  start = bench_now();
+  strarena_reset(sah);
+  bench_report("strarena_reset", 1, bench_now() - start);
+
+  // Refilling reuses the chunks, with no allocations.
+  start = bench_now();
+  for (unsigned int i = 0; i < SYMBOL_COUNT; i++) {
+    copies[i] = strarena_add(sah, symbols[i]);
+  }
+  bench_report("strarena_add after reset", SYMBOL_COUNT, bench_now() - start);
+  bench_use(copies);
+
+  start = bench_now();
+  strarena_destroy(sah);
+  bench_report("strarena_destroy", 1, bench_now() - start);
+}
+
+int main(void) {
+  make_symbols();
+  bench_duplicate();
+  bench_strarena_add();
+  free(copies);
+  free(symbols);
+  free(symbol_chars);
+  return EXIT_SUCCESS;
+}
@@ -47,6 +47,12 @@ def main(args):
     parser.add_argument(
         '--debugbuild', action='store_true',
         help='Enable debugging symbols, disable optimizations')
+    parser.add_argument(
+        '--mem-stats', action='store_true',
+        help='Track allocation statistics (see m65tool --mem-stats)')
+    parser.add_argument(
+        '--compact-handle', action='store_true',
+        help='Use 16-byte memory handles')
     args = parser.parse_args(args)
 
     if not os.path.exists('.git'):
@@ -72,6 +78,12 @@ def main(args):
     if args.debugbuild:
         conf_debug = ['CPPFLAGS=-DDEBUG', 'CFLAGS="-ggbd -O0"']
 
+    conf_mem_stats = []
+    if args.mem_stats:
+        conf_mem_stats = ['--enable-mem-stats']
+    if args.compact_handle:
+        conf_mem_stats.append('--enable-compact-handle')
+
     conf_crosswindows = []
     if args.windows:
         if platform.system() == 'Windows':
@@ -86,7 +98,8 @@ def main(args):
         else:
             error('Cannot build the Windows version (--windows) from macOS')
 
-    conf_cmd = ['./configure'] + conf_quiet + conf_debug + conf_crosswindows
+    conf_cmd = (['./configure'] + conf_quiet + conf_debug + conf_mem_stats +
+                conf_crosswindows)
     if run(conf_cmd, verbose=args.verbose):
         error('\n*** ./configure failed, aborting.\n')
 
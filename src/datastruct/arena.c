@@ -0,0 +1,194 @@
+#include "arena.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "mem.h"
+
+static const mem_allocator_spec ARENA_ALLOCATOR_SPEC;
+
+// Alignment of every arena allocation.
+#define ARENA_ALIGNMENT (_Alignof(max_align_t))
+
+struct arena_chunk {
+  // The next chunk in the arena's chunk list
+  arena_chunk *next;
+
+  // The memory for this chunk, including this header
+  mem_handle chunk_mh;
+
+  // The number of bytes available for allocations
+  size_t capacity;
+
+  // The number of bytes allocated
+  size_t used;
+};
+
+// Size of the chunk header, rounded up so that allocations are aligned.
+#define CHUNK_HEADER_SIZE \
+  ((sizeof(arena_chunk) + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1))
+
+// Whether a size can be aligned and given a chunk header without wrapping
+// around.
+static bool size_fits(size_t size) {
+  return size <= SIZE_MAX - ARENA_ALIGNMENT - CHUNK_HEADER_SIZE;
+}
+
+static size_t align_up(size_t size) {
+  return (size + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+}
+
+static char *chunk_data(arena_chunk *chunk) {
+  return (char *)chunk + CHUNK_HEADER_SIZE;
+}
+
+static arena_chunk *new_chunk(arena *ap, size_t capacity) {
+  if (!size_fits(capacity)) return (arena_chunk *)0;
+  mem_handle chunk_mh = mem_alloc(ap->chunk_allocator,
+                                  CHUNK_HEADER_SIZE + align_up(capacity));
+  if (!mem_is_valid(chunk_mh)) return (arena_chunk *)0;
+  arena_chunk *chunk = mem_p(chunk_mh);
+  chunk->next = (arena_chunk *)0;
+  chunk->chunk_mh = chunk_mh;
+  chunk->capacity = align_up(capacity);
+  chunk->used = 0;
+  return chunk;
+}
+
+arena_handle arena_create(mem_allocator allocator, size_t chunk_size) {
+  arena_handle ah = mem_alloc(allocator, sizeof(arena));
+  if (!mem_is_valid(ah)) return (arena_handle){0};
+  arena *ap = mem_p(ah);
+  ap->chunk_allocator = allocator;
+  ap->chunk_size = chunk_size ? chunk_size : ARENA_DEFAULT_CHUNK_SIZE;
+  ap->last_alloc = (void *)0;
+  ap->first_chunk = new_chunk(ap, ap->chunk_size);
+  if (!ap->first_chunk) {
+    mem_free(ah);
+    return (arena_handle){0};
+  }
+  ap->current_chunk = ap->first_chunk;
+  ap->allocator = (mem_allocator){.allocator_spec = &ARENA_ALLOCATOR_SPEC,
+                                  .allocator_data = ap};
+  if (!mem_allocator_register(&ap->allocator)) {
+    mem_free(ap->first_chunk->chunk_mh);
+    mem_free(ah);
+    return (arena_handle){0};
+  }
+  return ah;
+}
+
+bool arena_is_valid(arena_handle ah) {
+  return mem_is_valid(ah) && ((arena *)mem_p(ah))->first_chunk;
+}
+
+void arena_reset(arena_handle ah) {
+  if (!arena_is_valid(ah)) return;
+  arena *ap = mem_p(ah);
+  // Chunks after the first have their used count reset as the arena advances
+  // into them.
+  ap->first_chunk->used = 0;
+  ap->current_chunk = ap->first_chunk;
+  ap->last_alloc = (void *)0;
+}
+
+void arena_destroy(arena_handle ah) {
+  if (!arena_is_valid(ah)) return;
+  arena *ap = mem_p(ah);
+  arena_chunk *chunk = ap->first_chunk;
+  while (chunk) {
+    arena_chunk *next = chunk->next;
+    mem_free(chunk->chunk_mh);
+    chunk = next;
+  }
+  mem_allocator_unregister(ap->allocator);
+  mem_free(ah);
+}
+
+/**
+ * @brief Makes a chunk with room for size bytes the current chunk.
+ *
+ * This reuses the next chunk in the list if it is large enough. Otherwise it
+ * allocates a new chunk and inserts it after the current chunk.
+ *
+ * @param ap The arena
+ * @param size The size of the allocation that did not fit
+ * @return true on success
+ */
+static bool advance_chunk(arena *ap, size_t size) {
+  arena_chunk *next = ap->current_chunk->next;
+  if (!next || next->capacity < size) {
+    arena_chunk *chunk =
+        new_chunk(ap, size > ap->chunk_size ? size : ap->chunk_size);
+    if (!chunk) return false;
+    chunk->next = next;
+    ap->current_chunk->next = chunk;
+    next = chunk;
+  }
+  next->used = 0;
+  ap->current_chunk = next;
+  return true;
+}
+
+static mem_handle arena_alloc(mem_allocator allocator, size_t size) {
+  arena *ap = allocator.allocator_data;
+  if (!ap || !ap->current_chunk || !size_fits(size)) return (mem_handle){0};
+  arena_chunk *chunk = ap->current_chunk;
+  size_t aligned_size = align_up(size);
+  if (chunk->capacity - chunk->used < aligned_size) {
+    if (!advance_chunk(ap, aligned_size)) return (mem_handle){0};
+    chunk = ap->current_chunk;
+  }
+  void *data = chunk_data(chunk) + chunk->used;
+  chunk->used += aligned_size;
+  ap->last_alloc = data;
+  return mem_handle_make(data, size, allocator);
+}
+
+static mem_handle arena_realloc(mem_handle handle, size_t size) {
+  if (!mem_is_valid(handle)) return (mem_handle){0};
+  arena *ap = mem_handle_allocator(handle).allocator_data;
+  if (!ap || !ap->current_chunk || !size_fits(size)) return (mem_handle){0};
+
+  if (handle.data == ap->last_alloc) {
+    // The most recent allocation can grow or shrink in place if it fits.
+    arena_chunk *chunk = ap->current_chunk;
+    size_t offset = (char *)handle.data - chunk_data(chunk);
+    if (chunk->capacity - offset >= align_up(size)) {
+      chunk->used = offset + align_up(size);
+      handle.size = size;
+      return handle;
+    }
+  } else if (size <= handle.size) {
+    handle.size = size;
+    return handle;
+  }
+
+  mem_handle result = arena_alloc(ap->allocator, size);
+  if (!mem_is_valid(result)) return (mem_handle){0};
+  memcpy(result.data, handle.data, handle.size < size ? handle.size : size);
+  return result;
+}
+
+static mem_handle arena_free(mem_handle handle) {
+  arena *ap = mem_handle_allocator(handle).allocator_data;
+  if (ap && handle.data == ap->last_alloc) {
+    arena_chunk *chunk = ap->current_chunk;
+    chunk->used = (char *)handle.data - chunk_data(chunk);
+    ap->last_alloc = (void *)0;
+  }
+  return (mem_handle){0};
+}
+
+static const mem_allocator_spec ARENA_ALLOCATOR_SPEC =
+    (mem_allocator_spec){.allocator_type = MEM_ALLOCATOR_TYPE_ARENA,
+                         .alloc_func = arena_alloc,
+                         .realloc_func = arena_realloc,
+                         .free_func = arena_free};
+
+inline mem_allocator mem_allocator_arena(arena_handle ah) {
+  if (!ah.data) return (mem_allocator){.allocator_spec = &ARENA_ALLOCATOR_SPEC};
+  return ((arena *)ah.data)->allocator;
+}
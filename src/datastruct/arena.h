@@ -0,0 +1,115 @@
+/**
+ * @file arena.h
+ * @brief A bump allocator that frees all allocations at once.
+ *
+ *   arena_handle ah = arena_create(MEM_ALLOCATOR_PLAIN, 0);
+ *   if (!arena_is_valid(ah)) abort();
+ *   mem_allocator allocator = mem_allocator_arena(ah);
+ *
+ *   map_handle mh = map_create(allocator);
+ *   str word = str_duplicate_cstr_with_allocator("hello", allocator);
+ *   ...
+ *   arena_reset(ah);    // releases mh, word, and everything else at once
+ *   ...
+ *   arena_destroy(ah);  // releases the arena's memory
+ *
+ * An arena requests large chunks of memory from its parent allocator, and
+ * hands out allocations by advancing a pointer through the current chunk.
+ * Allocating is a pointer bump in the common case. Resetting the arena is
+ * O(1), and keeps the chunks for reuse. Destroying the arena returns its
+ * chunks to the parent allocator, regardless of how many allocations were
+ * made.
+ *
+ * `mem_free` releases memory only if it is the most recent allocation from the
+ * arena. `mem_realloc` of the most recent allocation grows or shrinks it in
+ * place if the current chunk has room. This makes strbuf growth cheap when a
+ * strbuf is the last thing allocated. Other reallocations copy to a new
+ * allocation, and the old memory is released when the arena is reset.
+ *
+ * Resetting or destroying an arena invalidates the memory of every handle
+ * allocated from it. Like a memtbl, an arena does not know about destructors,
+ * and is only suitable for Plain Old Data objects.
+ */
+
+#ifndef DATASTRUCT_ARENA_H
+#define DATASTRUCT_ARENA_H
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "mem.h"
+
+// Default size of an arena chunk, if zero is passed to `arena_create`.
+#define ARENA_DEFAULT_CHUNK_SIZE 65536
+
+// Internal type for a chunk of arena memory
+typedef struct arena_chunk arena_chunk;
+
+// An arena. Create with `arena_create`, destroy with `arena_destroy`.
+typedef struct arena {
+  // The allocator for chunks
+  mem_allocator chunk_allocator;
+
+  // The size of new chunks, in bytes
+  size_t chunk_size;
+
+  // The first chunk in the chunk list
+  arena_chunk *first_chunk;
+
+  // The chunk currently being allocated from
+  arena_chunk *current_chunk;
+
+  // The address of the most recent allocation, or null
+  void *last_alloc;
+
+  // This arena as an allocator
+  mem_allocator allocator;
+} arena;
+
+// Handle for an arena.
+typedef mem_handle arena_handle;
+
+/**
+ * @brief Creates an arena.
+ *
+ * Use `arena_is_valid` to confirm that the arena is valid before using.
+ * Functions will fail gracefully if called with an invalid arena.
+ *
+ * An allocation larger than the chunk size gets a chunk of its own.
+ *
+ * @param allocator A memory allocator to use for the arena and its chunks
+ * @param chunk_size The size of each chunk, or 0 for
+ *   `ARENA_DEFAULT_CHUNK_SIZE`
+ * @return arena_handle The arena, possibly invalid
+ */
+arena_handle arena_create(mem_allocator allocator, size_t chunk_size);
+
+/**
+ * @param ah Handle of the arena
+ * @return true if the arena is valid
+ */
+bool arena_is_valid(arena_handle ah);
+
+/**
+ * @brief Releases all allocations made from the arena.
+ *
+ * This is O(1). The arena keeps its chunks, and reuses them for subsequent
+ * allocations. All memory handles allocated from the arena become invalid.
+ *
+ * @param ah Handle of the arena
+ */
+void arena_reset(arena_handle ah);
+
+/**
+ * @brief Destroys an arena, releasing all of its memory.
+ *
+ * @param ah Handle of the arena to destroy
+ */
+void arena_destroy(arena_handle ah);
+
+/**
+ * @returns a `mem_allocator` that uses a given arena.
+ */
+mem_allocator mem_allocator_arena(arena_handle ah);
+
+#endif
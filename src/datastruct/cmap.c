@@ -0,0 +1,250 @@
+// For pthread_rwlock_t
+#define _POSIX_C_SOURCE 200809L
+
+#include "cmap.h"
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "hash.h"
+#include "str.h"
+
+// Each shard has its own cache line, so that threads locking different shards
+// do not write to the same line.
+struct cmap_shard {
+  _Alignas(64) pthread_rwlock_t lock;
+  map_handle mh;
+};
+
+// The alignment of the shards array, so that each shard starts a cache line.
+static const size_t SHARDS_ALIGNMENT = 64;
+
+// An odd constant that mixes every bit of a key hash into the high bits of the
+// product (2^64 divided by the golden ratio). A map uses the low bits of a hash
+// to place a key and the high 32 bits to tell keys apart, so the shard must
+// not simply take some of those bits: keys in one shard would crowd part of
+// its table, and weaker hashes such as FNV-1a spread their middle bits poorly.
+static const uint64_t SHARD_HASH_MULTIPLIER = 0x9e3779b97f4a7c15;
+
+static cmap_shard *cmap_shards(cmap *cp) {
+  return mem_p(cp->shards_mh);
+}
+
+/**
+ * @brief Frees the shards of a map, up to a number of shards.
+ *
+ * @param cp The map
+ * @param count The number of shards whose lock and map were created
+ */
+static void free_shards(cmap *cp, unsigned int count) {
+  cmap_shard *shards = cmap_shards(cp);
+  for (unsigned int i = 0; i < count; i++) {
+    map_destroy(shards[i].mh);
+    pthread_rwlock_destroy(&shards[i].lock);
+  }
+  mem_free(cp->shards_mh);
+}
+
+cmap_handle cmap_create(mem_allocator ma, unsigned int shard_count) {
+  if (shard_count == 0) shard_count = CMAP_DEFAULT_SHARD_COUNT;
+  if (shard_count > CMAP_MAX_SHARD_COUNT ||
+      (shard_count & (shard_count - 1)) != 0) {
+    return (cmap_handle){0};
+  }
+  cmap_handle ch = mem_alloc(ma, sizeof(cmap));
+  if (!mem_is_valid(ch)) return (cmap_handle){0};
+  cmap *cp = mem_p(ch);
+  cp->allocator = ma;
+  cp->shard_count = shard_count;
+  cp->shards_mh = mem_alloc_aligned(ma, sizeof(cmap_shard) * shard_count,
+                                    SHARDS_ALIGNMENT);
+  if (!mem_is_valid(cp->shards_mh)) {
+    mem_free(ch);
+    return (cmap_handle){0};
+  }
+  cmap_shard *shards = cmap_shards(cp);
+  for (unsigned int i = 0; i < shard_count; i++) {
+    shards[i].mh = map_create(ma);
+    if (!map_is_valid(shards[i].mh) ||
+        pthread_rwlock_init(&shards[i].lock, NULL) != 0) {
+      map_destroy(shards[i].mh);
+      free_shards(cp, i);
+      mem_free(ch);
+      return (cmap_handle){0};
+    }
+  }
+  return ch;
+}
+
+bool cmap_is_valid(cmap_handle ch) {
+  return mem_is_valid(ch) && mem_is_valid(((cmap *)mem_p(ch))->shards_mh);
+}
+
+/**
+ * @brief Gets the map for a handle passed to a public function.
+ *
+ * A valid map always has shards. This is only checked in DATASTRUCT_CHECKED
+ * builds.
+ *
+ * @param ch The concurrent map handle
+ * @return cmap* The map, or null if the handle is invalid
+ */
+static cmap *cmap_for_handle(cmap_handle ch) {
+  cmap *cp = mem_p(ch);
+  if (!cp || !DATASTRUCT_CHECK(mem_is_valid(cp->shards_mh))) {
+    return (cmap *)0;
+  }
+  return cp;
+}
+
+void cmap_destroy(cmap_handle ch) {
+  if (!cmap_is_valid(ch)) return;
+  cmap *cp = mem_p(ch);
+  free_shards(cp, cp->shard_count);
+  mem_free(ch);
+}
+
+size_t cmap_count(cmap_handle ch) {
+  cmap *cp = cmap_for_handle(ch);
+  if (!cp) return 0;
+  cmap_shard *shards = cmap_shards(cp);
+  size_t count = 0;
+  for (unsigned int i = 0; i < cp->shard_count; i++) {
+    pthread_rwlock_rdlock(&shards[i].lock);
+    count += ((map *)mem_p(shards[i].mh))->entry_count;
+    pthread_rwlock_unlock(&shards[i].lock);
+  }
+  return count;
+}
+
+static cmap_shard *shard_for_hash(cmap *cp, uint64_t key_hash) {
+  uint64_t mixed = (key_hash * SHARD_HASH_MULTIPLIER) >> 32;
+  return &cmap_shards(cp)[(mixed * cp->shard_count) >> 32];
+}
+
+bool cmap_set_str(cmap_handle ch, str key, mem_handle value) {
+  cmap *cp = cmap_for_handle(ch);
+  if (!cp || !str_is_valid(key) || !mem_is_valid(value)) return false;
+  uint64_t key_hash = hash_str(key);
+  cmap_shard *shard = shard_for_hash(cp, key_hash);
+  pthread_rwlock_wrlock(&shard->lock);
+  bool inserted;
+  mem_handle *slot =
+      map_get_or_insert_prehashed(shard->mh, key, key_hash, &inserted);
+  if (slot) *slot = value;
+  pthread_rwlock_unlock(&shard->lock);
+  return slot != (mem_handle *)0;
+}
+
+bool cmap_set_ptr(cmap_handle ch, void *key, mem_handle value) {
+  cmap *cp = cmap_for_handle(ch);
+  if (!cp || !mem_is_valid(value)) return false;
+  cmap_shard *shard = shard_for_hash(cp, hash_ptr(key));
+  pthread_rwlock_wrlock(&shard->lock);
+  bool ok = map_set_ptr(shard->mh, key, value);
+  pthread_rwlock_unlock(&shard->lock);
+  return ok;
+}
+
+mem_handle cmap_get_str(cmap_handle ch, str key) {
+  cmap *cp = cmap_for_handle(ch);
+  if (!cp || !str_is_valid(key)) return (mem_handle){0};
+  uint64_t key_hash = hash_str(key);
+  cmap_shard *shard = shard_for_hash(cp, key_hash);
+  pthread_rwlock_rdlock(&shard->lock);
+  mem_handle value = map_get_prehashed(shard->mh, key, key_hash);
+  pthread_rwlock_unlock(&shard->lock);
+  return value;
+}
+
+mem_handle cmap_get_ptr(cmap_handle ch, void *key) {
+  cmap *cp = cmap_for_handle(ch);
+  if (!cp) return (mem_handle){0};
+  cmap_shard *shard = shard_for_hash(cp, hash_ptr(key));
+  pthread_rwlock_rdlock(&shard->lock);
+  mem_handle value = map_get_ptr(shard->mh, key);
+  pthread_rwlock_unlock(&shard->lock);
+  return value;
+}
+
+/**
+ * @brief Gets the value slot for a key in a locked shard, and sets it to a
+ * value if the key is new.
+ *
+ * @param slot The slot from `map_get_or_insert`, possibly null
+ * @param inserted true if the key is new
+ * @param value The value for a new key
+ * @return mem_handle The value of the key, or an invalid handle if the slot is
+ *   null
+ */
+static mem_handle get_or_set_slot(mem_handle *slot, bool inserted,
+                                  mem_handle value) {
+  if (!slot) return (mem_handle){0};
+  if (inserted) *slot = value;
+  return *slot;
+}
+
+mem_handle cmap_get_or_set_str(cmap_handle ch, str key, mem_handle value) {
+  cmap *cp = cmap_for_handle(ch);
+  if (!cp || !str_is_valid(key) || !mem_is_valid(value)) {
+    return (mem_handle){0};
+  }
+  uint64_t key_hash = hash_str(key);
+  cmap_shard *shard = shard_for_hash(cp, key_hash);
+  pthread_rwlock_wrlock(&shard->lock);
+  bool inserted;
+  mem_handle *slot =
+      map_get_or_insert_prehashed(shard->mh, key, key_hash, &inserted);
+  mem_handle result = get_or_set_slot(slot, inserted, value);
+  pthread_rwlock_unlock(&shard->lock);
+  return result;
+}
+
+mem_handle cmap_get_or_set_ptr(cmap_handle ch, void *key, mem_handle value) {
+  cmap *cp = cmap_for_handle(ch);
+  if (!cp || !mem_is_valid(value)) return (mem_handle){0};
+  cmap_shard *shard = shard_for_hash(cp, hash_ptr(key));
+  pthread_rwlock_wrlock(&shard->lock);
+  bool inserted;
+  mem_handle *slot = map_get_or_insert_ptr(shard->mh, key, &inserted);
+  mem_handle result = get_or_set_slot(slot, inserted, value);
+  pthread_rwlock_unlock(&shard->lock);
+  return result;
+}
+
+// map_delete reports a failure to shrink, not whether the key was set, so the
+// key is looked up first. A failed shrink leaves the table larger, which is
+// harmless.
+bool cmap_delete_str(cmap_handle ch, str key) {
+  cmap *cp = cmap_for_handle(ch);
+  if (!cp || !str_is_valid(key)) return false;
+  uint64_t key_hash = hash_str(key);
+  cmap_shard *shard = shard_for_hash(cp, key_hash);
+  pthread_rwlock_wrlock(&shard->lock);
+  bool found = mem_is_valid(map_get_prehashed(shard->mh, key, key_hash));
+  if (found) map_delete_str(shard->mh, key);
+  pthread_rwlock_unlock(&shard->lock);
+  return found;
+}
+
+bool cmap_delete_ptr(cmap_handle ch, void *key) {
+  cmap *cp = cmap_for_handle(ch);
+  if (!cp) return false;
+  cmap_shard *shard = shard_for_hash(cp, hash_ptr(key));
+  pthread_rwlock_wrlock(&shard->lock);
+  bool found = mem_is_valid(map_get_ptr(shard->mh, key));
+  if (found) map_delete_ptr(shard->mh, key);
+  pthread_rwlock_unlock(&shard->lock);
+  return found;
+}
+
+unsigned int cmap_shard_count(cmap_handle ch) {
+  cmap *cp = cmap_for_handle(ch);
+  return cp ? cp->shard_count : 0;
+}
+
+map_handle cmap_shard_map(cmap_handle ch, unsigned int index) {
+  cmap *cp = cmap_for_handle(ch);
+  if (!cp || index >= cp->shard_count) return (map_handle){0};
+  return cmap_shards(cp)[index].mh;
+}
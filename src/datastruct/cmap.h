@@ -0,0 +1,207 @@
+/**
+ * @file cmap.h
+ * @brief A map that many threads can use at once.
+ *
+ *   cmap_handle symbols = cmap_create(MEM_ALLOCATOR_PLAIN, 0);
+ *   if (!cmap_is_valid(symbols)) abort();
+ *
+ *   // On any thread:
+ *   if (!cmap_set(symbols, name, value)) abort();
+ *
+ * A concurrent map divides its keys among shards by key hash. Each shard is
+ * an ordinary `map` with its own read-write lock, so threads that use
+ * different shards do not wait for each other, and lookups in the same shard
+ * run in parallel. With enough shards, such as the default, threads that fill
+ * one table in parallel rarely wait.
+ *
+ * Keys and values are as for `map`: keys are strs or pointers, the map keeps
+ * its own copy of each str key, and the map never owns the memory of a value.
+ * The allocator must be safe to use from several threads at once.
+ * MEM_ALLOCATOR_PLAIN is, including in `--enable-mem-stats` builds, whose
+ * statistics are locked; a memtbl is not.
+ *
+ * Each function locks one shard for the duration of the call, so a change is
+ * either fully visible to another thread or not at all. A function that reads
+ * or changes a value returns a copy of the handle, never a pointer into the
+ * map. `cmap_get_or_set` sets a key only if it is not already set, for loops
+ * where several threads may add the same key.
+ *
+ * There is no iterator that runs alongside other threads. When no thread is
+ * using the map, such as after parallel loading is done, each shard can be
+ * read with the `map` functions through `cmap_shard_map`.
+ */
+
+#ifndef DATASTRUCT_CMAP_H
+#define DATASTRUCT_CMAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "map.h"
+#include "mem.h"
+#include "str.h"
+
+// The number of shards of a map created with a shard count of 0
+#define CMAP_DEFAULT_SHARD_COUNT 64
+
+// The largest number of shards
+#define CMAP_MAX_SHARD_COUNT 256
+
+// Handle for a concurrent map, returned by `cmap_create`
+typedef mem_handle cmap_handle;
+
+// Internal type for a shard: a map and the lock that guards it
+typedef struct cmap_shard cmap_shard;
+
+// Internal type for a concurrent map data structure
+typedef struct cmap {
+  // The allocator for the shards, and for each shard's map
+  mem_allocator allocator;
+
+  // The array of shards
+  mem_handle shards_mh;
+
+  // The number of shards, a power of two
+  unsigned int shard_count;
+} cmap;
+
+/**
+ * @brief Creates a concurrent map.
+ *
+ * Use `cmap_is_valid` to validate the map before using.
+ *
+ * @param ma The memory allocator to use, which must be thread-safe
+ * @param shard_count The number of shards, a power of two up to
+ *   CMAP_MAX_SHARD_COUNT, or 0 for CMAP_DEFAULT_SHARD_COUNT. More shards than
+ *   threads keep threads from waiting on each other.
+ * @return cmap_handle A handle for the map, invalid if the shard count is not
+ *   allowed or memory could not be allocated
+ */
+cmap_handle cmap_create(mem_allocator ma, unsigned int shard_count);
+
+/**
+ * @param ch The concurrent map handle
+ * @return true if the map is valid
+ */
+bool cmap_is_valid(cmap_handle ch);
+
+/**
+ * @brief Destroys a concurrent map.
+ *
+ * No other thread may be using the map.
+ *
+ * @param ch The handle of the map to destroy
+ */
+void cmap_destroy(cmap_handle ch);
+
+/**
+ * @brief Gets the number of keys in a concurrent map.
+ *
+ * This counts each shard in turn. While other threads change the map, the
+ * result is only approximate.
+ *
+ * @param ch The concurrent map handle
+ * @return size_t The number of keys
+ */
+size_t cmap_count(cmap_handle ch);
+
+// clang-format off
+/**
+ * @brief Sets a key-value pair in a concurrent map.
+ *
+ * @param ch The cmap_handle
+ * @param key The key, either a str or a void*
+ * @param value The mem_handle value
+ * @return true on success, false if the handle, key, or value is invalid or
+ *   memory could not be allocated
+ */
+#define cmap_set(ch, key, value) \
+  _Generic((key), \
+    str: cmap_set_str, \
+    void *: cmap_set_ptr \
+  )((ch), (key), (value))
+// clang-format on
+bool cmap_set_str(cmap_handle ch, str key, mem_handle value);
+bool cmap_set_ptr(cmap_handle ch, void *key, mem_handle value);
+
+// clang-format off
+/**
+ * @brief Gets a value for a key in a concurrent map.
+ *
+ * @param ch The cmap_handle
+ * @param key The key, either a str or a void*
+ * @return mem_handle The value stored, or an invalid mem_handle if not found
+ */
+#define cmap_get(ch, key) \
+  _Generic((key), \
+    str: cmap_get_str, \
+    void *: cmap_get_ptr \
+  )((ch), (key))
+// clang-format on
+mem_handle cmap_get_str(cmap_handle ch, str key);
+mem_handle cmap_get_ptr(cmap_handle ch, void *key);
+
+// clang-format off
+/**
+ * @brief Gets the value for a key, setting it first if the key is not set.
+ *
+ * When several threads add the same key, exactly one of them sets its value,
+ * and all of them get that value back:
+ *
+ *   mem_handle canonical = cmap_get_or_set(names, name, copy);
+ *   if (mem_p(canonical) != mem_p(copy)) mem_free(copy);
+ *
+ * @param ch The cmap_handle
+ * @param key The key, either a str or a void*
+ * @param value The mem_handle value to set if the key is not set
+ * @return mem_handle The value of the key, or an invalid mem_handle if the key
+ *   could not be added
+ */
+#define cmap_get_or_set(ch, key, value) \
+  _Generic((key), \
+    str: cmap_get_or_set_str, \
+    void *: cmap_get_or_set_ptr \
+  )((ch), (key), (value))
+// clang-format on
+mem_handle cmap_get_or_set_str(cmap_handle ch, str key, mem_handle value);
+mem_handle cmap_get_or_set_ptr(cmap_handle ch, void *key, mem_handle value);
+
+// clang-format off
+/**
+ * @brief Deletes a key from a concurrent map.
+ *
+ * @param ch The cmap_handle
+ * @param key The key, either a str or a void*
+ * @return true if the key was in the map
+ */
+#define cmap_delete(ch, key) \
+  _Generic((key), \
+    str: cmap_delete_str, \
+    void *: cmap_delete_ptr \
+  )((ch), (key))
+// clang-format on
+bool cmap_delete_str(cmap_handle ch, str key);
+bool cmap_delete_ptr(cmap_handle ch, void *key);
+
+/**
+ * @param ch The concurrent map handle
+ * @return unsigned int The number of shards, or 0 if the handle is invalid
+ */
+unsigned int cmap_shard_count(cmap_handle ch);
+
+/**
+ * @brief Gets the map of one shard, to read without locking.
+ *
+ * Use this only while no other thread is using the concurrent map, such as to
+ * iterate over every value after parallel loading is done. Changing the
+ * shard's map directly is undefined: a key must stay in the shard its hash
+ * selects.
+ *
+ * @param ch The concurrent map handle
+ * @param index The index of the shard, less than `cmap_shard_count(ch)`
+ * @return map_handle The shard's map, or an invalid handle if the map handle
+ *   or index is invalid
+ */
+map_handle cmap_shard_map(cmap_handle ch, unsigned int index);
+
+#endif
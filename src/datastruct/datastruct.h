@@ -1,4 +1,13 @@
 #include "mem.h"
+#include "arena.h"
+#include "cmap.h"
+#include "hash.h"
+#include "intern.h"
 #include "map.h"
+#include "mapfile.h"
 #include "memtbl.h"
+#include "mmap.h"
+#include "slab.h"
 #include "str.h"
+#include "strarena.h"
+#include "tmap.h"
@@ -0,0 +1,137 @@
+#include "hash.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "mem.h"
+#include "str.h"
+
+#ifdef DATASTRUCT_HASH_FNV
+
+/**
+ * @brief Hashes bytes with Fowler/Noll/Vo 64-bit FNV-1a.
+ *
+ * Based on: http://isthe.com/chongo/tech/comp/fnv/
+ *
+ * The seed is hashed as the first eight bytes.
+ */
+uint64_t hash_bytes(const void *data, size_t size, uint64_t seed) {
+  static const uint64_t FNV_PRIME = 0x100000001b3;
+  uint64_t hash = 0xcbf29ce484222325;
+  for (unsigned int i = 0; i < 8; i++) {
+    hash = (hash ^ (seed & 0xff)) * FNV_PRIME;
+    seed >>= 8;
+  }
+  const unsigned char *p = data;
+  for (size_t i = 0; i < size; i++) {
+    hash = (hash ^ p[i]) * FNV_PRIME;
+  }
+  return hash;
+}
+
+#else
+
+// Secrets from wyhash. Each is odd, and has 32 bits set.
+static const uint64_t WY_P0 = 0xa0761d6478bd642f;
+static const uint64_t WY_P1 = 0xe7037ed1a0b428db;
+static const uint64_t WY_P2 = 0x8ebc6af09c88c6e3;
+static const uint64_t WY_P3 = 0x589965cc75374cc3;
+
+/**
+ * @brief Multiplies two 64-bit values into a 128-bit result.
+ *
+ * @param a Set to the low 64 bits of the result
+ * @param b Set to the high 64 bits of the result
+ */
+static inline void wy_mum(uint64_t *a, uint64_t *b) {
+#ifdef __SIZEOF_INT128__
+  __uint128_t r = (__uint128_t)*a * *b;
+  *a = (uint64_t)r;
+  *b = (uint64_t)(r >> 64);
+#else
+  uint64_t ha = *a >> 32, hb = *b >> 32;
+  uint64_t la = (uint32_t)*a, lb = (uint32_t)*b;
+  uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+  uint64_t t = rl + (rm0 << 32);
+  uint64_t carry = t < rl;
+  uint64_t lo = t + (rm1 << 32);
+  carry += lo < t;
+  *a = lo;
+  *b = rh + (rm0 >> 32) + (rm1 >> 32) + carry;
+#endif
+}
+
+static inline uint64_t wy_mix(uint64_t a, uint64_t b) {
+  wy_mum(&a, &b);
+  return a ^ b;
+}
+
+static inline uint64_t wy_read8(const unsigned char *p) {
+  uint64_t v;
+  memcpy(&v, p, 8);
+  return v;
+}
+
+static inline uint64_t wy_read4(const unsigned char *p) {
+  uint32_t v;
+  memcpy(&v, p, 4);
+  return v;
+}
+
+// Reads 1 to 3 bytes.
+static inline uint64_t wy_read3(const unsigned char *p, size_t size) {
+  return ((uint64_t)p[0] << 16) | ((uint64_t)p[size >> 1] << 8) |
+         p[size - 1];
+}
+
+uint64_t hash_bytes(const void *data, size_t size, uint64_t seed) {
+  const unsigned char *p = data;
+  seed ^= WY_P0;
+  uint64_t a, b;
+  if (size <= 16) {
+    if (size >= 4) {
+      // Two overlapping pairs of 4-byte reads cover 4 to 16 bytes.
+      size_t offset = (size >> 3) << 2;
+      a = (wy_read4(p) << 32) | wy_read4(p + offset);
+      b = (wy_read4(p + size - 4) << 32) | wy_read4(p + size - 4 - offset);
+    } else if (size > 0) {
+      a = wy_read3(p, size);
+      b = 0;
+    } else {
+      a = b = 0;
+    }
+  } else {
+    size_t remaining = size;
+    if (remaining > 48) {
+      // Three independent lanes, so that the multiplies can overlap.
+      uint64_t seed1 = seed, seed2 = seed;
+      do {
+        seed = wy_mix(wy_read8(p) ^ WY_P1, wy_read8(p + 8) ^ seed);
+        seed1 = wy_mix(wy_read8(p + 16) ^ WY_P2, wy_read8(p + 24) ^ seed1);
+        seed2 = wy_mix(wy_read8(p + 32) ^ WY_P3, wy_read8(p + 40) ^ seed2);
+        p += 48;
+        remaining -= 48;
+      } while (remaining > 48);
+      seed ^= seed1 ^ seed2;
+    }
+    while (remaining > 16) {
+      seed = wy_mix(wy_read8(p) ^ WY_P1, wy_read8(p + 8) ^ seed);
+      p += 16;
+      remaining -= 16;
+    }
+    // The last 16 bytes, which may overlap bytes already hashed.
+    a = wy_read8(p + remaining - 16);
+    b = wy_read8(p + remaining - 8);
+  }
+  a ^= WY_P1;
+  b ^= seed;
+  wy_mum(&a, &b);
+  return wy_mix(a ^ WY_P0 ^ size, b ^ WY_P1);
+}
+
+#endif
+
+extern inline uint64_t hash_str(str s);
+extern inline uint64_t hash_u64(uint64_t x);
+extern inline uint64_t hash_ptr(const void *p);
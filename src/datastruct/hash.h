@@ -0,0 +1,88 @@
+/**
+ * @file hash.h
+ * @brief Hash functions for bytes, strs, and pointers.
+ *
+ *   uint64_t h1 = hash_str(str_from_cstr("key"));
+ *   uint64_t h2 = hash_ptr(&thing);
+ *
+ * `hash_bytes` reads its input eight bytes at a time and mixes with 64x64-bit
+ * multiplies, after wyhash by Wang Yi (public domain). `hash_u64` is a single
+ * multiply followed by a shift, and is a bijection, so two different integers
+ * or pointers never have the same hash. Map tables index by the low bits of a
+ * hash, and the shift brings high bits down into them.
+ *
+ * When the library is built with `DATASTRUCT_HASH_FNV` defined, `hash_bytes`
+ * is 64-bit FNV-1a instead, and `hash_u64` is the MurmurHash3 finalizer. These
+ * are slower, and read one byte at a time, but are simpler and do not depend
+ * on the byte order of the machine.
+ *
+ * Hash values are not stable between builds, and must not be stored.
+ */
+
+#ifndef DATASTRUCT_HASH_H
+#define DATASTRUCT_HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "str.h"
+
+/**
+ * @brief Hashes a block of memory.
+ *
+ * @param data The address of the memory. This may be null if size is 0.
+ * @param size The number of bytes
+ * @param seed A value mixed into the hash, so that different seeds give
+ *   independent hashes of the same bytes
+ * @return uint64_t The hash
+ */
+uint64_t hash_bytes(const void *data, size_t size, uint64_t seed);
+
+/**
+ * @brief Hashes the contents of a str.
+ *
+ * This is inline.
+ *
+ * @param s The str. An invalid str hashes like an empty one.
+ * @return uint64_t The hash
+ */
+inline uint64_t hash_str(str s) {
+  return hash_bytes(mem_p(s), mem_size(s), 0);
+}
+
+/**
+ * @brief Hashes a 64-bit integer.
+ *
+ * This is a bijection: different integers always have different hashes. This
+ * is inline.
+ *
+ * @param x The integer
+ * @return uint64_t The hash
+ */
+inline uint64_t hash_u64(uint64_t x) {
+#ifdef DATASTRUCT_HASH_FNV
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccd;
+  x ^= x >> 33;
+  x *= 0xc4ceb9fe1a85ec53;
+  return x ^ (x >> 33);
+#else
+  x *= 0x9e3779b97f4a7c15;
+  return x ^ (x >> 29);
+#endif
+}
+
+/**
+ * @brief Hashes a memory address.
+ *
+ * This is a bijection: different addresses always have different hashes.
+ * This is inline.
+ *
+ * @param p The address
+ * @return uint64_t The hash
+ */
+inline uint64_t hash_ptr(const void *p) {
+  return hash_u64((uint64_t)(uintptr_t)p);
+}
+
+#endif
@@ -0,0 +1,258 @@
+#include "intern.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include "hash.h"
+
+// The canonical bytes of an atom follow this header in the arena, so that a
+// canonical str from the index leads back to its atom.
+typedef struct atom_header {
+  atom id;
+  uint32_t size;
+} atom_header;
+
+// The number of atoms the atoms array starts with room for
+static const size_t INITIAL_ATOMS_CAPACITY = 64;
+
+// The number of strings `intern_many` looks up at once. This sizes an array
+// on the stack.
+#define INTERN_BATCH_SIZE 64
+
+static const char **atom_bytes(intern_table *itp) {
+  return mem_p(itp->atoms_mh);
+}
+
+static atom canonical_atom(mem_handle canonical) {
+  return ((const atom_header *)mem_p(canonical) - 1)->id;
+}
+
+static bool same_bytes(str canonical, str s) {
+  return mem_size(canonical) == mem_size(s) &&
+         memcmp(mem_p(canonical), mem_p(s), mem_size(s)) == 0;
+}
+
+intern_handle intern_create(mem_allocator ma) {
+  intern_handle ih = mem_alloc(ma, sizeof(intern_table));
+  if (!mem_is_valid(ih)) return (intern_handle){0};
+  intern_table *itp = mem_p(ih);
+  *itp = (intern_table){
+      .allocator = ma,
+      .arena = arena_create(ma, 0),
+      .index_mh = map_create_hash_only(ma),
+      .atoms_mh = mem_alloc(ma, sizeof(char *) * INITIAL_ATOMS_CAPACITY)};
+  if (!arena_is_valid(itp->arena) || !map_is_valid(itp->index_mh) ||
+      !mem_is_valid(itp->atoms_mh)) {
+    arena_destroy(itp->arena);
+    map_destroy(itp->index_mh);
+    mem_free(itp->atoms_mh);
+    mem_free(ih);
+    return (intern_handle){0};
+  }
+  return ih;
+}
+
+bool intern_is_valid(intern_handle ih) {
+  return mem_is_valid(ih) &&
+         map_is_valid(((intern_table *)mem_p(ih))->index_mh);
+}
+
+/**
+ * @brief Gets the intern table for a handle passed to a public function.
+ *
+ * A valid table always has an index. This is only checked in
+ * DATASTRUCT_CHECKED builds.
+ *
+ * @param ih The intern table handle
+ * @return intern_table* The table, or null if the handle is invalid
+ */
+static intern_table *intern_for_handle(intern_handle ih) {
+  intern_table *itp = mem_p(ih);
+  if (!itp || !DATASTRUCT_CHECK(map_is_valid(itp->index_mh))) {
+    return (intern_table *)0;
+  }
+  return itp;
+}
+
+void intern_destroy(intern_handle ih) {
+  if (!intern_is_valid(ih)) return;
+  intern_table *itp = mem_p(ih);
+  map_destroy(itp->index_mh);
+  map_destroy(itp->collisions_mh);
+  mem_free(itp->atoms_mh);
+  arena_destroy(itp->arena);
+  mem_free(ih);
+}
+
+uint32_t intern_count(intern_handle ih) {
+  intern_table *itp = intern_for_handle(ih);
+  return itp ? itp->atom_count : 0;
+}
+
+/**
+ * @brief Grows the atoms array to hold a number of new atoms.
+ *
+ * @param itp The table
+ * @param count The number of atoms to make room for
+ * @return true on success, false if memory could not be allocated
+ */
+static bool reserve_atoms(intern_table *itp, size_t count) {
+  // Atoms are numbered from 1, and slot 0 is unused.
+  size_t needed = (size_t)itp->atom_count + 1 + count;
+  size_t capacity = mem_size(itp->atoms_mh) / sizeof(char *);
+  if (needed <= capacity) return true;
+  while (capacity < needed) capacity <<= 1;
+  mem_handle atoms_mh = mem_realloc(itp->atoms_mh, sizeof(char *) * capacity);
+  if (!mem_is_valid(atoms_mh)) return false;
+  itp->atoms_mh = atoms_mh;
+  return true;
+}
+
+/**
+ * @brief Makes a new atom for a string.
+ *
+ * @param itp The table
+ * @param s The string, which is not yet interned
+ * @return mem_handle The canonical str of the new atom, or an invalid handle
+ *   if memory could not be allocated
+ */
+static mem_handle add_atom(intern_table *itp, str s) {
+  size_t size = mem_size(s);
+  if (size > UINT32_MAX || itp->atom_count == UINT32_MAX - 1 ||
+      !reserve_atoms(itp, 1)) {
+    return (mem_handle){0};
+  }
+  size_t alloc_size = sizeof(atom_header) + size + 1;
+  mem_handle mh = mem_alloc(mem_allocator_arena(itp->arena), alloc_size);
+  if (!mem_is_valid(mh)) return (mem_handle){0};
+  atom_header *header = mem_p(mh);
+  *header = (atom_header){.id = itp->atom_count + 1, .size = size};
+  char *bytes = (char *)(header + 1);
+  if (size > 0) memcpy(bytes, mem_p(s), size);
+  bytes[size] = '\0';
+  atom_bytes(itp)[header->id] = bytes;
+  itp->atom_count = header->id;
+  itp->string_bytes += alloc_size;
+  return mem_handle_from_ptr(bytes, size);
+}
+
+/**
+ * @brief Interns a string whose hash is in the index for a different string.
+ *
+ * @param itp The table
+ * @param s The string
+ * @return atom The atom, or ATOM_NONE if memory could not be allocated
+ */
+static atom intern_collision(intern_table *itp, str s) {
+  if (!map_is_valid(itp->collisions_mh)) {
+    itp->collisions_mh = map_create(itp->allocator);
+    if (!map_is_valid(itp->collisions_mh)) return ATOM_NONE;
+  }
+  bool inserted;
+  mem_handle *slot = map_get_or_insert(itp->collisions_mh, s, &inserted);
+  if (!slot) return ATOM_NONE;
+  if (inserted) {
+    *slot = add_atom(itp, s);
+    if (!mem_is_valid(*slot)) {
+      map_delete(itp->collisions_mh, s);
+      return ATOM_NONE;
+    }
+  }
+  return canonical_atom(*slot);
+}
+
+static atom do_intern(intern_table *itp, str s) {
+  bool inserted;
+  mem_handle *slot = map_get_or_insert_prehashed(itp->index_mh, s,
+                                                 hash_str(s), &inserted);
+  if (!slot) return ATOM_NONE;
+  if (inserted) {
+    *slot = add_atom(itp, s);
+    if (!mem_is_valid(*slot)) {
+      map_delete(itp->index_mh, s);
+      return ATOM_NONE;
+    }
+    return canonical_atom(*slot);
+  }
+  if (same_bytes(*slot, s)) return canonical_atom(*slot);
+  return intern_collision(itp, s);
+}
+
+atom intern_str(intern_handle ih, str s) {
+  intern_table *itp = intern_for_handle(ih);
+  if (!itp || !str_is_valid(s)) return ATOM_NONE;
+  return do_intern(itp, s);
+}
+
+size_t intern_many(intern_handle ih, const str *strs, atom *atoms,
+                   size_t count) {
+  intern_table *itp = intern_for_handle(ih);
+  if (!itp || (count > 0 && (!strs || !atoms))) return 0;
+  size_t done = 0;
+  mem_handle found[INTERN_BATCH_SIZE];
+  while (done < count) {
+    size_t batch = count - done;
+    if (batch > INTERN_BATCH_SIZE) batch = INTERN_BATCH_SIZE;
+    // Looking up the whole batch first overlaps the cache misses of the
+    // lookups, and counts the strings that may be new.
+    size_t found_count =
+        map_get_many(itp->index_mh, strs + done, found, batch);
+    size_t new_count = batch - found_count;
+    if (new_count > 0) {
+      map_reserve(itp->index_mh,
+                  ((map *)mem_p(itp->index_mh))->entry_count + new_count);
+      reserve_atoms(itp, new_count);
+    }
+    for (size_t i = 0; i < batch; i++) {
+      str s = strs[done + i];
+      atom a = ATOM_NONE;
+      if (str_is_valid(s)) {
+        a = mem_is_valid(found[i]) && same_bytes(found[i], s)
+                ? canonical_atom(found[i])
+                : do_intern(itp, s);
+      }
+      if (a == ATOM_NONE) {
+        for (size_t j = done + i; j < count; j++) atoms[j] = ATOM_NONE;
+        return done + i;
+      }
+      atoms[done + i] = a;
+    }
+    done += batch;
+  }
+  return done;
+}
+
+atom intern_find(intern_handle ih, str s) {
+  intern_table *itp = intern_for_handle(ih);
+  if (!itp || !str_is_valid(s)) return ATOM_NONE;
+  mem_handle canonical = map_get(itp->index_mh, s);
+  if (!mem_is_valid(canonical)) return ATOM_NONE;
+  if (same_bytes(canonical, s)) return canonical_atom(canonical);
+  if (!map_is_valid(itp->collisions_mh)) return ATOM_NONE;
+  canonical = map_get(itp->collisions_mh, s);
+  return mem_is_valid(canonical) ? canonical_atom(canonical) : ATOM_NONE;
+}
+
+str intern_atom_str(intern_handle ih, atom a) {
+  intern_table *itp = intern_for_handle(ih);
+  if (!itp || a == ATOM_NONE || a > itp->atom_count) return (str){0};
+  const char *bytes = atom_bytes(itp)[a];
+  return mem_handle_from_ptr((void *)bytes,
+                             ((const atom_header *)bytes - 1)->size);
+}
+
+intern_memory intern_memory_use(intern_handle ih) {
+  intern_table *itp = intern_for_handle(ih);
+  if (!itp) return (intern_memory){0};
+  intern_memory result = {
+      .atom_count = itp->atom_count,
+      .string_bytes = itp->string_bytes,
+      .table_bytes = sizeof(intern_table) + map_memory_use(itp->index_mh) +
+                     map_memory_use(itp->collisions_mh) +
+                     mem_size(itp->atoms_mh)};
+  if (result.atom_count > 0) {
+    size_t total = result.string_bytes + result.table_bytes;
+    result.bytes_per_atom = (total + result.atom_count - 1) / result.atom_count;
+  }
+  return result;
+}
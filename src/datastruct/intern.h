@@ -0,0 +1,185 @@
+/**
+ * @file intern.h
+ * @brief A string intern table, which gives each distinct string a small
+ * integer id.
+ *
+ *   intern_handle names = intern_create(MEM_ALLOCATOR_PLAIN);
+ *   if (!intern_is_valid(names)) abort();
+ *   atom cmd = intern_str(names, word);
+ *   if (cmd == ATOM_NONE) abort();
+ *   if (cmd == help_atom) ...
+ *   printf("%s\n", mem_p(intern_atom_str(names, cmd)));
+ *
+ * Interning a string returns its atom: a `uint32_t` id that is the same for
+ * every string with the same bytes, and never changes. Once strings are
+ * interned, they can be compared by comparing atoms, and used as keys of
+ * integer-keyed maps such as `map_u32_u32`, without hashing or comparing
+ * their bytes again. The cost of hashing a string is paid once, when it is
+ * interned.
+ *
+ * The table keeps one canonical copy of each string's bytes, with a null
+ * terminator, in an arena. `intern_atom_str` returns it. Canonical strings
+ * do not move, and are valid until the table is destroyed. Atoms are numbered
+ * from 1 in the order that strings are first interned, so an atom can index
+ * an array, and ATOM_NONE (0) can mark a missing value.
+ *
+ * An intern table is a hash-only `map` from each string's hash to its
+ * canonical bytes, which are compared to confirm a match. Two strings with
+ * the same 64-bit hash are rare, and are kept in a second map with full
+ * keys. There is no way to remove a string from the table.
+ */
+
+#ifndef DATASTRUCT_INTERN_H
+#define DATASTRUCT_INTERN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "arena.h"
+#include "map.h"
+#include "mem.h"
+#include "str.h"
+
+// The id of an interned string
+typedef uint32_t atom;
+
+// An atom that no string has
+#define ATOM_NONE 0
+
+// Handle for an intern table, returned by `intern_create`
+typedef mem_handle intern_handle;
+
+// Internal type for an intern table
+typedef struct intern_table {
+  // The allocator for the maps, the atoms array, and the arena's chunks
+  mem_allocator allocator;
+
+  // The arena that holds the canonical strings
+  arena_handle arena;
+
+  // A hash-only map from the hash of each string to its canonical str
+  map_handle index_mh;
+
+  // A map from a string to its canonical str, for strings whose hash is
+  // already in the index for a different string. Invalid until needed.
+  map_handle collisions_mh;
+
+  // The canonical bytes of each atom, indexed by atom
+  mem_handle atoms_mh;
+
+  // The number of atoms, not counting ATOM_NONE
+  uint32_t atom_count;
+
+  // The number of bytes in the arena used by canonical strings
+  size_t string_bytes;
+} intern_table;
+
+// The memory that an intern table uses, from `intern_memory_use`
+typedef struct intern_memory {
+  // The number of atoms
+  size_t atom_count;
+
+  // Bytes of canonical strings, with each string's length, atom, null
+  // terminator, and padding
+  size_t string_bytes;
+
+  // Bytes of the maps and the atoms array
+  size_t table_bytes;
+
+  // The total divided by the number of atoms, rounded up, or 0 if there are
+  // no atoms
+  size_t bytes_per_atom;
+} intern_memory;
+
+/**
+ * @brief Creates an intern table.
+ *
+ * Use `intern_is_valid` to validate the table before using.
+ *
+ * @param ma The memory allocator to use
+ * @return intern_handle A handle for the table, invalid if memory could not
+ *   be allocated
+ */
+intern_handle intern_create(mem_allocator ma);
+
+/**
+ * @param ih The intern table handle
+ * @return true if the table is valid
+ */
+bool intern_is_valid(intern_handle ih);
+
+/**
+ * @brief Destroys an intern table, and the canonical strings of its atoms.
+ *
+ * @param ih The handle of the table to destroy
+ */
+void intern_destroy(intern_handle ih);
+
+/**
+ * @param ih The intern table handle
+ * @return uint32_t The number of atoms, or 0 if the handle is invalid. The
+ *   atoms are 1 to this number.
+ */
+uint32_t intern_count(intern_handle ih);
+
+/**
+ * @brief Interns a string.
+ *
+ * @param ih The intern table handle
+ * @param s The string. The empty string can be interned.
+ * @return atom The atom of the string, added if the string is new, or
+ *   ATOM_NONE if the handle or string is invalid or memory could not be
+ *   allocated
+ */
+atom intern_str(intern_handle ih, str s);
+
+/**
+ * @brief Interns an array of strings.
+ *
+ * This makes room in the table for every string first, so that the table
+ * grows at most once, such as when loading a symbol file or a word list.
+ *
+ * @param ih The intern table handle
+ * @param strs The strings
+ * @param atoms An array set to the atom of each string. If a string could not
+ *   be interned, its atom and the atoms of the strings after it are set to
+ *   ATOM_NONE.
+ * @param count The number of strings
+ * @return size_t The number of strings interned, which is count on success
+ */
+size_t intern_many(intern_handle ih, const str *strs, atom *atoms,
+                   size_t count);
+
+/**
+ * @brief Gets the atom of a string without interning it.
+ *
+ * @param ih The intern table handle
+ * @param s The string
+ * @return atom The atom of the string, or ATOM_NONE if the string has not
+ *   been interned
+ */
+atom intern_find(intern_handle ih, str s);
+
+/**
+ * @brief Gets the canonical string of an atom.
+ *
+ * The bytes are followed by a null terminator, so `mem_p` of the str is a C
+ * string. The memory must not be written.
+ *
+ * @param ih The intern table handle
+ * @param a The atom
+ * @return str The canonical string, or an invalid str if the atom is not in
+ *   the table
+ */
+str intern_atom_str(intern_handle ih, atom a);
+
+/**
+ * @brief Gets the memory that an intern table uses.
+ *
+ * @param ih The intern table handle
+ * @return intern_memory The memory use, all zero if the handle is invalid
+ */
+intern_memory intern_memory_use(intern_handle ih);
+
+#endif
@@ -1,266 +1,840 @@
 #include "map.h"
 
-#include <assert.h>
+#include <limits.h>
 #include <stdint.h>
+#include <string.h>
 
+#include "hash.h"
+#include "rhtable.h"
 #include "str.h"
 
+// The size of a new index table. Table sizes are powers of two.
 static const unsigned int INITIAL_TABLE_SIZE = 32;
 
-enum map_key_type { MAP_KEY_STR, MAP_KEY_PTR };
+// The alignment of the index table and the entries, so that a probe reads as
+// few cache lines as possible.
+static const size_t TABLE_ALIGNMENT = 64;
 
+// The number of old entries that an incremental resize moves per change to
+// the map. Each entry moved is at most one Robin Hood insertion into the
+// index. This is large enough that the old entries are gone well before the
+// new entries array is full.
+static const unsigned int MIGRATE_SLOTS = 32;
+
+// The number of keys that the bulk functions hash and prefetch before probing
+// for any of them, so that the cache misses of their probes overlap.
+#define BATCH_SIZE 16
+
+#if defined(__GNUC__) || defined(__clang__)
+#define PREFETCH(addr) __builtin_prefetch(addr)
+#else
+#define PREFETCH(addr) ((void)(addr))
+#endif
+
+// A slot of the index table. A key's home slot is picked by the low bits of
+// its hash.
+typedef struct index_slot {
+  rh_meta meta;
+
+  // The position of the slot's entry in the entries array
+  uint32_t entry_pos;
+} index_slot;
+
+// An entry is a hole, left by a deleted key, when its value handle is invalid.
 struct map_entry {
-  uint32_t key_hash;
+  // The hash of the key
+  uint64_t key_hash;
+
+  // The map's copy of a str key. This is invalid for a pointer key, and in a
+  // hash-only map.
+  str key;
+
   mem_handle value_handle;
 };
 
-map_handle map_create(mem_allocator ma) {
+// The key of an empty str, which needs no copy.
+static char EMPTY_KEY[1];
+
+/**
+ * @brief Gets the number of entries a table can hold before it grows.
+ *
+ * This is also the size of the entries array for the table.
+ *
+ * @param table_size The number of slots in the index table
+ * @return unsigned int The maximum number of entries
+ */
+static unsigned int max_entry_count(unsigned int table_size) {
+  return rh_max_count(table_size);
+}
+
+/**
+ * @brief Allocates an empty index table.
+ *
+ * @param mp The map
+ * @param table_size The number of slots
+ * @return mem_handle The index table, possibly invalid
+ */
+static mem_handle alloc_index(map *mp, unsigned int table_size) {
+  size_t size = sizeof(index_slot) * table_size;
+  mem_handle index_mh = mem_alloc_aligned(mp->allocator, size, TABLE_ALIGNMENT);
+  if (mem_is_valid(index_mh)) memset(mem_p(index_mh), 0, size);
+  return index_mh;
+}
+
+/**
+ * @brief Allocates the entries array for an index table.
+ *
+ * The array is not cleared: an entry is not read until it has been added.
+ *
+ * @param mp The map
+ * @param table_size The number of slots in the index table
+ * @return mem_handle The entries array, possibly invalid
+ */
+static mem_handle alloc_entries(map *mp, unsigned int table_size) {
+  return mem_alloc_aligned(mp->allocator,
+                           sizeof(map_entry) * max_entry_count(table_size),
+                           TABLE_ALIGNMENT);
+}
+
+static index_slot *index_slots(mem_handle index_mh) {
+  return mem_p(index_mh);
+}
+
+static map_entry *map_entries(mem_handle entries_mh) {
+  return mem_p(entries_mh);
+}
+
+static bool entry_is_hole(const map_entry *entry) {
+  return !mem_is_valid(entry->value_handle);
+}
+
+/**
+ * @brief Creates a map with either full keys or hash-only keys.
+ *
+ * @param ma The memory allocator
+ * @param hash_only true to store only key hashes
+ * @return map_handle A handle for the map
+ */
+static map_handle create_map(mem_allocator ma, bool hash_only) {
   map_handle mh = mem_alloc(ma, sizeof(map));
   if (!mem_is_valid(mh)) return (map_handle){0};
   map *mp = mem_p(mh);
+  mp->allocator = ma;
+  mp->hash_only = hash_only;
+  mp->incremental = false;
   mp->entry_count = 0;
+  mp->entries_used = 0;
   mp->table_size = INITIAL_TABLE_SIZE;
-  mp->entries_mh = mem_alloc_clear(ma, sizeof(map_entry) * INITIAL_TABLE_SIZE);
-  if (!mem_is_valid(mp->entries_mh)) {
+  mp->old_index_mh = (mem_handle){0};
+  mp->old_entries_mh = (mem_handle){0};
+  mp->old_table_size = 0;
+  mp->old_entries_used = 0;
+  mp->migrate_pos = 0;
+  mp->migrate_dst = 0;
+  mp->moved_end = 0;
+  mp->index_mh = alloc_index(mp, INITIAL_TABLE_SIZE);
+  mp->entries_mh = alloc_entries(mp, INITIAL_TABLE_SIZE);
+  if (!mem_is_valid(mp->index_mh) || !mem_is_valid(mp->entries_mh)) {
+    mem_free(mp->index_mh);
+    mem_free(mp->entries_mh);
     mem_free(mh);
     return (map_handle){0};
   }
   return mh;
 }
 
+map_handle map_create(mem_allocator ma) {
+  return create_map(ma, false);
+}
+
+map_handle map_create_hash_only(mem_allocator ma) {
+  return create_map(ma, true);
+}
+
 bool map_is_valid(map_handle mh) {
-  return mem_is_valid(mh) && mem_is_valid(((map *)mem_p(mh))->entries_mh);
+  return mem_is_valid(mh) && mem_is_valid(((map *)mem_p(mh))->index_mh);
+}
+
+/**
+ * @brief Gets the map for a handle passed to a public function.
+ *
+ * A valid map always has an index table. This is only checked in
+ * DATASTRUCT_CHECKED builds.
+ *
+ * @param mh The map handle
+ * @return map* The map, or null if the handle is invalid
+ */
+static map *map_for_handle(map_handle mh) {
+  map *mp = mem_p(mh);
+  if (!mp || !DATASTRUCT_CHECK(mem_is_valid(mp->index_mh))) return (map *)0;
+  return mp;
+}
+
+static bool is_resizing(map *mp) {
+  return mem_is_valid(mp->old_index_mh);
+}
+
+/**
+ * @brief Gets the number of positions in the map's order of entries.
+ *
+ * See `entry_in_order`.
+ *
+ * @param mp The map
+ * @return unsigned int The number of positions, including holes
+ */
+static unsigned int order_end(map *mp) {
+  if (!is_resizing(mp)) return mp->entries_used;
+  return mp->migrate_dst + (mp->old_entries_used - mp->migrate_pos) +
+         (mp->entries_used - mp->moved_end);
+}
+
+/**
+ * @brief Gets an entry by its position in the order keys were added.
+ *
+ * This is the position in the entries array. During an incremental resize,
+ * the entries array holds the old entries moved so far, then room for the old
+ * entries not yet moved, then the entries added since the resize started. The
+ * old entries not yet moved are read from the old entries array in place of
+ * that room.
+ *
+ * @param mp The map
+ * @param pos The position, less than `order_end(mp)`
+ * @return map_entry* The entry, possibly a hole
+ */
+static map_entry *entry_in_order(map *mp, unsigned int pos) {
+  if (is_resizing(mp) && pos >= mp->migrate_dst) {
+    unsigned int old_left = mp->old_entries_used - mp->migrate_pos;
+    if (pos - mp->migrate_dst < old_left) {
+      return &map_entries(mp->old_entries_mh)[mp->migrate_pos + pos -
+                                              mp->migrate_dst];
+    }
+    pos += mp->moved_end - mp->migrate_dst - old_left;
+  }
+  return &map_entries(mp->entries_mh)[pos];
 }
 
 void map_destroy(map_handle mh) {
   if (!map_is_valid(mh)) return;
   map *mp = mem_p(mh);
+  if (!mp->hash_only) {
+    // A hole's key is already freed and invalid.
+    unsigned int end = order_end(mp);
+    for (unsigned int i = 0; i < end; i++) {
+      mem_free(entry_in_order(mp, i)->key);
+    }
+  }
+  mem_free(mp->index_mh);
   mem_free(mp->entries_mh);
+  mem_free(mp->old_index_mh);
+  mem_free(mp->old_entries_mh);
   mem_free(mh);
 }
 
 /**
- * @brief Hash a str to a uint32.
- *
- * This uses Fowler/Noll/Vo 32-bit FNV-1a hash, based on:
- * http://isthe.com/chongo/tech/comp/fnv/
+ * @brief Places an index slot for a key that is not yet in a table, partway
+ * along its probe.
  *
- * The key type is included in the hashed value, i.e. a str and uint32 with the
- * same bytes will hash to different values.
+ * Only index slots move. Entries stay in place.
  *
- * @param key
- * @return uint32_t
+ * @param index_mh The index table, with at least one empty slot
+ * @param table_size The number of slots in the table, a power of two
+ * @param pos A position on the key's probe. No slot before it on the probe
+ *   has a shorter probe length than the key would.
+ * @param entry_meta The metadata for the key at that position
+ * @param entry_pos The position of the key's entry
  */
-static uint32_t hash_str(str key) {
-  uint32_t hash = 0x811c9dc5;
-
-  char c = MAP_KEY_STR;
-  hash ^= (uint32_t)c;
-  // GCC optimized equivalent to hash *= 0x01000193 :
-  hash += (hash << 1) + (hash << 4) + (hash << 7) + (hash << 8) + (hash << 24);
-
-  for (unsigned int i = 0; i < key.size; i++) {
-    c = ((char *)mem_p(key))[i];
-    hash ^= (uint32_t)c;
-    // GCC optimized equivalent to hash *= 0x01000193 :
-    hash +=
-        (hash << 1) + (hash << 4) + (hash << 7) + (hash << 8) + (hash << 24);
-  }
-  return hash;
+static void place_slot(mem_handle index_mh, unsigned int table_size,
+                       unsigned int pos, rh_meta entry_meta,
+                       uint32_t entry_pos) {
+  rh_slot_buf carry;
+  memcpy(carry.bytes,
+         &(index_slot){.meta = entry_meta, .entry_pos = entry_pos},
+         sizeof(index_slot));
+  rh_place(index_slots(index_mh), sizeof(index_slot), table_size, pos, &carry);
 }
 
 /**
- * @brief Hash a memory address to a uint32.
+ * @brief Adds an index slot for a key that is not yet in a table.
  *
- * This uses Fowler/Noll/Vo 32-bit FNV-1a hash, based on:
- * http://isthe.com/chongo/tech/comp/fnv/
+ * @param index_mh The index table, with at least one empty slot
+ * @param table_size The number of slots in the table, a power of two
+ * @param key_hash The hash of the key
+ * @param entry_pos The position of the key's entry
+ */
+static void insert_slot(mem_handle index_mh, unsigned int table_size,
+                        uint64_t key_hash, uint32_t entry_pos) {
+  place_slot(index_mh, table_size, key_hash & (table_size - 1),
+             rh_make_meta(key_hash, 1), entry_pos);
+}
+
+/**
+ * @brief Moves entries from the old entries array to the new one, during an
+ * incremental resize.
  *
- * The key type is included in the hashed value, i.e. a str and uint32 with the
- * same bytes will hash to different values.
+ * Old entries move in order, skipping holes, so that the entries stay in the
+ * order their keys were added. The old index is left as it is: a lookup in it
+ * ignores entries before `migrate_pos`. When every old entry has moved, the
+ * old index and entries are freed and the resize is done.
  *
- * @param key
- * @return uint32_t
+ * @param mp The map
+ * @param max_slots The most old entries to process, counting holes
  */
-static uint32_t hash_ptr(void *key) {
-  uint32_t hash = 0x811c9dc5;
-
-  char c = MAP_KEY_PTR;
-  hash ^= (uint32_t)c;
-  // GCC optimized equivalent to hash *= 0x01000193 :
-  hash += (hash << 1) + (hash << 4) + (hash << 7) + (hash << 8) + (hash << 24);
-
-  uintptr_t keyint = (uintptr_t)key;
-
-  for (unsigned int i = 0; i < sizeof(uintptr_t); i++) {
-    c = keyint & 255;
-    keyint = keyint >> 8;
-    hash ^= (uint32_t)c;
-    // GCC optimized equivalent to hash *= 0x01000193 :
-    hash +=
-        (hash << 1) + (hash << 4) + (hash << 7) + (hash << 8) + (hash << 24);
+static void migrate_entries(map *mp, unsigned int max_slots) {
+  if (!is_resizing(mp)) return;
+  map_entry *old_entries = map_entries(mp->old_entries_mh);
+  map_entry *entries = map_entries(mp->entries_mh);
+  for (unsigned int i = 0;
+       i < max_slots && mp->migrate_pos < mp->old_entries_used; i++) {
+    map_entry *entry = &old_entries[mp->migrate_pos++];
+    if (entry_is_hole(entry)) continue;
+    entries[mp->migrate_dst] = *entry;
+    insert_slot(mp->index_mh, mp->table_size, entry->key_hash,
+                mp->migrate_dst);
+    ++mp->migrate_dst;
   }
-  return hash;
+  if (mp->migrate_pos < mp->old_entries_used) return;
+
+  // Old entries deleted during the resize leave holes in the room reserved for
+  // them.
+  memset(&entries[mp->migrate_dst], 0,
+         sizeof(map_entry) * (mp->moved_end - mp->migrate_dst));
+  mem_free(mp->old_index_mh);
+  mem_free(mp->old_entries_mh);
+  mp->old_index_mh = (mem_handle){0};
+  mp->old_entries_mh = (mem_handle){0};
+  mp->old_table_size = 0;
+  mp->old_entries_used = 0;
+  mp->migrate_pos = 0;
+  mp->migrate_dst = 0;
+  mp->moved_end = 0;
 }
 
 /**
- * @brief Resizes the entries table.
+ * @brief Resizes the index table and the entries array, dropping holes.
  *
- * If is_grow is true, this doubles the size of the entries table. If is_grow
- * is false, this halves the size of the entries table. It's up to the caller
- * to only do this under appropriate conditions.
+ * A resize in progress is finished first. It's up to the caller to only do
+ * this under appropriate conditions.
  *
- * @param mh The map handle
- * @param is_grow true if growing, otherwise shrinking
+ * @param mp The map
+ * @param new_table_size The new number of slots, a power of two with room for
+ *   every entry
+ * @param incremental true to keep the current index and entries as the old
+ *   ones, and move the entries a few at a time as the map is changed
  * @return true on success
  */
-static bool resize_entries_table(map_handle mh, bool is_grow) {
-  map *mp = mem_p(mh);
-  unsigned int new_table_size = mp->table_size * (is_grow ? 2 : 0.5);
-  mem_handle new_entries_mh =
-      mem_alloc_clear(mh.allocator, sizeof(map_entry) * new_table_size);
-  if (!mem_p(new_entries_mh)) return false;
-
-  map_entry *old_entries = mem_p(mp->entries_mh);
-  map_entry *new_entries = mem_p(new_entries_mh);
-  for (unsigned int i = 0; i < mp->table_size; i++) {
-    if (!(old_entries + i)->key_hash) continue;
-    unsigned int new_pos = (old_entries + i)->key_hash % new_table_size;
-    *(new_entries + new_pos) = *(old_entries + i);
+static bool resize_entries_table(map *mp, unsigned int new_table_size,
+                                 bool incremental) {
+  migrate_entries(mp, UINT_MAX);
+  mem_handle new_index_mh = alloc_index(mp, new_table_size);
+  if (!mem_p(new_index_mh)) return false;
+  mem_handle new_entries_mh = alloc_entries(mp, new_table_size);
+  if (!mem_p(new_entries_mh)) {
+    mem_free(new_index_mh);
+    return false;
   }
 
-  mem_free(mp->entries_mh);
+  if (incremental) {
+    mp->old_index_mh = mp->index_mh;
+    mp->old_entries_mh = mp->entries_mh;
+    mp->old_table_size = mp->table_size;
+    mp->old_entries_used = mp->entries_used;
+    mp->migrate_pos = 0;
+    mp->migrate_dst = 0;
+    mp->moved_end = mp->entry_count;
+    mp->entries_used = mp->entry_count;
+  } else {
+    map_entry *old_entries = map_entries(mp->entries_mh);
+    map_entry *entries = map_entries(new_entries_mh);
+    unsigned int used = 0;
+    for (unsigned int i = 0; i < mp->entries_used; i++) {
+      if (entry_is_hole(&old_entries[i])) continue;
+      entries[used] = old_entries[i];
+      insert_slot(new_index_mh, new_table_size, entries[used].key_hash, used);
+      ++used;
+    }
+    mem_free(mp->index_mh);
+    mem_free(mp->entries_mh);
+    mp->entries_used = used;
+  }
   mp->table_size = new_table_size;
+  mp->index_mh = new_index_mh;
   mp->entries_mh = new_entries_mh;
   return true;
 }
 
 /**
- * @brief Locates the table position for a key.
+ * @brief Tests whether an entry has a given key.
  *
- * The position is either the position of an existing map_entry with the key,
- * or the next empty slot where a new entry with the key would go.
+ * @param mp The map
+ * @param entry The entry, not empty
+ * @param key_hash The hash of the key
+ * @param key The str key, or an invalid str for a pointer key
+ * @return true if the entry has the key
+ */
+static bool entry_has_key(map *mp, map_entry *entry, uint64_t key_hash,
+                          str key) {
+  if (entry->key_hash != key_hash) return false;
+  // A pointer key is determined by its hash. In a hash-only map, so is a str.
+  if (mp->hash_only) return true;
+  if (!mem_is_valid(key)) return !mem_is_valid(entry->key);
+  return mem_is_valid(entry->key) && entry->key.size == key.size &&
+         memcmp(mem_p(entry->key), mem_p(key), key.size) == 0;
+}
+
+// A key to probe an index table for
+typedef struct probe_key {
+  map *mp;
+
+  // The entries array the table refers to
+  map_entry *entries;
+
+  // Slots of entries before this position are skipped without reading the
+  // entries
+  unsigned int first_entry_pos;
+
+  uint64_t key_hash;
+
+  // The str key, or an invalid str for a pointer key
+  str key;
+} probe_key;
+
+static bool slot_has_key(const void *slot, const void *key) {
+  const index_slot *index = slot;
+  const probe_key *pk = key;
+  return index->entry_pos >= pk->first_entry_pos &&
+         entry_has_key(pk->mp, &pk->entries[index->entry_pos], pk->key_hash,
+                       pk->key);
+}
+
+/**
+ * @brief Probes an index table for the slot of a key.
  *
- * @param mh
- * @param key_hash
- * @return unsigned int
+ * @param mp The map
+ * @param index_mh The index table
+ * @param table_size The number of slots in the table, a power of two
+ * @param entries_mh The entries array the table refers to
+ * @param first_entry_pos Slots of entries before this position are skipped
+ *   without reading the entries
+ * @param key_hash The hash of the key
+ * @param key The str key, or an invalid str for a pointer key
+ * @return rh_probe The result
  */
-static unsigned int find_entry_pos(map_handle mh, uint32_t key_hash) {
-  map *mp = mem_p(mh);
-  map_entry *entries = mem_p(mp->entries_mh);
-  unsigned int start_pos = key_hash % mp->table_size;
-  unsigned int pos = start_pos;
-  do {
-    if (((entries + pos)->key_hash == key_hash) ||
-        ((entries + pos)->key_hash == 0)) {
-      return pos;
-    }
-    ++pos;
-    if (pos >= mp->table_size) pos = 0;
-  } while (pos != start_pos);
-  assert(pos != start_pos);
-  return -1;
+static rh_probe probe_table(map *mp, mem_handle index_mh,
+                            unsigned int table_size, mem_handle entries_mh,
+                            unsigned int first_entry_pos, uint64_t key_hash,
+                            str key) {
+  probe_key pk = {.mp = mp,
+                  .entries = map_entries(entries_mh),
+                  .first_entry_pos = first_entry_pos,
+                  .key_hash = key_hash,
+                  .key = key};
+  return rh_find(index_slots(index_mh), sizeof(index_slot), table_size,
+                 key_hash & (table_size - 1), key_hash, slot_has_key, &pk);
 }
 
-static bool do_set(map_handle mh, uint32_t key_hash, mem_handle value) {
-  map *mp = mem_p(mh);
-  map_entry *entries = mem_p(mp->entries_mh);
-  unsigned int pos = find_entry_pos(mh, key_hash);
-  if ((entries + pos)->key_hash == 0) {
-    ++mp->entry_count;
-    if (mp->entry_count > (mp->table_size / 2)) {
-      // A failed resize leaves the new entry unset.
-      if (!resize_entries_table(mh, true)) return false;
-
-      pos = find_entry_pos(mh, key_hash);
+// Probes the current index table for the slot of a key.
+static rh_probe probe_for_key(map *mp, uint64_t key_hash, str key) {
+  return probe_table(mp, mp->index_mh, mp->table_size, mp->entries_mh, 0,
+                     key_hash, key);
+}
+
+// Gets the entry of a slot of the current index table.
+static map_entry *slot_entry(map *mp, unsigned int pos) {
+  return &map_entries(mp->entries_mh)[index_slots(mp->index_mh)[pos]
+                                          .entry_pos];
+}
+
+/**
+ * @brief Finds the entry with a key among the old entries of an incremental
+ * resize that have not moved yet.
+ *
+ * @param mp The map
+ * @param key_hash The hash of the key
+ * @param key The str key, or an invalid str for a pointer key
+ * @return map_entry* The entry, or null if there is no resize in progress or
+ *   the key is not among the old entries
+ */
+static map_entry *find_old_entry(map *mp, uint64_t key_hash, str key) {
+  if (!is_resizing(mp)) return (map_entry *)0;
+  // An entry that has moved shares its key with the new entry, which may have
+  // been deleted and its key freed since, so it is skipped before its key is
+  // compared.
+  rh_probe probe =
+      probe_table(mp, mp->old_index_mh, mp->old_table_size,
+                  mp->old_entries_mh, mp->migrate_pos, key_hash, key);
+  if (!probe.found) return (map_entry *)0;
+  uint32_t entry_pos = index_slots(mp->old_index_mh)[probe.pos].entry_pos;
+  map_entry *entry = &map_entries(mp->old_entries_mh)[entry_pos];
+  return entry_is_hole(entry) ? (map_entry *)0 : entry;
+}
+
+/**
+ * @brief Finds the entry with a key.
+ *
+ * @param mp The map
+ * @param key_hash The hash of the key
+ * @param key The str key, or an invalid str for a pointer key
+ * @return map_entry* The entry, or null if the key is not in the map
+ */
+static map_entry *find_entry(map *mp, uint64_t key_hash, str key) {
+  rh_probe probe = probe_for_key(mp, key_hash, key);
+  if (!probe.found) return find_old_entry(mp, key_hash, key);
+  return slot_entry(mp, probe.pos);
+}
+
+/**
+ * @brief Makes the map's copy of a key for a new entry.
+ *
+ * @param mp The map
+ * @param key The str key, or an invalid str for a pointer key
+ * @param key_copy Set to the copy, or an invalid str if no copy is needed
+ * @return true on success, false if the copy could not be allocated
+ */
+static bool copy_key(map *mp, str key, str *key_copy) {
+  if (mp->hash_only || !mem_is_valid(key)) {
+    *key_copy = (str){0};
+    return true;
+  }
+  if (key.size == 0) {
+    *key_copy = mem_handle_from_ptr(EMPTY_KEY, 0);
+    return true;
+  }
+  *key_copy = mem_duplicate_with_allocator(mp->allocator, key);
+  return mem_is_valid(*key_copy);
+}
+
+/**
+ * @brief Finds the entry with a key, adding an entry if there is none.
+ *
+ * A new entry goes at the end of the entries array, and its value handle is
+ * invalid. When the array is full, the table is resized to drop the holes,
+ * and grows if it would still be more than half full.
+ *
+ * @param mp The map
+ * @param key_hash The hash of the key
+ * @param key The str key, or an invalid str for a pointer key
+ * @param inserted Set to true if the entry is new
+ * @return map_entry* The entry, or null if an entry could not be added
+ */
+static map_entry *do_get_or_insert(map *mp, uint64_t key_hash, str key,
+                                   bool *inserted) {
+  migrate_entries(mp, MIGRATE_SLOTS);
+  rh_probe probe = probe_for_key(mp, key_hash, key);
+  *inserted = false;
+  if (probe.found) return slot_entry(mp, probe.pos);
+  map_entry *old_entry = find_old_entry(mp, key_hash, key);
+  if (old_entry) return old_entry;
+  *inserted = true;
+
+  str key_copy;
+  if (!copy_key(mp, key, &key_copy)) return (map_entry *)0;
+  unsigned int max_count = max_entry_count(mp->table_size);
+  if (mp->entries_used + 1 > max_count) {
+    unsigned int new_table_size = mp->entry_count + 1 > max_count / 2
+                                      ? mp->table_size << 1
+                                      : mp->table_size;
+    // A failed resize leaves the new entry unset.
+    if (!resize_entries_table(mp, new_table_size, mp->incremental)) {
+      mem_free(key_copy);
+      return (map_entry *)0;
     }
+    probe = probe_for_key(mp, key_hash, key);
   }
-  (entries + pos)->key_hash = key_hash;
-  (entries + pos)->value_handle = value;
+  uint32_t entry_pos = mp->entries_used++;
+  map_entry *entry = &map_entries(mp->entries_mh)[entry_pos];
+  *entry = (map_entry){.key_hash = key_hash, .key = key_copy};
+  place_slot(mp->index_mh, mp->table_size, probe.pos, probe.key_meta,
+             entry_pos);
+  ++mp->entry_count;
+  return entry;
+}
 
+static bool do_set(map *mp, uint64_t key_hash, str key, mem_handle value) {
+  bool inserted;
+  map_entry *entry = do_get_or_insert(mp, key_hash, key, &inserted);
+  if (!entry) return false;
+  entry->value_handle = value;
   return true;
 }
 
-static mem_handle do_get(map_handle mh, uint32_t key_hash) {
-  map *mp = mem_p(mh);
-  map_entry *entries = mem_p(mp->entries_mh);
-  unsigned int pos = find_entry_pos(mh, key_hash);
-  if ((entries + pos)->key_hash == 0) return (mem_handle){0};
-  return (entries + pos)->value_handle;
+static mem_handle do_get(map *mp, uint64_t key_hash, str key) {
+  map_entry *entry = find_entry(mp, key_hash, key);
+  return entry ? entry->value_handle : (mem_handle){0};
 }
 
-static bool do_delete(map_handle mh, uint32_t key_hash) {
-  map *mp = mem_p(mh);
-  map_entry *entries = mem_p(mp->entries_mh);
-  unsigned int pos = find_entry_pos(mh, key_hash);
-  if ((entries + pos)->key_hash == 0) return false;
-
-  (entries + pos)->key_hash = 0;
-  (entries + pos)->value_handle = (mem_handle){0};
+static bool do_delete(map *mp, uint64_t key_hash, str key) {
+  migrate_entries(mp, MIGRATE_SLOTS);
+  map_entry *entry;
+  rh_probe probe = probe_for_key(mp, key_hash, key);
+  if (probe.found) {
+    entry = slot_entry(mp, probe.pos);
+    rh_remove(index_slots(mp->index_mh), sizeof(index_slot), mp->table_size,
+              probe.pos);
+  } else {
+    // An old entry that has not moved is not in the new index. The old index
+    // is left as it is, and skips holes.
+    entry = find_old_entry(mp, key_hash, key);
+    if (!entry) return false;
+  }
+  mem_free(entry->key);
+  *entry = (map_entry){0};
   --mp->entry_count;
 
-  // Shrink if entry count < 1/4th the table size. Note that this is not <=
-  // to leave a one-element threshold, so an add followed by a delete does not
-  // cause the table to grow then shrink immediately.
-  if (mp->entry_count < (mp->table_size / 4) &&
-      mp->table_size > INITIAL_TABLE_SIZE) {
-    return resize_entries_table(mh, false);
+  // A table whose entries array fills up grows only if its entries would pass
+  // 7/16ths of it, which leaves the doubled table 7/32nds full, well above the
+  // shrink threshold. An incremental resize in progress finishes before the
+  // next one starts.
+  if (rh_should_shrink(mp->entry_count, mp->table_size, INITIAL_TABLE_SIZE) &&
+      !is_resizing(mp)) {
+    return resize_entries_table(mp, mp->table_size >> 1, mp->incremental);
   }
   return true;
 }
 
 bool map_set_str(map_handle mh, str key, mem_handle value) {
-  if (!map_is_valid(mh)) return false;
-  if (!mem_p(value)) return false;
-  return do_set(mh, hash_str(key), value);
+  map *mp = map_for_handle(mh);
+  if (!mp || !str_is_valid(key) || !mem_is_valid(value)) return false;
+  return do_set(mp, hash_str(key), key, value);
 }
 
 bool map_set_ptr(map_handle mh, void *key, mem_handle value) {
-  if (!map_is_valid(mh)) return false;
-  if (!mem_is_valid(value)) return false;
-  return do_set(mh, hash_ptr(key), value);
+  map *mp = map_for_handle(mh);
+  if (!mp || !mem_is_valid(value)) return false;
+  return do_set(mp, hash_ptr(key), (str){0}, value);
 }
 
 mem_handle map_get_str(map_handle mh, str key) {
-  if (!map_is_valid(mh)) return (mem_handle){0};
-  return do_get(mh, hash_str(key));
+  map *mp = map_for_handle(mh);
+  if (!mp || !str_is_valid(key)) return (mem_handle){0};
+  return do_get(mp, hash_str(key), key);
 }
 
 mem_handle map_get_ptr(map_handle mh, void *key) {
-  if (!map_is_valid(mh)) return (mem_handle){0};
-  return do_get(mh, hash_ptr(key));
+  map *mp = map_for_handle(mh);
+  if (!mp) return (mem_handle){0};
+  return do_get(mp, hash_ptr(key), (str){0});
+}
+
+mem_handle map_get_prehashed(map_handle mh, str key, uint64_t key_hash) {
+  map *mp = map_for_handle(mh);
+  if (!mp || !str_is_valid(key) ||
+      !DATASTRUCT_CHECK(key_hash == hash_str(key))) {
+    return (mem_handle){0};
+  }
+  return do_get(mp, key_hash, key);
+}
+
+mem_handle *map_get_or_insert_str(map_handle mh, str key, bool *inserted) {
+  map *mp = map_for_handle(mh);
+  if (!mp || !str_is_valid(key) || !inserted) return (mem_handle *)0;
+  map_entry *entry = do_get_or_insert(mp, hash_str(key), key, inserted);
+  return entry ? &entry->value_handle : (mem_handle *)0;
+}
+
+mem_handle *map_get_or_insert_ptr(map_handle mh, void *key, bool *inserted) {
+  map *mp = map_for_handle(mh);
+  if (!mp || !inserted) return (mem_handle *)0;
+  map_entry *entry = do_get_or_insert(mp, hash_ptr(key), (str){0}, inserted);
+  return entry ? &entry->value_handle : (mem_handle *)0;
+}
+
+mem_handle *map_get_or_insert_prehashed(map_handle mh, str key,
+                                        uint64_t key_hash, bool *inserted) {
+  map *mp = map_for_handle(mh);
+  if (!mp || !str_is_valid(key) || !inserted ||
+      !DATASTRUCT_CHECK(key_hash == hash_str(key))) {
+    return (mem_handle *)0;
+  }
+  map_entry *entry = do_get_or_insert(mp, key_hash, key, inserted);
+  return entry ? &entry->value_handle : (mem_handle *)0;
 }
 
 bool map_delete_str(map_handle mh, str key) {
-  return do_delete(mh, hash_str(key));
+  map *mp = map_for_handle(mh);
+  if (!mp || !str_is_valid(key)) return false;
+  return do_delete(mp, hash_str(key), key);
 }
 
 bool map_delete_ptr(map_handle mh, void *key) {
-  return do_delete(mh, hash_ptr(key));
+  map *mp = map_for_handle(mh);
+  if (!mp) return false;
+  return do_delete(mp, hash_ptr(key), (str){0});
 }
 
-map_iter map_first_value_iter(map_handle mh) {
-  map *mp = mem_p(mh);
-  if (!mp) return (map_iter){0};
+/**
+ * @brief Grows the table so that it holds a number of entries without
+ * growing again.
+ *
+ * @param mp The map
+ * @param count The number of entries
+ * @return true on success, or if the table is already large enough
+ */
+static bool reserve(map *mp, size_t count) {
+  unsigned int table_size = mp->table_size;
+  while (max_entry_count(table_size) < count) {
+    if (table_size > UINT32_MAX / 2) return false;
+    table_size <<= 1;
+  }
+  if (table_size == mp->table_size) return true;
+  return resize_entries_table(mp, table_size, false);
+}
 
-  map_entry *first = mem_p(mp->entries_mh);
-  map_iter it =
-      (map_iter){.mh = mh, .pos = 0, .value_handle = first->value_handle};
-  if (!mem_p(first->value_handle)) it = map_next_value_iter(it);
-  return it;
+bool map_reserve(map_handle mh, size_t count) {
+  map *mp = map_for_handle(mh);
+  if (!mp) return false;
+  return reserve(mp, count);
 }
 
-map_iter map_next_value_iter(map_iter it) {
-  map *mp = mem_p(it.mh);
+size_t map_memory_use(map_handle mh) {
+  map *mp = map_for_handle(mh);
+  if (!mp) return 0;
+  return sizeof(map) + mem_size(mp->index_mh) + mem_size(mp->entries_mh) +
+         mem_size(mp->old_index_mh) + mem_size(mp->old_entries_mh);
+}
+
+// The keys passed to a bulk function: either strs or pointers.
+typedef struct key_list {
+  const str *strs;
+  void *const *ptrs;
+} key_list;
+
+static uint64_t key_list_hash(key_list keys, size_t i) {
+  return keys.strs ? hash_str(keys.strs[i]) : hash_ptr(keys.ptrs[i]);
+}
+
+// Gets a key from a key list, as do_get and do_set take it.
+static str key_list_str(key_list keys, size_t i) {
+  return keys.strs ? keys.strs[i] : (str){0};
+}
+
+/**
+ * @brief Hashes a batch of keys, and prefetches the first index slot of each
+ * key's probe.
+ *
+ * @param mp The map
+ * @param keys The keys
+ * @param start The index of the first key of the batch
+ * @param count The number of keys in the batch, up to BATCH_SIZE
+ * @param hashes Set to the hashes of the keys
+ */
+static void hash_batch(map *mp, key_list keys, size_t start, size_t count,
+                       uint64_t *hashes) {
+  index_slot *slots = index_slots(mp->index_mh);
+  unsigned int mask = mp->table_size - 1;
+  for (size_t i = 0; i < count; i++) {
+    hashes[i] = key_list_hash(keys, start + i);
+    PREFETCH(&slots[hashes[i] & mask]);
+  }
+}
+
+static size_t batch_count(size_t start, size_t count) {
+  return count - start < BATCH_SIZE ? count - start : BATCH_SIZE;
+}
+
+static bool set_many(map *mp, key_list keys, const mem_handle *values,
+                     size_t count) {
+  // Growing once up front, as if every key were new, keeps the table from
+  // being rehashed partway through, and keeps prefetched slots in place. If
+  // this fails, each set grows the table as needed.
+  reserve(mp, (size_t)mp->entries_used + count);
+  bool ok = true;
+  uint64_t hashes[BATCH_SIZE];
+  for (size_t start = 0; start < count; start += BATCH_SIZE) {
+    size_t batch = batch_count(start, count);
+    hash_batch(mp, keys, start, batch, hashes);
+    for (size_t i = 0; i < batch; i++) {
+      str key = key_list_str(keys, start + i);
+      if ((keys.strs && !str_is_valid(key)) ||
+          !mem_is_valid(values[start + i]) ||
+          !do_set(mp, hashes[i], key, values[start + i])) {
+        ok = false;
+      }
+    }
+  }
+  return ok;
+}
+
+static size_t get_many(map *mp, key_list keys, mem_handle *values,
+                       size_t count) {
+  size_t found = 0;
+  uint64_t hashes[BATCH_SIZE];
+  for (size_t start = 0; start < count; start += BATCH_SIZE) {
+    size_t batch = batch_count(start, count);
+    hash_batch(mp, keys, start, batch, hashes);
+    for (size_t i = 0; i < batch; i++) {
+      str key = key_list_str(keys, start + i);
+      values[start + i] = (keys.strs && !str_is_valid(key))
+                              ? (mem_handle){0}
+                              : do_get(mp, hashes[i], key);
+      found += mem_is_valid(values[start + i]);
+    }
+  }
+  return found;
+}
+
+bool map_set_many_str(map_handle mh, const str *keys, const mem_handle *values,
+                      size_t count) {
+  map *mp = map_for_handle(mh);
+  if (!mp || (count > 0 && (!keys || !values))) return false;
+  return set_many(mp, (key_list){.strs = keys}, values, count);
+}
+
+bool map_set_many_ptr(map_handle mh, void *const *keys,
+                      const mem_handle *values, size_t count) {
+  map *mp = map_for_handle(mh);
+  if (!mp || (count > 0 && (!keys || !values))) return false;
+  return set_many(mp, (key_list){.ptrs = keys}, values, count);
+}
+
+size_t map_get_many_str(map_handle mh, const str *keys, mem_handle *values,
+                        size_t count) {
+  map *mp = map_for_handle(mh);
+  if (!mp || (count > 0 && (!keys || !values))) return 0;
+  return get_many(mp, (key_list){.strs = keys}, values, count);
+}
+
+size_t map_get_many_ptr(map_handle mh, void *const *keys, mem_handle *values,
+                        size_t count) {
+  map *mp = map_for_handle(mh);
+  if (!mp || (count > 0 && (!keys || !values))) return 0;
+  return get_many(mp, (key_list){.ptrs = keys}, values, count);
+}
+
+bool map_set_incremental_resize(map_handle mh, bool incremental) {
+  map *mp = map_for_handle(mh);
+  if (!mp) return false;
+  if (!incremental) migrate_entries(mp, UINT_MAX);
+  mp->incremental = incremental;
+  return true;
+}
+
+/**
+ * @brief Makes an iterator for the first value at or after a position.
+ *
+ * @param mh The map handle
+ * @param pos The position, in the order keys were added
+ * @return map_iter The iterator, done if there are no more values
+ */
+static map_iter iter_from(map_handle mh, unsigned int pos) {
+  map *mp = map_for_handle(mh);
   if (!mp) return (map_iter){0};
+  unsigned int end = order_end(mp);
+  for (; pos < end; pos++) {
+    map_entry *entry = entry_in_order(mp, pos);
+    if (!entry_is_hole(entry)) {
+      return (map_iter){
+          .mh = mh, .pos = pos, .value_handle = entry->value_handle};
+    }
+  }
+  return (map_iter){0};
+}
 
-  map_entry *first = mem_p(mp->entries_mh);
-  unsigned int pos = it.pos + 1;
-  while (pos < mp->table_size &&
-         mem_p((first + pos)->value_handle) == (void *)0)
-    pos++;
-  if (pos >= mp->table_size) return (map_iter){0};
-  return (map_iter){
-      .mh = it.mh, .pos = pos, .value_handle = (first + pos)->value_handle};
+map_iter map_first_value_iter(map_handle mh) {
+  return iter_from(mh, 0);
+}
+
+map_iter map_next_value_iter(map_iter it) {
+  return iter_from(it.mh, it.pos + 1);
 }
 
 inline bool map_iter_done(map_iter it) {
@@ -270,3 +844,9 @@ inline bool map_iter_done(map_iter it) {
 inline mem_handle map_iter_value(map_iter it) {
   return it.value_handle;
 }
+
+str map_iter_key(map_iter it) {
+  map *mp = map_for_handle(it.mh);
+  if (!mp || map_iter_done(it)) return (str){0};
+  return entry_in_order(mp, it.pos)->key;
+}
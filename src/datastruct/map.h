@@ -4,6 +4,32 @@
  *
  * This map data structure can use `str` keys or `void *` keys.
  *
+ * Keys are compared by value. The map keeps its own copy of each str key,
+ * allocated with the map's allocator, so the caller's key memory can be
+ * reused after `map_set` returns. Pointer keys are compared by address.
+ *
+ * Keys are hashed to 64 bits. A map created with `map_create_hash_only`
+ * stores only the hash of each key. Pointer keys are still exact in such a
+ * map. Two different str keys with the same hash alias each other. This is
+ * unlikely below hundreds of millions of keys, and saves a copy of each key.
+ *
+ * Entries are kept in a dense array, in the order their keys were added. An
+ * index table finds them: an open-addressing hash table with Robin Hood
+ * probing, whose slots hold entry positions. Deleting a key shifts the index
+ * slots after it back into place, so lookups stay fast however keys are added
+ * and removed, and leaves a hole in the entries array. When the array is full,
+ * the holes are dropped, and the table grows if it is more than half full.
+ * Iterating visits the entries in order, and takes time in proportion to the
+ * number of entries, not the size of the table.
+ *
+ * Growing or shrinking the table moves every entry to a new table. By default
+ * this happens all at once, in the `map_set` or `map_delete` that crosses the
+ * threshold, which can take milliseconds for a large map. After
+ * `map_set_incremental_resize`, the old table is kept alongside the new one,
+ * and each later change to the map moves a few of its entries, so that no one
+ * call does more than a small, fixed amount of work. Lookups check both tables
+ * until the old one is empty. Entries keep their order while they move.
+ *
  * The value of an entry is a mem_handle. A map never owns the memory of the
  * value: when a key is deleted or the map is destroyed, the map does not free
  * entry memory. If you don't want to keep track of entry memory, use a memtbl
@@ -14,6 +40,7 @@
 #define DATASTRUCT_MAP_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #include "mem.h"
@@ -27,9 +54,52 @@ typedef struct map_entry map_entry;
 
 // Internal type for a map data structure
 typedef struct map {
+  // The allocator for the index table, the entries, and key copies
+  mem_allocator allocator;
+
+  // true if entries store only key hashes
+  bool hash_only;
+
+  // true if resizes move entries a few at a time
+  bool incremental;
+
+  // The index table: slots that hold the positions of entries
+  mem_handle index_mh;
+
+  // The number of slots in the index table, a power of two
+  unsigned int table_size;
+
+  // The entries, in the order their keys were added, with holes where keys
+  // were deleted
   mem_handle entries_mh;
+
+  // The number of positions of the entries array in use, including holes
+  unsigned int entries_used;
+
+  // The number of entries, in both arrays during an incremental resize
   unsigned int entry_count;
-  unsigned int table_size;
+
+  // During an incremental resize, the index table and entries whose entries
+  // are moving to entries_mh. Otherwise invalid.
+  mem_handle old_index_mh;
+  mem_handle old_entries_mh;
+
+  // The number of slots in the old index table, or 0
+  unsigned int old_table_size;
+
+  // The number of positions of the old entries array in use, or 0
+  unsigned int old_entries_used;
+
+  // The next position of the old entries to move. Every entry before it has
+  // moved.
+  unsigned int migrate_pos;
+
+  // The position in entries_mh of the next entry to move
+  unsigned int migrate_dst;
+
+  // The end of the room in entries_mh for the moved entries, where entries
+  // added during the resize begin
+  unsigned int moved_end;
 } map;
 
 /**
@@ -42,12 +112,39 @@ typedef struct map {
  */
 map_handle map_create(mem_allocator ma);
 
+/**
+ * @brief Creates a map that stores only the hashes of keys.
+ *
+ * This does not copy str keys. See the notes at the top of this file.
+ *
+ * @param ma The memory allocator to use
+ * @return map_handle A handle for the map
+ */
+map_handle map_create_hash_only(mem_allocator ma);
+
 /**
  * @param mh The map handle
  * @return true if the map is valid
  */
 bool map_is_valid(map_handle mh);
 
+/**
+ * @brief Sets whether a map resizes its table incrementally.
+ *
+ * See the notes at the top of this file. With incremental resizing, each
+ * `map_set`, `map_get_or_insert`, and `map_delete` moves up to a fixed number
+ * of old entries, so the latency of every call is bounded. Lookups
+ * do not move entries. `map_reserve` and `map_set_many` still resize all at
+ * once, as they are meant for bulk loading.
+ *
+ * Turning incremental resizing off finishes a resize in progress.
+ *
+ * @param mh The map handle
+ * @param incremental true to resize incrementally
+ * @return true on success, false if the handle is invalid
+ */
+bool map_set_incremental_resize(map_handle mh, bool incremental);
+
 /**
  * @brief Destroys a map.
  *
@@ -93,6 +190,68 @@ bool map_set_ptr(map_handle mh, void *key, mem_handle value);
 mem_handle map_get_str(map_handle mh, str key);
 mem_handle map_get_ptr(map_handle mh, void *key);
 
+/**
+ * @brief Gets a value for a str key whose hash is already known.
+ *
+ * See `map_get_or_insert_prehashed`.
+ *
+ * @param mh The map_handle
+ * @param key The key
+ * @param key_hash The hash of the key, from `hash_str(key)` (hash.h). In
+ *   DATASTRUCT_CHECKED builds, a wrong hash returns an invalid mem_handle.
+ * @return mem_handle The value stored, or an invalid mem_handle if not found
+ */
+mem_handle map_get_prehashed(map_handle mh, str key, uint64_t key_hash);
+
+// clang-format off
+/**
+ * @brief Gets the value slot for a key, adding the key if it is not set.
+ *
+ * This hashes the key and probes the table once, so that counting and
+ * deduplicating loops can update a value in place:
+ *
+ *   bool inserted;
+ *   mem_handle *slot = map_get_or_insert(mh, word, &inserted);
+ *   if (!slot) abort();
+ *   if (inserted) *slot = new_counter();
+ *   increment(*slot);
+ *
+ * If the key is new, the slot holds an invalid mem_handle. Store a valid
+ * handle in it before calling any other map function, or delete the key.
+ *
+ * The slot pointer is valid until the map is changed.
+ *
+ * @param mh The map_handle
+ * @param key The key, either a str or a void*
+ * @param inserted Set to true if the key was added, false if it was set
+ * @return mem_handle* The value slot, or null if the key could not be added,
+ *   possibly due to an out-of-memory error while resizing the internal table
+ */
+#define map_get_or_insert(mh, key, inserted) \
+  _Generic((key), \
+    str: map_get_or_insert_str, \
+    void *: map_get_or_insert_ptr \
+  )((mh), (key), (inserted))
+// clang-format on
+mem_handle *map_get_or_insert_str(map_handle mh, str key, bool *inserted);
+mem_handle *map_get_or_insert_ptr(map_handle mh, void *key, bool *inserted);
+
+/**
+ * @brief Gets the value slot for a str key whose hash is already known.
+ *
+ * This is `map_get_or_insert` for a caller that keeps the hash of a key, such
+ * as from an earlier lookup in another map, so that it is not hashed again.
+ *
+ * @param mh The map_handle
+ * @param key The key
+ * @param key_hash The hash of the key, from `hash_str(key)` (hash.h). In
+ *   DATASTRUCT_CHECKED builds, a wrong hash returns null.
+ * @param inserted Set to true if the key was added, false if it was set
+ * @return mem_handle* The value slot, or null if the key could not be added
+ */
+mem_handle *map_get_or_insert_prehashed(map_handle mh, str key,
+                                        uint64_t key_hash, bool *inserted);
+
 // clang-format off
 /**
  * @brief Deletes an entry from a map.
@@ -113,6 +272,88 @@ mem_handle map_get_ptr(map_handle mh, void *key);
 bool map_delete_str(map_handle mh, str key);
 bool map_delete_ptr(map_handle mh, void *key);
 
+/**
+ * @brief Grows a map's table so that it holds a number of keys without
+ * growing again.
+ *
+ * Setting keys one at a time grows the table by doubling, and each doubling
+ * reallocates the table and moves every entry. When the number of keys is
+ * known ahead of time, such as when loading a symbol file or a word list,
+ * reserving room first moves each entry once. Deleting keys can still shrink
+ * the table.
+ *
+ * @param mh The map_handle
+ * @param count The total number of keys the map should hold
+ * @return true on success, false if the table could not be grown
+ */
+bool map_reserve(map_handle mh, size_t count);
+
+// clang-format off
+/**
+ * @brief Sets many key-value pairs in a map.
+ *
+ * This reserves room for every key as if it were new, then hashes the keys a
+ * batch at a time and prefetches the table slots of a batch before probing
+ * for any of them. For a table larger than the CPU cache, the cache misses of
+ * the probes overlap instead of following one another.
+ *
+ * @param mh The map_handle
+ * @param keys An array of keys, either strs or void*s
+ * @param values An array of mem_handle values, one per key
+ * @param count The number of keys
+ * @return true if every key was set. An invalid key or value is skipped, and
+ *   returns false after the other keys are set.
+ */
+#define map_set_many(mh, keys, values, count) \
+  _Generic((keys), \
+    str *: map_set_many_str, \
+    const str *: map_set_many_str, \
+    void **: map_set_many_ptr \
+  )((mh), (keys), (values), (count))
+// clang-format on
+bool map_set_many_str(map_handle mh, const str *keys, const mem_handle *values,
+                      size_t count);
+bool map_set_many_ptr(map_handle mh, void *const *keys,
+                      const mem_handle *values, size_t count);
+
+// clang-format off
+/**
+ * @brief Gets the values of many keys in a map.
+ *
+ * Like `map_set_many`, this hashes and prefetches a batch of keys before
+ * probing for any of them.
+ *
+ * @param mh The map_handle
+ * @param keys An array of keys, either strs or void*s
+ * @param values An array set to the value of each key, or an invalid
+ *   mem_handle for a key that is not in the map
+ * @param count The number of keys
+ * @return size_t The number of keys found
+ */
+#define map_get_many(mh, keys, values, count) \
+  _Generic((keys), \
+    str *: map_get_many_str, \
+    const str *: map_get_many_str, \
+    void **: map_get_many_ptr \
+  )((mh), (keys), (values), (count))
+// clang-format on
+size_t map_get_many_str(map_handle mh, const str *keys, mem_handle *values,
+                        size_t count);
+size_t map_get_many_ptr(map_handle mh, void *const *keys, mem_handle *values,
+                        size_t count);
+
+/**
+ * @brief Gets the memory that a map uses for its tables.
+ *
+ * This counts the map itself, its index table, and its entries array, along
+ * with the old ones during an incremental resize. It does not count the
+ * map's copies of str keys, or the memory of values.
+ *
+ * @param mh The map_handle
+ * @return size_t The number of bytes, or 0 if the handle is invalid
+ */
+size_t map_memory_use(map_handle mh);
+
 // Map iterator
 typedef struct map_iter {
   map_handle mh;
@@ -123,8 +364,10 @@ typedef struct map_iter {
 /**
  * @brief Gets the first value iterator in a map iteration.
  *
- * Map values have no guaranteed order. If anything adds or deletes an element,
- * using an existing `map_iter` is undefined.
+ * Values are visited in the order their keys were added. Setting a key that
+ * is already in the map keeps its place; deleting a key and adding it again
+ * moves it to the end. If anything adds or deletes an element, using an
+ * existing `map_iter` is undefined.
  *
  * @param mh
  * @return map_iter
@@ -156,4 +399,16 @@ bool map_iter_done(map_iter it);
  */
 mem_handle map_iter_value(map_iter it);
 
+/**
+ * @brief Gets the key of the value pointed at by an iterator.
+ *
+ * The str is the map's own copy of the key, and is valid until the key is
+ * deleted or the map is destroyed.
+ *
+ * @param it
+ * @return str The key, or an invalid str if the key is a pointer, the map is
+ *   hash-only, or the iterator is done
+ */
+str map_iter_key(map_iter it);
+
 #endif
@@ -0,0 +1,336 @@
+#include "mapfile.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "hash.h"
+#include "mmap.h"
+
+// The layout of a map file is a header, the index table, the entries, and
+// then the bytes of the keys and values. Each part starts at a multiple of 8
+// bytes, and the file refers to its parts by offset from its start.
+
+// The first bytes of a map file
+static const char MAGIC[8] = "M65MAP\r\n";
+
+// Stored as an integer, this reads back the same only on a machine with the
+// same byte order.
+static const uint64_t BYTE_ORDER_MARK = 0x0102030405060708;
+
+// Text whose hash is stored in the header, to tell whether the file was
+// written with the same hash function as the build that reads it.
+static const char HASH_CHECK_TEXT[] = "m65tool map file";
+
+// The seed of the checksum, so that it is independent of the key hashes
+static const uint64_t CHECKSUM_SEED = 0x6d617066696c65;
+
+typedef struct file_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+  uint64_t byte_order;
+  uint64_t hash_check;
+  // The size of the whole file, in bytes
+  uint64_t file_size;
+  uint64_t entry_count;
+  // The number of index slots, a power of two larger than the entry count
+  uint64_t table_size;
+  // The hash of everything after the header
+  uint64_t checksum;
+} file_header;
+
+// A slot of the index table, which is probed linearly from the slot selected
+// by the low bits of the key hash.
+typedef struct file_slot {
+  // The high 32 bits of the key hash
+  uint32_t tag;
+  // The position of the entry plus one, or 0 for an empty slot
+  uint32_t entry;
+} file_slot;
+
+typedef struct file_entry {
+  uint64_t key_offset;
+  uint64_t key_size;
+  // A multiple of 8
+  uint64_t value_offset;
+  uint64_t value_size;
+} file_entry;
+
+// The largest number of entries, so that an entry position fits in a slot
+static const uint64_t MAX_ENTRY_COUNT = UINT32_MAX - 1;
+
+static uint64_t align8(uint64_t size) {
+  return (size + 7) & ~(uint64_t)7;
+}
+
+static uint64_t hash_check_value(void) {
+  return hash_bytes(HASH_CHECK_TEXT, sizeof(HASH_CHECK_TEXT) - 1, 0);
+}
+
+/**
+ * @brief Gets the number of index slots for a number of entries.
+ *
+ * The table is at most half full, and always has an empty slot to end a
+ * probe.
+ */
+static uint64_t table_size_for(uint64_t entry_count) {
+  uint64_t size = 1;
+  while (size < entry_count * 2 + 1) size <<= 1;
+  return size;
+}
+
+static uint64_t entries_offset(uint64_t table_size) {
+  return sizeof(file_header) + table_size * sizeof(file_slot);
+}
+
+static uint64_t data_offset(uint64_t table_size, uint64_t entry_count) {
+  return entries_offset(table_size) + entry_count * sizeof(file_entry);
+}
+
+/**
+ * @brief Gets the size of the data that a map's keys and values need.
+ *
+ * @param mh The map handle
+ * @param size Set to the total size, with each key and value aligned
+ * @return true on success, false if a key is not a str
+ */
+static bool data_size_for(map_handle mh, uint64_t *size) {
+  *size = 0;
+  for (map_iter it = map_first_value_iter(mh); !map_iter_done(it);
+       it = map_next_value_iter(it)) {
+    str key = map_iter_key(it);
+    if (!str_is_valid(key)) return false;
+    *size += align8(mem_size(key)) + align8(mem_size(map_iter_value(it)));
+  }
+  return true;
+}
+
+/**
+ * @brief Fills a buffer with the contents of a map file.
+ *
+ * @param mh The map handle
+ * @param data The buffer, cleared, of the size of the file
+ * @param header The header, with the sizes set
+ */
+static void fill_file(map_handle mh, unsigned char *data, file_header header) {
+  file_slot *slots = (file_slot *)(data + sizeof(file_header));
+  file_entry *entries =
+      (file_entry *)(data + entries_offset(header.table_size));
+  uint64_t offset = data_offset(header.table_size, header.entry_count);
+  uint64_t mask = header.table_size - 1;
+  uint32_t index = 0;
+  for (map_iter it = map_first_value_iter(mh); !map_iter_done(it);
+       it = map_next_value_iter(it), index++) {
+    str key = map_iter_key(it);
+    mem_handle value = map_iter_value(it);
+    file_entry *entry = &entries[index];
+    entry->key_offset = offset;
+    entry->key_size = mem_size(key);
+    if (entry->key_size > 0) {
+      memcpy(data + offset, mem_p(key), entry->key_size);
+    }
+    offset += align8(entry->key_size);
+    entry->value_offset = offset;
+    entry->value_size = mem_size(value);
+    if (entry->value_size > 0) {
+      memcpy(data + offset, mem_p(value), entry->value_size);
+    }
+    offset += align8(entry->value_size);
+
+    uint64_t key_hash = hash_str(key);
+    uint64_t pos = key_hash & mask;
+    while (slots[pos].entry != 0) pos = (pos + 1) & mask;
+    slots[pos] = (file_slot){.tag = key_hash >> 32, .entry = index + 1};
+  }
+
+  header.checksum = hash_bytes(data + sizeof(file_header),
+                               header.file_size - sizeof(file_header),
+                               CHECKSUM_SEED);
+  memcpy(data, &header, sizeof(header));
+}
+
+/**
+ * @brief Writes bytes to a new file.
+ *
+ * @return true on success, false if the file could not be written
+ */
+static bool write_bytes(const char *path, const void *data, size_t size) {
+  FILE *outfile = fopen(path, "wb");
+  if (!outfile) return false;
+  bool ok = fwrite(data, 1, size, outfile) == size;
+  // Closing flushes, and can fail.
+  ok = fclose(outfile) == 0 && ok;
+  return ok;
+}
+
+bool mapfile_write(map_handle mh, const char *path) {
+  if (!map_is_valid(mh) || !path) return false;
+  map *mp = mem_p(mh);
+  uint64_t size;
+  if (mp->hash_only || mp->entry_count > MAX_ENTRY_COUNT ||
+      !data_size_for(mh, &size)) {
+    return false;
+  }
+  file_header header = {.version = MAPFILE_VERSION,
+                        .byte_order = BYTE_ORDER_MARK,
+                        .hash_check = hash_check_value(),
+                        .entry_count = mp->entry_count,
+                        .table_size = table_size_for(mp->entry_count)};
+  memcpy(header.magic, MAGIC, sizeof(MAGIC));
+  header.file_size = data_offset(header.table_size, header.entry_count) + size;
+  if (header.file_size > MEM_HANDLE_MAX_SIZE) return false;
+
+  mem_handle file_mh = mem_alloc_clear(MEM_ALLOCATOR_PLAIN, header.file_size);
+  size_t path_length = strlen(path);
+  mem_handle tmp_path_mh = mem_alloc(MEM_ALLOCATOR_PLAIN, path_length + 5);
+  bool ok = mem_is_valid(file_mh) && mem_is_valid(tmp_path_mh);
+  if (ok) {
+    fill_file(mh, mem_p(file_mh), header);
+    char *tmp_path = mem_p(tmp_path_mh);
+    memcpy(tmp_path, path, path_length);
+    memcpy(tmp_path + path_length, ".tmp", 5);
+    ok = write_bytes(tmp_path, mem_p(file_mh), header.file_size);
+#ifdef WINDOWS
+    // rename does not replace an existing file on Windows.
+    if (ok) remove(path);
+#endif
+    ok = ok && rename(tmp_path, path) == 0;
+    if (!ok) remove(tmp_path);
+  }
+  mem_free(tmp_path_mh);
+  mem_free(file_mh);
+  return ok;
+}
+
+/**
+ * @brief Checks that the header of a file describes this build and the size
+ * of the file.
+ *
+ * @param data The contents of the file
+ * @param size The size of the file
+ * @return true if the header is valid
+ */
+static bool header_is_valid(const unsigned char *data, size_t size) {
+  if (size < sizeof(file_header)) return false;
+  const file_header *header = (const file_header *)data;
+  if (memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0 ||
+      header->version != MAPFILE_VERSION ||
+      header->byte_order != BYTE_ORDER_MARK ||
+      header->hash_check != hash_check_value() || header->file_size != size) {
+    return false;
+  }
+  // Each check keeps the next from overflowing.
+  uint64_t table_size = header->table_size;
+  uint64_t entry_count = header->entry_count;
+  return table_size > entry_count && (table_size & (table_size - 1)) == 0 &&
+         table_size <= size / sizeof(file_slot) &&
+         entry_count <= size / sizeof(file_entry) &&
+         data_offset(table_size, entry_count) <= size;
+}
+
+/**
+ * @brief Checks that every slot and entry of a file stays within the file,
+ * and that the table has an empty slot.
+ *
+ * This makes lookups safe in a file whose checksum matches but whose
+ * contents were not written by `mapfile_write`. A probe stops at an empty
+ * slot, so without one, a lookup of a missing key would never end.
+ *
+ * @param data The contents of a file with a valid header
+ * @return true if the table and entries are valid
+ */
+static bool table_is_valid(const unsigned char *data) {
+  const file_header *header = (const file_header *)data;
+  const file_slot *slots = (const file_slot *)(data + sizeof(file_header));
+  bool has_empty_slot = false;
+  for (uint64_t i = 0; i < header->table_size; i++) {
+    if (slots[i].entry > header->entry_count) return false;
+    if (slots[i].entry == 0) has_empty_slot = true;
+  }
+  if (!has_empty_slot) return false;
+  const file_entry *entries =
+      (const file_entry *)(data + entries_offset(header->table_size));
+  uint64_t start = data_offset(header->table_size, header->entry_count);
+  uint64_t size = header->file_size;
+  for (uint64_t i = 0; i < header->entry_count; i++) {
+    const file_entry *entry = &entries[i];
+    if (entry->key_offset < start || entry->key_offset > size ||
+        entry->key_size > size - entry->key_offset ||
+        entry->value_offset < start || entry->value_offset > size ||
+        entry->value_size > size - entry->value_offset ||
+        entry->value_offset % 8 != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+mapfile_handle mapfile_open(const char *path) {
+  if (!path) return (mapfile_handle){0};
+  mem_handle file_mh = mem_handle_from_file(path);
+  if (!mem_is_valid(file_mh)) return (mapfile_handle){0};
+  const unsigned char *data = mem_p(file_mh);
+  size_t size = mem_size(file_mh);
+  if (!header_is_valid(data, size) ||
+      hash_bytes(data + sizeof(file_header), size - sizeof(file_header),
+                 CHECKSUM_SEED) != ((const file_header *)data)->checksum ||
+      !table_is_valid(data)) {
+    mem_free(file_mh);
+    return (mapfile_handle){0};
+  }
+  // The file is mapped for the checksum's sequential pass. From here on it is
+  // a random-access index.
+  mem_handle_advise_random(file_mh);
+
+  mapfile_handle mfh = mem_alloc(MEM_ALLOCATOR_PLAIN, sizeof(mapfile));
+  if (!mem_is_valid(mfh)) {
+    mem_free(file_mh);
+    return (mapfile_handle){0};
+  }
+  const file_header *header = (const file_header *)data;
+  *(mapfile *)mem_p(mfh) = (mapfile){.file_mh = file_mh,
+                                     .entry_count = header->entry_count,
+                                     .table_size = header->table_size};
+  return mfh;
+}
+
+bool mapfile_is_valid(mapfile_handle mfh) {
+  return mem_is_valid(mfh) && mem_is_valid(((mapfile *)mem_p(mfh))->file_mh);
+}
+
+void mapfile_close(mapfile_handle mfh) {
+  if (!mapfile_is_valid(mfh)) return;
+  mem_free(((mapfile *)mem_p(mfh))->file_mh);
+  mem_free(mfh);
+}
+
+size_t mapfile_count(mapfile_handle mfh) {
+  if (!mapfile_is_valid(mfh)) return 0;
+  return ((mapfile *)mem_p(mfh))->entry_count;
+}
+
+mem_handle mapfile_get(mapfile_handle mfh, str key) {
+  mapfile *mfp = mem_p(mfh);
+  if (!mfp || !str_is_valid(key)) return (mem_handle){0};
+  unsigned char *data = mem_p(mfp->file_mh);
+  const file_slot *slots = (const file_slot *)(data + sizeof(file_header));
+  const file_entry *entries =
+      (const file_entry *)(data + entries_offset(mfp->table_size));
+  uint64_t key_hash = hash_str(key);
+  uint32_t tag = key_hash >> 32;
+  size_t key_size = mem_size(key);
+  size_t mask = mfp->table_size - 1;
+  for (size_t pos = key_hash & mask; slots[pos].entry != 0;
+       pos = (pos + 1) & mask) {
+    if (slots[pos].tag != tag) continue;
+    const file_entry *entry = &entries[slots[pos].entry - 1];
+    if (entry->key_size == key_size &&
+        (key_size == 0 ||
+         memcmp(data + entry->key_offset, mem_p(key), key_size) == 0)) {
+      return mem_handle_from_ptr(data + entry->value_offset,
+                                 entry->value_size);
+    }
+  }
+  return (mem_handle){0};
+}
@@ -0,0 +1,126 @@
+/**
+ * @file mapfile.h
+ * @brief A read-only map stored in a file, for fast startup.
+ *
+ *   mapfile_handle symbols = mapfile_open("symbols.m65map");
+ *   if (!mapfile_is_valid(symbols)) {
+ *     map_handle mh = build_symbols();  // the slow way
+ *     mapfile_write(mh, "symbols.m65map");
+ *     ...
+ *   }
+ *   mem_handle value = mapfile_get(symbols, str_from_cstr("irq_handler"));
+ *   ...
+ *   mapfile_close(symbols);
+ *
+ * `mapfile_write` saves a map with str keys to a file: an index table, the
+ * keys, and a copy of the bytes of each value. `mapfile_open` maps the file
+ * into memory and looks keys up in place. Opening a file does not rebuild
+ * the table, hash any keys, or allocate memory for them, so a table of any
+ * size is ready after one pass over the file to verify its checksum.
+ *
+ * A value is saved as the bytes that its handle refers to, so values must be
+ * plain data: a value that contains pointers or handles does not mean the same
+ * thing when it is read back. `mapfile_get` returns a handle to the bytes in
+ * the mapped file, aligned to 8 bytes, which must not be written or freed.
+ *
+ * The file refers to its own contents by offset from its start, so it can be
+ * mapped at any address. It is not portable between builds: integers are
+ * stored in the byte order of the machine, and keys are placed by `hash_str`,
+ * which differs between builds. A file records both, along with a format
+ * version and a checksum, and `mapfile_open` fails for a file written by a
+ * different build, an older format, or that is truncated or corrupt. Treat a
+ * map file as a cache that can be rebuilt from its source.
+ */
+
+#ifndef DATASTRUCT_MAPFILE_H
+#define DATASTRUCT_MAPFILE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "map.h"
+#include "mem.h"
+#include "str.h"
+
+// The version of the file format. Files of other versions fail to open.
+#define MAPFILE_VERSION 1
+
+// Handle for a map file, returned by `mapfile_open`
+typedef mem_handle mapfile_handle;
+
+// Internal type for an open map file
+typedef struct mapfile {
+  // The mapped contents of the file
+  mem_handle file_mh;
+
+  // The number of keys
+  size_t entry_count;
+
+  // The number of slots in the index table, a power of two
+  size_t table_size;
+} mapfile;
+
+/**
+ * @brief Writes a map to a file.
+ *
+ * Every key of the map must be a str, so a map with pointer keys or a
+ * hash-only map cannot be written. Keys are saved in the order of the map's
+ * iteration. Each value is saved as a copy of the bytes it refers to, so
+ * values must not contain pointers or handles.
+ *
+ * The map is written to a temporary file beside the path, which then
+ * replaces any file at the path, so that a reader never sees part of a file.
+ *
+ * @param mh The map handle
+ * @param path The path of the file to write
+ * @return true on success, false if the map cannot be saved, or memory could
+ *   not be allocated, or the file could not be written
+ */
+bool mapfile_write(map_handle mh, const char *path);
+
+/**
+ * @brief Opens a map file written by `mapfile_write`.
+ *
+ * This maps the file into memory, checks its header, and reads it once to
+ * verify its checksum and the bounds of every key and value.
+ *
+ * @param path The path of the file to open
+ * @return mapfile_handle A handle for the file, or an invalid handle if it
+ *   could not be opened or was not written by this build with this format
+ *   version
+ */
+mapfile_handle mapfile_open(const char *path);
+
+/**
+ * @param mfh The map file handle
+ * @return true if the map file is valid
+ */
+bool mapfile_is_valid(mapfile_handle mfh);
+
+/**
+ * @brief Closes a map file.
+ *
+ * This unmaps the file. Handles returned by `mapfile_get` are no longer valid.
+ *
+ * @param mfh The handle of the map file to close
+ */
+void mapfile_close(mapfile_handle mfh);
+
+/**
+ * @param mfh The map file handle
+ * @return size_t The number of keys, or 0 if the handle is invalid
+ */
+size_t mapfile_count(mapfile_handle mfh);
+
+/**
+ * @brief Gets a value for a key in a map file.
+ *
+ * @param mfh The map file handle
+ * @param key The key
+ * @return mem_handle The bytes of the value saved for the key, in the mapped
+ *   file, or an invalid mem_handle if not found. The memory must not be
+ *   written, and is valid until the file is closed.
+ */
+mem_handle mapfile_get(mapfile_handle mfh, str key);
+
+#endif
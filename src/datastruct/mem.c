@@ -1,32 +1,24 @@
 #include "mem.h"
 
 #include <signal.h>
+#include <stdatomic.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
-static void *mem_handle_data(mem_handle handle) {
-  return handle.data;
-}
-
 static const mem_allocator_spec MEM_ALLOCATOR_NOT_ALLOCATED_SPEC =
-    (mem_allocator_spec){.allocator_type = MEM_ALLOCATOR_TYPE_NOT_ALLOCATED,
-                         .p_func = mem_handle_data};
-
-const mem_allocator MEM_ALLOCATOR_NOT_ALLOCATED =
-    (mem_allocator){.allocator_spec = &MEM_ALLOCATOR_NOT_ALLOCATED_SPEC};
+    (mem_allocator_spec){.allocator_type = MEM_ALLOCATOR_TYPE_NOT_ALLOCATED};
 
 static mem_handle plain_alloc(mem_allocator allocator, size_t size) {
-  return (mem_handle){
-      .data = malloc(size), .size = size, .allocator = allocator};
+  return mem_handle_make(malloc(size), size, allocator);
 }
 
 static mem_handle plain_realloc(mem_handle handle, size_t size) {
   if (!mem_is_valid(handle)) return (mem_handle){0};
-  return (mem_handle){.data = realloc(handle.data, size),
-                      .size = size,
-                      .allocator = handle.allocator};
+  return mem_handle_make(realloc(handle.data, size), size,
+                         mem_handle_allocator(handle));
 }
 
 static mem_handle plain_free(mem_handle handle) {
@@ -38,44 +30,374 @@ static const mem_allocator_spec MEM_ALLOCATOR_PLAIN_SPEC =
     (mem_allocator_spec){.allocator_type = MEM_ALLOCATOR_TYPE_PLAIN,
                          .alloc_func = plain_alloc,
                          .realloc_func = plain_realloc,
-                         .free_func = plain_free,
-                         .p_func = mem_handle_data};
+                         .free_func = plain_free};
+
+// Header stored just before the memory of an aligned allocation.
+typedef struct aligned_header {
+  // The allocation from the parent allocator that contains this one
+  mem_handle parent_mh;
+
+  // The alignment of the memory, in bytes
+  size_t alignment;
+} aligned_header;
+
+static aligned_header *header_for(mem_handle handle) {
+  return (aligned_header *)handle.data - 1;
+}
+
+// The size to request from the parent allocator for an aligned allocation.
+static size_t parent_size(size_t size, size_t alignment) {
+  return size + sizeof(aligned_header) + alignment - 1;
+}
+
+static bool parent_size_fits(size_t size, size_t alignment) {
+  return alignment <= MEM_HANDLE_MAX_SIZE / 2 &&
+         size <= MEM_HANDLE_MAX_SIZE - sizeof(aligned_header) - alignment;
+}
+
+// The offset of aligned memory from the start of its parent allocation,
+// leaving room for the header.
+static size_t aligned_offset(char *parent_p, size_t alignment) {
+  uintptr_t start = (uintptr_t)parent_p + sizeof(aligned_header);
+  uintptr_t aligned = (start + alignment - 1) & ~(uintptr_t)(alignment - 1);
+  return aligned - (uintptr_t)parent_p;
+}
+
+static mem_handle aligned_realloc(mem_handle handle, size_t size) {
+  if (!mem_is_valid(handle)) return (mem_handle){0};
+  aligned_header header = *header_for(handle);
+  if (!parent_size_fits(size, header.alignment)) return (mem_handle){0};
+  size_t old_offset = (char *)handle.data - (char *)mem_p(header.parent_mh);
+  mem_handle parent_mh =
+      mem_realloc(header.parent_mh, parent_size(size, header.alignment));
+  if (!mem_is_valid(parent_mh)) return (mem_handle){0};
+
+  // The parent allocation may have moved to an address with a different
+  // alignment. If so, move the contents to the new aligned offset.
+  char *parent_p = mem_p(parent_mh);
+  size_t offset = aligned_offset(parent_p, header.alignment);
+  if (offset != old_offset) {
+    size_t old_size = mem_size(handle);
+    memmove(parent_p + offset, parent_p + old_offset,
+            old_size < size ? old_size : size);
+  }
+  mem_handle result =
+      mem_handle_make(parent_p + offset, size, mem_handle_allocator(handle));
+  *header_for(result) = (aligned_header){.parent_mh = parent_mh,
+                                         .alignment = header.alignment};
+  return result;
+}
+
+static mem_handle aligned_free(mem_handle handle) {
+  mem_free(header_for(handle)->parent_mh);
+  return (mem_handle){0};
+}
+
+// Aligned allocations are made by mem_alloc_aligned, which knows the parent
+// allocator.
+static const mem_allocator_spec MEM_ALLOCATOR_ALIGNED_SPEC =
+    (mem_allocator_spec){.allocator_type = MEM_ALLOCATOR_TYPE_ALIGNED,
+                         .realloc_func = aligned_realloc,
+                         .free_func = aligned_free};
+
+#if defined(DATASTRUCT_COMPACT_HANDLE) || defined(DATASTRUCT_MEM_STATS)
+
+// Guards the allocator registry and the allocation statistics, for threads
+// that create allocators or allocate at once, such as threads sharing a cmap.
+// Both are updated rarely or only in diagnostic builds, so a simple spin lock
+// is enough.
+static atomic_flag global_lock = ATOMIC_FLAG_INIT;
+
+static void lock_globals(void) {
+  while (atomic_flag_test_and_set_explicit(&global_lock,
+                                           memory_order_acquire)) {
+  }
+}
+
+static void unlock_globals(void) {
+  atomic_flag_clear_explicit(&global_lock, memory_order_release);
+}
+
+#endif
+
+#ifdef DATASTRUCT_COMPACT_HANDLE
+
+// Defined in mmap.c.
+extern const mem_allocator_spec _datastruct_mmap_allocator_spec;
+extern const mem_allocator_spec _datastruct_mmap_huge_allocator_spec;
+extern const mem_allocator_spec _datastruct_file_allocator_spec;
+
+const mem_allocator MEM_ALLOCATOR_NOT_ALLOCATED =
+    (mem_allocator){.allocator_spec = &MEM_ALLOCATOR_NOT_ALLOCATED_SPEC,
+                    .allocator_id = _DATASTRUCT_NOT_ALLOCATED_ID};
+
+const mem_allocator MEM_ALLOCATOR_PLAIN =
+    (mem_allocator){.allocator_spec = &MEM_ALLOCATOR_PLAIN_SPEC,
+                    .allocator_id = _DATASTRUCT_PLAIN_ID};
+
+static const mem_allocator MEM_ALLOCATOR_ALIGNED =
+    (mem_allocator){.allocator_spec = &MEM_ALLOCATOR_ALIGNED_SPEC,
+                    .allocator_id = _DATASTRUCT_ALIGNED_ID};
+
+// The built-in allocators are kept apart from the registry so that the
+// registry is zero-initialized and takes no space in the executable.
+const mem_allocator
+    _datastruct_mem_builtin_allocators[_DATASTRUCT_FIRST_REGISTERED_ID] = {
+        [_DATASTRUCT_NOT_ALLOCATED_ID] =
+            {.allocator_spec = &MEM_ALLOCATOR_NOT_ALLOCATED_SPEC,
+             .allocator_id = _DATASTRUCT_NOT_ALLOCATED_ID},
+        [_DATASTRUCT_PLAIN_ID] = {.allocator_spec = &MEM_ALLOCATOR_PLAIN_SPEC,
+                                  .allocator_id = _DATASTRUCT_PLAIN_ID},
+        [_DATASTRUCT_ALIGNED_ID] =
+            {.allocator_spec = &MEM_ALLOCATOR_ALIGNED_SPEC,
+             .allocator_id = _DATASTRUCT_ALIGNED_ID},
+        [_DATASTRUCT_MMAP_ID] =
+            {.allocator_spec = &_datastruct_mmap_allocator_spec,
+             .allocator_id = _DATASTRUCT_MMAP_ID},
+        [_DATASTRUCT_MMAP_HUGE_ID] =
+            {.allocator_spec = &_datastruct_mmap_huge_allocator_spec,
+             .allocator_id = _DATASTRUCT_MMAP_HUGE_ID},
+        [_DATASTRUCT_FILE_ID] =
+            {.allocator_spec = &_datastruct_file_allocator_spec,
+             .allocator_id = _DATASTRUCT_FILE_ID}};
+
+mem_allocator _datastruct_mem_allocator_registry[MEM_ALLOCATOR_REGISTRY_SIZE];
+
+// Indexes released by mem_allocator_unregister, available for reuse.
+static mem_allocator_id free_ids[MEM_ALLOCATOR_REGISTRY_SIZE];
+static unsigned int free_id_count = 0;
+
+// The lowest index that has never been used.
+static unsigned int next_unused_id = _DATASTRUCT_FIRST_REGISTERED_ID;
+
+bool mem_allocator_register(mem_allocator *allocator) {
+  bool registered = true;
+  lock_globals();
+  if (free_id_count > 0) {
+    allocator->allocator_id = free_ids[--free_id_count];
+  } else if (next_unused_id < MEM_ALLOCATOR_REGISTRY_SIZE) {
+    allocator->allocator_id = next_unused_id++;
+  } else {
+    registered = false;
+  }
+  if (registered) {
+    _datastruct_mem_allocator_registry[allocator->allocator_id] = *allocator;
+  }
+  unlock_globals();
+  return registered;
+}
+
+void mem_allocator_unregister(mem_allocator allocator) {
+  if (allocator.allocator_id < _DATASTRUCT_FIRST_REGISTERED_ID) return;
+  lock_globals();
+  _datastruct_mem_allocator_registry[allocator.allocator_id] =
+      (mem_allocator){0};
+  free_ids[free_id_count++] = allocator.allocator_id;
+  unlock_globals();
+}
+
+#else
+
+const mem_allocator MEM_ALLOCATOR_NOT_ALLOCATED =
+    (mem_allocator){.allocator_spec = &MEM_ALLOCATOR_NOT_ALLOCATED_SPEC};
 
 const mem_allocator MEM_ALLOCATOR_PLAIN =
     (mem_allocator){.allocator_spec = &MEM_ALLOCATOR_PLAIN_SPEC};
 
+static const mem_allocator MEM_ALLOCATOR_ALIGNED =
+    (mem_allocator){.allocator_spec = &MEM_ALLOCATOR_ALIGNED_SPEC};
+
+bool mem_allocator_register(mem_allocator *allocator) {
+  (void)allocator;
+  return true;
+}
+
+void mem_allocator_unregister(mem_allocator allocator) {
+  (void)allocator;
+}
+
+#endif
+
+extern inline mem_allocator mem_handle_allocator(mem_handle handle);
+extern inline mem_handle mem_handle_make(void *data, size_t size,
+                                         mem_allocator allocator);
+
 inline mem_handle mem_handle_from_ptr(void *ptr, size_t size) {
-  return (mem_handle){
-      .allocator = MEM_ALLOCATOR_NOT_ALLOCATED, .data = ptr, .size = size};
+  return mem_handle_make(ptr, size, MEM_ALLOCATOR_NOT_ALLOCATED);
+}
+
+// The number of deferral regions this thread is inside. SIGINT is deferred
+// while this is non-zero.
+static _Thread_local unsigned int sigint_defer_depth = 0;
+
+// Set by the SIGINT handler when SIGINT arrives inside a deferral region.
+static atomic_bool sigint_pending = false;
+
+// The handler set by mem_set_sigint_handler.
+static void (*volatile app_sigint_handler)(int) = SIG_DFL;
+
+static void deferring_sigint_handler(int sig) {
+  // Some platforms reset the handler to SIG_DFL when a signal is delivered.
+  signal(SIGINT, deferring_sigint_handler);
+  if (sigint_defer_depth > 0) {
+    atomic_store(&sigint_pending, true);
+    return;
+  }
+  app_sigint_handler(sig);
+}
+
+bool mem_set_sigint_handler(void (*handler)(int)) {
+  if (handler == SIG_DFL || handler == SIG_IGN) {
+    return signal(SIGINT, handler) != SIG_ERR;
+  }
+  app_sigint_handler = handler;
+  return signal(SIGINT, deferring_sigint_handler) != SIG_ERR;
+}
+
+inline void mem_sigint_defer_begin(void) {
+  ++sigint_defer_depth;
+  atomic_signal_fence(memory_order_seq_cst);
+}
+
+inline void mem_sigint_defer_end(void) {
+  atomic_signal_fence(memory_order_seq_cst);
+  if (--sigint_defer_depth == 0 &&
+      atomic_load_explicit(&sigint_pending, memory_order_relaxed) &&
+      atomic_exchange(&sigint_pending, false)) {
+    // Re-raise so that the handler runs in signal context, as it would have
+    // without the deferral.
+    raise(SIGINT);
+  }
 }
 
 /**
- * @brief Macro to disable SIGINT for a block.
+ * @brief Macro to defer SIGINT for a block.
  *
  * Usage: sigint_guard { ...statements... }
  *
  * Do not exit prematurely out of the block (return, goto). This will result in
- * the SIGINT handler not getting restored correctly.
+ * SIGINT being deferred indefinitely.
+ */
+// This macro treats the statement block as a run-once for loop, entering a
+// deferral region at the beginning of the block and leaving it at the end.
+// Neither makes a system call unless a SIGINT arrived during the block.
+#define sigint_guard                                            \
+  for (int guard_i = (mem_sigint_defer_begin(), 0); !guard_i; \
+       (guard_i = 1, mem_sigint_defer_end()))
+
+#ifdef DATASTRUCT_MEM_STATS
+
+// Statistics for each allocator, in the order of first use.
+static mem_stats stats_table[MEM_STATS_MAX_ALLOCATORS];
+static unsigned int stats_count = 0;
+
+/**
+ * @brief Finds the statistics for an allocator.
+ *
+ * The caller must hold the global lock.
+ *
+ * @param allocator The allocator
+ * @param create If true, starts statistics for a new allocator
+ * @return mem_stats* The statistics, or null if not found or the table is full
  */
-// This macro treats the statement block as a run-once for loop, storing the
-// current SIGINT handler and replacing it with SIG_IGN at the beginning of the
-// block, then restoring the SIGINT handler at the end.
-//
-// TODO: Does this need to use a custom SIGINT handler to trigger the current
-// handler at the end of the block if tripped during the block?
-#define sigint_guard                           \
-  for (struct {                                \
-         void (*sigint_handler)(int);          \
-         int i;                                \
-       } guard = {signal(SIGINT, SIG_IGN), 0}; \
-       !guard.i; (guard.i = 1, signal(SIGINT, guard.sigint_handler)))
+static mem_stats *find_stats(mem_allocator allocator, bool create) {
+  for (unsigned int i = 0; i < stats_count; i++) {
+    if (stats_table[i].allocator.allocator_spec == allocator.allocator_spec &&
+        stats_table[i].allocator.allocator_data == allocator.allocator_data) {
+      return &stats_table[i];
+    }
+  }
+  if (!create || stats_count == MEM_STATS_MAX_ALLOCATORS) {
+    return (mem_stats *)0;
+  }
+  mem_stats *stats = &stats_table[stats_count++];
+  *stats = (mem_stats){.allocator = allocator};
+  return stats;
+}
+
+static void count_size(mem_stats *stats, size_t size) {
+  unsigned int bucket = 0;
+  while (size && bucket < MEM_STATS_HISTOGRAM_SIZE - 1) {
+    size >>= 1;
+    ++bucket;
+  }
+  ++stats->size_histogram[bucket];
+}
+
+static void add_live_bytes(mem_stats *stats, size_t size) {
+  stats->live_bytes += size;
+  if (stats->live_bytes > stats->peak_bytes) {
+    stats->peak_bytes = stats->live_bytes;
+  }
+}
+
+static void sub_live_bytes(mem_stats *stats, size_t size) {
+  // Memory allocated before mem_stats_reset was not counted.
+  stats->live_bytes -= size < stats->live_bytes ? size : stats->live_bytes;
+}
+
+static void stats_alloc(mem_allocator allocator, size_t size,
+                        mem_handle result) {
+  lock_globals();
+  mem_stats *stats = find_stats(allocator, true);
+  if (stats) {
+    count_size(stats, size);
+    if (!mem_is_valid(result)) {
+      ++stats->fail_count;
+    } else {
+      ++stats->alloc_count;
+      add_live_bytes(stats, size);
+    }
+  }
+  unlock_globals();
+}
+
+static void stats_realloc(mem_handle handle, size_t size, mem_handle result) {
+  lock_globals();
+  mem_stats *stats = find_stats(mem_handle_allocator(handle), true);
+  if (stats) {
+    count_size(stats, size);
+    if (!mem_is_valid(result)) {
+      ++stats->fail_count;
+    } else {
+      ++stats->realloc_count;
+      if (result.data != handle.data) {
+        ++stats->realloc_copy_count;
+        stats->realloc_copy_bytes += handle.size < size ? handle.size : size;
+      }
+      sub_live_bytes(stats, handle.size);
+      add_live_bytes(stats, size);
+    }
+  }
+  unlock_globals();
+}
+
+static void stats_free(mem_handle handle) {
+  lock_globals();
+  mem_stats *stats = find_stats(mem_handle_allocator(handle), true);
+  if (stats) {
+    ++stats->free_count;
+    sub_live_bytes(stats, handle.size);
+  }
+  unlock_globals();
+}
+
+#else
+
+#define stats_alloc(allocator, size, result)
+#define stats_realloc(handle, size, result)
+#define stats_free(handle)
+
+#endif
 
 mem_handle mem_alloc(mem_allocator allocator, size_t size) {
-  if (!allocator.allocator_spec || !allocator.allocator_spec->alloc_func)
+  if (!allocator.allocator_spec || !allocator.allocator_spec->alloc_func ||
+      size > MEM_HANDLE_MAX_SIZE)
     return (mem_handle){0};
   mem_handle result;
   sigint_guard {
     result = allocator.allocator_spec->alloc_func(allocator, size);
+    stats_alloc(allocator, size, result);
   }
   return result;
 }
@@ -88,42 +410,54 @@ mem_handle mem_alloc_clear(mem_allocator allocator, size_t size) {
   return handle;
 }
 
+mem_handle mem_alloc_aligned(mem_allocator allocator, size_t size,
+                             size_t alignment) {
+  if (!alignment || (alignment & (alignment - 1))) return (mem_handle){0};
+  if (alignment <= _Alignof(max_align_t)) return mem_alloc(allocator, size);
+  if (!parent_size_fits(size, alignment)) return (mem_handle){0};
+  mem_handle result = (mem_handle){0};
+  sigint_guard {
+    mem_handle parent_mh = mem_alloc(allocator, parent_size(size, alignment));
+    if (mem_is_valid(parent_mh)) {
+      char *parent_p = mem_p(parent_mh);
+      result = mem_handle_make(parent_p + aligned_offset(parent_p, alignment),
+                               size, MEM_ALLOCATOR_ALIGNED);
+      *header_for(result) =
+          (aligned_header){.parent_mh = parent_mh, .alignment = alignment};
+    }
+    stats_alloc(MEM_ALLOCATOR_ALIGNED, size, result);
+  }
+  return result;
+}
+
 mem_handle mem_realloc(mem_handle handle, size_t size) {
-  if (!mem_is_valid(handle) || !handle.allocator.allocator_spec ||
-      !handle.allocator.allocator_spec->realloc_func)
+  const mem_allocator_spec *spec = mem_handle_allocator(handle).allocator_spec;
+  if (!mem_is_valid(handle) || !spec || !spec->realloc_func ||
+      size > MEM_HANDLE_MAX_SIZE)
     return (mem_handle){0};
   mem_handle result;
   sigint_guard {
-    result = handle.allocator.allocator_spec->realloc_func(handle, size);
+    result = spec->realloc_func(handle, size);
+    stats_realloc(handle, size, result);
   }
   return result;
 }
 
 mem_handle mem_free(mem_handle handle) {
-  if (!mem_is_valid(handle) || !handle.allocator.allocator_spec ||
-      !handle.allocator.allocator_spec->free_func)
+  const mem_allocator_spec *spec = mem_handle_allocator(handle).allocator_spec;
+  if (!mem_is_valid(handle) || !spec || !spec->free_func)
     return (mem_handle){0};
   mem_handle result;
   sigint_guard {
-    result = handle.allocator.allocator_spec->free_func(handle);
+    result = spec->free_func(handle);
+    stats_free(handle);
   }
   return result;
 }
 
-void *mem_p(mem_handle handle) {
-  if (!mem_is_valid(handle) || !handle.allocator.allocator_spec ||
-      !handle.allocator.allocator_spec->p_func)
-    return (void *)0;
-  return handle.allocator.allocator_spec->p_func(handle);
-}
-
-inline size_t mem_size(mem_handle handle) {
-  return handle.size;
-}
-
-inline bool mem_is_valid(mem_handle handle) {
-  return handle.data != (void *)0;
-}
+extern inline bool mem_is_valid(mem_handle handle);
+extern inline void *mem_p(mem_handle handle);
+extern inline size_t mem_size(mem_handle handle);
 
 mem_handle mem_duplicate_with_allocator(mem_allocator allocator,
                                         mem_handle handle) {
@@ -135,5 +469,74 @@ mem_handle mem_duplicate_with_allocator(mem_allocator allocator,
 }
 
 inline mem_handle mem_duplicate(mem_handle handle) {
-  return mem_duplicate_with_allocator(handle.allocator, handle);
+  if (mem_is_valid(handle) && mem_handle_allocator(handle).allocator_spec ==
+                                  &MEM_ALLOCATOR_ALIGNED_SPEC) {
+    aligned_header *header = header_for(handle);
+    mem_handle new_handle =
+        mem_alloc_aligned(mem_handle_allocator(header->parent_mh),
+                          mem_size(handle), header->alignment);
+    if (!mem_is_valid(new_handle)) return (mem_handle){0};
+    memcpy(new_handle.data, handle.data, mem_size(handle));
+    return new_handle;
+  }
+  return mem_duplicate_with_allocator(mem_handle_allocator(handle), handle);
+}
+
+#ifdef DATASTRUCT_MEM_STATS
+
+bool mem_stats_enabled(void) {
+  return true;
 }
+
+mem_stats mem_stats_get(mem_allocator allocator) {
+  lock_globals();
+  mem_stats *stats = find_stats(allocator, false);
+  mem_stats result = stats ? *stats : (mem_stats){0};
+  unlock_globals();
+  return result;
+}
+
+unsigned int mem_stats_allocator_count(void) {
+  lock_globals();
+  unsigned int count = stats_count;
+  unlock_globals();
+  return count;
+}
+
+mem_stats mem_stats_get_by_index(unsigned int index) {
+  lock_globals();
+  mem_stats result =
+      index < stats_count ? stats_table[index] : (mem_stats){0};
+  unlock_globals();
+  return result;
+}
+
+void mem_stats_reset(void) {
+  lock_globals();
+  stats_count = 0;
+  unlock_globals();
+}
+
+#else
+
+bool mem_stats_enabled(void) {
+  return false;
+}
+
+mem_stats mem_stats_get(mem_allocator allocator) {
+  (void)allocator;
+  return (mem_stats){0};
+}
+
+unsigned int mem_stats_allocator_count(void) {
+  return 0;
+}
+
+mem_stats mem_stats_get_by_index(unsigned int index) {
+  (void)index;
+  return (mem_stats){0};
+}
+
+void mem_stats_reset(void) {}
+
+#endif
@@ -7,14 +7,17 @@
  * handle abstraction. An allocator can have a pointer payload, and can attach a
  * pointer payload to each memory handle.
  *
- * This is primarily intended to support both plain allocation and memory table
- * allocation (see memtbl.h) throughout the datastruct library. The user
- * provides an allocator to a constructor, and the object uses that allocator
- * throughout its lifetime.
+ * This is primarily intended to support plain allocation, memory table
+ * allocation (see memtbl.h), arena allocation (see arena.h), slab allocation
+ * (see slab.h), and mmap allocation (see mmap.h) throughout the datastruct
+ * library. The user provides an allocator to a constructor, and the object
+ * uses that allocator throughout its lifetime.
  *
- * Memory operations guard against being interrupted by SIGINT to keep the
- * internal state of an allocator consistent. This allows a memtbl allocator
- * to be used as part of a SIGINT handler, to abort an operation cleanly.
+ * Memory operations defer SIGINT until they complete, to keep the internal
+ * state of an allocator consistent. This allows a memtbl allocator to be used
+ * as part of a SIGINT handler, to abort an operation cleanly. Install the
+ * handler with `mem_set_sigint_handler` to get this guarantee. Deferral does
+ * not make system calls, and is tracked per thread.
  *
  * Allocation returns a handle that can be used to access the address of the
  * memory, reallocate the memory, and free the memory. The handle is small and
@@ -24,6 +27,18 @@
  * You can wrap unowned pointers with a memory handle for use with datastruct
  * operations. `mem_realloc` and `mem_free` do nothing when given such a handle.
  * See `mem_handle_from_ptr`.
+ *
+ * By default, a handle is 32 bytes and includes its allocator. When the library
+ * is built with `DATASTRUCT_COMPACT_HANDLE` defined (`./configure
+ * --enable-compact-handle`), a handle is 16 bytes and refers to its allocator
+ * by index. See `mem_handle_allocator`.
+ *
+ * When the library is built with `DATASTRUCT_MEM_STATS` defined (`./configure
+ * --enable-mem-stats`), memory operations also keep statistics for each
+ * allocator. See `mem_stats_get`. Statistics are guarded by a lock, so they
+ * are safe to keep with threads that allocate at once, such as threads
+ * sharing a cmap. Without `DATASTRUCT_MEM_STATS`, statistics cost nothing and
+ * the query functions report no data.
  */
 
 #ifndef DATASTRUCT_MEM_H
@@ -33,12 +48,37 @@
 #include <stdint.h>
 #include <stdlib.h>
 
+// Whether internal consistency checks are compiled in. These are on by
+// default, and off when NDEBUG is defined. Define DATASTRUCT_CHECKED as 0 or 1
+// to override.
+#ifndef DATASTRUCT_CHECKED
+#ifdef NDEBUG
+#define DATASTRUCT_CHECKED 0
+#else
+#define DATASTRUCT_CHECKED 1
+#endif
+#endif
+
+// Internal: evaluates an invariant on a hot path when DATASTRUCT_CHECKED is
+// set, and assumes it is true otherwise. Public functions still reject invalid
+// handles in all builds.
+#if DATASTRUCT_CHECKED
+#define DATASTRUCT_CHECK(cond) (cond)
+#else
+#define DATASTRUCT_CHECK(cond) true
+#endif
+
 // Type tags for mem_allocator.
 enum mem_allocator_type {
   MEM_ALLOCATOR_TYPE_INVALID = 0,
   MEM_ALLOCATOR_TYPE_NOT_ALLOCATED,
   MEM_ALLOCATOR_TYPE_PLAIN,
-  MEM_ALLOCATOR_TYPE_MEMTBL  // memtbl.h
+  MEM_ALLOCATOR_TYPE_MEMTBL,  // memtbl.h
+  MEM_ALLOCATOR_TYPE_ARENA,   // arena.h
+  MEM_ALLOCATOR_TYPE_SLAB,    // slab.h
+  MEM_ALLOCATOR_TYPE_MMAP,    // mmap.h
+  MEM_ALLOCATOR_TYPE_FILE,    // mmap.h
+  MEM_ALLOCATOR_TYPE_ALIGNED  // mem_alloc_aligned
 };
 
 typedef struct mem_handle mem_handle;
@@ -48,19 +88,77 @@ typedef struct mem_allocator_spec {
   mem_handle (*alloc_func)(mem_allocator allocator, size_t size);
   mem_handle (*realloc_func)(mem_handle handle, size_t size);
   mem_handle (*free_func)(mem_handle handle);
+
+  // Gets the address of a handle's memory. If null, the address is
+  // `handle.data`, and `mem_p` does not make an indirect call.
   void *(*p_func)(mem_handle handle);
 } mem_allocator_spec;
 
+// Index of an allocator in the allocator registry. See
+// `mem_allocator_register`.
+typedef uint16_t mem_allocator_id;
+
 // Allocator for `mem_alloc` and datastruct constructors.
 struct mem_allocator {
   const mem_allocator_spec *allocator_spec;
   void *allocator_data;
+#ifdef DATASTRUCT_COMPACT_HANDLE
+  // The index of this allocator in the registry
+  mem_allocator_id allocator_id;
+#endif
 };
 
 // Simple allocators with no attached data.
 extern const mem_allocator MEM_ALLOCATOR_NOT_ALLOCATED;
 extern const mem_allocator MEM_ALLOCATOR_PLAIN;
 
+#ifdef DATASTRUCT_COMPACT_HANDLE
+
+// The largest size of an allocation, limited by the compact handle layout.
+#define MEM_HANDLE_MAX_SIZE ((size_t)0xffffffffffff)
+
+// The number of allocators that can be registered at one time, including the
+// simple allocators.
+#define MEM_ALLOCATOR_REGISTRY_SIZE 65536
+
+// Handle for an allocation.
+//
+// This is the compact layout, selected by defining DATASTRUCT_COMPACT_HANDLE
+// (`./configure --enable-compact-handle`). The handle is 16 bytes, and is
+// passed and returned in two registers. The allocator is stored as an index
+// into the allocator registry. Use `mem_handle_allocator` to get it.
+//
+// `size` is a 48-bit bit-field. Use `mem_size` to read it as a `size_t`.
+struct mem_handle {
+  void *data;
+  uint64_t size : 48;
+  uint64_t allocator_id : 16;
+};
+
+// Internal: registry indexes of the allocators with no attached data, which
+// are always registered. Index 0 is the invalid allocator.
+enum {
+  _DATASTRUCT_NOT_ALLOCATED_ID = 1,
+  _DATASTRUCT_PLAIN_ID,
+  _DATASTRUCT_ALIGNED_ID,
+  _DATASTRUCT_MMAP_ID,       // mmap.h
+  _DATASTRUCT_MMAP_HUGE_ID,  // mmap.h
+  _DATASTRUCT_FILE_ID,       // mmap.h
+  _DATASTRUCT_FIRST_REGISTERED_ID
+};
+
+// Internal: the allocators with no attached data, indexed by their ids.
+extern const mem_allocator _datastruct_mem_builtin_allocators[];
+
+// Internal: the allocator registry, indexed by mem_allocator_id, for ids from
+// _DATASTRUCT_FIRST_REGISTERED_ID.
+extern mem_allocator _datastruct_mem_allocator_registry[];
+
+#else
+
+// The largest size of an allocation.
+#define MEM_HANDLE_MAX_SIZE SIZE_MAX
+
 // Handle for an allocation.
 struct mem_handle {
   void *data;
@@ -68,6 +166,68 @@ struct mem_handle {
   mem_allocator allocator;
 };
 
+#endif
+
+/**
+ * @brief Gets the allocator of a memory handle.
+ *
+ * @param handle The memory handle
+ * @return mem_allocator The allocator that owns the memory
+ */
+inline mem_allocator mem_handle_allocator(mem_handle handle) {
+#ifdef DATASTRUCT_COMPACT_HANDLE
+  mem_allocator_id id = handle.allocator_id;
+  return id < _DATASTRUCT_FIRST_REGISTERED_ID
+             ? _datastruct_mem_builtin_allocators[id]
+             : _datastruct_mem_allocator_registry[id];
+#else
+  return handle.allocator;
+#endif
+}
+
+/**
+ * @brief Makes a memory handle.
+ *
+ * This is for use by allocator implementations.
+ *
+ * @param data The address of the memory
+ * @param size The size of the memory, at most `MEM_HANDLE_MAX_SIZE`
+ * @param allocator The allocator that owns the memory
+ * @return mem_handle The handle
+ */
+inline mem_handle mem_handle_make(void *data, size_t size,
+                                  mem_allocator allocator) {
+#ifdef DATASTRUCT_COMPACT_HANDLE
+  return (mem_handle){
+      .data = data, .size = size, .allocator_id = allocator.allocator_id};
+#else
+  return (mem_handle){.data = data, .size = size, .allocator = allocator};
+#endif
+}
+
+/**
+ * @brief Registers an allocator that has attached data.
+ *
+ * With the compact handle layout, each handle refers to its allocator by an
+ * index into a registry. An allocator with attached data, such as a memtbl,
+ * registers itself when it is created, and unregisters itself when it is
+ * destroyed. The simple allocators are always registered. The registry is
+ * guarded by a lock, so threads can create and destroy allocators at once.
+ *
+ * With the default layout, this does nothing and always succeeds.
+ *
+ * @param allocator The allocator. On success, its `allocator_id` is set.
+ * @return true on success, false if the registry is full
+ */
+bool mem_allocator_register(mem_allocator *allocator);
+
+/**
+ * @brief Unregisters an allocator, so that its index can be reused.
+ *
+ * @param allocator The allocator
+ */
+void mem_allocator_unregister(mem_allocator allocator);
+
 /**
  * @return mem_handle for an unowned region of memory
  */
@@ -76,8 +236,8 @@ mem_handle mem_handle_from_ptr(void *ptr, size_t size);
 /**
  * @brief Allocates memory.
  *
- * @param ma The memory allocator, from either `mem_allocator_plain` or
- *   `mem_allocator_memtbl`
+ * @param ma The memory allocator, such as `MEM_ALLOCATOR_PLAIN`,
+ *   `mem_allocator_memtbl`, or `mem_allocator_arena`
  * @param size The amount of memory to allocate
  * @return A memory handle, possibly invalid. Test `mem_p(handle)` for null
  * before using.
@@ -87,22 +247,39 @@ mem_handle mem_alloc(mem_allocator allocator, size_t size);
 /**
  * @brief Allocates memory, cleared with zeroes.
  *
- * @param ma The memory allocator, from either `mem_allocator_plain` or
- *   `mem_allocator_memtbl`
+ * @param ma The memory allocator, such as `MEM_ALLOCATOR_PLAIN`,
+ *   `mem_allocator_memtbl`, or `mem_allocator_arena`
  * @param size The amount of memory to allocate
  * @return A memory handle, possibly invalid. Test `mem_p(handle)` for null
  * before using.
  */
 mem_handle mem_alloc_clear(mem_allocator allocator, size_t size);
 
+/**
+ * @brief Allocates memory at an address that is a multiple of an alignment.
+ *
+ * Every allocator returns memory aligned for any standard type. For a larger
+ * alignment, such as a cache line or a SIMD register, this allocates extra
+ * memory from the allocator and returns a handle with its own allocator type.
+ * `mem_realloc`, `mem_duplicate`, and `mem_free` work with the handle as
+ * usual. `mem_realloc` and `mem_duplicate` keep the alignment.
+ *
+ * @param allocator The memory allocator, such as `MEM_ALLOCATOR_PLAIN`,
+ *   `mem_allocator_memtbl`, or `mem_allocator_arena`
+ * @param size The amount of memory to allocate
+ * @param alignment The alignment in bytes, a power of two
+ * @return A memory handle, possibly invalid. Test `mem_p(handle)` for null
+ * before using.
+ */
+mem_handle mem_alloc_aligned(mem_allocator allocator, size_t size,
+                             size_t alignment);
+
 /**
  * @brief Reallocates memory.
  *
  * After using, replace the original memory handle with the new one returned
- * by this function. Technically you can reuse the original memory handle
- * value when using a memtbl allocator, but you must use the new handle with
- * the plain allocator. Doing so in both cases makes your code compatible
- * with both allocators.
+ * by this function. After a successful reallocation, do not use the original
+ * handle with any allocator.
  *
  * In all cases, call `mem_p(handle)` again after the reallocation to access the
  * address, which may have changed (or become `(void *)0` on failure) after
@@ -127,27 +304,39 @@ mem_handle mem_realloc(mem_handle handle, size_t size);
  */
 mem_handle mem_free(mem_handle handle);
 
+/**
+ * @param handle The memory handle
+ * @return true if the memory handle is valid
+ */
+inline bool mem_is_valid(mem_handle handle) {
+  return handle.data != (void *)0;
+}
+
 /**
  * @brief Accesses the address of memory for a handle.
  *
  * This returns `(void *)0` if the handle is invalid, such as after a failed
  * allocation.
  *
+ * This is inline. For the allocators in this library, it does not make a
+ * function call.
+ *
  * @param handle The memory handle
  * @return void* The address of the allocated memory
  */
-void *mem_p(mem_handle handle);
+inline void *mem_p(mem_handle handle) {
+  if (!mem_is_valid(handle)) return (void *)0;
+  const mem_allocator_spec *spec = mem_handle_allocator(handle).allocator_spec;
+  if (!DATASTRUCT_CHECK(spec)) return (void *)0;
+  return spec->p_func ? spec->p_func(handle) : handle.data;
+}
 
 /**
  * @return size_t The size of the memory region
  */
-size_t mem_size(mem_handle handle);
-
-/**
- * @param handle The memory handle
- * @return true if the memory handle is valid
- */
-bool mem_is_valid(mem_handle handle);
+inline size_t mem_size(mem_handle handle) {
+  return handle.size;
+}
 
 /**
  * @brief Duplicates a memory region.
@@ -170,4 +359,125 @@ mem_handle mem_duplicate(mem_handle handle);
 mem_handle mem_duplicate_with_allocator(mem_allocator allocator,
                                         mem_handle handle);
 
+/**
+ * @brief Sets the SIGINT handler, deferred during memory operations.
+ *
+ * If SIGINT arrives while a thread is inside a memory operation, the handler
+ * is called when the operation completes. Otherwise the handler is called
+ * immediately. `SIG_DFL` and `SIG_IGN` are installed directly, without
+ * deferral.
+ *
+ * Use this instead of `signal(SIGINT, handler)` when the handler may abort an
+ * operation that uses a memtbl allocator, such as with longjmp.
+ *
+ * @param handler The SIGINT handler
+ * @return true on success
+ */
+bool mem_set_sigint_handler(void (*handler)(int));
+
+/**
+ * @brief Begins a region of code in which SIGINT is deferred.
+ *
+ * Every memory operation runs inside such a region. Callers can use this to
+ * make a sequence of operations atomic with respect to the handler set by
+ * `mem_set_sigint_handler`. Regions can be nested. Each call must be paired
+ * with a call to `mem_sigint_defer_end` on the same thread.
+ */
+void mem_sigint_defer_begin(void);
+
+/**
+ * @brief Ends a region of code in which SIGINT is deferred.
+ *
+ * If SIGINT arrived during the outermost region, this delivers it.
+ */
+void mem_sigint_defer_end(void);
+
+// The number of buckets in `mem_stats.size_histogram`.
+#define MEM_STATS_HISTOGRAM_SIZE 32
+
+// The most allocators that have statistics. Memory operations with further
+// allocators are not counted.
+#define MEM_STATS_MAX_ALLOCATORS 64
+
+// Allocation statistics for one allocator.
+typedef struct mem_stats {
+  // The allocator
+  mem_allocator allocator;
+
+  // The number of bytes currently allocated
+  size_t live_bytes;
+
+  // The most bytes allocated at one time
+  size_t peak_bytes;
+
+  // The number of successful calls to `mem_alloc`
+  size_t alloc_count;
+
+  // The number of successful calls to `mem_realloc`
+  size_t realloc_count;
+
+  // The number of reallocations that moved the memory to a new address
+  size_t realloc_copy_count;
+
+  // The number of bytes copied by reallocations that moved the memory
+  size_t realloc_copy_bytes;
+
+  // The number of calls to `mem_free`
+  size_t free_count;
+
+  // The number of failed allocations and reallocations
+  size_t fail_count;
+
+  // Allocations and reallocations, by requested size. Bucket 0 counts a size of
+  // 0, and bucket i counts sizes from 2^(i-1) to 2^i - 1. The last bucket also
+  // counts all larger sizes.
+  size_t size_histogram[MEM_STATS_HISTOGRAM_SIZE];
+} mem_stats;
+
+/**
+ * @return true if the library was built with `DATASTRUCT_MEM_STATS`
+ */
+bool mem_stats_enabled(void);
+
+/**
+ * @brief Gets the allocation statistics for an allocator.
+ *
+ * Allocators are identified by their spec and data. For example, every
+ * `MEM_ALLOCATOR_PLAIN` shares one set of statistics, and each memtbl has its
+ * own. Allocators that allocate from a parent allocator, such as a slab, have
+ * statistics at both levels.
+ *
+ * Only `mem_alloc`, `mem_realloc`, and `mem_free` are counted. Destroying a
+ * memtbl or resetting an arena releases memory without counting it as freed.
+ *
+ * Map tables grow by allocating a new table and freeing the old one. Strbufs
+ * grow by reallocating. Compare `size_histogram` and `realloc_copy_bytes` to
+ * see which dominates.
+ *
+ * @param allocator The allocator
+ * @return mem_stats The statistics, all zero if none are recorded
+ */
+mem_stats mem_stats_get(mem_allocator allocator);
+
+/**
+ * @return unsigned int The number of allocators with statistics
+ */
+unsigned int mem_stats_allocator_count(void);
+
+/**
+ * @brief Gets the allocation statistics for an allocator, by index.
+ *
+ * Use this with `mem_stats_allocator_count` to report on all allocators.
+ * Allocators are listed in the order of their first memory operation.
+ *
+ * @param index The index, from 0 to `mem_stats_allocator_count()` - 1
+ * @return mem_stats The statistics, all zero if index is out of range
+ */
+mem_stats mem_stats_get_by_index(unsigned int index);
+
+/**
+ * @brief Discards all allocation statistics.
+ */
+void mem_stats_reset(void);
+
 #endif
\ No newline at end of file
@@ -1,14 +1,83 @@
 #include "memtbl.h"
 
-#include "map.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
 #include "mem.h"
 
+static const mem_allocator_spec MEMTBL_ALLOCATOR_SPEC;
+
+struct memtbl_entry {
+  memtbl_entry *prev;
+  memtbl_entry *next;
+
+  // The order of the allocation in the table, for checkpoints
+  uint64_t seq;
+};
+
+// Size of the entry header, rounded up so that allocations are aligned.
+#define ENTRY_HEADER_SIZE                                  \
+  ((sizeof(memtbl_entry) + _Alignof(max_align_t) - 1) & \
+   ~(_Alignof(max_align_t) - 1))
+
+static memtbl_entry *entry_for_data(void *data) {
+  return (memtbl_entry *)((char *)data - ENTRY_HEADER_SIZE);
+}
+
+static void *data_for_entry(memtbl_entry *entry) {
+  return (char *)entry + ENTRY_HEADER_SIZE;
+}
+
+// Whether an allocation of a size has room for its entry header.
+static bool entry_size_fits(size_t size) {
+  return size <= SIZE_MAX - ENTRY_HEADER_SIZE;
+}
+
+/**
+ * @brief Points an entry's neighbors at the entry.
+ *
+ * This links a new entry into the list, or relinks an entry that moved.
+ *
+ * @param tblp The memtbl
+ * @param entry The entry, with prev and next already set
+ */
+static void link_entry(memtbl *tblp, memtbl_entry *entry) {
+  if (entry->prev) {
+    entry->prev->next = entry;
+  } else {
+    tblp->first_entry = entry;
+  }
+  if (entry->next) {
+    entry->next->prev = entry;
+  } else {
+    tblp->last_entry = entry;
+  }
+}
+
+static void unlink_entry(memtbl *tblp, memtbl_entry *entry) {
+  if (entry->prev) {
+    entry->prev->next = entry->next;
+  } else {
+    tblp->first_entry = entry->next;
+  }
+  if (entry->next) {
+    entry->next->prev = entry->prev;
+  } else {
+    tblp->last_entry = entry->prev;
+  }
+}
+
 memtbl_handle memtbl_create(mem_allocator allocator) {
   memtbl_handle mthandle = mem_alloc(allocator, sizeof(memtbl));
   if (!mem_is_valid(mthandle)) return (memtbl_handle){0};
   memtbl *tblp = mem_p(mthandle);
-  tblp->mem_map_handle = map_create(allocator);
-  if (!mem_is_valid(tblp->mem_map_handle)) {
+  tblp->first_entry = (memtbl_entry *)0;
+  tblp->last_entry = (memtbl_entry *)0;
+  tblp->next_seq = 0;
+  tblp->allocator = (mem_allocator){.allocator_spec = &MEMTBL_ALLOCATOR_SPEC,
+                                    .allocator_data = tblp};
+  if (!mem_allocator_register(&tblp->allocator)) {
     mem_free(mthandle);
     return (memtbl_handle){0};
   }
@@ -16,85 +85,87 @@ memtbl_handle memtbl_create(mem_allocator allocator) {
 }
 
 bool memtbl_is_valid(memtbl_handle mthandle) {
-  return (mem_is_valid(mthandle) &&
-          map_is_valid(((memtbl *)mem_p(mthandle))->mem_map_handle));
+  return mem_is_valid(mthandle);
 }
 
 void memtbl_destroy(memtbl_handle mthandle) {
   if (!memtbl_is_valid(mthandle)) return;
-  memtbl *mtp = mem_p(mthandle);
-  map_iter it = map_first_value_iter(mtp->mem_map_handle);
-  while (!map_iter_done(it)) {
-    mem_free(map_iter_value(it));
-    it = map_next_value_iter(it);
+  memtbl *tblp = mem_p(mthandle);
+  memtbl_entry *entry = tblp->first_entry;
+  while (entry) {
+    memtbl_entry *next = entry->next;
+    free(entry);
+    entry = next;
   }
-  map_destroy(mtp->mem_map_handle);
+  mem_allocator_unregister(tblp->allocator);
   mem_free(mthandle);
 }
 
 static mem_handle memtbl_alloc(mem_allocator allocator, size_t size) {
   memtbl *tblp = allocator.allocator_data;
-  if (!tblp || !mem_is_valid(tblp->mem_map_handle)) return (mem_handle){0};
-  void *data = malloc(size);
-  if (!data) return (mem_handle){0};
-  mem_handle result = {.allocator = allocator, .data = data, .size = size};
-  bool mapset_success = map_set(tblp->mem_map_handle, data, result);
-  if (!mapset_success) {
-    free(data);
-    return (mem_handle){0};
-  }
-  return result;
+  if (!tblp || !entry_size_fits(size)) return (mem_handle){0};
+  memtbl_entry *entry = malloc(ENTRY_HEADER_SIZE + size);
+  if (!entry) return (mem_handle){0};
+  entry->prev = tblp->last_entry;
+  entry->next = (memtbl_entry *)0;
+  entry->seq = tblp->next_seq++;
+  link_entry(tblp, entry);
+  return mem_handle_make(data_for_entry(entry), size, allocator);
 }
 
 static mem_handle memtbl_realloc(mem_handle handle, size_t size) {
   if (!mem_is_valid(handle)) return (mem_handle){0};
-  memtbl *tblp = handle.allocator.allocator_data;
-  if (!tblp || !mem_is_valid(tblp->mem_map_handle)) return (mem_handle){0};
-  void *old_data = mem_p(handle);
-  void *new_data = realloc(old_data, size);
-  if (!new_data) return (mem_handle){0};
-  mem_handle result = {
-      .allocator = handle.allocator, .data = new_data, .size = size};
-  // (old_data may be free'd by realloc but we only use it as a hash key here.
-  // Static analyzers will complain.)
-  if (new_data != old_data) {
-    if (!map_set(tblp->mem_map_handle, new_data, result) ||
-        !map_delete(tblp->mem_map_handle, old_data)) {
-      free(new_data);
-      return (mem_handle){0};
-    }
-  }
-  return result;
+  memtbl *tblp = mem_handle_allocator(handle).allocator_data;
+  if (!tblp || !entry_size_fits(size)) return (mem_handle){0};
+  memtbl_entry *new_entry =
+      realloc(entry_for_data(handle.data), ENTRY_HEADER_SIZE + size);
+  if (!new_entry) return (mem_handle){0};
+  // The entry keeps its place in the list. Its neighbors need the new address
+  // if realloc moved it.
+  link_entry(tblp, new_entry);
+  return mem_handle_make(data_for_entry(new_entry), size, tblp->allocator);
 }
 
 static mem_handle memtbl_free(mem_handle handle) {
   if (!mem_is_valid(handle)) return (mem_handle){0};
-  memtbl *tblp = handle.allocator.allocator_data;
-  if (!tblp || !mem_is_valid(tblp->mem_map_handle)) return (mem_handle){0};
-  void *data = mem_p(handle);
-  map_delete(tblp->mem_map_handle, data);
-  free(data);
+  memtbl *tblp = mem_handle_allocator(handle).allocator_data;
+  if (!tblp) return (mem_handle){0};
+  memtbl_entry *entry = entry_for_data(handle.data);
+  unlink_entry(tblp, entry);
+  free(entry);
   return (mem_handle){0};
 }
 
-static void *memtbl_p(mem_handle handle) {
-  if (!mem_is_valid(handle)) return (void *)0;
-  memtbl *tblp = handle.allocator.allocator_data;
-  if (!tblp || !mem_is_valid(tblp->mem_map_handle)) return (void *)0;
-  mem_handle result = map_get(tblp->mem_map_handle, handle.data);
-  // Don't use mem_p here! result = handle if it's in the table, or is invalid
-  // if it's not.
-  return result.data;
-}
-
 static const mem_allocator_spec MEMTBL_ALLOCATOR_SPEC =
     (mem_allocator_spec){.allocator_type = MEM_ALLOCATOR_TYPE_MEMTBL,
                          .alloc_func = memtbl_alloc,
                          .realloc_func = memtbl_realloc,
-                         .free_func = memtbl_free,
-                         .p_func = memtbl_p};
+                         .free_func = memtbl_free};
 
 inline mem_allocator mem_allocator_memtbl(memtbl_handle mth) {
-  return (mem_allocator){.allocator_spec = &MEMTBL_ALLOCATOR_SPEC,
-                         .allocator_data = mth.data};
+  if (!mth.data) {
+    return (mem_allocator){.allocator_spec = &MEMTBL_ALLOCATOR_SPEC};
+  }
+  return ((memtbl *)mth.data)->allocator;
+}
+
+memtbl_checkpoint memtbl_mark(memtbl_handle mthandle) {
+  if (!memtbl_is_valid(mthandle)) return (memtbl_checkpoint){0};
+  return (memtbl_checkpoint){.seq = ((memtbl *)mem_p(mthandle))->next_seq};
+}
+
+void memtbl_rewind(memtbl_handle mthandle, memtbl_checkpoint checkpoint) {
+  if (!memtbl_is_valid(mthandle)) return;
+  memtbl *tblp = mem_p(mthandle);
+  mem_sigint_defer_begin();
+  // New entries are added at the end of the list, and realloc keeps an
+  // entry's place, so the entries after the checkpoint are a suffix.
+  memtbl_entry *entry = tblp->last_entry;
+  while (entry && entry->seq >= checkpoint.seq) {
+    memtbl_entry *prev = entry->prev;
+    unlink_entry(tblp, entry);
+    free(entry);
+    entry = prev;
+  }
+  mem_sigint_defer_end();
 }
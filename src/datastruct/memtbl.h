@@ -1,7 +1,5 @@
-#include "map.h"
-#include "mem.h"
-
 /**
+ * @file memtbl.h
  * @brief A memory allocator that remembers allocations, and frees all when
  * destroyed.
  *
@@ -18,18 +16,64 @@
  *
  * This is intended to be used in combination with a SIGINT handler and longjmp
  * to abort an operation cleanly. `mem_alloc` et al. are atomic with respect to
- * the SIGINT handler, so the memtbl remains in a consistent state.
+ * a SIGINT handler set with `mem_set_sigint_handler`, so the memtbl remains in
+ * a consistent state.
+ *
+ * Each allocation is prefixed with a small header that links it into a list
+ * owned by the table. Accessing memtbl memory with `mem_p` is O(1), and
+ * destroying a table walks the list once.
+ *
+ * A checkpoint releases only the allocations made after it, and leaves the
+ * table valid for further use:
+ *
+ *   memtbl_checkpoint cp = memtbl_mark(mth);
+ *   if (setjmp(abort_transfer)) {
+ *     memtbl_rewind(mth, cp);  // frees only what the transfer allocated
+ *     return;
+ *   }
+ *   ...
+ *
+ * Rewinding takes time proportional to the number of allocations made since
+ * the checkpoint that are still live. Checkpoints nest: rewinding to an outer
+ * checkpoint also releases everything after an inner one.
  *
  * A memory table does not know about destructors, and as such is only suitable
  * for Plain Old Data objects. A memory table can be the allocator for another
  * memory table. Naturally, the topmost memory table must use a plain allocator.
  */
 
+#ifndef DATASTRUCT_MEMTBL_H
+#define DATASTRUCT_MEMTBL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "mem.h"
+
+// Internal type for the header of a memtbl allocation
+typedef struct memtbl_entry memtbl_entry;
+
 // A memory table. Create with `memtbl_create`, destroy with `memtbl_destroy`.
 typedef struct memtbl {
-  map_handle mem_map_handle;
+  // The oldest allocation in the table, or null
+  memtbl_entry *first_entry;
+
+  // The newest allocation in the table, or null
+  memtbl_entry *last_entry;
+
+  // This table as an allocator
+  mem_allocator allocator;
+
+  // The sequence number of the next allocation
+  uint64_t next_seq;
 } memtbl;
 
+// A point in the allocation history of a memtbl. See `memtbl_mark`.
+typedef struct memtbl_checkpoint {
+  // The sequence number of the first allocation after the checkpoint
+  uint64_t seq;
+} memtbl_checkpoint;
+
 // Handle for a memtbl.
 typedef mem_handle memtbl_handle;
 
@@ -63,3 +107,29 @@ void memtbl_destroy(memtbl_handle mthandle);
  * @returns a `mem_allocator` that uses a given memtbl.
  */
 mem_allocator mem_allocator_memtbl(memtbl_handle mthandle);
+
+/**
+ * @brief Marks a checkpoint in a memory table.
+ *
+ * @param mthandle Handle of the memory table
+ * @return memtbl_checkpoint The checkpoint, for use with `memtbl_rewind`
+ */
+memtbl_checkpoint memtbl_mark(memtbl_handle mthandle);
+
+/**
+ * @brief Frees all allocations made after a checkpoint.
+ *
+ * Allocations made before the checkpoint are untouched, even if they were
+ * reallocated after it. Handles for the freed allocations must be discarded.
+ * As with `memtbl_destroy`, a child memtbl allocated after the checkpoint is
+ * freed without freeing its own allocations.
+ *
+ * This is atomic with respect to a SIGINT handler set with
+ * `mem_set_sigint_handler`.
+ *
+ * @param mthandle Handle of the memory table
+ * @param checkpoint A checkpoint returned by `memtbl_mark` for this table
+ */
+void memtbl_rewind(memtbl_handle mthandle, memtbl_checkpoint checkpoint);
+
+#endif
@@ -0,0 +1,388 @@
+#ifdef LINUX
+// For mremap and MADV_HUGEPAGE
+#define _GNU_SOURCE
+#endif
+
+#include "mmap.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef WINDOWS
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "mem.h"
+
+extern const mem_allocator_spec _datastruct_mmap_huge_allocator_spec;
+extern const mem_allocator_spec _datastruct_file_allocator_spec;
+
+static bool is_mapped(size_t size) {
+  return size >= MMAP_MIN_SIZE;
+}
+
+#ifdef WINDOWS
+
+static void *map_pages(size_t size, bool huge) {
+  (void)huge;
+  return malloc(size);
+}
+
+static void *remap_pages(void *data, size_t old_size, size_t size, bool huge) {
+  (void)old_size;
+  (void)huge;
+  return realloc(data, size);
+}
+
+static void unmap_pages(void *data, size_t size) {
+  (void)size;
+  free(data);
+}
+
+#else
+
+/**
+ * @brief Rounds a size up to a whole number of pages.
+ */
+static size_t page_round(size_t size) {
+  static size_t page_size = 0;
+  if (!page_size) page_size = (size_t)sysconf(_SC_PAGESIZE);
+  return (size + page_size - 1) & ~(page_size - 1);
+}
+
+static void advise_huge(void *data, size_t size, bool huge) {
+#ifdef MADV_HUGEPAGE
+  if (huge) madvise(data, page_round(size), MADV_HUGEPAGE);
+#else
+  (void)data;
+  (void)size;
+  (void)huge;
+#endif
+}
+
+/**
+ * @brief Maps new anonymous pages.
+ *
+ * @param size The size of the allocation, not rounded
+ * @param huge true to request transparent huge pages
+ * @return void* The address of the pages, or null on failure
+ */
+static void *map_pages(size_t size, bool huge) {
+  void *data = mmap(NULL, page_round(size), PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (data == MAP_FAILED) return NULL;
+  advise_huge(data, size, huge);
+  return data;
+}
+
+/**
+ * @brief Resizes mapped pages, keeping their contents.
+ *
+ * On Linux, the kernel moves the pages if they cannot grow in place, without
+ * copying their contents. Elsewhere, growing copies the contents to new pages.
+ *
+ * @param data The address of the pages
+ * @param old_size The current size of the allocation, not rounded
+ * @param size The new size of the allocation, not rounded
+ * @param huge true to request transparent huge pages
+ * @return void* The new address of the pages, or null on failure. On failure,
+ *   the old pages are unchanged.
+ */
+static void *remap_pages(void *data, size_t old_size, size_t size, bool huge) {
+  size_t old_length = page_round(old_size);
+  size_t length = page_round(size);
+  if (length == old_length) return data;
+#ifdef MREMAP_MAYMOVE
+  void *result = mremap(data, old_length, length, MREMAP_MAYMOVE);
+  if (result == MAP_FAILED) return NULL;
+  if (length > old_length) advise_huge(result, size, huge);
+  return result;
+#else
+  if (length < old_length) {
+    munmap((char *)data + length, old_length - length);
+    return data;
+  }
+  void *result = map_pages(size, huge);
+  if (!result) return NULL;
+  memcpy(result, data, old_size);
+  munmap(data, old_length);
+  return result;
+#endif
+}
+
+static void unmap_pages(void *data, size_t size) {
+  munmap(data, page_round(size));
+}
+
+#endif
+
+static bool is_huge(mem_handle handle) {
+  return mem_handle_allocator(handle).allocator_spec ==
+         &_datastruct_mmap_huge_allocator_spec;
+}
+
+static mem_handle do_alloc(mem_allocator allocator, size_t size, bool huge) {
+  void *data = is_mapped(size) ? map_pages(size, huge) : malloc(size);
+  return mem_handle_make(data, size, allocator);
+}
+
+static mem_handle mmap_alloc(mem_allocator allocator, size_t size) {
+  return do_alloc(allocator, size, false);
+}
+
+static mem_handle mmap_huge_alloc(mem_allocator allocator, size_t size) {
+  return do_alloc(allocator, size, true);
+}
+
+static mem_handle mmap_free(mem_handle handle) {
+  size_t size = mem_size(handle);
+  if (is_mapped(size)) {
+    unmap_pages(handle.data, size);
+  } else {
+    free(handle.data);
+  }
+  return (mem_handle){0};
+}
+
+static mem_handle mmap_realloc(mem_handle handle, size_t size) {
+  if (!mem_is_valid(handle)) return (mem_handle){0};
+  mem_allocator allocator = mem_handle_allocator(handle);
+  size_t old_size = mem_size(handle);
+  void *data;
+  if (is_mapped(old_size) && is_mapped(size)) {
+    data = remap_pages(handle.data, old_size, size, is_huge(handle));
+  } else if (!is_mapped(old_size) && !is_mapped(size)) {
+    data = realloc(handle.data, size);
+  } else {
+    // Moving between malloc and mapped pages.
+    mem_handle result = do_alloc(allocator, size, is_huge(handle));
+    if (!mem_is_valid(result)) return (mem_handle){0};
+    memcpy(result.data, handle.data, old_size < size ? old_size : size);
+    mmap_free(handle);
+    return result;
+  }
+  return mem_handle_make(data, size, allocator);
+}
+
+const mem_allocator_spec _datastruct_mmap_allocator_spec =
+    (mem_allocator_spec){.allocator_type = MEM_ALLOCATOR_TYPE_MMAP,
+                         .alloc_func = mmap_alloc,
+                         .realloc_func = mmap_realloc,
+                         .free_func = mmap_free};
+
+const mem_allocator_spec _datastruct_mmap_huge_allocator_spec =
+    (mem_allocator_spec){.allocator_type = MEM_ALLOCATOR_TYPE_MMAP,
+                         .alloc_func = mmap_huge_alloc,
+                         .realloc_func = mmap_realloc,
+                         .free_func = mmap_free};
+
+#ifdef WINDOWS
+
+static mem_handle file_free(mem_handle handle) {
+  free(handle.data);
+  return (mem_handle){0};
+}
+
+#else
+
+static mem_handle file_free(mem_handle handle) {
+  munmap(handle.data, mem_size(handle));
+  return (mem_handle){0};
+}
+
+#endif
+
+// Files can only be mapped and unmapped.
+const mem_allocator_spec _datastruct_file_allocator_spec =
+    (mem_allocator_spec){.allocator_type = MEM_ALLOCATOR_TYPE_FILE,
+                         .free_func = file_free};
+
+#ifdef DATASTRUCT_COMPACT_HANDLE
+
+const mem_allocator MEM_ALLOCATOR_MMAP =
+    (mem_allocator){.allocator_spec = &_datastruct_mmap_allocator_spec,
+                    .allocator_id = _DATASTRUCT_MMAP_ID};
+
+const mem_allocator MEM_ALLOCATOR_MMAP_HUGE =
+    (mem_allocator){.allocator_spec = &_datastruct_mmap_huge_allocator_spec,
+                    .allocator_id = _DATASTRUCT_MMAP_HUGE_ID};
+
+static const mem_allocator FILE_ALLOCATOR =
+    (mem_allocator){.allocator_spec = &_datastruct_file_allocator_spec,
+                    .allocator_id = _DATASTRUCT_FILE_ID};
+
+#else
+
+const mem_allocator MEM_ALLOCATOR_MMAP =
+    (mem_allocator){.allocator_spec = &_datastruct_mmap_allocator_spec};
+
+const mem_allocator MEM_ALLOCATOR_MMAP_HUGE =
+    (mem_allocator){.allocator_spec = &_datastruct_mmap_huge_allocator_spec};
+
+static const mem_allocator FILE_ALLOCATOR =
+    (mem_allocator){.allocator_spec = &_datastruct_file_allocator_spec};
+
+#endif
+
+// The contents of an empty file.
+static char EMPTY_FILE[1];
+
+/**
+ * @brief Doubles the size of a buffer that a file is being read into.
+ *
+ * @param buf The buffer, which is freed on failure
+ * @return true on success
+ */
+static bool grow_read_buffer(mem_handle *buf) {
+  size_t size = mem_size(*buf);
+  mem_handle result = (mem_handle){0};
+  if (size <= MEM_HANDLE_MAX_SIZE / 2) result = mem_realloc(*buf, size * 2);
+  if (!mem_is_valid(result)) {
+    mem_free(*buf);
+    return false;
+  }
+  *buf = result;
+  return true;
+}
+
+/**
+ * @brief Shrinks a buffer that a file was read into to the size read.
+ *
+ * @param buf The buffer
+ * @param size The number of bytes read
+ * @return mem_handle The contents, or an invalid handle on failure, when the
+ *   buffer is freed
+ */
+static mem_handle finish_read_buffer(mem_handle buf, size_t size) {
+  if (size == 0) {
+    mem_free(buf);
+    return mem_handle_from_ptr(EMPTY_FILE, 0);
+  }
+  mem_handle result = mem_realloc(buf, size);
+  if (!mem_is_valid(result)) mem_free(buf);
+  return result;
+}
+
+#ifdef WINDOWS
+
+/**
+ * @brief Reads the rest of a stream that cannot seek, such as a pipe, into
+ * allocated memory.
+ *
+ * @param infile The stream
+ * @return mem_handle The contents, or an invalid handle on failure
+ */
+static mem_handle read_stream(FILE *infile) {
+  mem_handle buf = mem_alloc(MEM_ALLOCATOR_MMAP, MMAP_MIN_SIZE);
+  size_t size = 0;
+  while (mem_is_valid(buf)) {
+    if (size == mem_size(buf) && !grow_read_buffer(&buf)) break;
+    size += fread((char *)mem_p(buf) + size, 1, mem_size(buf) - size, infile);
+    if (ferror(infile)) {
+      mem_free(buf);
+      break;
+    }
+    if (feof(infile)) return finish_read_buffer(buf, size);
+  }
+  return (mem_handle){0};
+}
+
+mem_handle mem_handle_from_file(const char *path) {
+  FILE *infile = fopen(path, "rb");
+  if (!infile) return (mem_handle){0};
+  mem_handle result = (mem_handle){0};
+  long size = -1;
+  if (fseek(infile, 0, SEEK_END) == 0) size = ftell(infile);
+  if (size < 0) {
+    result = read_stream(infile);
+  } else if (size == 0) {
+    result = mem_handle_from_ptr(EMPTY_FILE, 0);
+  } else if ((size_t)size <= MEM_HANDLE_MAX_SIZE &&
+             fseek(infile, 0, SEEK_SET) == 0) {
+    void *data = malloc(size);
+    if (data && fread(data, 1, size, infile) == (size_t)size) {
+      result = mem_handle_make(data, size, FILE_ALLOCATOR);
+    } else {
+      free(data);
+    }
+  }
+  fclose(infile);
+  return result;
+}
+
+void mem_handle_advise_random(mem_handle handle) {
+  (void)handle;
+}
+
+#else
+
+/**
+ * @brief Reads the rest of a file that cannot be mapped, such as a pipe, into
+ * allocated memory.
+ *
+ * @param fd The file descriptor
+ * @return mem_handle The contents, or an invalid handle on failure
+ */
+static mem_handle read_fd(int fd) {
+  mem_handle buf = mem_alloc(MEM_ALLOCATOR_MMAP, MMAP_MIN_SIZE);
+  size_t size = 0;
+  while (mem_is_valid(buf)) {
+    if (size == mem_size(buf) && !grow_read_buffer(&buf)) break;
+    ssize_t count = read(fd, (char *)mem_p(buf) + size, mem_size(buf) - size);
+    if (count == 0) return finish_read_buffer(buf, size);
+    if (count > 0) {
+      size += (size_t)count;
+    } else if (errno != EINTR) {
+      mem_free(buf);
+      break;
+    }
+  }
+  return (mem_handle){0};
+}
+
+mem_handle mem_handle_from_file(const char *path) {
+  int fd = open(path, O_RDONLY);
+  if (fd == -1) return (mem_handle){0};
+  struct stat st;
+  mem_handle result = (mem_handle){0};
+  if (fstat(fd, &st) == -1) {
+    close(fd);
+    return result;
+  }
+  // Pipes, terminals and files that report no size, such as those in /proc,
+  // are read instead.
+  size_t size = (size_t)st.st_size;
+  if (S_ISREG(st.st_mode) && size > 0) {
+    void *data = size <= MEM_HANDLE_MAX_SIZE
+                     ? mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0)
+                     : MAP_FAILED;
+    if (data != MAP_FAILED) {
+      madvise(data, size, MADV_SEQUENTIAL);
+      madvise(data, size, MADV_WILLNEED);
+      result = mem_handle_make(data, size, FILE_ALLOCATOR);
+    }
+  } else if (!S_ISDIR(st.st_mode)) {
+    result = read_fd(fd);
+  }
+  // The mapping stays valid after the file is closed.
+  close(fd);
+  return result;
+}
+
+void mem_handle_advise_random(mem_handle handle) {
+  if (!mem_is_valid(handle) || mem_size(handle) == 0 ||
+      mem_handle_allocator(handle).allocator_spec !=
+          &_datastruct_file_allocator_spec) {
+    return;
+  }
+  madvise(mem_p(handle), mem_size(handle), MADV_RANDOM);
+}
+
+#endif
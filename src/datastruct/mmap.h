@@ -0,0 +1,90 @@
+/**
+ * @file mmap.h
+ * @brief An allocator for large buffers that grow in place, and memory-mapped
+ * files.
+ *
+ *   strbuf_handle buf = strbuf_create(MEM_ALLOCATOR_MMAP, 64);
+ *   for (...) strbuf_concatenate_str(buf, line);  // no copying once large
+ *   strbuf_destroy(buf);
+ *
+ * The mmap allocator requests allocations of at least `MMAP_MIN_SIZE` bytes
+ * directly from the operating system as whole pages. Reallocating such an
+ * allocation remaps its pages with `mremap` instead of copying its contents,
+ * so a buffer that grows to many megabytes is never copied. This suits large
+ * strbufs, such as the contents of a file, and other objects whose size is
+ * not known in advance.
+ *
+ * Smaller allocations use malloc, so an object can start small and use the
+ * mmap allocator throughout its lifetime. Growing past `MMAP_MIN_SIZE` copies
+ * the contents once.
+ *
+ * `MEM_ALLOCATOR_MMAP_HUGE` also asks the kernel to back the pages with
+ * transparent huge pages, which reduces TLB misses when scanning very large
+ * buffers. The kernel may ignore the request.
+ *
+ * `mremap` and transparent huge pages are Linux features. On other POSIX
+ * systems, growing a mapping copies its contents to new pages. On Windows, both
+ * allocators behave like `MEM_ALLOCATOR_PLAIN`.
+ *
+ * `mem_handle_from_file` maps a file read-only and returns a handle to its
+ * contents, so that parsers can scan the file without copying it:
+ *
+ *   str text = mem_handle_from_file("words.txt");  // or str_from_file
+ *   if (!str_is_valid(text)) abort();
+ *   ...
+ *   mem_free(text);  // unmaps the file
+ */
+
+#ifndef DATASTRUCT_MMAP_H
+#define DATASTRUCT_MMAP_H
+
+#include "mem.h"
+
+// The smallest allocation that the mmap allocators map from the operating
+// system, in bytes. Smaller allocations use malloc.
+#define MMAP_MIN_SIZE 131072
+
+// Allocators that map large allocations from the operating system.
+extern const mem_allocator MEM_ALLOCATOR_MMAP;
+extern const mem_allocator MEM_ALLOCATOR_MMAP_HUGE;
+
+/**
+ * @brief Maps a file into memory, read-only.
+ *
+ * The handle refers to the contents of the file, and can be used as a str.
+ * The memory must not be written. `mem_free` unmaps the file. `mem_realloc`
+ * fails.
+ *
+ * The mapping is advised for sequential access, so that the kernel reads
+ * ahead of a scan from start to end. Pages are loaded as they are accessed.
+ * If the file is truncated while it is mapped, accessing the missing pages
+ * raises SIGBUS.
+ *
+ * A file that cannot be mapped, such as a pipe, a terminal, or `/dev/stdin`
+ * when it is one of these, is read to its end into memory from
+ * `MEM_ALLOCATOR_MMAP` instead, which `mem_free` also frees.
+ *
+ * An empty file returns a valid handle of size 0 that does not need to be
+ * freed. On Windows, this reads the file into allocated memory instead.
+ *
+ * @param path The path to the file
+ * @return mem_handle The handle for the contents, or an invalid handle if the
+ *   file could not be opened or read
+ */
+mem_handle mem_handle_from_file(const char *path);
+
+/**
+ * @brief Advises the mapping of a file for random access.
+ *
+ * Use this after a first pass over a file from `mem_handle_from_file`, when
+ * the rest of its use is lookups at scattered offsets, so that the kernel
+ * neither reads the whole file ahead nor drops pages behind the reads.
+ *
+ * This does nothing on Windows, where the file was read into memory, or if
+ * the handle is not a mapped file.
+ *
+ * @param handle The handle from `mem_handle_from_file`
+ */
+void mem_handle_advise_random(mem_handle handle);
+
+#endif
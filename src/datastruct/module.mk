@@ -0,0 +1,97 @@
+# Benchmarks for the datastruct module. These are not built by `make` or
+# `make check`. To build and run them:
+#
+#   make bench
+
+EXTRA_PROGRAMS = \
+    bench/bench_access \
+    bench/bench_cmap \
+    bench/bench_handle \
+    bench/bench_hash \
+    bench/bench_intern \
+    bench/bench_map \
+    bench/bench_map_latency \
+    bench/bench_mapfile \
+    bench/bench_mem \
+    bench/bench_memtbl \
+    bench/bench_mmap \
+    bench/bench_slab \
+    bench/bench_str \
+    bench/bench_strarena
+
+bench_bench_access_SOURCES = \
+    bench/datastruct/bench_access.c \
+    bench/bench.h
+bench_bench_access_LDADD = libdatastruct.la
+
+bench_bench_cmap_SOURCES = \
+    bench/datastruct/bench_cmap.c \
+    bench/bench.h
+bench_bench_cmap_LDADD = libdatastruct.la
+
+bench_bench_handle_SOURCES = \
+    bench/datastruct/bench_handle.c \
+    bench/bench.h
+bench_bench_handle_LDADD = libdatastruct.la
+
+bench_bench_hash_SOURCES = \
+    bench/datastruct/bench_hash.c \
+    bench/bench.h
+bench_bench_hash_LDADD = libdatastruct.la
+
+bench_bench_intern_SOURCES = \
+    bench/datastruct/bench_intern.c \
+    bench/bench.h
+bench_bench_intern_LDADD = libdatastruct.la
+
+bench_bench_map_SOURCES = \
+    bench/datastruct/bench_map.c \
+    bench/bench.h
+bench_bench_map_LDADD = libdatastruct.la
+
+bench_bench_map_latency_SOURCES = \
+    bench/datastruct/bench_map_latency.c \
+    bench/bench.h
+bench_bench_map_latency_LDADD = libdatastruct.la
+
+bench_bench_mapfile_SOURCES = \
+    bench/datastruct/bench_mapfile.c \
+    bench/bench.h
+bench_bench_mapfile_LDADD = libdatastruct.la
+
+bench_bench_mem_SOURCES = \
+    bench/datastruct/bench_mem.c \
+    bench/bench.h
+bench_bench_mem_LDADD = libdatastruct.la
+
+bench_bench_memtbl_SOURCES = \
+    bench/datastruct/bench_memtbl.c \
+    bench/bench.h
+bench_bench_memtbl_LDADD = libdatastruct.la
+
+bench_bench_mmap_SOURCES = \
+    bench/datastruct/bench_mmap.c \
+    bench/bench.h
+bench_bench_mmap_LDADD = libdatastruct.la
+
+bench_bench_slab_SOURCES = \
+    bench/datastruct/bench_slab.c \
+    bench/bench.h
+bench_bench_slab_LDADD = libdatastruct.la
+
+bench_bench_str_SOURCES = \
+    bench/datastruct/bench_str.c \
+    bench/bench.h
+bench_bench_str_LDADD = libdatastruct.la
+
+bench_bench_strarena_SOURCES = \
+    bench/datastruct/bench_strarena.c \
+    bench/bench.h
+bench_bench_strarena_LDADD = libdatastruct.la
+
+CLEANFILES += $(EXTRA_PROGRAMS)
+
+bench: $(EXTRA_PROGRAMS)
+	@for prog in $(EXTRA_PROGRAMS); do echo "### $$prog"; ./$$prog || exit 1; done
+
+.PHONY: bench
@@ -0,0 +1,195 @@
+/**
+ * @file rhtable.h
+ * @brief Internal: the Robin Hood hash table core shared by map and tmap.
+ *
+ * A table is an array of fixed-size slots, a power of two of them. Each slot
+ * starts with an `rh_meta`, and the rest of the slot belongs to the table's
+ * owner: a `map` index slot holds the position of an entry, and a `tmap` slot
+ * holds the entry itself. The owner picks each key's home slot from its hash,
+ * and compares keys. This file finds, places, and removes slots, so that both
+ * maps probe the same way and resize at the same loads.
+ *
+ * Robin Hood insertion lets a slot with a longer probe take the place of a
+ * slot with a shorter one, and the displaced slot continues probing. This
+ * keeps probe lengths short and even, so a probe for a key that is not in the
+ * table stops early. Deletion shifts the following slots back, so probes have
+ * no gaps and no tombstones are needed.
+ *
+ * The functions are inline so that each owner's key comparison and slot size
+ * are compiled into its probe loop.
+ */
+
+#ifndef DATASTRUCT_RHTABLE_H
+#define DATASTRUCT_RHTABLE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// The largest slot, in bytes
+#define RH_MAX_SLOT_SIZE 128
+
+// The metadata of a slot. The low 32 bits are the probe length of the slot:
+// its distance from its home slot, plus one. The probe length of an empty slot
+// is 0. The high 32 bits are the high 32 bits of the key hash of the slot, so
+// that a probe rarely compares a key that does not match.
+typedef uint64_t rh_meta;
+
+// Storage for a slot while it is moved
+typedef union rh_slot_buf {
+  max_align_t align;
+  rh_meta meta;
+  unsigned char bytes[RH_MAX_SLOT_SIZE];
+} rh_slot_buf;
+
+// The result of probing a table for a key.
+typedef struct rh_probe {
+  // true if the key is in the table
+  bool found;
+
+  // The position of the key's slot, or the position where a new slot for the
+  // key belongs
+  unsigned int pos;
+
+  // The metadata the key has at that position
+  rh_meta key_meta;
+} rh_probe;
+
+// Tests whether a slot, whose metadata matches a key's, has the key.
+typedef bool rh_slot_has_key(const void *slot, const void *key);
+
+static inline rh_meta rh_make_meta(uint64_t key_hash, uint32_t probe_length) {
+  return (key_hash & 0xffffffff00000000) | probe_length;
+}
+
+static inline uint32_t rh_probe_length(rh_meta meta) {
+  return (uint32_t)meta;
+}
+
+/**
+ * @brief Gets the number of keys a table can hold before it grows.
+ *
+ * Robin Hood probing keeps probe lengths short up to a load factor of 7/8.
+ *
+ * @param table_size The number of slots in the table
+ * @return unsigned int The maximum number of keys
+ */
+static inline unsigned int rh_max_count(unsigned int table_size) {
+  return table_size - table_size / 8;
+}
+
+/**
+ * @brief Tests whether a table should shrink to half its size.
+ *
+ * A table shrinks below 1/8 full, which leaves the halved table 1/4 full. A
+ * table grows at 7/8 full, which leaves the doubled table 7/16 full. The gap
+ * between these keeps a churn of adds and deletes near either threshold from
+ * growing and shrinking the table over and over.
+ *
+ * @param count The number of keys
+ * @param table_size The number of slots in the table
+ * @param min_table_size The size of a new table, which is never shrunk
+ * @return true if the table should shrink
+ */
+static inline bool rh_should_shrink(unsigned int count, unsigned int table_size,
+                                    unsigned int min_table_size) {
+  return count < table_size / 8 && table_size > min_table_size;
+}
+
+static inline rh_meta *rh_slot(void *slots, size_t slot_size,
+                               unsigned int pos) {
+  return (rh_meta *)((unsigned char *)slots + pos * slot_size);
+}
+
+/**
+ * @brief Probes a table for the slot of a key.
+ *
+ * The probe stops at a slot whose probe length is shorter than the key's
+ * would be there. Robin Hood insertion would have put the key in that slot,
+ * so the key is not further along, and a new slot for the key goes there.
+ *
+ * @param slots The table
+ * @param slot_size The size of a slot
+ * @param table_size The number of slots, a power of two
+ * @param home_pos The key's home slot
+ * @param key_hash The hash of the key
+ * @param has_key Compares a slot with the key
+ * @param key The key, passed to has_key
+ * @return rh_probe The result
+ */
+static inline rh_probe rh_find(void *slots, size_t slot_size,
+                               unsigned int table_size, unsigned int home_pos,
+                               uint64_t key_hash, rh_slot_has_key *has_key,
+                               const void *key) {
+  unsigned int mask = table_size - 1;
+  unsigned int pos = home_pos;
+  rh_meta key_meta = rh_make_meta(key_hash, 1);
+  for (;;) {
+    rh_meta *slot = rh_slot(slots, slot_size, pos);
+    if (rh_probe_length(*slot) < rh_probe_length(key_meta)) break;
+    if (*slot == key_meta && has_key(slot, key)) {
+      return (rh_probe){.found = true, .pos = pos, .key_meta = key_meta};
+    }
+    pos = (pos + 1) & mask;
+    ++key_meta;
+  }
+  return (rh_probe){.found = false, .pos = pos, .key_meta = key_meta};
+}
+
+/**
+ * @brief Places a slot for a key that is not yet in a table, partway along
+ * its probe.
+ *
+ * @param slots The table, with at least one empty slot
+ * @param slot_size The size of a slot
+ * @param table_size The number of slots, a power of two
+ * @param pos A position on the key's probe. No slot before it on the probe
+ *   has a shorter probe length than the key would.
+ * @param carry The new slot, with its metadata for that position. This is
+ *   used to carry displaced slots, and is overwritten.
+ */
+static inline void rh_place(void *slots, size_t slot_size,
+                            unsigned int table_size, unsigned int pos,
+                            rh_slot_buf *carry) {
+  unsigned int mask = table_size - 1;
+  rh_slot_buf resident;
+  rh_meta *slot = rh_slot(slots, slot_size, pos);
+  while (*slot) {
+    if (rh_probe_length(*slot) < rh_probe_length(carry->meta)) {
+      memcpy(resident.bytes, slot, slot_size);
+      memcpy(slot, carry->bytes, slot_size);
+      memcpy(carry->bytes, resident.bytes, slot_size);
+    }
+    pos = (pos + 1) & mask;
+    ++carry->meta;
+    slot = rh_slot(slots, slot_size, pos);
+  }
+  memcpy(slot, carry->bytes, slot_size);
+}
+
+/**
+ * @brief Removes a slot from a table, and clears the slot left empty.
+ *
+ * Each following slot that is not in its home slot moves back by one.
+ *
+ * @param slots The table
+ * @param slot_size The size of a slot
+ * @param table_size The number of slots, a power of two
+ * @param pos The position of the slot
+ */
+static inline void rh_remove(void *slots, size_t slot_size,
+                             unsigned int table_size, unsigned int pos) {
+  unsigned int mask = table_size - 1;
+  unsigned int next = (pos + 1) & mask;
+  while (rh_probe_length(*rh_slot(slots, slot_size, next)) > 1) {
+    rh_meta *slot = rh_slot(slots, slot_size, pos);
+    memcpy(slot, rh_slot(slots, slot_size, next), slot_size);
+    --*slot;
+    pos = next;
+    next = (next + 1) & mask;
+  }
+  memset(rh_slot(slots, slot_size, pos), 0, slot_size);
+}
+
+#endif
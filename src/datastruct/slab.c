@@ -0,0 +1,214 @@
+#include "slab.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "mem.h"
+
+static const mem_allocator_spec SLAB_ALLOCATOR_SPEC;
+
+static const size_t CLASS_OBJECT_SIZES[SLAB_CLASS_COUNT] = {16, 32,  48,  64,
+                                                            96, 128, 192, 256};
+
+struct slab_page {
+  // The next page of the same size class
+  slab_page *next;
+
+  // The memory for this page, including this header
+  mem_handle page_mh;
+};
+
+// Size of the page header, rounded up so that objects are aligned.
+#define PAGE_HEADER_SIZE                             \
+  ((sizeof(slab_page) + _Alignof(max_align_t) - 1) & \
+   ~(_Alignof(max_align_t) - 1))
+
+/**
+ * @brief Finds the size class for an allocation size.
+ *
+ * @param size The allocation size, at most SLAB_MAX_OBJECT_SIZE
+ * @return unsigned int The index of the smallest class that fits
+ */
+static unsigned int class_for_size(size_t size) {
+  // Maps (size - 1) / 16 to a class index.
+  static const unsigned char CLASS_FOR_SIXTEENTHS[16] = {
+      0, 1, 2, 3, 4, 4, 5, 5, 6, 6, 6, 6, 7, 7, 7, 7};
+  return size ? CLASS_FOR_SIXTEENTHS[(size - 1) / 16] : 0;
+}
+
+static bool is_large(size_t size) {
+  return size > SLAB_MAX_OBJECT_SIZE;
+}
+
+slab_handle slab_create(mem_allocator allocator) {
+  slab_handle sh = mem_alloc(allocator, sizeof(slab));
+  if (!mem_is_valid(sh)) return (slab_handle){0};
+  slab *sp = mem_p(sh);
+  sp->parent_allocator = allocator;
+  sp->large_in_use = 0;
+  for (unsigned int i = 0; i < SLAB_CLASS_COUNT; i++) {
+    sp->classes[i] = (slab_class){.object_size = CLASS_OBJECT_SIZES[i]};
+  }
+  sp->allocator = (mem_allocator){.allocator_spec = &SLAB_ALLOCATOR_SPEC,
+                                  .allocator_data = sp};
+  if (!mem_allocator_register(&sp->allocator)) {
+    mem_free(sh);
+    return (slab_handle){0};
+  }
+  return sh;
+}
+
+bool slab_is_valid(slab_handle sh) {
+  return mem_is_valid(sh);
+}
+
+void slab_destroy(slab_handle sh) {
+  if (!slab_is_valid(sh)) return;
+  slab *sp = mem_p(sh);
+  for (unsigned int i = 0; i < SLAB_CLASS_COUNT; i++) {
+    slab_page *page = sp->classes[i].pages;
+    while (page) {
+      slab_page *next = page->next;
+      mem_free(page->page_mh);
+      page = next;
+    }
+  }
+  mem_allocator_unregister(sp->allocator);
+  mem_free(sh);
+}
+
+/**
+ * @brief Adds a page to a size class, to be carved into fresh objects.
+ *
+ * @param sp The slab
+ * @param cls The size class
+ * @return true on success
+ */
+static bool add_page(slab *sp, slab_class *cls) {
+  mem_handle page_mh = mem_alloc(sp->parent_allocator, SLAB_PAGE_SIZE);
+  if (!mem_is_valid(page_mh)) return false;
+  slab_page *page = mem_p(page_mh);
+  page->page_mh = page_mh;
+  page->next = cls->pages;
+  cls->pages = page;
+  cls->fresh_object = (char *)page + PAGE_HEADER_SIZE;
+  size_t objects = (SLAB_PAGE_SIZE - PAGE_HEADER_SIZE) / cls->object_size;
+  cls->fresh_end = cls->fresh_object + objects * cls->object_size;
+  cls->object_capacity += objects;
+  return true;
+}
+
+/**
+ * @brief Allocates memory from the parent allocator for a large allocation.
+ *
+ * The result is a handle for the slab allocator, so that `mem_free` and
+ * `mem_realloc` come back to the slab.
+ */
+static mem_handle large_alloc(mem_allocator allocator, size_t size) {
+  slab *sp = allocator.allocator_data;
+  mem_handle parent_mh = mem_alloc(sp->parent_allocator, size);
+  if (!mem_is_valid(parent_mh)) return (mem_handle){0};
+  ++sp->large_in_use;
+  return mem_handle_make(mem_p(parent_mh), size, allocator);
+}
+
+static mem_handle parent_handle(slab *sp, mem_handle handle) {
+  return mem_handle_make(handle.data, mem_size(handle), sp->parent_allocator);
+}
+
+static mem_handle slab_alloc(mem_allocator allocator, size_t size) {
+  slab *sp = allocator.allocator_data;
+  if (!sp) return (mem_handle){0};
+  if (is_large(size)) return large_alloc(allocator, size);
+
+  slab_class *cls = &sp->classes[class_for_size(size)];
+  void *data;
+  if (cls->free_list) {
+    data = cls->free_list;
+    cls->free_list = *(void **)data;
+  } else {
+    if (cls->fresh_object == cls->fresh_end && !add_page(sp, cls)) {
+      return (mem_handle){0};
+    }
+    data = cls->fresh_object;
+    cls->fresh_object += cls->object_size;
+  }
+  ++cls->objects_in_use;
+  return mem_handle_make(data, size, allocator);
+}
+
+static mem_handle slab_free(mem_handle handle) {
+  slab *sp = mem_handle_allocator(handle).allocator_data;
+  if (!sp) return (mem_handle){0};
+  if (is_large(handle.size)) {
+    mem_free(parent_handle(sp, handle));
+    --sp->large_in_use;
+    return (mem_handle){0};
+  }
+
+  slab_class *cls = &sp->classes[class_for_size(handle.size)];
+  *(void **)handle.data = cls->free_list;
+  cls->free_list = handle.data;
+  --cls->objects_in_use;
+  return (mem_handle){0};
+}
+
+static mem_handle slab_realloc(mem_handle handle, size_t size) {
+  if (!mem_is_valid(handle)) return (mem_handle){0};
+  slab *sp = mem_handle_allocator(handle).allocator_data;
+  if (!sp) return (mem_handle){0};
+
+  if (is_large(handle.size) && is_large(size)) {
+    mem_handle parent_mh = mem_realloc(parent_handle(sp, handle), size);
+    if (!mem_is_valid(parent_mh)) return (mem_handle){0};
+    return mem_handle_make(mem_p(parent_mh), size, sp->allocator);
+  }
+  if (!is_large(handle.size) && !is_large(size) &&
+      class_for_size(handle.size) == class_for_size(size)) {
+    handle.size = size;
+    return handle;
+  }
+
+  mem_handle result = slab_alloc(sp->allocator, size);
+  if (!mem_is_valid(result)) return (mem_handle){0};
+  memcpy(result.data, handle.data, handle.size < size ? handle.size : size);
+  slab_free(handle);
+  return result;
+}
+
+static const mem_allocator_spec SLAB_ALLOCATOR_SPEC =
+    (mem_allocator_spec){.allocator_type = MEM_ALLOCATOR_TYPE_SLAB,
+                         .alloc_func = slab_alloc,
+                         .realloc_func = slab_realloc,
+                         .free_func = slab_free};
+
+inline mem_allocator mem_allocator_slab(slab_handle sh) {
+  if (!sh.data) return (mem_allocator){.allocator_spec = &SLAB_ALLOCATOR_SPEC};
+  return ((slab *)sh.data)->allocator;
+}
+
+slab_class_stats slab_get_class_stats(slab_handle sh,
+                                      unsigned int class_index) {
+  if (!slab_is_valid(sh) || class_index >= SLAB_CLASS_COUNT) {
+    return (slab_class_stats){0};
+  }
+  slab_class *cls = &((slab *)mem_p(sh))->classes[class_index];
+  size_t page_count = 0;
+  for (slab_page *page = cls->pages; page; page = page->next) ++page_count;
+  return (slab_class_stats){.object_size = cls->object_size,
+                            .page_count = page_count,
+                            .objects_in_use = cls->objects_in_use,
+                            .object_capacity = cls->object_capacity};
+}
+
+double slab_utilization(slab_handle sh) {
+  if (!slab_is_valid(sh)) return 0.0;
+  slab *sp = mem_p(sh);
+  size_t used = 0, capacity = 0;
+  for (unsigned int i = 0; i < SLAB_CLASS_COUNT; i++) {
+    used += sp->classes[i].objects_in_use * sp->classes[i].object_size;
+    capacity += sp->classes[i].object_capacity * sp->classes[i].object_size;
+  }
+  return capacity ? (double)used / capacity : 0.0;
+}
@@ -0,0 +1,163 @@
+/**
+ * @file slab.h
+ * @brief A size-class allocator for small objects.
+ *
+ *   slab_handle sh = slab_create(MEM_ALLOCATOR_PLAIN);
+ *   if (!slab_is_valid(sh)) abort();
+ *   mem_allocator allocator = mem_allocator_slab(sh);
+ *
+ *   map_handle mh = map_create(allocator);
+ *   strbuf_handle buf = strbuf_create(allocator, 64);
+ *   ...
+ *   strbuf_destroy(buf);
+ *   map_destroy(mh);
+ *   slab_destroy(sh);
+ *
+ * A slab allocator rounds each small allocation up to one of a fixed set of
+ * size classes. Each size class carves objects out of large pages requested
+ * from the parent allocator, and keeps a free list of released objects.
+ * Allocating and freeing a small object is O(1), needs no call to malloc, and
+ * keeps objects of the same size close together in memory. This suits the
+ * small header structs of maps, strbufs, and memtbls, when many of them are
+ * live at once.
+ *
+ * Allocations larger than `SLAB_MAX_OBJECT_SIZE` are passed through to the
+ * parent allocator. The slab does not keep track of these. Free them before
+ * destroying the slab, or use a memtbl as the parent allocator.
+ *
+ * Destroying the slab returns all pages to the parent allocator, including
+ * pages with objects that were not freed.
+ */
+
+#ifndef DATASTRUCT_SLAB_H
+#define DATASTRUCT_SLAB_H
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "mem.h"
+
+// The number of size classes in a slab allocator.
+#define SLAB_CLASS_COUNT 8
+
+// The largest allocation served from slab pages, in bytes.
+#define SLAB_MAX_OBJECT_SIZE 256
+
+// The size of a slab page, in bytes.
+#define SLAB_PAGE_SIZE 65536
+
+// Internal type for a page of slab objects
+typedef struct slab_page slab_page;
+
+// Internal type for the free objects and pages of one size class
+typedef struct slab_class {
+  // The size of each object, in bytes
+  size_t object_size;
+
+  // Released objects available for reuse, linked through their first bytes
+  void *free_list;
+
+  // The pages owned by this class, newest first
+  slab_page *pages;
+
+  // The next object in the newest page that has never been allocated
+  char *fresh_object;
+
+  // The end of the newest page
+  char *fresh_end;
+
+  // The number of objects currently allocated
+  size_t objects_in_use;
+
+  // The number of objects that fit in all pages of this class
+  size_t object_capacity;
+} slab_class;
+
+// A slab allocator. Create with `slab_create`, destroy with `slab_destroy`.
+typedef struct slab {
+  // The allocator for pages and large allocations
+  mem_allocator parent_allocator;
+
+  // The size classes, smallest first
+  slab_class classes[SLAB_CLASS_COUNT];
+
+  // The number of large allocations passed through to the parent allocator
+  size_t large_in_use;
+
+  // This slab as an allocator
+  mem_allocator allocator;
+} slab;
+
+// Handle for a slab allocator.
+typedef mem_handle slab_handle;
+
+// Utilization statistics for one size class.
+typedef struct slab_class_stats {
+  // The size of each object, in bytes
+  size_t object_size;
+
+  // The number of pages allocated for this class
+  size_t page_count;
+
+  // The number of objects currently allocated
+  size_t objects_in_use;
+
+  // The number of objects that fit in this class's pages
+  size_t object_capacity;
+} slab_class_stats;
+
+/**
+ * @brief Creates a slab allocator.
+ *
+ * Use `slab_is_valid` to confirm that the slab is valid before using.
+ * Functions will fail gracefully if called with an invalid slab.
+ *
+ * @param allocator A memory allocator to use for the slab, its pages, and
+ *   large allocations
+ * @return slab_handle The slab, possibly invalid
+ */
+slab_handle slab_create(mem_allocator allocator);
+
+/**
+ * @param sh Handle of the slab
+ * @return true if the slab is valid
+ */
+bool slab_is_valid(slab_handle sh);
+
+/**
+ * @brief Destroys a slab allocator, releasing all of its pages.
+ *
+ * @param sh Handle of the slab to destroy
+ */
+void slab_destroy(slab_handle sh);
+
+/**
+ * @returns a `mem_allocator` that uses a given slab.
+ */
+mem_allocator mem_allocator_slab(slab_handle sh);
+
+/**
+ * @brief Gets utilization statistics for a size class.
+ *
+ * @param sh Handle of the slab
+ * @param class_index The size class, from 0 to `SLAB_CLASS_COUNT` - 1
+ * @return slab_class_stats The statistics, or all zeroes if the slab or
+ *   class_index is invalid
+ */
+slab_class_stats slab_get_class_stats(slab_handle sh,
+                                      unsigned int class_index);
+
+/**
+ * @brief Gets the fraction of slab page memory that is allocated.
+ *
+ * This is the number of bytes in allocated objects divided by the number of
+ * bytes available for objects in all pages. It does not include large
+ * allocations passed through to the parent allocator.
+ *
+ * @param sh Handle of the slab
+ * @return double The utilization, from 0.0 to 1.0, or 0.0 if there are no
+ *   pages
+ */
+double slab_utilization(slab_handle sh);
+
+#endif
@@ -1,13 +1,23 @@
 #include "str.h"
 
 #include <ctype.h>
+#include <limits.h>
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
 #include "mem.h"
+#include "mmap.h"
 
 #define STR_CSTR_BUFSIZE 1024
 static char STR_CSTR_BUFFER[STR_CSTR_BUFSIZE];
@@ -16,6 +26,10 @@ str str_from_cstr(const char *cstr) {
   return mem_handle_from_ptr((void *)cstr, strlen(cstr));
 }
 
+str str_from_file(const char *path) {
+  return mem_handle_from_file(path);
+}
+
 str str_duplicate_cstr_with_allocator(const char *cstr,
                                       mem_allocator allocator) {
   if (!cstr) {
@@ -40,15 +54,17 @@ str str_duplicate_strbuf_with_allocator(strbuf_handle buf_handle,
 
 str str_duplicate_str(str strval) {
   if (!str_is_valid(strval)) return (str){0};
-  if (strval.allocator.allocator_spec->allocator_type ==
+  mem_allocator allocator = mem_handle_allocator(strval);
+  if (allocator.allocator_spec->allocator_type ==
       MEM_ALLOCATOR_TYPE_NOT_ALLOCATED) {
     return str_duplicate_str_with_allocator(strval, MEM_ALLOCATOR_PLAIN);
   }
-  return str_duplicate_str_with_allocator(strval, strval.allocator);
+  return str_duplicate_str_with_allocator(strval, allocator);
 }
 
 str str_duplicate_strbuf(strbuf_handle buf_handle) {
-  return str_duplicate_strbuf_with_allocator(buf_handle, buf_handle.allocator);
+  return str_duplicate_strbuf_with_allocator(buf_handle,
+                                             mem_handle_allocator(buf_handle));
 }
 
 inline void str_destroy(str strval) {
@@ -62,9 +78,7 @@ str str_write_cstr_to_buf(str strval, char *buf, size_t bufsize) {
   size_t size_to_copy = strval.size < bufsize - 1 ? strval.size : bufsize - 1;
   memcpy(buf, mem_p(strval), size_to_copy);
   buf[size_to_copy] = (char)0;
-  return (str){.data = buf,
-               .size = size_to_copy,
-               .allocator = MEM_ALLOCATOR_NOT_ALLOCATED};
+  return mem_handle_make(buf, size_to_copy, MEM_ALLOCATOR_NOT_ALLOCATED);
 }
 
 char *str_cstr(str strval) {
@@ -83,22 +97,176 @@ inline size_t str_length(str strval) {
   return strval.size;
 }
 
+#ifdef __SSE2__
+// The number of false candidates allowed per 16 positions scanned, plus a
+// fixed allowance, before the SIMD filter gives up and the search falls back
+// to Horspool.
+static const size_t FILTER_FALSE_CANDIDATE_ALLOWANCE = 16;
+
+/**
+ * @brief Searches by filtering positions on two bytes of the needle.
+ *
+ * Positions whose first byte and byte at filter_offset match the needle are
+ * candidates, compared in full with memcmp. Positions are filtered 16 at a
+ * time with SSE2, or 32 at a time with AVX2. This stops early if too many
+ * candidates do not match, such as for "aab" in "aaaa...".
+ *
+ * @param h The haystack
+ * @param n The size of the haystack, at least m
+ * @param needle The needle
+ * @param m The size of the needle, at least 2
+ * @param filter_offset The offset of the second filter byte in the needle
+ * @param[out] scanned The number of positions searched without a match
+ * @return const char* The match, or null if there is no match in the
+ *   positions scanned
+ */
+static const char *filter_find(const char *h, size_t n, const char *needle,
+                               size_t m, size_t filter_offset,
+                               size_t *scanned) {
+  size_t i = 0;
+  size_t false_candidates = 0;
+  size_t positions = n - m + 1;
+#ifdef __AVX2__
+  const __m256i first32 = _mm256_set1_epi8(needle[0]);
+  const __m256i second32 = _mm256_set1_epi8(needle[filter_offset]);
+  for (; i + 32 <= positions; i += 32) {
+    __m256i a = _mm256_loadu_si256((const __m256i *)(h + i));
+    __m256i b = _mm256_loadu_si256((const __m256i *)(h + i + filter_offset));
+    uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_and_si256(
+        _mm256_cmpeq_epi8(a, first32), _mm256_cmpeq_epi8(b, second32)));
+    while (mask) {
+      size_t pos = i + (size_t)__builtin_ctz(mask);
+      if (memcmp(h + pos, needle, m) == 0) return h + pos;
+      mask &= mask - 1;
+      false_candidates++;
+    }
+    if (false_candidates > i / 16 + FILTER_FALSE_CANDIDATE_ALLOWANCE) {
+      *scanned = i + 32;
+      return (const char *)0;
+    }
+  }
+#endif
+  const __m128i first16 = _mm_set1_epi8(needle[0]);
+  const __m128i second16 = _mm_set1_epi8(needle[filter_offset]);
+  for (; i + 16 <= positions; i += 16) {
+    __m128i a = _mm_loadu_si128((const __m128i *)(h + i));
+    __m128i b = _mm_loadu_si128((const __m128i *)(h + i + filter_offset));
+    uint32_t mask = (uint32_t)_mm_movemask_epi8(
+        _mm_and_si128(_mm_cmpeq_epi8(a, first16), _mm_cmpeq_epi8(b, second16)));
+    while (mask) {
+      size_t pos = i + (size_t)__builtin_ctz(mask);
+      if (memcmp(h + pos, needle, m) == 0) return h + pos;
+      mask &= mask - 1;
+      false_candidates++;
+    }
+    if (false_candidates > i / 16 + FILTER_FALSE_CANDIDATE_ALLOWANCE) {
+      *scanned = i + 16;
+      return (const char *)0;
+    }
+  }
+  for (; i < positions; i++) {
+    if (h[i] == needle[0] && h[i + filter_offset] == needle[filter_offset] &&
+        memcmp(h + i, needle, m) == 0) {
+      return h + i;
+    }
+  }
+  *scanned = positions;
+  return (const char *)0;
+}
+#endif
+
+/**
+ * @brief Searches with the Boyer-Moore-Horspool algorithm.
+ *
+ * @param finder The finder, with a needle of at least 2 bytes
+ * @param h The haystack
+ * @param n The size of the haystack
+ * @return const char* The match, or null if not found
+ */
+static const char *horspool_find(const str_finder *finder, const char *h,
+                                 size_t n) {
+  const char *needle = mem_p(finder->needle);
+  size_t m = mem_size(finder->needle);
+  char last = needle[m - 1];
+  for (size_t i = 0; i + m <= n;
+       i += finder->shift[(unsigned char)h[i + m - 1]]) {
+    if (h[i + m - 1] == last && memcmp(h + i, needle, m - 1) == 0) {
+      return h + i;
+    }
+  }
+  return (const char *)0;
+}
+
+static size_t filter_offset_for(const char *needle, size_t m) {
+  size_t offset = m - 1;
+  while (offset > 1 && needle[offset] == needle[0]) offset--;
+  return offset;
+}
+
+static int find_result(const char *h, const char *found) {
+  if (!found || found - h > INT_MAX) return -1;
+  return (int)(found - h);
+}
+
+/**
+ * @brief Finds a needle, using a finder if one is given.
+ *
+ * Without a finder, one is only made if the search falls back to Horspool.
+ *
+ * @param strval The haystack
+ * @param needle_str The needle
+ * @param finder The finder for the needle, or null
+ * @return int The index of the match, or -1
+ */
+static int find(str strval, str needle_str, const str_finder *finder) {
+  if (!str_is_valid(strval) || !str_is_valid(needle_str)) return -1;
+  const char *h = mem_p(strval);
+  size_t n = mem_size(strval);
+  const char *needle = mem_p(needle_str);
+  size_t m = mem_size(needle_str);
+  if (m > n) return -1;
+  if (m == 0) return 0;
+  if (m == 1) return find_result(h, memchr(h, needle[0], n));
+
+  size_t scanned = 0;
+#ifdef __SSE2__
+  size_t filter_offset =
+      finder ? finder->filter_offset : filter_offset_for(needle, m);
+  const char *found = filter_find(h, n, needle, m, filter_offset, &scanned);
+  if (found || scanned == n - m + 1) return find_result(h, found);
+#endif
+  str_finder made;
+  if (!finder) {
+    made = str_finder_make(needle_str);
+    finder = &made;
+  }
+  return find_result(h, horspool_find(finder, h + scanned, n - scanned));
+}
+
 int str_find(str strval, str substring) {
-  if (!str_is_valid(strval) || !str_is_valid(substring)) return -1;
-  if (strval.size < substring.size) return -1;
+  return find(strval, substring, (const str_finder *)0);
+}
 
-  char *strval_p = mem_p(strval);
-  char *substring_p = mem_p(substring);
-
-  for (unsigned int start_i = 0; start_i < strval.size - substring.size + 1;
-       start_i++) {
-    size_t offset = 0;
-    while (offset < substring.size &&
-           strval_p[start_i + offset] == substring_p[offset])
-      offset++;
-    if (offset == substring.size) return start_i;
+str_finder str_finder_make(str substring) {
+  str_finder finder = {.needle = substring};
+  if (!str_is_valid(substring)) return finder;
+  const char *needle = mem_p(substring);
+  size_t m = mem_size(substring);
+  if (m < 2) return finder;
+  finder.filter_offset = filter_offset_for(needle, m);
+  uint8_t max_shift = m < UINT8_MAX ? (uint8_t)m : UINT8_MAX;
+  memset(finder.shift, max_shift, sizeof(finder.shift));
+  for (size_t j = 0; j < m - 1; j++) {
+    size_t shift = m - 1 - j;
+    finder.shift[(unsigned char)needle[j]] =
+        shift < UINT8_MAX ? (uint8_t)shift : UINT8_MAX;
   }
-  return -1;
+  return finder;
+}
+
+int str_finder_find(const str_finder *finder, str strval) {
+  if (!finder) return -1;
+  return find(strval, finder->needle, finder);
 }
 
 int str_compare(str first, str second) {
@@ -123,42 +291,57 @@ int str_compare(str first, str second) {
   return 1;
 }
 
-str str_split_pop(str strval, str delim, str *part) {
-  if (!str_is_valid(strval) || !(str_is_valid(delim))) return (str){0};
-  int pos = str_find(strval, delim);
+/**
+ * @brief Splits strval at a delimiter found at pos.
+ *
+ * @param strval The str to split
+ * @param pos The index of the delimiter, or -1 if not found
+ * @param delim_size The size of the delimiter
+ * @param[out] part The str up to the delimiter
+ * @return str The str after the delimiter, or an invalid str if not found
+ */
+static str split_at(str strval, int pos, size_t delim_size, str *part) {
   char *strval_p = mem_p(strval);
 
-  part->data = strval_p;
-  part->allocator = MEM_ALLOCATOR_NOT_ALLOCATED;
   if (pos == -1) {
-    part->size = strval.size;
+    *part = mem_handle_make(strval_p, strval.size, MEM_ALLOCATOR_NOT_ALLOCATED);
     return (str){0};
   } else {
-    part->size = pos;
-    return (str){.data = strval_p + pos + delim.size,
-                 .size = strval.size - pos - delim.size,
-                 .allocator = MEM_ALLOCATOR_NOT_ALLOCATED};
+    *part = mem_handle_make(strval_p, pos, MEM_ALLOCATOR_NOT_ALLOCATED);
+    return mem_handle_make(strval_p + pos + delim_size,
+                           strval.size - pos - delim_size,
+                           MEM_ALLOCATOR_NOT_ALLOCATED);
   }
 }
 
+str str_split_pop(str strval, str delim, str *part) {
+  if (!str_is_valid(strval) || !(str_is_valid(delim))) return (str){0};
+  return split_at(strval, str_find(strval, delim), delim.size, part);
+}
+
+str str_split_pop_finder(str strval, const str_finder *finder, str *part) {
+  if (!str_is_valid(strval) || !finder || !str_is_valid(finder->needle)) {
+    return (str){0};
+  }
+  return split_at(strval, str_finder_find(finder, strval),
+                  finder->needle.size, part);
+}
+
 str str_split_whitespace_pop(str strval, str *part) {
   if (!str_is_valid(strval)) return (str){0};
   char *strval_p = mem_p(strval);
   unsigned int start = 0, pos = 0;
 
   // Skip leading whitespace
-  if (isspace(*strval_p)) {
-    while (start < str_length(strval) && isspace(*(strval_p + start))) ++start;
-  }
+  while (start < str_length(strval) && isspace(*(strval_p + start))) ++start;
 
   // Find next space
   pos = start;
   while (pos < str_length(strval) && !isspace(*(strval_p + pos))) ++pos;
 
   // Pop region from start to pos
-  part->data = strval_p + start;
-  part->allocator = MEM_ALLOCATOR_NOT_ALLOCATED;
-  part->size = pos - start;
+  *part = mem_handle_make(strval_p + start, pos - start,
+                          MEM_ALLOCATOR_NOT_ALLOCATED);
 
   // Locate end of next whitespace region
   while (pos < str_length(strval) && isspace(*(strval_p + pos))) ++pos;
@@ -167,9 +350,145 @@ str str_split_whitespace_pop(str strval, str *part) {
   if (pos == strval.size) return (str){0};
 
   // Otherwise, return from start of next non-space region to end
-  return (str){.data = strval_p + pos,
-               .size = strval.size - pos,
-               .allocator = MEM_ALLOCATOR_NOT_ALLOCATED};
+  return mem_handle_make(strval_p + pos, strval.size - pos,
+                         MEM_ALLOCATOR_NOT_ALLOCATED);
+}
+
+str_delims str_delims_make(str bytes) {
+  str_delims delims = {0};
+  if (!str_is_valid(bytes)) return delims;
+  const unsigned char *bytes_p = mem_p(bytes);
+  for (size_t i = 0; i < mem_size(bytes); i++) {
+    unsigned char c = bytes_p[i];
+    uint64_t bit = (uint64_t)1 << (c & 63);
+    if (delims.bitmap[c >> 6] & bit) continue;
+    delims.bitmap[c >> 6] |= bit;
+    if (delims.byte_count < STR_DELIMS_COMPARE_MAX) {
+      delims.bytes[delims.byte_count] = (char)c;
+    }
+    ++delims.byte_count;
+  }
+  return delims;
+}
+
+// The number of bytes that str_tokenize classifies at once, one per bit of a
+// mask
+static const size_t TOKENIZE_BLOCK_SIZE = 64;
+
+#ifdef __SSE2__
+/**
+ * @brief Finds the delimiters in a full block by comparing with each
+ *   delimiter byte.
+ *
+ * @param delims The delimiter set, with at most STR_DELIMS_COMPARE_MAX bytes
+ * @param block The block, of TOKENIZE_BLOCK_SIZE bytes
+ * @return uint64_t Bit i is set if block[i] is a delimiter
+ */
+static uint64_t compare_delims(const str_delims *delims, const char *block) {
+#ifdef __AVX2__
+  __m256i lo = _mm256_loadu_si256((const __m256i *)block);
+  __m256i hi = _mm256_loadu_si256((const __m256i *)(block + 32));
+  __m256i lo_found = _mm256_setzero_si256();
+  __m256i hi_found = _mm256_setzero_si256();
+  for (unsigned int d = 0; d < delims->byte_count; d++) {
+    __m256i delim = _mm256_set1_epi8(delims->bytes[d]);
+    lo_found = _mm256_or_si256(lo_found, _mm256_cmpeq_epi8(lo, delim));
+    hi_found = _mm256_or_si256(hi_found, _mm256_cmpeq_epi8(hi, delim));
+  }
+  return (uint64_t)(uint32_t)_mm256_movemask_epi8(lo_found) |
+         (uint64_t)(uint32_t)_mm256_movemask_epi8(hi_found) << 32;
+#else
+  __m128i b0 = _mm_loadu_si128((const __m128i *)block);
+  __m128i b1 = _mm_loadu_si128((const __m128i *)(block + 16));
+  __m128i b2 = _mm_loadu_si128((const __m128i *)(block + 32));
+  __m128i b3 = _mm_loadu_si128((const __m128i *)(block + 48));
+  __m128i f0 = _mm_setzero_si128(), f1 = f0, f2 = f0, f3 = f0;
+  for (unsigned int d = 0; d < delims->byte_count; d++) {
+    __m128i delim = _mm_set1_epi8(delims->bytes[d]);
+    f0 = _mm_or_si128(f0, _mm_cmpeq_epi8(b0, delim));
+    f1 = _mm_or_si128(f1, _mm_cmpeq_epi8(b1, delim));
+    f2 = _mm_or_si128(f2, _mm_cmpeq_epi8(b2, delim));
+    f3 = _mm_or_si128(f3, _mm_cmpeq_epi8(b3, delim));
+  }
+  return (uint64_t)(uint16_t)_mm_movemask_epi8(f0) |
+         (uint64_t)(uint16_t)_mm_movemask_epi8(f1) << 16 |
+         (uint64_t)(uint16_t)_mm_movemask_epi8(f2) << 32 |
+         (uint64_t)(uint16_t)_mm_movemask_epi8(f3) << 48;
+#endif
+}
+#endif
+
+/**
+ * @brief Finds the delimiters in a block.
+ *
+ * @param delims The delimiter set
+ * @param block The block
+ * @param size The size of the block, at most TOKENIZE_BLOCK_SIZE
+ * @return uint64_t Bit i is set if block[i] is a delimiter. Bits from size
+ *   up are set, as if the block were padded with delimiters.
+ */
+static uint64_t delim_mask(const str_delims *delims, const char *block,
+                           size_t size) {
+#ifdef __SSE2__
+  if (size == TOKENIZE_BLOCK_SIZE &&
+      delims->byte_count <= STR_DELIMS_COMPARE_MAX) {
+    return compare_delims(delims, block);
+  }
+#endif
+  uint64_t mask = size < TOKENIZE_BLOCK_SIZE ? ~(uint64_t)0 << size : 0;
+  for (size_t i = 0; i < size; i++) {
+    unsigned char c = (unsigned char)block[i];
+    mask |= ((delims->bitmap[c >> 6] >> (c & 63)) & 1) << i;
+  }
+  return mask;
+}
+
+str str_tokenize(str strval, const str_delims *delims, str *tokens,
+                 size_t max_tokens, size_t *count) {
+  *count = 0;
+  if (!str_is_valid(strval) || !delims) return (str){0};
+  if (max_tokens == 0) return strval;
+  char *strval_p = mem_p(strval);
+  size_t size = mem_size(strval);
+  size_t found = 0;
+  size_t token_start = 0;
+  bool in_token = false;
+  for (size_t base = 0; base < size; base += TOKENIZE_BLOCK_SIZE) {
+    size_t block_size = size - base < TOKENIZE_BLOCK_SIZE
+                            ? size - base
+                            : TOKENIZE_BLOCK_SIZE;
+    uint64_t mask = delim_mask(delims, strval_p + base, block_size);
+
+    // A bit is set where a byte is a delimiter and the byte before it is not,
+    // or the other way around.
+    uint64_t changes = mask ^ (mask << 1 | (in_token ? 0 : 1));
+    while (changes) {
+      size_t pos = base + (size_t)__builtin_ctzll(changes);
+      changes &= changes - 1;
+      in_token = !in_token;
+      if (in_token) {
+        token_start = pos;
+        continue;
+      }
+      tokens[found++] =
+          mem_handle_make(strval_p + token_start, pos - token_start,
+                          MEM_ALLOCATOR_NOT_ALLOCATED);
+      if (found == max_tokens) {
+        *count = found;
+        if (pos == size) return (str){0};
+        return mem_handle_make(strval_p + pos, size - pos,
+                               MEM_ALLOCATOR_NOT_ALLOCATED);
+      }
+    }
+  }
+  // A token that runs to the end of a full last block
+  if (in_token) {
+    tokens[found++] = mem_handle_make(strval_p + token_start,
+                                      size - token_start,
+                                      MEM_ALLOCATOR_NOT_ALLOCATED);
+  }
+  *count = found;
+  return (str){0};
 }
 
 strbuf_handle strbuf_create(mem_allocator allocator, size_t size) {
@@ -202,10 +521,8 @@ bool strbuf_is_valid(strbuf_handle buf_handle) {
 str strbuf_str(strbuf_handle buf_handle) {
   if (!mem_is_valid(buf_handle)) return (str){0};
   strbuf *bufp = mem_p(buf_handle);
-  str result = bufp->data;
-  result.size = bufp->length;
-  result.allocator = MEM_ALLOCATOR_NOT_ALLOCATED;
-  return result;
+  return mem_handle_make(bufp->data.data, bufp->length,
+                         MEM_ALLOCATOR_NOT_ALLOCATED);
 }
 
 void strbuf_reset(strbuf_handle buf_handle) {
@@ -281,8 +598,9 @@ bool strbuf_concatenate_printf(strbuf_handle buf_handle, const char *fmt, ...) {
 
 strbuf_handle strbuf_duplicate(strbuf_handle buf_handle) {
   if (!strbuf_is_valid(buf_handle)) return (strbuf_handle){0};
-  strbuf_handle new_handle = strbuf_create(
-      buf_handle.allocator, ((strbuf *)mem_p(buf_handle))->data.size);
+  strbuf_handle new_handle =
+      strbuf_create(mem_handle_allocator(buf_handle),
+                    mem_size(((strbuf *)mem_p(buf_handle))->data));
   if (!strbuf_is_valid(new_handle)) return (strbuf_handle){0};
   if (!strbuf_concatenate_strbuf(new_handle, buf_handle)) {
     str_destroy(new_handle);
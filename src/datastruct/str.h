@@ -20,6 +20,7 @@
 #define DATASTRUCT_STR_H
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 
 #include "mem.h"
@@ -52,6 +53,48 @@ typedef struct strbuf {
   size_t length;
 } strbuf;
 
+/**
+ * @brief A substring to search for, prepared by `str_finder_make`.
+ *
+ * A finder does the work that depends only on the substring once, so that
+ * searching many strs for the same substring does not repeat it.
+ */
+typedef struct str_finder {
+  // The substring, which is not copied
+  str needle;
+
+  // The offset in the needle of the second byte that a candidate match must
+  // have, after its first byte. This is the last byte that differs from the
+  // first, so that a needle such as "aab" is not filtered on two equal bytes.
+  size_t filter_offset;
+
+  // The Horspool shift for each value of the last byte of a window, capped at
+  // 255
+  uint8_t shift[256];
+} str_finder;
+
+// The number of delimiter bytes that `str_tokenize` compares 16 or 32 bytes
+// at a time. A larger set is looked up a byte at a time.
+#define STR_DELIMS_COMPARE_MAX 16
+
+// The bytes that `isspace` accepts in the C locale, for `str_delims_make`
+#define STR_WHITESPACE " \t\n\v\f\r"
+
+/**
+ * @brief A set of delimiter bytes for `str_tokenize`, made by
+ *   `str_delims_make`.
+ */
+typedef struct str_delims {
+  // One bit for each byte value, set if the byte is a delimiter
+  uint64_t bitmap[4];
+
+  // The delimiter bytes, if there are at most STR_DELIMS_COMPARE_MAX
+  char bytes[STR_DELIMS_COMPARE_MAX];
+
+  // The number of delimiter bytes
+  unsigned int byte_count;
+} str_delims;
+
 /**
  * @brief Makes a str that points to a given C string.
  *
@@ -63,6 +106,20 @@ typedef struct strbuf {
  */
 str str_from_cstr(const char *cstr);
 
+/**
+ * @brief Makes a str with the contents of a file, without copying.
+ *
+ * The file is mapped into memory read-only, or read into memory if it is a
+ * pipe. See `mem_handle_from_file`. Call `str_destroy` to unmap it. strs split
+ * from this str refer to the mapping, and must be discarded when it is
+ * unmapped.
+ *
+ * @param path The path to the file
+ * @return str The contents of the file, or an invalid str if the file could
+ *   not be opened
+ */
+str str_from_file(const char *path);
+
 /**
  * @brief Duplicates a str into a new str, reusing the allocator.
  *
@@ -118,7 +175,8 @@ str str_duplicate_strbuf_with_allocator(strbuf_handle buf_handle,
  * @brief Invalidate and deallocate a str, as appropriate.
  *
  * This only attempts to deallocate memory if the str was created by
- * `str_duplicate`. In all cases, it updates the str to be invalid.
+ * `str_duplicate` or `str_from_file`. In all cases, it updates the str to be
+ * invalid.
  *
  * @param strp Ptr to the str
  */
@@ -179,13 +237,45 @@ size_t str_length(str strval);
 /**
  * @brief Finds the left-most occurrence of a substring in a string.
  *
+ * Candidate positions are found 16 or 32 bytes at a time by matching the
+ * substring's first byte and one later byte, with SSE2 or AVX2 when the
+ * compiler targets them. If candidates turn out to be false too often, and on
+ * other CPUs, the search falls back to Boyer-Moore-Horspool. A one-byte
+ * substring uses `memchr`.
+ *
+ * To search many strs for the same substring, use a `str_finder`.
+ *
  * @param strval The str to be searched
  * @param substring The substring to locate inside str
  * @return int The character index of the located occurrence of
- *   substring, or -1 if not found
+ *   substring, or -1 if not found. An empty substring is found at 0.
  */
 int str_find(str strval, str substring);
 
+/**
+ * @brief Prepares a substring for repeated searches.
+ *
+ * The finder refers to the substring's memory, which must remain valid while
+ * the finder is in use.
+ *
+ * @param substring The substring to search for
+ * @return str_finder The finder. If substring is invalid, `str_finder_find`
+ *   with it does not find anything.
+ */
+str_finder str_finder_make(str substring);
+
+/**
+ * @brief Finds the left-most occurrence of a finder's substring in a string.
+ *
+ * This is the same as `str_find` with the substring.
+ *
+ * @param finder The finder
+ * @param strval The str to be searched
+ * @return int The character index of the located occurrence of the
+ *   substring, or -1 if not found
+ */
+int str_finder_find(const str_finder *finder, str strval);
+
 /**
  * @brief Compares two strs lexicographically.
  *
@@ -245,6 +335,19 @@ int str_compare(str first, str second);
  */
 str str_split_pop(str strval, str delim, str *part);
 
+/**
+ * @brief Splits a str with a prepared delimiter and returns the next part.
+ *
+ * This is the same as `str_split_pop`, with the delimiter prepared once by
+ * `str_finder_make`, for splitting a large str into many parts.
+ *
+ * @param strval The str to split
+ * @param finder The finder for the delimiter
+ * @param[out] part The str up to the delimiter
+ * @return str The str that starts after the delimiter to the end of strval
+ */
+str str_split_pop_finder(str strval, const str_finder *finder, str *part);
+
 /**
  * @brief Splits a str on whitespace and returns the next part.
  *
@@ -263,6 +366,50 @@ str str_split_pop(str strval, str delim, str *part);
  */
 str str_split_whitespace_pop(str strval, str *part);
 
+/**
+ * @brief Makes a set of delimiter bytes for `str_tokenize`.
+ *
+ *   str_delims delims = str_delims_make(str_from_cstr(STR_WHITESPACE ",:"));
+ *
+ * @param bytes The delimiter bytes, in any order
+ * @return str_delims The set. If bytes is invalid, the set is empty.
+ */
+str_delims str_delims_make(str bytes);
+
+/**
+ * @brief Splits a str into tokens separated by delimiters, a batch at a time.
+ *
+ * A token is a run of bytes that are not in the delimiter set. As with
+ * `str_split_whitespace_pop`, leading, trailing, and repeated delimiters do
+ * not make empty tokens. Each token refers to the memory of strval.
+ *
+ * This stores up to max_tokens tokens in the tokens array and returns the
+ * rest of strval after the last token stored, or an invalid str once the end
+ * of strval is reached. (The rest can have no tokens left, in which case the
+ * next call stores none.) To tokenize a whole str:
+ *
+ *   str tokens[256];
+ *   while (str_is_valid(text)) {
+ *     size_t count;
+ *     text = str_tokenize(text, &delims, tokens, 256, &count);
+ *     for (size_t i = 0; i < count; i++) use_token(tokens[i]);
+ *   }
+ *
+ * Delimiters are found 64 bytes at a time, with SSE2 or AVX2 comparisons when
+ * the compiler targets them. This never reads past the end of strval, so
+ * strval can be a mapped file, such as from `str_from_file`.
+ *
+ * @param strval The str to tokenize
+ * @param delims The delimiter set
+ * @param[out] tokens The array to store tokens in
+ * @param max_tokens The size of the tokens array
+ * @param[out] count The number of tokens stored
+ * @return str The rest of strval, or an invalid str at the end of strval or
+ *   if strval is invalid
+ */
+str str_tokenize(str strval, const str_delims *delims, str *tokens,
+                 size_t max_tokens, size_t *count);
+
 /**
  * @brief Creates a strbuf.
  *
@@ -0,0 +1,173 @@
+#include "strarena.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "mem.h"
+
+struct strarena_chunk {
+  // The next chunk in the arena's chunk list
+  strarena_chunk *next;
+
+  // The memory for this chunk, including this header
+  mem_handle chunk_mh;
+
+  // The number of bytes available for strings
+  size_t capacity;
+
+  // The number of bytes used by strings
+  size_t used;
+};
+
+static char *chunk_data(strarena_chunk *chunk) {
+  return (char *)(chunk + 1);
+}
+
+static strarena_chunk *new_chunk(strarena *sap, size_t capacity) {
+  if (capacity > MEM_HANDLE_MAX_SIZE - sizeof(strarena_chunk)) {
+    return (strarena_chunk *)0;
+  }
+  mem_handle chunk_mh =
+      mem_alloc(sap->chunk_allocator, sizeof(strarena_chunk) + capacity);
+  if (!mem_is_valid(chunk_mh)) return (strarena_chunk *)0;
+  strarena_chunk *chunk = mem_p(chunk_mh);
+  chunk->next = (strarena_chunk *)0;
+  chunk->chunk_mh = chunk_mh;
+  chunk->capacity = capacity;
+  chunk->used = 0;
+  return chunk;
+}
+
+strarena_handle strarena_create(mem_allocator ma, size_t chunk_size) {
+  strarena_handle sah = mem_alloc(ma, sizeof(strarena));
+  if (!mem_is_valid(sah)) return (strarena_handle){0};
+  strarena *sap = mem_p(sah);
+  sap->chunk_allocator = ma;
+  sap->chunk_size = chunk_size ? chunk_size : STRARENA_DEFAULT_CHUNK_SIZE;
+  sap->string_bytes = 0;
+  sap->first_chunk = new_chunk(sap, sap->chunk_size);
+  if (!sap->first_chunk) {
+    mem_free(sah);
+    return (strarena_handle){0};
+  }
+  sap->current_chunk = sap->first_chunk;
+  return sah;
+}
+
+bool strarena_is_valid(strarena_handle sah) {
+  return mem_is_valid(sah) && ((strarena *)mem_p(sah))->first_chunk;
+}
+
+void strarena_reset(strarena_handle sah) {
+  if (!strarena_is_valid(sah)) return;
+  strarena *sap = mem_p(sah);
+  // Chunks after the first have their used count reset as the arena advances
+  // into them.
+  sap->first_chunk->used = 0;
+  sap->current_chunk = sap->first_chunk;
+  sap->string_bytes = 0;
+}
+
+void strarena_destroy(strarena_handle sah) {
+  if (!strarena_is_valid(sah)) return;
+  strarena *sap = mem_p(sah);
+  strarena_chunk *chunk = sap->first_chunk;
+  while (chunk) {
+    strarena_chunk *next = chunk->next;
+    mem_free(chunk->chunk_mh);
+    chunk = next;
+  }
+  mem_free(sah);
+}
+
+/**
+ * @brief Makes a chunk with room for size bytes the current chunk.
+ *
+ * This reuses the next chunk in the list if it is large enough. Otherwise it
+ * allocates a new chunk and inserts it after the current chunk.
+ *
+ * @param sap The arena
+ * @param size The size of the string that did not fit
+ * @return true on success
+ */
+static bool advance_chunk(strarena *sap, size_t size) {
+  strarena_chunk *next = sap->current_chunk->next;
+  if (!next || next->capacity < size) {
+    strarena_chunk *chunk =
+        new_chunk(sap, size > sap->chunk_size ? size : sap->chunk_size);
+    if (!chunk) return false;
+    chunk->next = next;
+    sap->current_chunk->next = chunk;
+    next = chunk;
+  }
+  next->used = 0;
+  sap->current_chunk = next;
+  return true;
+}
+
+/**
+ * @brief Gets the arena for a handle passed to a public function.
+ *
+ * A valid arena always has a first chunk. This is only checked in
+ * DATASTRUCT_CHECKED builds.
+ *
+ * @param sah The string arena handle
+ * @return strarena* The arena, or null if the handle is invalid
+ */
+static strarena *strarena_for_handle(strarena_handle sah) {
+  strarena *sap = mem_p(sah);
+  if (!sap || !DATASTRUCT_CHECK(sap->first_chunk)) return (strarena *)0;
+  return sap;
+}
+
+/**
+ * @brief Copies bytes into the arena, followed by a null terminator.
+ *
+ * @param sap The arena
+ * @param data The bytes, which may be null if size is 0
+ * @param size The number of bytes
+ * @return str The copy, or an invalid str if memory could not be allocated
+ */
+static str add_bytes(strarena *sap, const void *data, size_t size) {
+  if (size >= MEM_HANDLE_MAX_SIZE) return (str){0};
+  size_t total = size + 1;
+  strarena_chunk *chunk = sap->current_chunk;
+  if (chunk->capacity - chunk->used < total) {
+    if (!advance_chunk(sap, total)) return (str){0};
+    chunk = sap->current_chunk;
+  }
+  char *p = chunk_data(chunk) + chunk->used;
+  if (size > 0) memcpy(p, data, size);
+  p[size] = '\0';
+  chunk->used += total;
+  sap->string_bytes += total;
+  return mem_handle_from_ptr(p, size);
+}
+
+str strarena_add(strarena_handle sah, str s) {
+  strarena *sap = strarena_for_handle(sah);
+  if (!sap || !str_is_valid(s)) return (str){0};
+  return add_bytes(sap, mem_p(s), mem_size(s));
+}
+
+str strarena_add_cstr(strarena_handle sah, const char *cstr) {
+  strarena *sap = strarena_for_handle(sah);
+  if (!sap || !cstr) return (str){0};
+  return add_bytes(sap, cstr, strlen(cstr));
+}
+
+size_t strarena_string_bytes(strarena_handle sah) {
+  if (!strarena_is_valid(sah)) return 0;
+  return ((strarena *)mem_p(sah))->string_bytes;
+}
+
+size_t strarena_memory_use(strarena_handle sah) {
+  if (!strarena_is_valid(sah)) return 0;
+  strarena *sap = mem_p(sah);
+  size_t total = sizeof(strarena);
+  for (strarena_chunk *chunk = sap->first_chunk; chunk; chunk = chunk->next) {
+    total += mem_size(chunk->chunk_mh);
+  }
+  return total;
+}
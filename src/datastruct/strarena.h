@@ -0,0 +1,138 @@
+/**
+ * @file strarena.h
+ * @brief An append-only arena of strings that never move.
+ *
+ *   strarena_handle names = strarena_create(MEM_ALLOCATOR_PLAIN, 0);
+ *   if (!strarena_is_valid(names)) abort();
+ *   str name = strarena_add(names, strbuf_str(buf));  // outlives buf's data
+ *   if (!str_is_valid(name)) abort();
+ *   ...
+ *   strarena_destroy(names);  // releases every string at once
+ *
+ * A str from `strbuf_str` is only valid until the strbuf grows, and keeping
+ * many strings with `str_duplicate_str` makes one allocation per string. A
+ * string arena copies each string to the end of a large chunk instead, so
+ * tens of thousands of symbol names or tokens take a handful of allocations.
+ * A chunk is never reallocated: when a string does not fit in the rest of the
+ * current chunk, it goes to a new chunk, so a str from the arena stays valid
+ * until the arena is reset or destroyed.
+ *
+ * Strings are packed end to end with no alignment padding. Each is followed
+ * by a null terminator, so `mem_p` of a str from the arena is a C string.
+ *
+ * A str from the arena does not own its memory, and `mem_free` of it does
+ * nothing. `strarena_reset` releases every string in O(1) and keeps the
+ * chunks for reuse.
+ */
+
+#ifndef DATASTRUCT_STRARENA_H
+#define DATASTRUCT_STRARENA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "mem.h"
+#include "str.h"
+
+// Default size of a string arena chunk, if zero is passed to
+// `strarena_create`.
+#define STRARENA_DEFAULT_CHUNK_SIZE 65536
+
+// Internal type for a chunk of a string arena
+typedef struct strarena_chunk strarena_chunk;
+
+// Internal type for a string arena
+typedef struct strarena {
+  // The allocator for chunks
+  mem_allocator chunk_allocator;
+
+  // The size of new chunks, in bytes
+  size_t chunk_size;
+
+  // The first chunk in the chunk list
+  strarena_chunk *first_chunk;
+
+  // The chunk that strings are added to
+  strarena_chunk *current_chunk;
+
+  // The total size of the strings added since the arena was created or
+  // reset, with their null terminators
+  size_t string_bytes;
+} strarena;
+
+// Handle for a string arena, returned by `strarena_create`
+typedef mem_handle strarena_handle;
+
+/**
+ * @brief Creates a string arena.
+ *
+ * Use `strarena_is_valid` to validate the arena before using.
+ *
+ * A string longer than the chunk size gets a chunk of its own.
+ *
+ * @param ma The memory allocator for the arena and its chunks
+ * @param chunk_size The size of each chunk, or 0 for
+ *   `STRARENA_DEFAULT_CHUNK_SIZE`
+ * @return strarena_handle The arena, invalid if the chunk size is too large or
+ *   memory could not be allocated
+ */
+strarena_handle strarena_create(mem_allocator ma, size_t chunk_size);
+
+/**
+ * @param sah The string arena handle
+ * @return true if the arena is valid
+ */
+bool strarena_is_valid(strarena_handle sah);
+
+/**
+ * @brief Releases every string in the arena.
+ *
+ * This is O(1). The arena keeps its chunks, and reuses them for strings
+ * added later. Every str from the arena becomes invalid.
+ *
+ * @param sah The string arena handle
+ */
+void strarena_reset(strarena_handle sah);
+
+/**
+ * @brief Destroys a string arena, releasing all of its memory.
+ *
+ * @param sah The handle of the arena to destroy
+ */
+void strarena_destroy(strarena_handle sah);
+
+/**
+ * @brief Copies a string into the arena.
+ *
+ * @param sah The string arena handle
+ * @param s The string to copy
+ * @return str The copy, followed by a null terminator, valid until the arena
+ *   is reset or destroyed. This is invalid if the handle or string is invalid
+ *   or memory could not be allocated.
+ */
+str strarena_add(strarena_handle sah, str s);
+
+/**
+ * @brief Copies a C string into the arena.
+ *
+ * @param sah The string arena handle
+ * @param cstr The null-terminated string to copy
+ * @return str The copy, as for `strarena_add`
+ */
+str strarena_add_cstr(strarena_handle sah, const char *cstr);
+
+/**
+ * @param sah The string arena handle
+ * @return size_t The total size of the strings in the arena, with their null
+ *   terminators, or 0 if the handle is invalid
+ */
+size_t strarena_string_bytes(strarena_handle sah);
+
+/**
+ * @param sah The string arena handle
+ * @return size_t The total size of the arena's chunks, which is the memory
+ *   the arena uses, or 0 if the handle is invalid
+ */
+size_t strarena_memory_use(strarena_handle sah);
+
+#endif
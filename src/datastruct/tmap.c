@@ -0,0 +1,429 @@
+#include "tmap.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "hash.h"
+#include "rhtable.h"
+#include "str.h"
+
+// The size of a new table. Table sizes are powers of two.
+static const unsigned int INITIAL_TABLE_SIZE = 32;
+
+// The alignment of the table, so that a probe reads as few cache lines as
+// possible.
+static const size_t TABLE_ALIGNMENT = 64;
+
+// The size of a str key in an entry: the address of the map's copy, then its
+// 32-bit size. The copy was allocated with the map's allocator, so the key's
+// handle can be remade from these.
+#define STR_KEY_SIZE (sizeof(char *) + sizeof(uint32_t))
+
+// An upper bound on the size of a slot: the metadata, a str key, then the
+// largest value, each padded to the largest alignment.
+#define MAX_ALIGNED(n) \
+  (((n) + _Alignof(max_align_t) - 1) & ~(_Alignof(max_align_t) - 1))
+#define MAX_SLOT_SIZE                                       \
+  (MAX_ALIGNED(sizeof(rh_meta)) + MAX_ALIGNED(STR_KEY_SIZE) + \
+   MAX_ALIGNED(TMAP_MAX_VALUE_SIZE))
+_Static_assert(MAX_SLOT_SIZE <= RH_MAX_SLOT_SIZE, "tmap slots are too large");
+
+// The key of an empty str, which needs no copy.
+static char EMPTY_KEY[1];
+
+static size_t round_up(size_t n, size_t align) {
+  return (n + align - 1) & ~(align - 1);
+}
+
+static size_t key_size(tmap_key_kind key_kind) {
+  switch (key_kind) {
+    case TMAP_KEY_STR:
+      return STR_KEY_SIZE;
+    case TMAP_KEY_U32:
+      return sizeof(uint32_t);
+    default:
+      return sizeof(uint64_t);
+  }
+}
+
+static size_t key_align(tmap_key_kind key_kind) {
+  switch (key_kind) {
+    case TMAP_KEY_STR:
+      return _Alignof(char *);
+    case TMAP_KEY_U32:
+      return _Alignof(uint32_t);
+    default:
+      return _Alignof(uint64_t);
+  }
+}
+
+/**
+ * @brief Allocates a cleared table.
+ *
+ * @param tp The typed map
+ * @param table_size The number of slots
+ * @return mem_handle The table, possibly invalid
+ */
+static mem_handle alloc_table(tmap *tp, unsigned int table_size) {
+  size_t size = (size_t)tp->slot_size * table_size;
+  mem_handle table_mh = mem_alloc_aligned(tp->allocator, size, TABLE_ALIGNMENT);
+  if (mem_is_valid(table_mh)) memset(mem_p(table_mh), 0, size);
+  return table_mh;
+}
+
+static rh_meta *table_slot(tmap *tp, mem_handle table_mh, unsigned int pos) {
+  return rh_slot(mem_p(table_mh), tp->slot_size, pos);
+}
+
+static unsigned char *slot_entry(tmap *tp, rh_meta *slot) {
+  return (unsigned char *)slot + tp->entry_offset;
+}
+
+// A key's home slot is picked by the high 32 bits of its hash, which are kept
+// in its slot's metadata, so the table can be resized without reading or
+// rehashing keys.
+static unsigned int home_pos(uint64_t key_hash, unsigned int table_size) {
+  return (key_hash >> 32) & (table_size - 1);
+}
+
+tmap_handle tmap_create(mem_allocator ma, tmap_key_kind key_kind,
+                        size_t value_size, size_t value_align) {
+  if (value_size == 0 || value_size > TMAP_MAX_VALUE_SIZE ||
+      value_align == 0 || (value_align & (value_align - 1)) != 0 ||
+      value_align > _Alignof(max_align_t)) {
+    return (tmap_handle){0};
+  }
+  tmap_handle th = mem_alloc(ma, sizeof(tmap));
+  if (!mem_is_valid(th)) return (tmap_handle){0};
+  tmap *tp = mem_p(th);
+  size_t entry_align = key_align(key_kind);
+  if (value_align > entry_align) entry_align = value_align;
+  size_t slot_align = entry_align > _Alignof(rh_meta) ? entry_align
+                                                       : _Alignof(rh_meta);
+  tp->allocator = ma;
+  tp->key_kind = key_kind;
+  tp->value_offset = round_up(key_size(key_kind), value_align);
+  tp->entry_size = round_up(tp->value_offset + value_size, entry_align);
+  tp->entry_offset = round_up(sizeof(rh_meta), entry_align);
+  tp->slot_size = round_up(tp->entry_offset + tp->entry_size, slot_align);
+  tp->entry_count = 0;
+  tp->table_size = INITIAL_TABLE_SIZE;
+  tp->table_mh = alloc_table(tp, INITIAL_TABLE_SIZE);
+  if (!mem_is_valid(tp->table_mh)) {
+    mem_free(th);
+    return (tmap_handle){0};
+  }
+  return th;
+}
+
+bool tmap_is_valid(tmap_handle th) {
+  return mem_is_valid(th) && mem_is_valid(((tmap *)mem_p(th))->table_mh);
+}
+
+/**
+ * @brief Gets the typed map for a handle passed to a public function.
+ *
+ * A valid map always has a table. This is only checked in DATASTRUCT_CHECKED
+ * builds.
+ *
+ * @param th The typed map handle
+ * @return tmap* The map, or null if the handle is invalid
+ */
+static tmap *tmap_for_handle(tmap_handle th) {
+  tmap *tp = mem_p(th);
+  if (!tp || !DATASTRUCT_CHECK(mem_is_valid(tp->table_mh))) return (tmap *)0;
+  return tp;
+}
+
+// Gets the str key of an entry, without its allocator.
+static str entry_str_key(const unsigned char *entry) {
+  char *data;
+  uint32_t size;
+  memcpy(&data, entry, sizeof(data));
+  memcpy(&size, entry + sizeof(data), sizeof(size));
+  return mem_handle_from_ptr(data, size);
+}
+
+// Frees the map's copy of the str key of an entry.
+static void free_str_key(tmap *tp, const unsigned char *entry) {
+  str key = entry_str_key(entry);
+  if (key.size == 0) return;
+  mem_free(mem_handle_make(mem_p(key), key.size, tp->allocator));
+}
+
+void tmap_destroy(tmap_handle th) {
+  if (!tmap_is_valid(th)) return;
+  tmap *tp = mem_p(th);
+  if (tp->key_kind == TMAP_KEY_STR) {
+    for (unsigned int i = 0; i < tp->table_size; i++) {
+      rh_meta *slot = table_slot(tp, tp->table_mh, i);
+      if (*slot) free_str_key(tp, slot_entry(tp, slot));
+    }
+  }
+  mem_free(tp->table_mh);
+  mem_free(th);
+}
+
+size_t tmap_count(tmap_handle th) {
+  tmap *tp = tmap_for_handle(th);
+  return tp ? tp->entry_count : 0;
+}
+
+/**
+ * @brief Resizes the table.
+ *
+ * @param tp The typed map
+ * @param new_table_size The new number of slots, which holds every entry
+ * @return true on success
+ */
+static bool resize_table(tmap *tp, unsigned int new_table_size) {
+  mem_handle new_table_mh = alloc_table(tp, new_table_size);
+  if (!mem_p(new_table_mh)) return false;
+
+  void *new_slots = mem_p(new_table_mh);
+  rh_slot_buf carry;
+  for (unsigned int i = 0; i < tp->table_size; i++) {
+    rh_meta *slot = table_slot(tp, tp->table_mh, i);
+    if (!*slot) continue;
+    memcpy(carry.bytes, slot, tp->slot_size);
+    carry.meta = rh_make_meta(*slot, 1);
+    rh_place(new_slots, tp->slot_size, new_table_size,
+             home_pos(*slot, new_table_size), &carry);
+  }
+
+  mem_free(tp->table_mh);
+  tp->table_size = new_table_size;
+  tp->table_mh = new_table_mh;
+  return true;
+}
+
+static uint64_t key_hash(tmap *tp, str key, uint64_t int_key) {
+  return tp->key_kind == TMAP_KEY_STR ? hash_str(key) : hash_u64(int_key);
+}
+
+// A key to probe a table for
+typedef struct probe_key {
+  tmap *tp;
+
+  // The str key of a map of str keys
+  str key;
+
+  // The key of a map of integer or pointer keys
+  uint64_t int_key;
+} probe_key;
+
+static bool slot_has_key(const void *slot, const void *key) {
+  const probe_key *pk = key;
+  const unsigned char *entry =
+      (const unsigned char *)slot + pk->tp->entry_offset;
+  switch (pk->tp->key_kind) {
+    case TMAP_KEY_STR: {
+      str entry_key = entry_str_key(entry);
+      return entry_key.size == pk->key.size &&
+             memcmp(mem_p(entry_key), mem_p(pk->key), pk->key.size) == 0;
+    }
+    case TMAP_KEY_U32: {
+      uint32_t entry_key;
+      memcpy(&entry_key, entry, sizeof(entry_key));
+      return entry_key == pk->int_key;
+    }
+    default: {
+      uint64_t entry_key;
+      memcpy(&entry_key, entry, sizeof(entry_key));
+      return entry_key == pk->int_key;
+    }
+  }
+}
+
+/**
+ * @brief Probes for the slot with a key.
+ *
+ * @param tp The typed map
+ * @param key_hash The hash of the key
+ * @param key The str key of a map of str keys
+ * @param int_key The key of a map of integer or pointer keys
+ * @return rh_probe The result
+ */
+static rh_probe probe_for_key(tmap *tp, uint64_t key_hash, str key,
+                              uint64_t int_key) {
+  probe_key pk = {.tp = tp, .key = key, .int_key = int_key};
+  return rh_find(mem_p(tp->table_mh), tp->slot_size, tp->table_size,
+                 home_pos(key_hash, tp->table_size), key_hash, slot_has_key,
+                 &pk);
+}
+
+/**
+ * @brief Gets the map for a handle and checks a key passed to a public
+ * function.
+ *
+ * @param th The typed map handle
+ * @param key The str key of a map of str keys
+ * @param int_key The key of a map of integer or pointer keys
+ * @return tmap* The map, or null if the handle or key is invalid
+ */
+static tmap *tmap_for_key(tmap_handle th, str key, uint64_t int_key) {
+  tmap *tp = tmap_for_handle(th);
+  if (!tp) return (tmap *)0;
+  if (tp->key_kind == TMAP_KEY_STR &&
+      (!str_is_valid(key) || key.size > UINT32_MAX)) {
+    return (tmap *)0;
+  }
+  if (tp->key_kind == TMAP_KEY_U32 && int_key > UINT32_MAX) return (tmap *)0;
+  return tp;
+}
+
+static void *entry_value(tmap *tp, unsigned int pos) {
+  return slot_entry(tp, table_slot(tp, tp->table_mh, pos)) + tp->value_offset;
+}
+
+void *tmap_get(tmap_handle th, str key, uint64_t int_key) {
+  tmap *tp = tmap_for_key(th, key, int_key);
+  if (!tp) return (void *)0;
+  rh_probe probe =
+      probe_for_key(tp, key_hash(tp, key, int_key), key, int_key);
+  return probe.found ? entry_value(tp, probe.pos) : (void *)0;
+}
+
+/**
+ * @brief Makes a new slot for a key.
+ *
+ * @param tp The typed map
+ * @param key The str key of a map of str keys
+ * @param int_key The key of a map of integer or pointer keys
+ * @param slot Set to the slot, with a copy of a str key and a zeroed value,
+ *   and no metadata
+ * @return true on success, false if the key could not be copied
+ */
+static bool make_slot(tmap *tp, str key, uint64_t int_key, rh_slot_buf *slot) {
+  memset(slot->bytes, 0, tp->slot_size);
+  unsigned char *entry = slot->bytes + tp->entry_offset;
+  switch (tp->key_kind) {
+    case TMAP_KEY_STR: {
+      char *data = EMPTY_KEY;
+      uint32_t size = key.size;
+      if (size > 0) {
+        str key_copy = mem_duplicate_with_allocator(tp->allocator, key);
+        if (!mem_is_valid(key_copy)) return false;
+        data = mem_p(key_copy);
+      }
+      memcpy(entry, &data, sizeof(data));
+      memcpy(entry + sizeof(data), &size, sizeof(size));
+      return true;
+    }
+    case TMAP_KEY_U32: {
+      uint32_t entry_key = int_key;
+      memcpy(entry, &entry_key, sizeof(entry_key));
+      return true;
+    }
+    default:
+      memcpy(entry, &int_key, sizeof(int_key));
+      return true;
+  }
+}
+
+void *tmap_get_or_insert(tmap_handle th, str key, uint64_t int_key,
+                         bool *inserted) {
+  tmap *tp = tmap_for_key(th, key, int_key);
+  if (!tp) return (void *)0;
+  uint64_t hash = key_hash(tp, key, int_key);
+  rh_probe probe = probe_for_key(tp, hash, key, int_key);
+  if (inserted) *inserted = !probe.found;
+  if (probe.found) return entry_value(tp, probe.pos);
+
+  rh_slot_buf slot;
+  if (!make_slot(tp, key, int_key, &slot)) return (void *)0;
+  if (tp->entry_count + 1 > rh_max_count(tp->table_size)) {
+    if (!resize_table(tp, tp->table_size << 1)) {
+      if (tp->key_kind == TMAP_KEY_STR) {
+        free_str_key(tp, slot.bytes + tp->entry_offset);
+      }
+      return (void *)0;
+    }
+    probe = probe_for_key(tp, hash, key, int_key);
+  }
+  slot.meta = probe.key_meta;
+  rh_place(mem_p(tp->table_mh), tp->slot_size, tp->table_size, probe.pos,
+           &slot);
+  ++tp->entry_count;
+  return entry_value(tp, probe.pos);
+}
+
+bool tmap_delete(tmap_handle th, str key, uint64_t int_key) {
+  tmap *tp = tmap_for_key(th, key, int_key);
+  if (!tp) return false;
+  rh_probe probe =
+      probe_for_key(tp, key_hash(tp, key, int_key), key, int_key);
+  if (!probe.found) return false;
+  if (tp->key_kind == TMAP_KEY_STR) {
+    free_str_key(tp, slot_entry(tp, table_slot(tp, tp->table_mh, probe.pos)));
+  }
+  rh_remove(mem_p(tp->table_mh), tp->slot_size, tp->table_size, probe.pos);
+  --tp->entry_count;
+
+  // A failed shrink leaves the table larger, which is harmless.
+  if (rh_should_shrink(tp->entry_count, tp->table_size, INITIAL_TABLE_SIZE)) {
+    resize_table(tp, tp->table_size >> 1);
+  }
+  return true;
+}
+
+/**
+ * @brief Makes an iterator for the first entry at or after a position.
+ *
+ * @param th The typed map handle
+ * @param pos The position
+ * @return tmap_iter The iterator, done if there are no more entries
+ */
+static tmap_iter iter_from(tmap_handle th, unsigned int pos) {
+  tmap *tp = tmap_for_handle(th);
+  if (!tp) return (tmap_iter){0};
+  while (pos < tp->table_size && !*table_slot(tp, tp->table_mh, pos)) pos++;
+  if (pos >= tp->table_size) return (tmap_iter){0};
+  return (tmap_iter){
+      .th = th,
+      .pos = pos,
+      .entry = slot_entry(tp, table_slot(tp, tp->table_mh, pos))};
+}
+
+tmap_iter tmap_first_iter(tmap_handle th) {
+  return iter_from(th, 0);
+}
+
+tmap_iter tmap_next_iter(tmap_iter it) {
+  if (tmap_iter_done(it)) return (tmap_iter){0};
+  return iter_from(it.th, it.pos + 1);
+}
+
+bool tmap_iter_done(tmap_iter it) {
+  return it.entry == (void *)0;
+}
+
+void *tmap_iter_value(tmap_iter it) {
+  if (tmap_iter_done(it)) return (void *)0;
+  return (unsigned char *)it.entry + ((tmap *)mem_p(it.th))->value_offset;
+}
+
+str tmap_iter_str_key(tmap_iter it) {
+  if (tmap_iter_done(it) || ((tmap *)mem_p(it.th))->key_kind != TMAP_KEY_STR)
+    return (str){0};
+  return entry_str_key(it.entry);
+}
+
+uint64_t tmap_iter_int_key(tmap_iter it) {
+  if (tmap_iter_done(it)) return 0;
+  switch (((tmap *)mem_p(it.th))->key_kind) {
+    case TMAP_KEY_STR:
+      return 0;
+    case TMAP_KEY_U32: {
+      uint32_t key;
+      memcpy(&key, it.entry, sizeof(key));
+      return key;
+    }
+    default: {
+      uint64_t key;
+      memcpy(&key, it.entry, sizeof(key));
+      return key;
+    }
+  }
+}
@@ -0,0 +1,331 @@
+/**
+ * @file tmap.h
+ * @brief Maps that store small values inline, in type-specialized variants.
+ *
+ *   map_str_u32_handle counts = map_str_u32_create(MEM_ALLOCATOR_PLAIN);
+ *   if (!map_str_u32_is_valid(counts)) abort();
+ *   uint32_t *count = map_str_u32_get_or_insert(counts, word, (bool *)0);
+ *   if (!count) abort();
+ *   ++*count;
+ *
+ * The value of a `map` entry is a mem_handle, which refers to memory allocated
+ * somewhere else. A typed map stores a small Plain Old Data value in the entry
+ * itself, so a counter or an integer needs no allocation of its own, and is
+ * read and updated in place. A new entry's value is zeroed.
+ *
+ * A key is a str, a uint32_t, a uint64_t, or a pointer. The map keeps its own
+ * copy of each str key, as `map` does, and stores only the copy's address and
+ * 32-bit size, so a str key is at most 4 GiB - 1 bytes. A str key to a
+ * uint32_t value, such as a word and its count, is a 16-byte entry. Integer
+ * keys are stored as integers: a uint32_t key to a uint32_t value, such as a
+ * MEGA65 28-bit address and its label number, is an 8-byte entry, where a
+ * `map` entry is 40 bytes or more. Each slot also has 8 bytes of probe
+ * metadata.
+ *
+ * The variants are declared with `TMAP_DEFINE`, which makes a set of inline
+ * functions that cast to and from the value type around the untyped `tmap_*`
+ * functions. The variants declared here are:
+ *
+ *   map_str_u32   str       -> uint32_t
+ *   map_str_u64   str       -> uint64_t
+ *   map_str_ptr   str       -> void *
+ *   map_u32_u32   uint32_t  -> uint32_t
+ *   map_u32_ptr   uint32_t  -> void *
+ *   map_u64_u64   uint64_t  -> uint64_t
+ *   map_ptr_ptr   void *    -> void *
+ *
+ * Another can be declared for any value type of up to TMAP_MAX_VALUE_SIZE
+ * bytes:
+ *
+ *   typedef struct { uint16_t line; uint16_t col; } pos;
+ *   TMAP_DEFINE(map_u32_pos, U32, pos)
+ *
+ * A typed map is an open-addressing hash table with Robin Hood probing, using
+ * the same probing, insertion, deletion, and resize thresholds as `map`
+ * (rhtable.h). Unlike `map`, it stores each entry in its table slot, with no
+ * separate entries array, so it keeps no insertion order and always resizes
+ * all at once. Adding or deleting a key moves other entries, so a value
+ * pointer is only valid until the map is changed.
+ */
+
+#ifndef DATASTRUCT_TMAP_H
+#define DATASTRUCT_TMAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mem.h"
+#include "str.h"
+
+// The largest value a typed map can store inline, in bytes
+#define TMAP_MAX_VALUE_SIZE 64
+
+// Handle for a typed map, returned by `tmap_create`
+typedef mem_handle tmap_handle;
+
+// The type of a typed map's keys
+typedef enum tmap_key_kind {
+  TMAP_KEY_STR,
+  TMAP_KEY_U32,
+  TMAP_KEY_U64,
+  TMAP_KEY_PTR
+} tmap_key_kind;
+
+// Internal type for a typed map data structure
+typedef struct tmap {
+  // The allocator for the table and key copies
+  mem_allocator allocator;
+
+  tmap_key_kind key_kind;
+
+  // The size of an entry: the key, then the value, then padding
+  unsigned int entry_size;
+
+  // The offset of the value within an entry
+  unsigned int value_offset;
+
+  // The size of a table slot: its probe metadata, then the entry, then padding
+  unsigned int slot_size;
+
+  // The offset of the entry within a slot
+  unsigned int entry_offset;
+
+  // The table of slots
+  mem_handle table_mh;
+  unsigned int entry_count;
+
+  // The number of slots in the table, a power of two
+  unsigned int table_size;
+} tmap;
+
+/**
+ * @brief Creates a typed map.
+ *
+ * This is usually called through a variant's create function, such as
+ * `map_str_u32_create`. Use `tmap_is_valid` to validate the map before using.
+ *
+ * @param ma The memory allocator to use
+ * @param key_kind The type of the keys
+ * @param value_size The size of a value, from 1 to TMAP_MAX_VALUE_SIZE
+ * @param value_align The alignment of a value, a power of two no greater than
+ *   that of max_align_t
+ * @return tmap_handle A handle for the map, invalid if the value does not fit
+ *   or memory could not be allocated
+ */
+tmap_handle tmap_create(mem_allocator ma, tmap_key_kind key_kind,
+                        size_t value_size, size_t value_align);
+
+/**
+ * @param th The typed map handle
+ * @return true if the map is valid
+ */
+bool tmap_is_valid(tmap_handle th);
+
+/**
+ * @brief Destroys a typed map.
+ *
+ * @param th The handle of the map to destroy
+ */
+void tmap_destroy(tmap_handle th);
+
+/**
+ * @param th The typed map handle
+ * @return size_t The number of keys in the map
+ */
+size_t tmap_count(tmap_handle th);
+
+/**
+ * @brief Gets the value for a key.
+ *
+ * @param th The typed map handle
+ * @param key The key of a map of str keys, otherwise ignored
+ * @param int_key The key of a map of integer or pointer keys, otherwise
+ *   ignored
+ * @return void* The value, or null if the key is not in the map
+ */
+void *tmap_get(tmap_handle th, str key, uint64_t int_key);
+
+/**
+ * @brief Gets the value for a key, adding the key with a zeroed value if it is
+ * not set.
+ *
+ * @param th The typed map handle
+ * @param key The key of a map of str keys, otherwise ignored
+ * @param int_key The key of a map of integer or pointer keys, otherwise
+ *   ignored
+ * @param inserted If not null, set to true if the key was added
+ * @return void* The value, or null if the key could not be added, possibly due
+ *   to an out-of-memory error while resizing the internal table, or because a
+ *   str key is 4 GiB or longer
+ */
+void *tmap_get_or_insert(tmap_handle th, str key, uint64_t int_key,
+                         bool *inserted);
+
+/**
+ * @brief Deletes a key from a typed map.
+ *
+ * If the table could not be shrunk afterward, it stays larger.
+ *
+ * @param th The typed map handle
+ * @param key The key of a map of str keys, otherwise ignored
+ * @param int_key The key of a map of integer or pointer keys, otherwise
+ *   ignored
+ * @return true if the key was in the map
+ */
+bool tmap_delete(tmap_handle th, str key, uint64_t int_key);
+
+// Typed map iterator
+typedef struct tmap_iter {
+  tmap_handle th;
+  unsigned int pos;
+
+  // The entry at pos, or null when the iteration is done
+  void *entry;
+} tmap_iter;
+
+/**
+ * @brief Gets the first iterator in a typed map iteration.
+ *
+ * Entries have no guaranteed order. If anything adds or deletes a key, using
+ * an existing `tmap_iter` is undefined.
+ *
+ * @param th The typed map handle
+ * @return tmap_iter
+ */
+tmap_iter tmap_first_iter(tmap_handle th);
+
+/**
+ * @brief Gets the next iterator in a typed map iteration.
+ *
+ * @param it
+ * @return tmap_iter
+ */
+tmap_iter tmap_next_iter(tmap_iter it);
+
+/**
+ * @param it
+ * @return true if the iterator does not point to an entry and has no entries
+ *   after it
+ */
+bool tmap_iter_done(tmap_iter it);
+
+/**
+ * @param it An iterator that is not done
+ * @return void* The value of the entry
+ */
+void *tmap_iter_value(tmap_iter it);
+
+/**
+ * @param it An iterator of a map of str keys that is not done
+ * @return str The key of the entry, owned by the map
+ */
+str tmap_iter_str_key(tmap_iter it);
+
+/**
+ * @param it An iterator of a map of integer or pointer keys that is not done
+ * @return uint64_t The key of the entry
+ */
+uint64_t tmap_iter_int_key(tmap_iter it);
+
+// Internal: the key type of each key kind, and how a variant passes a key to
+// and from the tmap functions.
+#define TMAP_KEY_TYPE_STR str
+#define TMAP_KEY_TYPE_U32 uint32_t
+#define TMAP_KEY_TYPE_U64 uint64_t
+#define TMAP_KEY_TYPE_PTR void *
+#define TMAP_STR_ARG_STR(key) (key)
+#define TMAP_STR_ARG_U32(key) ((str){0})
+#define TMAP_STR_ARG_U64(key) ((str){0})
+#define TMAP_STR_ARG_PTR(key) ((str){0})
+#define TMAP_INT_ARG_STR(key) 0
+#define TMAP_INT_ARG_U32(key) (key)
+#define TMAP_INT_ARG_U64(key) (key)
+#define TMAP_INT_ARG_PTR(key) ((uintptr_t)(key))
+#define TMAP_ITER_KEY_STR(it) tmap_iter_str_key(it)
+#define TMAP_ITER_KEY_U32(it) ((uint32_t)tmap_iter_int_key(it))
+#define TMAP_ITER_KEY_U64(it) tmap_iter_int_key(it)
+#define TMAP_ITER_KEY_PTR(it) ((void *)(uintptr_t)tmap_iter_int_key(it))
+
+/**
+ * @brief Declares a typed map variant.
+ *
+ * This declares `<name>_handle` and inline functions that mirror the `tmap_*`
+ * functions with typed keys and values:
+ *
+ *   <name>_handle <name>_create(mem_allocator ma)
+ *   bool <name>_is_valid(<name>_handle h)
+ *   void <name>_destroy(<name>_handle h)
+ *   size_t <name>_count(<name>_handle h)
+ *   value_type *<name>_get(<name>_handle h, key)
+ *   value_type *<name>_get_or_insert(<name>_handle h, key, bool *inserted)
+ *   bool <name>_set(<name>_handle h, key, value_type value)
+ *   bool <name>_delete(<name>_handle h, key)
+ *   tmap_iter <name>_first_iter(<name>_handle h)
+ *   value_type *<name>_iter_value(tmap_iter it)
+ *   key <name>_iter_key(tmap_iter it)
+ *
+ * Iteration continues with `tmap_next_iter` and `tmap_iter_done`.
+ *
+ * @param name The name of the variant
+ * @param key_kind STR, U32, U64, or PTR
+ * @param value_type The type of a value
+ */
+#define TMAP_DEFINE(name, key_kind, value_type)                              \
+  typedef tmap_handle name##_handle;                                         \
+  static inline name##_handle name##_create(mem_allocator ma) {              \
+    return tmap_create(ma, TMAP_KEY_##key_kind, sizeof(value_type),          \
+                       _Alignof(value_type));                                \
+  }                                                                          \
+  static inline bool name##_is_valid(name##_handle h) {                      \
+    return tmap_is_valid(h);                                                 \
+  }                                                                          \
+  static inline void name##_destroy(name##_handle h) {                       \
+    tmap_destroy(h);                                                         \
+  }                                                                          \
+  static inline size_t name##_count(name##_handle h) {                       \
+    return tmap_count(h);                                                    \
+  }                                                                          \
+  static inline value_type *name##_get(name##_handle h,                      \
+                                       TMAP_KEY_TYPE_##key_kind key) {       \
+    return (value_type *)tmap_get(h, TMAP_STR_ARG_##key_kind(key),           \
+                                  TMAP_INT_ARG_##key_kind(key));             \
+  }                                                                          \
+  static inline value_type *name##_get_or_insert(                            \
+      name##_handle h, TMAP_KEY_TYPE_##key_kind key, bool *inserted) {       \
+    return (value_type *)tmap_get_or_insert(                                 \
+        h, TMAP_STR_ARG_##key_kind(key), TMAP_INT_ARG_##key_kind(key),       \
+        inserted);                                                           \
+  }                                                                          \
+  static inline bool name##_set(name##_handle h,                             \
+                                TMAP_KEY_TYPE_##key_kind key,                \
+                                value_type value) {                          \
+    value_type *slot = name##_get_or_insert(h, key, (bool *)0);              \
+    if (!slot) return false;                                                 \
+    *slot = value;                                                           \
+    return true;                                                             \
+  }                                                                          \
+  static inline bool name##_delete(name##_handle h,                          \
+                                   TMAP_KEY_TYPE_##key_kind key) {           \
+    return tmap_delete(h, TMAP_STR_ARG_##key_kind(key),                      \
+                       TMAP_INT_ARG_##key_kind(key));                        \
+  }                                                                          \
+  static inline tmap_iter name##_first_iter(name##_handle h) {               \
+    return tmap_first_iter(h);                                               \
+  }                                                                          \
+  static inline value_type *name##_iter_value(tmap_iter it) {                \
+    return (value_type *)tmap_iter_value(it);                                \
+  }                                                                          \
+  static inline TMAP_KEY_TYPE_##key_kind name##_iter_key(tmap_iter it) {     \
+    return TMAP_ITER_KEY_##key_kind(it);                                     \
+  }
+
+TMAP_DEFINE(map_str_u32, STR, uint32_t)
+TMAP_DEFINE(map_str_u64, STR, uint64_t)
+TMAP_DEFINE(map_str_ptr, STR, void *)
+TMAP_DEFINE(map_u32_u32, U32, uint32_t)
+TMAP_DEFINE(map_u32_ptr, U32, void *)
+TMAP_DEFINE(map_u64_u64, U64, uint64_t)
+TMAP_DEFINE(map_ptr_ptr, PTR, void *)
+
+#endif
@@ -4,8 +4,9 @@
 #include <stdlib.h>
 #include <unistd.h>
 
-#include "datastruct/map.h"
+#include "datastruct/mem.h"
 #include "datastruct/str.h"
+#include "datastruct/tmap.h"
 
 int getopt_test(int argc, char **argv) {
   static int verbose_flag;
@@ -70,98 +71,51 @@ int getopt_test(int argc, char **argv) {
   return 0;
 }
 
-mem_handle counts;
-const unsigned int INITIAL_COUNTS_SIZE = 128;
-unsigned int words_seen = 0;
-map_handle mymap;
-
-void process_line(str line) {
-  str word;
-  while (str_is_valid(line)) {
-    line = str_split_whitespace_pop(line, &word);
-    if (word.size > 0) {
-      mem_handle entry = map_get(mymap, word);
-      if (mem_is_valid(entry)) {
-        // Seen word
-        unsigned int *valp = mem_p(entry);
-        ++(*valp);
-
-      } else {
-        // New word
-        ++words_seen;
-        if (words_seen > counts.size) {
-          counts = mem_realloc(counts, counts.size * 2);
-          if (!mem_is_valid(counts)) {
-            puts("Error resizing counts array\n");
-            exit(EXIT_FAILURE);
-          }
-        }
-        unsigned int *arr = mem_p(counts);
-        mem_handle value =
-            mem_handle_from_ptr(&arr[words_seen - 1], sizeof(unsigned int));
-        if (!map_set(mymap, word, value)) {
-          puts("Error adding new key to map\n");
-          exit(EXIT_FAILURE);
-        }
-        arr[words_seen - 1] = 1;
-      }
-    }
-  }
-}
+map_str_u32_handle mymap;
 
-void word_freq(char *fname) {
-  FILE *infile;
+// The number of words that word_freq tokenizes at a time
+#define WORD_BATCH_SIZE 256
 
-  infile = fopen(fname, "r");
-  if (infile == (void *)0) {
-    printf("Could not open file '%s'\n", fname);
+void count_word(str word) {
+  // A new word's count starts at zero.
+  uint32_t *count = map_str_u32_get_or_insert(mymap, word, (bool *)0);
+  if (!count) {
+    puts("Error adding new key to map\n");
     exit(EXIT_FAILURE);
   }
+  ++(*count);
+}
 
-  counts = mem_alloc(MEM_ALLOCATOR_PLAIN,
-                     sizeof(unsigned int) * INITIAL_COUNTS_SIZE);
-  if (!mem_is_valid(counts)) {
-    puts("Error creating counts array\n");
+void word_freq(char *fname) {
+  str text = str_from_file(fname);
+  if (!str_is_valid(text)) {
+    printf("Could not open file '%s'\n", fname);
     exit(EXIT_FAILURE);
   }
 
-  mymap = map_create(MEM_ALLOCATOR_PLAIN);
-  if (!map_is_valid(mymap)) {
+  mymap = map_str_u32_create(MEM_ALLOCATOR_PLAIN);
+  if (!map_str_u32_is_valid(mymap)) {
     puts("Error creating map\n");
     exit(EXIT_FAILURE);
   }
 
-  int c;
-  strbuf_handle buf = strbuf_create(MEM_ALLOCATOR_PLAIN, 100);
-  if (!strbuf_is_valid(buf)) {
-    puts("Error creating strbuf\n");
-    exit(EXIT_FAILURE);
-  }
-  str line;
-  while ((c = getc(infile)) != EOF) {
-    // This reads from stdin into a strbuf one line at a time, then uses
-    // str_split_whitespace_pop to parse it into words. We could just as easily
-    // do the word splitting while we read characters, but this is meant to
-    // exercise the library.
-    if (c == '\n') {
-      line = strbuf_str(buf);
-      process_line(line);
-      strbuf_reset(buf);
-    } else {
-      if (!strbuf_concatenate_char(buf, c)) {
-        puts("Error growing string buffer\n");
-        exit(EXIT_FAILURE);
-      }
-    }
+  // This maps the file into memory and splits the whole file into words with
+  // str_tokenize, a batch at a time. The map copies each new word as its key.
+  str_delims whitespace = str_delims_make(str_from_cstr(STR_WHITESPACE));
+  str words[WORD_BATCH_SIZE];
+  str remaining = text;
+  while (str_is_valid(remaining)) {
+    size_t word_count;
+    remaining = str_tokenize(remaining, &whitespace, words, WORD_BATCH_SIZE,
+                             &word_count);
+    for (size_t i = 0; i < word_count; i++) count_word(words[i]);
   }
-  line = strbuf_str(buf);
-  if (line.size > 0) process_line(line);
 
   int most_freq[5] = {0};
   int least_freq[5] = {0};
-  unsigned int *arr = mem_p(counts);
-  for (int i = 0; i < words_seen; i++) {
-    unsigned int count = arr[i];
+  tmap_iter count_it = map_str_u32_first_iter(mymap);
+  while (!tmap_iter_done(count_it)) {
+    unsigned int count = *map_str_u32_iter_value(count_it);
     for (int p = 0; p < 5; p++) {
       if (most_freq[p] == count) {
         break;
@@ -172,7 +126,7 @@ void word_freq(char *fname) {
         count = t;
       }
     }
-    count = arr[i];
+    count = *map_str_u32_iter_value(count_it);
     for (int p = 0; p < 5; p++) {
       if (least_freq[p] == count) {
         break;
@@ -183,14 +137,14 @@ void word_freq(char *fname) {
         count = t;
       }
     }
+    count_it = tmap_next_iter(count_it);
   }
 
   unsigned int most_freq_matches[5] = {0};
   unsigned int least_freq_matches[5] = {0};
-  map_iter it = map_first_value_iter(mymap);
-  while (!map_iter_done(it)) {
-    mem_handle count_handle = map_iter_value(it);
-    unsigned int count = *((unsigned int *)mem_p(count_handle));
+  tmap_iter it = map_str_u32_first_iter(mymap);
+  while (!tmap_iter_done(it)) {
+    unsigned int count = *map_str_u32_iter_value(it);
     for (int i = 0; i < 5; i++) {
       if (count == most_freq[i]) {
         ++most_freq_matches[i];
@@ -199,7 +153,7 @@ void word_freq(char *fname) {
         ++least_freq_matches[i];
       }
     }
-    it = map_next_value_iter(it);
+    it = tmap_next_iter(it);
   }
 
   puts("Most frequent words\n==================\nCount\tWords\n");
@@ -211,13 +165,78 @@ void word_freq(char *fname) {
     printf("%d\t%d\n", least_freq[i], least_freq_matches[i]);
   }
 
-  fclose(infile);
+  map_str_u32_destroy(mymap);
+  str_destroy(text);
+}
+
+const char *allocator_type_name(enum mem_allocator_type allocator_type) {
+  switch (allocator_type) {
+    case MEM_ALLOCATOR_TYPE_PLAIN:
+      return "plain";
+    case MEM_ALLOCATOR_TYPE_MEMTBL:
+      return "memtbl";
+    case MEM_ALLOCATOR_TYPE_ARENA:
+      return "arena";
+    case MEM_ALLOCATOR_TYPE_SLAB:
+      return "slab";
+    case MEM_ALLOCATOR_TYPE_MMAP:
+      return "mmap";
+    case MEM_ALLOCATOR_TYPE_FILE:
+      return "file";
+    default:
+      return "other";
+  }
+}
+
+void print_mem_stats(void) {
+  if (!mem_stats_enabled()) {
+    puts("\nMemory statistics are not available. Rebuild with "
+         "./configure --enable-mem-stats.");
+    return;
+  }
+  puts("\nMemory statistics\n=================");
+  for (unsigned int i = 0; i < mem_stats_allocator_count(); i++) {
+    mem_stats stats = mem_stats_get_by_index(i);
+    printf("\nAllocator %u (%s)\n", i,
+           allocator_type_name(stats.allocator.allocator_spec->allocator_type));
+    printf("  live bytes:     %zu\n", stats.live_bytes);
+    printf("  peak bytes:     %zu\n", stats.peak_bytes);
+    printf("  allocs:         %zu\n", stats.alloc_count);
+    printf("  reallocs:       %zu (%zu moved, %zu bytes copied)\n",
+           stats.realloc_count, stats.realloc_copy_count,
+           stats.realloc_copy_bytes);
+    printf("  frees:          %zu\n", stats.free_count);
+    printf("  failures:       %zu\n", stats.fail_count);
+    puts("  size histogram:");
+    for (unsigned int b = 0; b < MEM_STATS_HISTOGRAM_SIZE; b++) {
+      if (stats.size_histogram[b] == 0) continue;
+      size_t low = b ? (size_t)1 << (b - 1) : 0;
+      size_t high = b ? ((size_t)1 << b) - 1 : 0;
+      printf("    %10zu - %-10zu %zu\n", low, high, stats.size_histogram[b]);
+    }
+  }
 }
 
 int main(int argc, char **argv) {
-  if (argc != 2) {
-    puts("Usage: m65tool file.txt");
+  static int mem_stats_flag;
+  // clang-format off
+  static struct option long_options[] = {
+    {"mem-stats", no_argument, &mem_stats_flag, 1},
+    {0, 0, 0, 0}
+  };
+  // clang-format on
+
+  int opt;
+  while ((opt = getopt_long(argc, argv, "", long_options, (int *)0)) != -1) {
+    if (opt != 0) {
+      puts("Usage: m65tool [--mem-stats] file.txt");
+      exit(EXIT_FAILURE);
+    }
+  }
+  if (argc - optind != 1) {
+    puts("Usage: m65tool [--mem-stats] file.txt");
     exit(EXIT_FAILURE);
   }
-  word_freq(argv[1]);
+  word_freq(argv[optind]);
+  if (mem_stats_flag) print_mem_stats();
 }
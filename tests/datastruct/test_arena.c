@@ -0,0 +1,162 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "datastruct/arena.h"
+#include "datastruct/map.h"
+#include "datastruct/str.h"
+#include "unity.h"
+
+arena_handle ah;
+mem_allocator ma;
+
+void setUp(void) {
+  ah = arena_create(MEM_ALLOCATOR_PLAIN, 256);
+  ma = mem_allocator_arena(ah);
+}
+
+void tearDown(void) {
+  arena_destroy(ah);
+}
+
+void test_ArenaCreate_IsValid(void) {
+  TEST_ASSERT_TRUE(arena_is_valid(ah));
+}
+
+void test_ArenaCreate_InvalidAllocator_IsInvalid(void) {
+  arena_handle bad = arena_create((mem_allocator){0}, 256);
+  TEST_ASSERT_FALSE(arena_is_valid(bad));
+}
+
+void test_MemAlloc_ArenaAllocator_AllocatesMemory(void) {
+  mem_handle result = mem_alloc(ma, sizeof(int));
+  TEST_ASSERT_TRUE(mem_is_valid(result));
+  TEST_ASSERT_EQUAL(sizeof(int), mem_size(result));
+  int *ptr = mem_p(result);
+  *ptr = 123;
+  TEST_ASSERT_EQUAL(123, *ptr);
+}
+
+void test_MemAlloc_ArenaAllocator_AlignsAllocations(void) {
+  mem_handle first = mem_alloc(ma, 1);
+  mem_handle second = mem_alloc(ma, 1);
+  TEST_ASSERT_EQUAL(0, (uintptr_t)mem_p(first) % _Alignof(max_align_t));
+  TEST_ASSERT_EQUAL(0, (uintptr_t)mem_p(second) % _Alignof(max_align_t));
+  TEST_ASSERT_NOT_EQUAL(mem_p(first), mem_p(second));
+}
+
+void test_MemAlloc_PastChunkSize_AllocatesNewChunk(void) {
+  arena *ap = mem_p(ah);
+  arena_chunk *first_chunk = ap->current_chunk;
+  for (int i = 0; i < 20; i++) {
+    mem_handle result = mem_alloc(ma, 32);
+    TEST_ASSERT_TRUE(mem_is_valid(result));
+    memset(mem_p(result), i, 32);
+  }
+  TEST_ASSERT_NOT_EQUAL(first_chunk, ap->current_chunk);
+}
+
+void test_MemAlloc_LargerThanChunk_Succeeds(void) {
+  mem_handle result = mem_alloc(ma, 1000);
+  TEST_ASSERT_TRUE(mem_is_valid(result));
+  memset(mem_p(result), 0xff, 1000);
+}
+
+void test_MemAlloc_ArenaAllocatorHugeSize_Fails(void) {
+  // The size aligned or with a chunk header added would wrap around.
+  TEST_ASSERT_FALSE(mem_is_valid(mem_alloc(ma, SIZE_MAX - 3)));
+  mem_handle result = mem_alloc(ma, 16);
+  TEST_ASSERT_FALSE(mem_is_valid(mem_realloc(result, SIZE_MAX - 3)));
+  TEST_ASSERT_EQUAL(16, mem_size(result));
+  arena_handle huge = arena_create(MEM_ALLOCATOR_PLAIN, SIZE_MAX);
+  TEST_ASSERT_FALSE(arena_is_valid(huge));
+}
+
+void test_MemRealloc_LastAllocation_GrowsInPlace(void) {
+  mem_handle result = mem_alloc(ma, 16);
+  void *orig = mem_p(result);
+  result = mem_realloc(result, 64);
+  TEST_ASSERT_TRUE(mem_is_valid(result));
+  TEST_ASSERT_EQUAL(64, mem_size(result));
+  TEST_ASSERT_EQUAL_PTR(orig, mem_p(result));
+}
+
+void test_MemRealloc_NotLastAllocation_CopiesData(void) {
+  mem_handle result = mem_alloc(ma, 16);
+  memcpy(mem_p(result), "0123456789abcdef", 16);
+  mem_handle other = mem_alloc(ma, 16);
+  TEST_ASSERT_TRUE(mem_is_valid(other));
+  mem_handle grown = mem_realloc(result, 64);
+  TEST_ASSERT_TRUE(mem_is_valid(grown));
+  TEST_ASSERT_NOT_EQUAL(mem_p(result), mem_p(grown));
+  TEST_ASSERT_EQUAL_MEMORY("0123456789abcdef", mem_p(grown), 16);
+}
+
+void test_MemRealloc_PastChunkSize_CopiesData(void) {
+  mem_handle result = mem_alloc(ma, 16);
+  memcpy(mem_p(result), "0123456789abcdef", 16);
+  result = mem_realloc(result, 1000);
+  TEST_ASSERT_TRUE(mem_is_valid(result));
+  TEST_ASSERT_EQUAL(1000, mem_size(result));
+  TEST_ASSERT_EQUAL_MEMORY("0123456789abcdef", mem_p(result), 16);
+}
+
+void test_MemAllocAligned_ArenaAllocator_KeepsAlignment(void) {
+  mem_alloc(ma, 8);
+  mem_handle result = mem_alloc_aligned(ma, 24, 64);
+  TEST_ASSERT_TRUE(mem_is_valid(result));
+  TEST_ASSERT_EQUAL(0, (uintptr_t)mem_p(result) % 64);
+  memcpy(mem_p(result), "0123456789abcdef", 16);
+  result = mem_realloc(result, 1000);
+  TEST_ASSERT_TRUE(mem_is_valid(result));
+  TEST_ASSERT_EQUAL(0, (uintptr_t)mem_p(result) % 64);
+  TEST_ASSERT_EQUAL_MEMORY("0123456789abcdef", mem_p(result), 16);
+  mem_free(result);
+}
+
+void test_MemFree_LastAllocation_ReusesMemory(void) {
+  mem_handle result = mem_alloc(ma, 16);
+  void *orig = mem_p(result);
+  result = mem_free(result);
+  TEST_ASSERT_FALSE(mem_is_valid(result));
+  result = mem_alloc(ma, 16);
+  TEST_ASSERT_EQUAL_PTR(orig, mem_p(result));
+}
+
+void test_ArenaReset_ReusesMemory(void) {
+  mem_handle result = mem_alloc(ma, 16);
+  void *orig = mem_p(result);
+  for (int i = 0; i < 20; i++) mem_alloc(ma, 32);
+  arena_reset(ah);
+  result = mem_alloc(ma, 16);
+  TEST_ASSERT_EQUAL_PTR(orig, mem_p(result));
+}
+
+void test_ArenaReset_ReusesLaterChunks(void) {
+  arena *ap = mem_p(ah);
+  for (int i = 0; i < 20; i++) mem_alloc(ma, 32);
+  arena_chunk *last_chunk = ap->current_chunk;
+  TEST_ASSERT_NOT_EQUAL(ap->first_chunk, last_chunk);
+  arena_reset(ah);
+  TEST_ASSERT_EQUAL_PTR(ap->first_chunk, ap->current_chunk);
+  for (int i = 0; i < 20; i++) mem_alloc(ma, 32);
+  TEST_ASSERT_EQUAL_PTR(last_chunk, ap->current_chunk);
+}
+
+void test_MapCreate_ArenaAllocator_StoresValues(void) {
+  map_handle mh = map_create(ma);
+  TEST_ASSERT_TRUE(map_is_valid(mh));
+  str key = str_duplicate_cstr_with_allocator("key1", ma);
+  mem_handle val = mem_alloc(ma, sizeof(int));
+  TEST_ASSERT_TRUE(map_set(mh, key, val));
+  TEST_ASSERT_EQUAL_PTR(mem_p(val), mem_p(map_get(mh, key)));
+}
+
+void test_StrbufConcatenate_ArenaAllocator_GrowsBuffer(void) {
+  strbuf_handle buf = strbuf_create(ma, 4);
+  TEST_ASSERT_TRUE(strbuf_is_valid(buf));
+  for (int i = 0; i < 100; i++) {
+    TEST_ASSERT_TRUE(strbuf_concatenate_cstr(buf, "abc"));
+  }
+  TEST_ASSERT_EQUAL(300, str_length(strbuf_str(buf)));
+}
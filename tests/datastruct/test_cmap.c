@@ -0,0 +1,181 @@
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "datastruct/cmap.h"
+#include "datastruct/str.h"
+#include "unity.h"
+
+cmap_handle cmaph;
+mem_handle val, val2;
+
+void setUp(void) {
+  cmaph = cmap_create(MEM_ALLOCATOR_PLAIN, 0);
+  val = mem_alloc(MEM_ALLOCATOR_PLAIN, sizeof(int));
+  val2 = mem_alloc(MEM_ALLOCATOR_PLAIN, sizeof(int));
+}
+
+void tearDown(void) {
+  cmap_destroy(cmaph);
+  mem_free(val);
+  mem_free(val2);
+}
+
+void test_CmapCreate_ShardCount(void) {
+  TEST_ASSERT_TRUE(cmap_is_valid(cmaph));
+  TEST_ASSERT_EQUAL(CMAP_DEFAULT_SHARD_COUNT, cmap_shard_count(cmaph));
+
+  cmap_handle ch = cmap_create(MEM_ALLOCATOR_PLAIN, 4);
+  TEST_ASSERT_TRUE(cmap_is_valid(ch));
+  TEST_ASSERT_EQUAL(4, cmap_shard_count(ch));
+  cmap_destroy(ch);
+
+  TEST_ASSERT_FALSE(cmap_is_valid(cmap_create(MEM_ALLOCATOR_PLAIN, 3)));
+  TEST_ASSERT_FALSE(cmap_is_valid(
+      cmap_create(MEM_ALLOCATOR_PLAIN, CMAP_MAX_SHARD_COUNT * 2)));
+}
+
+void test_CmapSet_StrAndPtrKeys_FindsValues(void) {
+  char loc;
+  TEST_ASSERT_TRUE(cmap_set(cmaph, str_from_cstr("key1"), val));
+  TEST_ASSERT_TRUE(cmap_set(cmaph, (void *)&loc, val2));
+  TEST_ASSERT_EQUAL_PTR(mem_p(val),
+                        mem_p(cmap_get(cmaph, str_from_cstr("key1"))));
+  TEST_ASSERT_EQUAL_PTR(mem_p(val2), mem_p(cmap_get(cmaph, (void *)&loc)));
+  TEST_ASSERT_FALSE(mem_is_valid(cmap_get(cmaph, str_from_cstr("key2"))));
+  TEST_ASSERT_EQUAL(2, cmap_count(cmaph));
+
+  TEST_ASSERT_TRUE(cmap_set(cmaph, str_from_cstr("key1"), val2));
+  TEST_ASSERT_EQUAL_PTR(mem_p(val2),
+                        mem_p(cmap_get(cmaph, str_from_cstr("key1"))));
+  TEST_ASSERT_EQUAL(2, cmap_count(cmaph));
+}
+
+void test_CmapGetOrSet_SetKey_KeepsFirstValue(void) {
+  str key = str_from_cstr("key1");
+  TEST_ASSERT_EQUAL_PTR(mem_p(val), mem_p(cmap_get_or_set(cmaph, key, val)));
+  TEST_ASSERT_EQUAL_PTR(mem_p(val), mem_p(cmap_get_or_set(cmaph, key, val2)));
+  TEST_ASSERT_EQUAL(1, cmap_count(cmaph));
+}
+
+void test_CmapDelete_ReturnsWhetherKeyWasSet(void) {
+  char loc;
+  TEST_ASSERT_TRUE(cmap_set(cmaph, str_from_cstr("key1"), val));
+  TEST_ASSERT_TRUE(cmap_set(cmaph, (void *)&loc, val));
+  TEST_ASSERT_TRUE(cmap_delete(cmaph, str_from_cstr("key1")));
+  TEST_ASSERT_FALSE(cmap_delete(cmaph, str_from_cstr("key1")));
+  TEST_ASSERT_TRUE(cmap_delete(cmaph, (void *)&loc));
+  TEST_ASSERT_FALSE(cmap_delete(cmaph, (void *)&loc));
+  TEST_ASSERT_EQUAL(0, cmap_count(cmaph));
+}
+
+void test_CmapShard_ManyKeys_SpreadsOverShards(void) {
+  char keybuf[16];
+  for (unsigned int i = 0; i < 6400; i++) {
+    snprintf(keybuf, sizeof(keybuf), "sym_%u", i);
+    TEST_ASSERT_TRUE(cmap_set(cmaph, str_from_cstr(keybuf), val));
+  }
+  size_t total = 0;
+  for (unsigned int i = 0; i < cmap_shard_count(cmaph); i++) {
+    map_handle mh = cmap_shard_map(cmaph, i);
+    TEST_ASSERT_TRUE(map_is_valid(mh));
+    size_t count = ((map *)mem_p(mh))->entry_count;
+    // About 100 keys per shard
+    TEST_ASSERT_TRUE(count > 50 && count < 150);
+    total += count;
+  }
+  TEST_ASSERT_EQUAL(6400, total);
+  TEST_ASSERT_FALSE(
+      map_is_valid(cmap_shard_map(cmaph, cmap_shard_count(cmaph))));
+}
+
+// The work of one thread in the threaded test.
+typedef struct worker {
+  pthread_t thread;
+  unsigned int id;
+  // Values for keys that every thread adds, and for keys of this thread
+  char *shared_values;
+  char *own_values;
+  // Set to the number of calls that did not behave as expected
+  unsigned int errors;
+} worker;
+
+static const unsigned int THREAD_COUNT = 4;
+static const unsigned int KEYS_PER_THREAD = 5000;
+static const unsigned int SHARED_KEY_COUNT = 1000;
+
+static void *run_worker(void *arg) {
+  worker *w = arg;
+  char keybuf[32];
+  for (unsigned int i = 0; i < KEYS_PER_THREAD; i++) {
+    snprintf(keybuf, sizeof(keybuf), "t%u_%u", w->id, i);
+    if (!cmap_set(cmaph, str_from_cstr(keybuf),
+                  mem_handle_from_ptr(&w->own_values[i], 1))) {
+      ++w->errors;
+    }
+    if (i < SHARED_KEY_COUNT) {
+      snprintf(keybuf, sizeof(keybuf), "shared_%u", i);
+      mem_handle value = cmap_get_or_set(
+          cmaph, str_from_cstr(keybuf),
+          mem_handle_from_ptr(&w->shared_values[i], 1));
+      if (!mem_is_valid(value)) ++w->errors;
+    }
+  }
+  for (unsigned int i = 0; i < KEYS_PER_THREAD; i++) {
+    snprintf(keybuf, sizeof(keybuf), "t%u_%u", w->id, i);
+    if (mem_p(cmap_get(cmaph, str_from_cstr(keybuf))) != &w->own_values[i]) {
+      ++w->errors;
+    }
+    if (i % 2) {
+      if (!cmap_delete(cmaph, str_from_cstr(keybuf))) ++w->errors;
+    }
+  }
+  return NULL;
+}
+
+void test_CmapThreads_SetGetAndDelete_MatchesExpected(void) {
+  static char shared_values[4][1000];
+  static char own_values[4][5000];
+  worker workers[4];
+  for (unsigned int t = 0; t < THREAD_COUNT; t++) {
+    workers[t] = (worker){.id = t,
+                          .shared_values = shared_values[t],
+                          .own_values = own_values[t]};
+    TEST_ASSERT_EQUAL(0, pthread_create(&workers[t].thread, NULL, run_worker,
+                                        &workers[t]));
+  }
+  for (unsigned int t = 0; t < THREAD_COUNT; t++) {
+    pthread_join(workers[t].thread, NULL);
+    TEST_ASSERT_EQUAL(0, workers[t].errors);
+  }
+
+  TEST_ASSERT_EQUAL(
+      THREAD_COUNT * KEYS_PER_THREAD / 2 + SHARED_KEY_COUNT,
+      cmap_count(cmaph));
+  // Each shared key has the value of whichever thread added it first.
+  char keybuf[32];
+  for (unsigned int i = 0; i < SHARED_KEY_COUNT; i++) {
+    snprintf(keybuf, sizeof(keybuf), "shared_%u", i);
+    char *p = mem_p(cmap_get(cmaph, str_from_cstr(keybuf)));
+    bool from_a_thread = false;
+    for (unsigned int t = 0; t < THREAD_COUNT; t++) {
+      from_a_thread |= p == &shared_values[t][i];
+    }
+    TEST_ASSERT_TRUE(from_a_thread);
+  }
+}
+
+void test_CmapInvalidHandle_Fails(void) {
+  cmap_handle bad = (cmap_handle){0};
+  char loc;
+  TEST_ASSERT_FALSE(cmap_is_valid(bad));
+  TEST_ASSERT_FALSE(cmap_set(bad, str_from_cstr("key1"), val));
+  TEST_ASSERT_FALSE(cmap_set(bad, (void *)&loc, val));
+  TEST_ASSERT_FALSE(mem_is_valid(cmap_get(bad, str_from_cstr("key1"))));
+  TEST_ASSERT_FALSE(mem_is_valid(cmap_get_or_set(bad, (void *)&loc, val)));
+  TEST_ASSERT_FALSE(cmap_delete(bad, str_from_cstr("key1")));
+  TEST_ASSERT_EQUAL(0, cmap_count(bad));
+  TEST_ASSERT_EQUAL(0, cmap_shard_count(bad));
+  TEST_ASSERT_FALSE(cmap_set(cmaph, str_from_cstr("key1"), (mem_handle){0}));
+  cmap_destroy(bad);
+}
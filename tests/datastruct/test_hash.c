@@ -0,0 +1,167 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "datastruct/hash.h"
+#include "datastruct/str.h"
+#include "unity.h"
+
+// A fixed pseudorandom sequence, so that results do not vary between runs.
+static uint64_t rand_state;
+
+void setUp(void) {
+  rand_state = 0x123456789abcdef;
+}
+
+static uint64_t next_rand(void) {
+  rand_state ^= rand_state << 13;
+  rand_state ^= rand_state >> 7;
+  rand_state ^= rand_state << 17;
+  return rand_state;
+}
+
+static int compare_u64(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+/**
+ * @brief Counts the distinct values of the low 16 bits of a set of hashes.
+ *
+ * For 65,536 independent random values, the expected count is 65,536 * (1 -
+ * 1/e), or about 41,427, with a standard deviation of about 80.
+ */
+static unsigned int count_low_bits(uint64_t *hashes, unsigned int count) {
+  static unsigned char seen[65536];
+  memset(seen, 0, sizeof(seen));
+  unsigned int distinct = 0;
+  for (unsigned int i = 0; i < count; i++) {
+    unsigned int bucket = hashes[i] & 0xffff;
+    if (!seen[bucket]) ++distinct;
+    seen[bucket] = 1;
+  }
+  return distinct;
+}
+
+static unsigned int count_duplicates(uint64_t *hashes, unsigned int count) {
+  qsort(hashes, count, sizeof(*hashes), compare_u64);
+  unsigned int duplicates = 0;
+  for (unsigned int i = 1; i < count; i++) {
+    duplicates += hashes[i] == hashes[i - 1];
+  }
+  return duplicates;
+}
+
+void test_HashBytes_SameBytes_SameHash(void) {
+  char other[] = "hello, world";
+  TEST_ASSERT_EQUAL_UINT64(hash_bytes("hello, world", 12, 0),
+                           hash_bytes(other, 12, 0));
+  TEST_ASSERT_TRUE(hash_bytes("hello, world", 12, 0) !=
+                   hash_bytes("hello, world", 12, 1));
+  TEST_ASSERT_TRUE(hash_bytes("hello, world", 12, 0) !=
+                   hash_bytes("hello, world", 11, 0));
+}
+
+void test_HashBytes_Empty_IsValid(void) {
+  TEST_ASSERT_EQUAL_UINT64(hash_bytes(NULL, 0, 0), hash_bytes("x", 0, 0));
+  TEST_ASSERT_EQUAL_UINT64(hash_bytes(NULL, 0, 0), hash_str((str){0}));
+  TEST_ASSERT_EQUAL_UINT64(hash_bytes(NULL, 0, 0),
+                           hash_str(str_from_cstr("")));
+}
+
+void test_HashBytes_AllSizes_ReadsOnlyGivenBytes(void) {
+  unsigned char buf[200];
+  for (unsigned int i = 0; i < sizeof(buf); i++) buf[i] = next_rand();
+  for (size_t size = 0; size <= 130; size++) {
+    // An exact-size copy, so that reading past the end is an error under a
+    // memory checker.
+    unsigned char *copy = malloc(size ? size : 1);
+    memcpy(copy, buf + 1, size);
+    uint64_t expected = hash_bytes(copy, size, 0);
+    free(copy);
+    buf[0] ^= 0xff;
+    buf[size + 1] ^= 0xff;
+    TEST_ASSERT_EQUAL_UINT64(expected, hash_bytes(buf + 1, size, 0));
+  }
+}
+
+void test_HashBytes_FlipOneBit_ChangesHalfTheBits(void) {
+#ifdef DATASTRUCT_HASH_FNV
+  TEST_IGNORE_MESSAGE("FNV-1a does not avalanche");
+#endif
+  static const size_t SIZES[] = {3, 8, 13, 16, 40, 100};
+  static const unsigned int TRIALS = 200;
+  unsigned char input[100];
+  for (unsigned int s = 0; s < sizeof(SIZES) / sizeof(SIZES[0]); s++) {
+    size_t size = SIZES[s];
+    for (size_t bit = 0; bit < size * 8; bit++) {
+      unsigned int flips[64] = {0};
+      for (unsigned int t = 0; t < TRIALS; t++) {
+        for (size_t i = 0; i < size; i++) input[i] = next_rand();
+        uint64_t before = hash_bytes(input, size, 0);
+        input[bit / 8] ^= 1 << (bit % 8);
+        uint64_t diff = before ^ hash_bytes(input, size, 0);
+        for (unsigned int out = 0; out < 64; out++) {
+          flips[out] += (diff >> out) & 1;
+        }
+      }
+      // Each output bit should flip in half of the trials. The standard
+      // deviation is about 7.
+      for (unsigned int out = 0; out < 64; out++) {
+        TEST_ASSERT_UINT_WITHIN(40, TRIALS / 2, flips[out]);
+      }
+    }
+  }
+}
+
+void test_HashStr_WordLists_NoCollisions(void) {
+  static const unsigned int COUNT = 100000 + 26 * 26 * 26;
+  uint64_t *hashes = malloc(sizeof(*hashes) * COUNT);
+  char word[16];
+  unsigned int count = 0;
+  for (unsigned int i = 0; i < 100000; i++) {
+    snprintf(word, sizeof(word), "sym_%u", i);
+    hashes[count++] = hash_str(str_from_cstr(word));
+  }
+  for (unsigned int i = 0; i < 26 * 26 * 26; i++) {
+    word[0] = 'a' + i % 26;
+    word[1] = 'a' + i / 26 % 26;
+    word[2] = 'a' + i / (26 * 26);
+    hashes[count++] = hash_bytes(word, 3, 0);
+  }
+  TEST_ASSERT_EQUAL(0, count_duplicates(hashes, count));
+  free(hashes);
+}
+
+void test_HashStr_SimilarKeys_SpreadLowBits(void) {
+  uint64_t *hashes = malloc(sizeof(*hashes) * 65536);
+  char word[16];
+  for (unsigned int i = 0; i < 65536; i++) {
+    snprintf(word, sizeof(word), "sym_%u", i);
+    hashes[i] = hash_str(str_from_cstr(word));
+  }
+  TEST_ASSERT_UINT_WITHIN(400, 41427, count_low_bits(hashes, 65536));
+  free(hashes);
+}
+
+void test_HashPtr_AlignedAddresses_SpreadLowBits(void) {
+  static const uintptr_t STRIDES[] = {8, 16, 24, 48, 64, 4096};
+  uint64_t *hashes = malloc(sizeof(*hashes) * 65536);
+  for (unsigned int s = 0; s < sizeof(STRIDES) / sizeof(STRIDES[0]); s++) {
+    uintptr_t base = (uintptr_t)hashes;
+    for (unsigned int i = 0; i < 65536; i++) {
+      hashes[i] = hash_ptr((void *)(base + i * STRIDES[s]));
+    }
+    // A single multiply is not quite random, but is within a few percent.
+    TEST_ASSERT_GREATER_OR_EQUAL(40000, count_low_bits(hashes, 65536));
+  }
+  free(hashes);
+}
+
+void test_HashU64_Sequential_NoCollisions(void) {
+  uint64_t *hashes = malloc(sizeof(*hashes) * 100000);
+  for (unsigned int i = 0; i < 100000; i++) hashes[i] = hash_u64(i);
+  TEST_ASSERT_EQUAL(0, count_duplicates(hashes, 100000));
+  free(hashes);
+}
@@ -0,0 +1,145 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "datastruct/intern.h"
+#include "datastruct/map.h"
+#include "datastruct/str.h"
+#include "unity.h"
+
+intern_handle ih;
+
+void setUp(void) {
+  ih = intern_create(MEM_ALLOCATOR_PLAIN);
+}
+
+void tearDown(void) {
+  intern_destroy(ih);
+}
+
+void test_InternCreate_IsEmpty(void) {
+  TEST_ASSERT_TRUE(intern_is_valid(ih));
+  TEST_ASSERT_EQUAL(0, intern_count(ih));
+  TEST_ASSERT_EQUAL(ATOM_NONE, intern_find(ih, str_from_cstr("help")));
+}
+
+void test_InternStr_SameBytes_ReturnsSameAtom(void) {
+  char buf[8] = "help";
+  atom help = intern_str(ih, str_from_cstr("help"));
+  atom list = intern_str(ih, str_from_cstr("list"));
+  TEST_ASSERT_EQUAL(1, help);
+  TEST_ASSERT_EQUAL(2, list);
+  // A different copy of the same bytes
+  TEST_ASSERT_EQUAL(help, intern_str(ih, str_from_cstr(buf)));
+  TEST_ASSERT_EQUAL(help, intern_find(ih, str_from_cstr("help")));
+  TEST_ASSERT_EQUAL(2, intern_count(ih));
+}
+
+void test_InternAtomStr_ReturnsCanonicalCString(void) {
+  char buf[8] = "loop";
+  atom loop = intern_str(ih, str_from_cstr(buf));
+  strcpy(buf, "xxxx");
+  str canonical = intern_atom_str(ih, loop);
+  TEST_ASSERT_EQUAL(4, mem_size(canonical));
+  TEST_ASSERT_EQUAL_STRING("loop", mem_p(canonical));
+  TEST_ASSERT_EQUAL_PTR(mem_p(canonical), mem_p(intern_atom_str(ih, loop)));
+  TEST_ASSERT_FALSE(str_is_valid(intern_atom_str(ih, ATOM_NONE)));
+  TEST_ASSERT_FALSE(str_is_valid(intern_atom_str(ih, loop + 1)));
+}
+
+void test_InternStr_EmptyString_HasAtom(void) {
+  atom empty = intern_str(ih, str_from_cstr(""));
+  TEST_ASSERT_NOT_EQUAL(ATOM_NONE, empty);
+  TEST_ASSERT_EQUAL(empty, intern_find(ih, str_from_cstr("")));
+  TEST_ASSERT_EQUAL(0, mem_size(intern_atom_str(ih, empty)));
+  TEST_ASSERT_EQUAL_STRING("", mem_p(intern_atom_str(ih, empty)));
+}
+
+void test_InternStr_ManyStrings_KeepsCanonicalBytes(void) {
+  char keybuf[16];
+  for (unsigned int i = 0; i < 10000; i++) {
+    snprintf(keybuf, sizeof(keybuf), "sym_%u", i);
+    TEST_ASSERT_EQUAL(i + 1, intern_str(ih, str_from_cstr(keybuf)));
+  }
+  TEST_ASSERT_EQUAL(10000, intern_count(ih));
+  for (unsigned int i = 0; i < 10000; i++) {
+    snprintf(keybuf, sizeof(keybuf), "sym_%u", i);
+    TEST_ASSERT_EQUAL(i + 1, intern_find(ih, str_from_cstr(keybuf)));
+    TEST_ASSERT_EQUAL_STRING(keybuf, mem_p(intern_atom_str(ih, i + 1)));
+  }
+}
+
+void test_InternMany_RepeatedStrings_ReturnsAtoms(void) {
+  atom existing = intern_str(ih, str_from_cstr("b"));
+  str strs[200];
+  atom atoms[200];
+  const char *words[] = {"a", "b", "c", "a"};
+  for (unsigned int i = 0; i < 200; i++) strs[i] = str_from_cstr(words[i % 4]);
+  TEST_ASSERT_EQUAL(200, intern_many(ih, strs, atoms, 200));
+  TEST_ASSERT_EQUAL(3, intern_count(ih));
+  for (unsigned int i = 0; i < 200; i++) {
+    TEST_ASSERT_EQUAL(intern_find(ih, strs[i]), atoms[i]);
+  }
+  TEST_ASSERT_EQUAL(existing, atoms[1]);
+  TEST_ASSERT_EQUAL(atoms[0], atoms[3]);
+}
+
+void test_InternMany_InvalidStr_StopsThere(void) {
+  str strs[] = {str_from_cstr("a"), (str){0}, str_from_cstr("b")};
+  atom atoms[] = {7, 7, 7};
+  TEST_ASSERT_EQUAL(1, intern_many(ih, strs, atoms, 3));
+  TEST_ASSERT_NOT_EQUAL(ATOM_NONE, atoms[0]);
+  TEST_ASSERT_EQUAL(ATOM_NONE, atoms[1]);
+  TEST_ASSERT_EQUAL(ATOM_NONE, atoms[2]);
+  TEST_ASSERT_EQUAL(1, intern_count(ih));
+}
+
+void test_InternStr_HashCollision_KeepsStringsApart(void) {
+  // Fake a collision: the index has the hash of "b" for the bytes of "a".
+  atom a = intern_str(ih, str_from_cstr("a"));
+  map_handle index_mh = ((intern_table *)mem_p(ih))->index_mh;
+  bool inserted;
+  mem_handle *slot = map_get_or_insert(index_mh, str_from_cstr("b"), &inserted);
+  TEST_ASSERT_TRUE(inserted);
+  *slot = intern_atom_str(ih, a);
+
+  TEST_ASSERT_EQUAL(ATOM_NONE, intern_find(ih, str_from_cstr("b")));
+  atom b = intern_str(ih, str_from_cstr("b"));
+  TEST_ASSERT_NOT_EQUAL(ATOM_NONE, b);
+  TEST_ASSERT_NOT_EQUAL(a, b);
+  TEST_ASSERT_EQUAL(b, intern_str(ih, str_from_cstr("b")));
+  TEST_ASSERT_EQUAL(b, intern_find(ih, str_from_cstr("b")));
+  TEST_ASSERT_EQUAL(a, intern_find(ih, str_from_cstr("a")));
+  TEST_ASSERT_EQUAL_STRING("b", mem_p(intern_atom_str(ih, b)));
+}
+
+void test_InternMemoryUse_CountsStringsAndTables(void) {
+  char keybuf[16];
+  for (unsigned int i = 0; i < 1000; i++) {
+    snprintf(keybuf, sizeof(keybuf), "sym_%u", i);
+    intern_str(ih, str_from_cstr(keybuf));
+  }
+  intern_memory use = intern_memory_use(ih);
+  TEST_ASSERT_EQUAL(1000, use.atom_count);
+  // Each string has its bytes, a null terminator, and an 8-byte header.
+  TEST_ASSERT_TRUE(use.string_bytes >= 1000 * (5 + 1 + 8));
+  TEST_ASSERT_TRUE(use.string_bytes <= 1000 * (7 + 1 + 8));
+  TEST_ASSERT_TRUE(use.table_bytes > 0);
+  TEST_ASSERT_EQUAL((use.string_bytes + use.table_bytes + 999) / 1000,
+                    use.bytes_per_atom);
+}
+
+void test_InternInvalidHandle_Fails(void) {
+  intern_handle bad = (intern_handle){0};
+  atom atoms[1];
+  str strs[] = {str_from_cstr("a")};
+  TEST_ASSERT_FALSE(intern_is_valid(bad));
+  TEST_ASSERT_EQUAL(ATOM_NONE, intern_str(bad, str_from_cstr("a")));
+  TEST_ASSERT_EQUAL(0, intern_many(bad, strs, atoms, 1));
+  TEST_ASSERT_EQUAL(ATOM_NONE, intern_find(bad, str_from_cstr("a")));
+  TEST_ASSERT_FALSE(str_is_valid(intern_atom_str(bad, 1)));
+  TEST_ASSERT_EQUAL(0, intern_count(bad));
+  TEST_ASSERT_EQUAL(0, intern_memory_use(bad).atom_count);
+  TEST_ASSERT_EQUAL(ATOM_NONE, intern_str(ih, (str){0}));
+  intern_destroy(bad);
+}
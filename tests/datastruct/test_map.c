@@ -1,5 +1,9 @@
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
+#include "datastruct/hash.h"
 #include "datastruct/map.h"
 #include "datastruct/str.h"
 #include "unity.h"
@@ -58,21 +62,222 @@ void test_MapSet_ExistingKey_ReplacesValue(void) {
   TEST_ASSERT_EQUAL_PTR(mem_p(val2), mem_p(result));
 }
 
-void test_MapSet_17Keys_GrowsTable(void) {
+void test_MapSet_29Keys_GrowsTable(void) {
   char loc, *locptr = &loc;
 
   map *mapptr = mem_p(maph);
   TEST_ASSERT_EQUAL(0, mapptr->entry_count);
   TEST_ASSERT_EQUAL(32, mapptr->table_size);
 
-  for (int i = 0; i < 17; i++) {
+  for (int i = 0; i < 28; i++) {
     TEST_ASSERT_TRUE(map_set(maph, (void *)locptr + i, val));
   }
+  TEST_ASSERT_EQUAL(32, mapptr->table_size);
+  TEST_ASSERT_TRUE(map_set(maph, (void *)locptr + 28, val));
 
-  TEST_ASSERT_EQUAL(17, mapptr->entry_count);
+  TEST_ASSERT_EQUAL(29, mapptr->entry_count);
   TEST_ASSERT_EQUAL(64, mapptr->table_size);
 }
 
+void test_MapSet_GrowsTable_KeepsTableAligned(void) {
+  char loc, *locptr = &loc;
+  map *mapptr = mem_p(maph);
+  TEST_ASSERT_EQUAL(0, (uintptr_t)mem_p(mapptr->index_mh) % 64);
+  for (int i = 0; i < 100; i++) {
+    TEST_ASSERT_TRUE(map_set(maph, (void *)locptr + i, val));
+  }
+  TEST_ASSERT_EQUAL(0, (uintptr_t)mem_p(mapptr->index_mh) % 64);
+}
+
+void test_MapSet_ReusedKeyMemory_KeepsKey(void) {
+  strbuf_handle buf = strbuf_create(MEM_ALLOCATOR_PLAIN, 16);
+  strbuf_concatenate_cstr(buf, "alpha");
+  TEST_ASSERT_TRUE(map_set(maph, strbuf_str(buf), val));
+  strbuf_reset(buf);
+  strbuf_concatenate_cstr(buf, "bravo");
+  TEST_ASSERT_TRUE(map_set(maph, strbuf_str(buf), val2));
+  strbuf_destroy(buf);
+
+  TEST_ASSERT_EQUAL_PTR(mem_p(val),
+                        mem_p(map_get(maph, str_from_cstr("alpha"))));
+  TEST_ASSERT_EQUAL_PTR(mem_p(val2),
+                        mem_p(map_get(maph, str_from_cstr("bravo"))));
+}
+
+void test_MapSet_ManyStrKeys_KeepsEveryKey(void) {
+  char keybuf[16];
+  for (int i = 0; i < 100000; i++) {
+    int len = snprintf(keybuf, sizeof(keybuf), "sym_%d", i);
+    mem_handle value = mem_handle_from_ptr(keybuf, i + 1);
+    TEST_ASSERT_TRUE(map_set(maph, mem_handle_from_ptr(keybuf, len), value));
+  }
+  for (int i = 0; i < 100000; i++) {
+    int len = snprintf(keybuf, sizeof(keybuf), "sym_%d", i);
+    mem_handle result = map_get(maph, mem_handle_from_ptr(keybuf, len));
+    TEST_ASSERT_EQUAL(i + 1, mem_size(result));
+  }
+  TEST_ASSERT_EQUAL(100000, ((map *)mem_p(maph))->entry_count);
+}
+
+void test_MapSet_EmptyStrKey_FindsValue(void) {
+  TEST_ASSERT_TRUE(map_set(maph, str_from_cstr(""), val));
+  TEST_ASSERT_EQUAL_PTR(mem_p(val), mem_p(map_get(maph, str_from_cstr(""))));
+  TEST_ASSERT_FALSE(mem_is_valid(map_get(maph, strkey)));
+  TEST_ASSERT_TRUE(map_delete(maph, str_from_cstr("")));
+}
+
+void test_MapSet_InvalidStrKey_ReturnsFalse(void) {
+  TEST_ASSERT_FALSE(map_set(maph, (str){0}, val));
+  TEST_ASSERT_FALSE(mem_is_valid(map_get(maph, (str){0})));
+}
+
+void test_MapCreateHashOnly_FindsValues(void) {
+  map_handle hmh = map_create_hash_only(MEM_ALLOCATOR_PLAIN);
+  TEST_ASSERT_TRUE(map_is_valid(hmh));
+  TEST_ASSERT_TRUE(map_set(hmh, strkey, val));
+  TEST_ASSERT_TRUE(map_set(hmh, ptrkey, val2));
+  TEST_ASSERT_EQUAL_PTR(mem_p(val), mem_p(map_get(hmh, str_from_cstr("key1"))));
+  TEST_ASSERT_EQUAL_PTR(mem_p(val2), mem_p(map_get(hmh, ptrkey)));
+  TEST_ASSERT_TRUE(map_delete(hmh, strkey));
+  TEST_ASSERT_FALSE(mem_is_valid(map_get(hmh, strkey)));
+  map_destroy(hmh);
+}
+
+void test_MapGetOrInsert_NewKey_InsertsSlot(void) {
+  bool inserted = false;
+  mem_handle *slot = map_get_or_insert(maph, strkey, &inserted);
+  TEST_ASSERT_NOT_NULL(slot);
+  TEST_ASSERT_TRUE(inserted);
+  TEST_ASSERT_FALSE(mem_is_valid(*slot));
+  *slot = val;
+  TEST_ASSERT_EQUAL_PTR(mem_p(val), mem_p(map_get(maph, strkey)));
+  TEST_ASSERT_EQUAL(1, ((map *)mem_p(maph))->entry_count);
+}
+
+void test_MapGetOrInsert_ExistingKey_ReturnsSlot(void) {
+  TEST_ASSERT_TRUE(map_set(maph, ptrkey, val));
+  bool inserted = true;
+  mem_handle *slot = map_get_or_insert(maph, ptrkey, &inserted);
+  TEST_ASSERT_NOT_NULL(slot);
+  TEST_ASSERT_FALSE(inserted);
+  TEST_ASSERT_EQUAL_PTR(mem_p(val), mem_p(*slot));
+  *slot = val2;
+  TEST_ASSERT_EQUAL_PTR(mem_p(val2), mem_p(map_get(maph, ptrkey)));
+}
+
+void test_MapGetOrInsert_CountsWords(void) {
+  // Counts are kept in the value handle sizes.
+  static const char *WORDS[] = {"b", "a", "b", "c", "b", "a"};
+  char keybuf[16];
+  for (int r = 0; r < 1000; r++) {
+    for (int i = 0; i < 6; i++) {
+      int len = snprintf(keybuf, sizeof(keybuf), "%s%d", WORDS[i], r);
+      bool inserted;
+      mem_handle *slot = map_get_or_insert(
+          maph, mem_handle_from_ptr(keybuf, len), &inserted);
+      TEST_ASSERT_NOT_NULL(slot);
+      TEST_ASSERT_EQUAL(inserted, !mem_is_valid(*slot));
+      size_t count = inserted ? 1 : mem_size(*slot) + 1;
+      *slot = mem_handle_from_ptr(keybuf, count);
+    }
+  }
+  TEST_ASSERT_EQUAL(3000, ((map *)mem_p(maph))->entry_count);
+  TEST_ASSERT_EQUAL(3, mem_size(map_get(maph, str_from_cstr("b999"))));
+  TEST_ASSERT_EQUAL(2, mem_size(map_get(maph, str_from_cstr("a0"))));
+  TEST_ASSERT_EQUAL(1, mem_size(map_get(maph, str_from_cstr("c500"))));
+}
+
+void test_MapGetOrInsertPrehashed_FindsSameSlot(void) {
+  bool inserted;
+  mem_handle *slot = map_get_or_insert_prehashed(maph, strkey,
+                                                 hash_str(strkey), &inserted);
+  TEST_ASSERT_NOT_NULL(slot);
+  TEST_ASSERT_TRUE(inserted);
+  *slot = val;
+  TEST_ASSERT_EQUAL_PTR(slot, map_get_or_insert(maph, strkey, &inserted));
+  TEST_ASSERT_FALSE(inserted);
+}
+
+void test_MapReserve_ThenSet_DoesNotGrow(void) {
+  char loc, *locptr = &loc;
+  map *mapptr = mem_p(maph);
+  TEST_ASSERT_TRUE(map_reserve(maph, 1000));
+  TEST_ASSERT_EQUAL(2048, mapptr->table_size);
+  for (int i = 0; i < 1000; i++) {
+    TEST_ASSERT_TRUE(map_set(maph, (void *)locptr + i, val));
+  }
+  TEST_ASSERT_EQUAL(2048, mapptr->table_size);
+
+  // Reserving less than the table holds does nothing.
+  TEST_ASSERT_TRUE(map_reserve(maph, 10));
+  TEST_ASSERT_EQUAL(2048, mapptr->table_size);
+  TEST_ASSERT_FALSE(map_reserve((map_handle){0}, 10));
+}
+
+void test_MapMemoryUse_GrowsWithTable(void) {
+  size_t empty_use = map_memory_use(maph);
+  TEST_ASSERT_TRUE(empty_use > sizeof(map));
+  TEST_ASSERT_TRUE(map_reserve(maph, 1000));
+  TEST_ASSERT_TRUE(map_memory_use(maph) > empty_use + 1000 * sizeof(uint32_t));
+  TEST_ASSERT_EQUAL(0, map_memory_use((map_handle){0}));
+}
+
+void test_MapSetMany_StrKeys_SetsEveryKey(void) {
+  static const unsigned int COUNT = 1000;
+  char *keybuf = malloc(16 * COUNT);
+  str keys[1000];
+  mem_handle values[1000];
+  for (unsigned int i = 0; i < COUNT; i++) {
+    int len = snprintf(keybuf + i * 16, 16, "sym_%u", i);
+    keys[i] = mem_handle_from_ptr(keybuf + i * 16, len);
+    values[i] = mem_handle_from_ptr(keybuf, i + 1);
+  }
+  TEST_ASSERT_TRUE(map_set_many(maph, keys, values, COUNT));
+  TEST_ASSERT_EQUAL(COUNT, ((map *)mem_p(maph))->entry_count);
+  TEST_ASSERT_EQUAL(2048, ((map *)mem_p(maph))->table_size);
+
+  mem_handle results[1000];
+  keys[COUNT / 2] = str_from_cstr("missing");
+  TEST_ASSERT_EQUAL(COUNT - 1, map_get_many(maph, keys, results, COUNT));
+  for (unsigned int i = 0; i < COUNT; i++) {
+    if (i == COUNT / 2) {
+      TEST_ASSERT_FALSE(mem_is_valid(results[i]));
+    } else {
+      TEST_ASSERT_EQUAL(i + 1, mem_size(results[i]));
+    }
+  }
+  free(keybuf);
+}
+
+void test_MapSetMany_PtrKeys_SetsEveryKey(void) {
+  char locs[40];
+  void *keys[40];
+  mem_handle values[40];
+  for (int i = 0; i < 40; i++) {
+    keys[i] = &locs[i];
+    values[i] = mem_handle_from_ptr(&locs[i], i + 1);
+  }
+  // A repeated key replaces the earlier value.
+  keys[39] = &locs[0];
+  TEST_ASSERT_TRUE(map_set_many(maph, keys, values, 40));
+  TEST_ASSERT_EQUAL(39, ((map *)mem_p(maph))->entry_count);
+
+  mem_handle results[40];
+  TEST_ASSERT_EQUAL(40, map_get_many(maph, keys, results, 40));
+  TEST_ASSERT_EQUAL(40, mem_size(results[0]));
+  TEST_ASSERT_EQUAL(39, mem_size(results[38]));
+}
+
+void test_MapSetMany_InvalidValue_SetsOtherKeys(void) {
+  str keys[3] = {str_from_cstr("a"), str_from_cstr("b"), str_from_cstr("c")};
+  mem_handle values[3] = {val, (mem_handle){0}, val2};
+  TEST_ASSERT_FALSE(map_set_many(maph, keys, values, 3));
+  TEST_ASSERT_EQUAL_PTR(mem_p(val), mem_p(map_get(maph, keys[0])));
+  TEST_ASSERT_FALSE(mem_is_valid(map_get(maph, keys[1])));
+  TEST_ASSERT_EQUAL_PTR(mem_p(val2), mem_p(map_get(maph, keys[2])));
+  TEST_ASSERT_TRUE(map_set_many(maph, keys, values, 0));
+}
+
 void test_MapDelete_ExistingStrKey_UnsetsKey(void) {
   TEST_ASSERT_TRUE(map_set(maph, strkey, val));
   mem_handle result = map_get(maph, strkey);
@@ -112,19 +317,211 @@ void test_MapDelete_AfterGrowth_ShrinksTable(void) {
   TEST_ASSERT_EQUAL(0, mapptr->entry_count);
   TEST_ASSERT_EQUAL(32, mapptr->table_size);
 
-  for (int i = 0; i < 17; i++) {
+  for (int i = 0; i < 29; i++) {
     TEST_ASSERT_TRUE(map_set(maph, (void *)locptr + i, val));
   }
 
-  TEST_ASSERT_EQUAL(17, mapptr->entry_count);
+  TEST_ASSERT_EQUAL(29, mapptr->entry_count);
   TEST_ASSERT_EQUAL(64, mapptr->table_size);
 
-  TEST_ASSERT_TRUE(map_delete(maph, (void *)locptr));
-  TEST_ASSERT_TRUE(map_delete(maph, (void *)locptr + 1));
-  TEST_ASSERT_EQUAL(15, mapptr->entry_count);
+  for (int i = 0; i < 21; i++) {
+    TEST_ASSERT_TRUE(map_delete(maph, (void *)locptr + i));
+  }
+  TEST_ASSERT_EQUAL(8, mapptr->entry_count);
+  TEST_ASSERT_EQUAL(64, mapptr->table_size);
+  TEST_ASSERT_TRUE(map_delete(maph, (void *)locptr + 21));
+  TEST_ASSERT_EQUAL(7, mapptr->entry_count);
   TEST_ASSERT_EQUAL(32, mapptr->table_size);
 }
 
+void test_MapSetDelete_ChurnNearThreshold_DoesNotResizeRepeatedly(void) {
+  // A set then a delete of a new key, at every entry count near the grow and
+  // shrink thresholds of the first few table sizes.
+  static char locs[200];
+  map *mapptr = mem_p(maph);
+  for (int live = 1; live < 100; live++) {
+    TEST_ASSERT_TRUE(map_set(maph, (void *)&locs[live - 1], val));
+    unsigned int resizes = 0;
+    unsigned int table_size = mapptr->table_size;
+    for (int i = 0; i < 2000; i++) {
+      TEST_ASSERT_TRUE(map_set(maph, (void *)&locs[100 + i % 100], val));
+      if (mapptr->table_size != table_size) ++resizes;
+      table_size = mapptr->table_size;
+      TEST_ASSERT_TRUE(map_delete(maph, (void *)&locs[100 + i % 100]));
+      if (mapptr->table_size != table_size) ++resizes;
+      table_size = mapptr->table_size;
+    }
+    TEST_ASSERT_TRUE(resizes <= 1);
+    TEST_ASSERT_EQUAL(live, mapptr->entry_count);
+  }
+}
+
+void test_MapDelete_ManyKeys_KeepsOtherKeys(void) {
+  char keybuf[16];
+  for (int i = 0; i < 10000; i++) {
+    int len = snprintf(keybuf, sizeof(keybuf), "sym_%d", i);
+    mem_handle value = mem_handle_from_ptr(keybuf, i + 1);
+    TEST_ASSERT_TRUE(map_set(maph, mem_handle_from_ptr(keybuf, len), value));
+  }
+  // Delete every third key, so that many probe chains lose a middle entry.
+  for (int i = 0; i < 10000; i += 3) {
+    int len = snprintf(keybuf, sizeof(keybuf), "sym_%d", i);
+    TEST_ASSERT_TRUE(map_delete(maph, mem_handle_from_ptr(keybuf, len)));
+  }
+  for (int i = 0; i < 10000; i++) {
+    int len = snprintf(keybuf, sizeof(keybuf), "sym_%d", i);
+    mem_handle result = map_get(maph, mem_handle_from_ptr(keybuf, len));
+    if (i % 3 == 0) {
+      TEST_ASSERT_FALSE(mem_is_valid(result));
+    } else {
+      TEST_ASSERT_EQUAL(i + 1, mem_size(result));
+    }
+  }
+  TEST_ASSERT_EQUAL(6666, ((map *)mem_p(maph))->entry_count);
+}
+
+void test_MapIncrementalResize_Grow_KeepsOldTableUntilMoved(void) {
+  char locs[200];
+  map *mapptr = mem_p(maph);
+  TEST_ASSERT_TRUE(map_set_incremental_resize(maph, true));
+  for (int i = 0; i < 29; i++) {
+    TEST_ASSERT_TRUE(map_set(maph, (void *)&locs[i], val));
+  }
+  // The 29th key started a resize. The old table still holds most entries.
+  TEST_ASSERT_EQUAL(64, mapptr->table_size);
+  TEST_ASSERT_TRUE(mem_is_valid(mapptr->old_entries_mh));
+  TEST_ASSERT_EQUAL(32, mapptr->old_table_size);
+  for (int i = 0; i < 29; i++) {
+    TEST_ASSERT_TRUE(mem_is_valid(map_get(maph, (void *)&locs[i])));
+  }
+
+  // The old table is gone after a few more changes.
+  TEST_ASSERT_TRUE(map_set(maph, (void *)&locs[29], val));
+  TEST_ASSERT_TRUE(map_set(maph, (void *)&locs[30], val));
+  TEST_ASSERT_TRUE(map_set(maph, (void *)&locs[31], val));
+  TEST_ASSERT_FALSE(mem_is_valid(mapptr->old_entries_mh));
+  TEST_ASSERT_EQUAL(32, mapptr->entry_count);
+  for (int i = 0; i < 32; i++) {
+    TEST_ASSERT_TRUE(mem_is_valid(map_get(maph, (void *)&locs[i])));
+  }
+}
+
+void test_MapIncrementalResize_KeyInOldTable_FindsSameSlot(void) {
+  char locs[29];
+  map *mapptr = mem_p(maph);
+  TEST_ASSERT_TRUE(map_set_incremental_resize(maph, true));
+  for (int i = 0; i < 29; i++) {
+    TEST_ASSERT_TRUE(map_set(maph, (void *)&locs[i], val));
+  }
+  TEST_ASSERT_TRUE(mem_is_valid(mapptr->old_entries_mh));
+  bool inserted;
+  mem_handle *slot = map_get_or_insert(maph, (void *)&locs[28], &inserted);
+  TEST_ASSERT_NOT_NULL(slot);
+  TEST_ASSERT_FALSE(inserted);
+  *slot = val2;
+  TEST_ASSERT_EQUAL_PTR(mem_p(val2),
+                        mem_p(map_get(maph, (void *)&locs[28])));
+  TEST_ASSERT_EQUAL(29, mapptr->entry_count);
+}
+
+void test_MapIncrementalResize_Iter_ReturnsValuesInBothTables(void) {
+  char locs[29];
+  TEST_ASSERT_TRUE(map_set_incremental_resize(maph, true));
+  for (int i = 0; i < 29; i++) {
+    TEST_ASSERT_TRUE(
+        map_set(maph, (void *)&locs[i], mem_handle_from_ptr(&locs[i], 1)));
+  }
+  TEST_ASSERT_TRUE(mem_is_valid(((map *)mem_p(maph))->old_entries_mh));
+  bool seen[29] = {false};
+  int count = 0;
+  for (map_iter it = map_first_value_iter(maph); !map_iter_done(it);
+       it = map_next_value_iter(it)) {
+    char *p = mem_p(map_iter_value(it));
+    TEST_ASSERT_FALSE(seen[p - locs]);
+    seen[p - locs] = true;
+    ++count;
+  }
+  TEST_ASSERT_EQUAL(29, count);
+}
+
+void test_MapIncrementalResize_TurnOff_FinishesResize(void) {
+  char locs[29];
+  map *mapptr = mem_p(maph);
+  TEST_ASSERT_TRUE(map_set_incremental_resize(maph, true));
+  for (int i = 0; i < 29; i++) {
+    TEST_ASSERT_TRUE(map_set(maph, (void *)&locs[i], val));
+  }
+  TEST_ASSERT_TRUE(mem_is_valid(mapptr->old_entries_mh));
+  TEST_ASSERT_TRUE(map_set_incremental_resize(maph, false));
+  TEST_ASSERT_FALSE(mem_is_valid(mapptr->old_entries_mh));
+  TEST_ASSERT_EQUAL(0, mapptr->old_table_size);
+  TEST_ASSERT_FALSE(map_set_incremental_resize((map_handle){0}, true));
+}
+
+void test_MapIncrementalResize_DeleteMovedKey_GetDoesNotReadFreedKey(void) {
+  // A moved entry's key is freed when the key is deleted from the new table,
+  // while the old index still refers to the old entry. Built with a
+  // sanitizer, this fails if a lookup compares the freed key.
+  char keybuf[16];
+  map *mapptr = mem_p(maph);
+  TEST_ASSERT_TRUE(map_set_incremental_resize(maph, true));
+  int count = 0;
+  while (!mem_is_valid(mapptr->old_entries_mh) ||
+         mapptr->old_entries_used < 512) {
+    snprintf(keybuf, sizeof(keybuf), "key_%d", count++);
+    TEST_ASSERT_TRUE(map_set_str(maph, str_from_cstr(keybuf), val));
+  }
+  // Old entries move in order, so each deleted key has moved.
+  int deleted = 0;
+  while (mem_is_valid(mapptr->old_entries_mh)) {
+    snprintf(keybuf, sizeof(keybuf), "key_%d", deleted++);
+    str key = str_from_cstr(keybuf);
+    TEST_ASSERT_TRUE(map_delete_str(maph, key));
+    TEST_ASSERT_FALSE(mem_is_valid(map_get_str(maph, key)));
+  }
+  TEST_ASSERT_TRUE(deleted > 1);
+  for (int i = 0; i < count; i++) {
+    snprintf(keybuf, sizeof(keybuf), "key_%d", i);
+    TEST_ASSERT_EQUAL(i >= deleted,
+                      mem_is_valid(map_get_str(maph, str_from_cstr(keybuf))));
+  }
+  TEST_ASSERT_EQUAL(count - deleted, mapptr->entry_count);
+}
+
+void test_MapIncrementalResize_ManyChanges_MatchesExpected(void) {
+  // Grows and shrinks through many resizes, with sets and deletes landing on
+  // keys in both tables.
+  static const int KEY_COUNT = 5000;
+  static bool present[5000];
+  static char locs[5000];
+  memset(present, 0, sizeof(present));
+  TEST_ASSERT_TRUE(map_set_incremental_resize(maph, true));
+  unsigned int rand_state = 12345;
+  int expected_count = 0;
+  for (int round = 0; round < 6; round++) {
+    // Fill, then empty most of the map.
+    bool filling = round % 2 == 0;
+    for (int op = 0; op < 20000; op++) {
+      rand_state = rand_state * 1103515245 + 12345;
+      int k = (rand_state >> 8) % KEY_COUNT;
+      if (filling || (op % 8 == 0)) {
+        TEST_ASSERT_TRUE(map_set(maph, (void *)&locs[k], val));
+        if (!present[k]) ++expected_count;
+        present[k] = true;
+      } else {
+        map_delete(maph, (void *)&locs[k]);
+        if (present[k]) --expected_count;
+        present[k] = false;
+      }
+    }
+    TEST_ASSERT_EQUAL(expected_count, ((map *)mem_p(maph))->entry_count);
+    for (int k = 0; k < KEY_COUNT; k++) {
+      TEST_ASSERT_EQUAL(present[k],
+                        mem_is_valid(map_get(maph, (void *)&locs[k])));
+    }
+  }
+}
+
 void test_MapIter_NonEmptyMap_ReturnsAllValues(void) {
   TEST_ASSERT_TRUE(map_set(maph, strkey, val));
   TEST_ASSERT_TRUE(map_set(maph, str_from_cstr("key2"), val2));
@@ -148,3 +545,93 @@ void test_MapIter_NonEmptyMap_ReturnsAllValues(void) {
 void test_MapIter_EmptyMap_ReturnsDoneIteratorFirst(void) {
   TEST_ASSERT_TRUE(map_iter_done(map_first_value_iter(maph)));
 }
+
+void test_MapIterKey_ReturnsStrKeysOnly(void) {
+  char loc;
+  TEST_ASSERT_TRUE(map_set(maph, str_from_cstr("key1"), val));
+  TEST_ASSERT_TRUE(map_set(maph, (void *)&loc, val2));
+  map_iter it = map_first_value_iter(maph);
+  TEST_ASSERT_EQUAL(0, str_compare(map_iter_key(it), str_from_cstr("key1")));
+  it = map_next_value_iter(it);
+  TEST_ASSERT_FALSE(str_is_valid(map_iter_key(it)));
+  it = map_next_value_iter(it);
+  TEST_ASSERT_TRUE(map_iter_done(it));
+  TEST_ASSERT_FALSE(str_is_valid(map_iter_key(it)));
+}
+
+void test_MapIter_ReturnsValuesInInsertionOrder(void) {
+  char locs[100];
+  for (int i = 0; i < 100; i++) {
+    TEST_ASSERT_TRUE(
+        map_set(maph, (void *)&locs[i], mem_handle_from_ptr(&locs[i], 1)));
+  }
+  // Setting a key again keeps its place. Adding it again moves it to the end.
+  TEST_ASSERT_TRUE(
+      map_set(maph, (void *)&locs[10], mem_handle_from_ptr(&locs[10], 1)));
+  TEST_ASSERT_TRUE(map_delete(maph, (void *)&locs[20]));
+  TEST_ASSERT_TRUE(
+      map_set(maph, (void *)&locs[20], mem_handle_from_ptr(&locs[20], 1)));
+
+  int count = 0;
+  for (map_iter it = map_first_value_iter(maph); !map_iter_done(it);
+       it = map_next_value_iter(it)) {
+    char *p = mem_p(map_iter_value(it));
+    int expected = count < 20 ? count : (count < 99 ? count + 1 : 20);
+    TEST_ASSERT_EQUAL(expected, p - locs);
+    ++count;
+  }
+  TEST_ASSERT_EQUAL(100, count);
+}
+
+void test_MapDelete_ThenAdd_DropsHoles(void) {
+  char locs[64];
+  map *mapptr = mem_p(maph);
+  for (int i = 0; i < 28; i++) {
+    TEST_ASSERT_TRUE(map_set(maph, (void *)&locs[i], val));
+  }
+  for (int i = 0; i < 20; i++) {
+    TEST_ASSERT_TRUE(map_delete(maph, (void *)&locs[i]));
+  }
+  TEST_ASSERT_EQUAL(8, mapptr->entry_count);
+  TEST_ASSERT_EQUAL(28, mapptr->entries_used);
+
+  // The entries array is full, but the table is not, so the holes are dropped
+  // without growing.
+  TEST_ASSERT_TRUE(map_set(maph, (void *)&locs[28], val));
+  TEST_ASSERT_EQUAL(32, mapptr->table_size);
+  TEST_ASSERT_EQUAL(9, mapptr->entry_count);
+  TEST_ASSERT_EQUAL(9, mapptr->entries_used);
+  for (int i = 0; i < 29; i++) {
+    TEST_ASSERT_EQUAL(i >= 20, mem_is_valid(map_get(maph, (void *)&locs[i])));
+  }
+}
+
+void test_MapIncrementalResize_Iter_KeepsInsertionOrder(void) {
+  char locs[120];
+  map *mapptr = mem_p(maph);
+  TEST_ASSERT_TRUE(map_set_incremental_resize(maph, true));
+  for (int i = 0; i < 114; i++) {
+    TEST_ASSERT_TRUE(
+        map_set(maph, (void *)&locs[i], mem_handle_from_ptr(&locs[i], 1)));
+  }
+  // The 113th key started a resize, and the 114th moved some old entries.
+  // Deleting an old entry that has not moved leaves a hole in its place.
+  TEST_ASSERT_TRUE(map_delete(maph, (void *)&locs[100]));
+  TEST_ASSERT_TRUE(mem_is_valid(mapptr->old_entries_mh));
+  TEST_ASSERT_EQUAL(113, mapptr->entry_count);
+
+  for (int round = 0; round < 2; round++) {
+    int count = 0;
+    for (map_iter it = map_first_value_iter(maph); !map_iter_done(it);
+         it = map_next_value_iter(it)) {
+      char *p = mem_p(map_iter_value(it));
+      TEST_ASSERT_EQUAL(count < 100 ? count : count + 1, p - locs);
+      ++count;
+    }
+    TEST_ASSERT_EQUAL(113, count);
+    // Finishes the resize, then checks the order again.
+    TEST_ASSERT_TRUE(map_set_incremental_resize(maph, false));
+    TEST_ASSERT_FALSE(mem_is_valid(mapptr->old_entries_mh));
+  }
+  TEST_ASSERT_EQUAL(113, mapptr->entry_count);
+}
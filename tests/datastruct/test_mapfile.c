@@ -0,0 +1,179 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "datastruct/hash.h"
+#include "datastruct/map.h"
+#include "datastruct/mapfile.h"
+#include "datastruct/mmap.h"
+#include "datastruct/str.h"
+#include "unity.h"
+
+static const char *TEST_FILE = "test_mapfile_file.tmp";
+
+map_handle maph;
+mapfile_handle mfh;
+
+void setUp(void) {
+  maph = map_create(MEM_ALLOCATOR_PLAIN);
+  mfh = (mapfile_handle){0};
+}
+
+void tearDown(void) {
+  mapfile_close(mfh);
+  map_destroy(maph);
+  remove(TEST_FILE);
+}
+
+// Overwrites bytes of the test file.
+static void patch_test_file(long offset, const void *data, size_t size) {
+  FILE *file = fopen(TEST_FILE, "r+b");
+  TEST_ASSERT_NOT_NULL(file);
+  TEST_ASSERT_EQUAL(0, fseek(file, offset, SEEK_SET));
+  TEST_ASSERT_EQUAL(size, fwrite(data, 1, size, file));
+  fclose(file);
+}
+
+void test_MapfileWrite_Open_FindsValues(void) {
+  uint32_t addresses[] = {0x2000, 0xc000, 0xfffe};
+  map_set(maph, str_from_cstr("start"), mem_handle_from_ptr(&addresses[0], 4));
+  map_set(maph, str_from_cstr("loop"), mem_handle_from_ptr(&addresses[1], 4));
+  map_set(maph, str_from_cstr(""), mem_handle_from_ptr(&addresses[2], 4));
+  map_set(maph, str_from_cstr("label"), str_from_cstr("some text"));
+  TEST_ASSERT_TRUE(mapfile_write(maph, TEST_FILE));
+
+  mfh = mapfile_open(TEST_FILE);
+  TEST_ASSERT_TRUE(mapfile_is_valid(mfh));
+  TEST_ASSERT_EQUAL(4, mapfile_count(mfh));
+  mem_handle value = mapfile_get(mfh, str_from_cstr("loop"));
+  TEST_ASSERT_EQUAL(4, mem_size(value));
+  TEST_ASSERT_EQUAL(0xc000, *(uint32_t *)mem_p(value));
+  TEST_ASSERT_EQUAL(0, (uintptr_t)mem_p(value) % 8);
+  value = mapfile_get(mfh, str_from_cstr(""));
+  TEST_ASSERT_EQUAL(0xfffe, *(uint32_t *)mem_p(value));
+  value = mapfile_get(mfh, str_from_cstr("label"));
+  TEST_ASSERT_EQUAL(0, str_compare(value, str_from_cstr("some text")));
+  TEST_ASSERT_FALSE(mem_is_valid(mapfile_get(mfh, str_from_cstr("star"))));
+  TEST_ASSERT_FALSE(mem_is_valid(mapfile_get(mfh, str_from_cstr("starts"))));
+}
+
+void test_MapfileWrite_ManyKeys_FindsEveryKey(void) {
+  static uint32_t values[10000];
+  char keybuf[16];
+  for (uint32_t i = 0; i < 10000; i++) {
+    values[i] = i * 3;
+    snprintf(keybuf, sizeof(keybuf), "sym_%u", (unsigned int)i);
+    map_set(maph, str_from_cstr(keybuf), mem_handle_from_ptr(&values[i], 4));
+  }
+  // Deleted keys are not written.
+  map_delete(maph, str_from_cstr("sym_5"));
+  TEST_ASSERT_TRUE(mapfile_write(maph, TEST_FILE));
+
+  mfh = mapfile_open(TEST_FILE);
+  TEST_ASSERT_TRUE(mapfile_is_valid(mfh));
+  TEST_ASSERT_EQUAL(9999, mapfile_count(mfh));
+  for (uint32_t i = 0; i < 10000; i++) {
+    snprintf(keybuf, sizeof(keybuf), "sym_%u", (unsigned int)i);
+    mem_handle value = mapfile_get(mfh, str_from_cstr(keybuf));
+    if (i == 5) {
+      TEST_ASSERT_FALSE(mem_is_valid(value));
+    } else {
+      TEST_ASSERT_EQUAL(i * 3, *(uint32_t *)mem_p(value));
+    }
+  }
+}
+
+void test_MapfileWrite_Empty_OpensEmpty(void) {
+  TEST_ASSERT_TRUE(mapfile_write(maph, TEST_FILE));
+  mfh = mapfile_open(TEST_FILE);
+  TEST_ASSERT_TRUE(mapfile_is_valid(mfh));
+  TEST_ASSERT_EQUAL(0, mapfile_count(mfh));
+  TEST_ASSERT_FALSE(mem_is_valid(mapfile_get(mfh, str_from_cstr("key"))));
+}
+
+void test_MapfileWrite_Rewrite_ReplacesFile(void) {
+  map_set(maph, str_from_cstr("old"), str_from_cstr("1"));
+  TEST_ASSERT_TRUE(mapfile_write(maph, TEST_FILE));
+  map_delete(maph, str_from_cstr("old"));
+  map_set(maph, str_from_cstr("new"), str_from_cstr("2"));
+  TEST_ASSERT_TRUE(mapfile_write(maph, TEST_FILE));
+
+  mfh = mapfile_open(TEST_FILE);
+  TEST_ASSERT_FALSE(mem_is_valid(mapfile_get(mfh, str_from_cstr("old"))));
+  TEST_ASSERT_TRUE(mem_is_valid(mapfile_get(mfh, str_from_cstr("new"))));
+}
+
+void test_MapfileWrite_PtrKeysOrHashOnly_Fails(void) {
+  char loc;
+  map_set(maph, (void *)&loc, str_from_cstr("1"));
+  TEST_ASSERT_FALSE(mapfile_write(maph, TEST_FILE));
+
+  map_handle hash_only = map_create_hash_only(MEM_ALLOCATOR_PLAIN);
+  map_set(hash_only, str_from_cstr("key"), str_from_cstr("1"));
+  TEST_ASSERT_FALSE(mapfile_write(hash_only, TEST_FILE));
+  map_destroy(hash_only);
+
+  TEST_ASSERT_FALSE(mapfile_is_valid(mapfile_open(TEST_FILE)));
+}
+
+void test_MapfileOpen_Corrupt_Fails(void) {
+  map_set(maph, str_from_cstr("key"), str_from_cstr("value"));
+  TEST_ASSERT_TRUE(mapfile_write(maph, TEST_FILE));
+
+  // The last byte is part of the value "value", padded to 8 bytes.
+  FILE *file = fopen(TEST_FILE, "rb");
+  TEST_ASSERT_EQUAL(0, fseek(file, 0, SEEK_END));
+  long size = ftell(file);
+  fclose(file);
+  patch_test_file(size - 4, "X", 1);
+  TEST_ASSERT_FALSE(mapfile_is_valid(mapfile_open(TEST_FILE)));
+}
+
+void test_MapfileOpen_OtherVersion_Fails(void) {
+  TEST_ASSERT_TRUE(mapfile_write(maph, TEST_FILE));
+  uint32_t version = MAPFILE_VERSION + 1;
+  patch_test_file(8, &version, sizeof(version));
+  TEST_ASSERT_FALSE(mapfile_is_valid(mapfile_open(TEST_FILE)));
+}
+
+void test_MapfileOpen_Truncated_Fails(void) {
+  map_set(maph, str_from_cstr("key"), str_from_cstr("value"));
+  TEST_ASSERT_TRUE(mapfile_write(maph, TEST_FILE));
+  mem_handle contents = mem_handle_from_file(TEST_FILE);
+  mem_handle copy = mem_duplicate_with_allocator(MEM_ALLOCATOR_PLAIN, contents);
+  mem_free(contents);
+  FILE *file = fopen(TEST_FILE, "wb");
+  fwrite(mem_p(copy), 1, mem_size(copy) - 8, file);
+  fclose(file);
+  mem_free(copy);
+  TEST_ASSERT_FALSE(mapfile_is_valid(mapfile_open(TEST_FILE)));
+}
+
+void test_MapfileOpen_NoEmptySlot_Fails(void) {
+  map_set(maph, str_from_cstr("key"), str_from_cstr("value"));
+  TEST_ASSERT_TRUE(mapfile_write(maph, TEST_FILE));
+
+  // Every slot of the 4-slot table after the 64-byte header refers to the
+  // one entry, with a checksum that matches. A lookup of a missing key would
+  // probe forever.
+  uint32_t slots[4][2] = {{1, 1}, {1, 1}, {1, 1}, {1, 1}};
+  patch_test_file(64, slots, sizeof(slots));
+  mem_handle contents = mem_handle_from_file(TEST_FILE);
+  TEST_ASSERT_TRUE(mem_is_valid(contents));
+  TEST_ASSERT_EQUAL(4, ((uint64_t *)mem_p(contents))[6]);
+  uint64_t checksum = hash_bytes((char *)mem_p(contents) + 64,
+                                 mem_size(contents) - 64, 0x6d617066696c65);
+  mem_free(contents);
+  patch_test_file(56, &checksum, sizeof(checksum));
+  TEST_ASSERT_FALSE(mapfile_is_valid(mapfile_open(TEST_FILE)));
+}
+
+void test_MapfileInvalidHandle_Fails(void) {
+  mapfile_handle bad = (mapfile_handle){0};
+  TEST_ASSERT_FALSE(mapfile_is_valid(bad));
+  TEST_ASSERT_EQUAL(0, mapfile_count(bad));
+  TEST_ASSERT_FALSE(mem_is_valid(mapfile_get(bad, str_from_cstr("key"))));
+  TEST_ASSERT_FALSE(mapfile_is_valid(mapfile_open("no_such_file.tmp")));
+  TEST_ASSERT_FALSE(mapfile_write((map_handle){0}, TEST_FILE));
+  mapfile_close(bad);
+}
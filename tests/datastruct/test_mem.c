@@ -1,8 +1,63 @@
+#include <signal.h>
+#include <stdint.h>
 #include <string.h>
 
 #include "datastruct/mem.h"
 #include "unity.h"
 
+int sigint_count;
+
+void counting_sigint(int sig) {
+  ++sigint_count;
+}
+
+void setUp(void) {
+  sigint_count = 0;
+}
+
+void tearDown(void) {
+  signal(SIGINT, SIG_DFL);
+}
+
+void test_MemHandle_Layout_HasExpectedSize(void) {
+#ifdef DATASTRUCT_COMPACT_HANDLE
+  TEST_ASSERT_EQUAL(16, sizeof(mem_handle));
+#else
+  TEST_ASSERT_EQUAL(sizeof(void *) * 2 + sizeof(mem_allocator),
+                    sizeof(mem_handle));
+#endif
+}
+
+void test_MemHandleAllocator_ReturnsAllocator(void) {
+  mem_handle result = mem_alloc(MEM_ALLOCATOR_PLAIN, sizeof(int));
+  mem_allocator allocator = mem_handle_allocator(result);
+  TEST_ASSERT_EQUAL_PTR(MEM_ALLOCATOR_PLAIN.allocator_spec,
+                        allocator.allocator_spec);
+  mem_free(result);
+  int foo = 0;
+  result = mem_handle_from_ptr(&foo, sizeof(int));
+  TEST_ASSERT_EQUAL_PTR(MEM_ALLOCATOR_NOT_ALLOCATED.allocator_spec,
+                        mem_handle_allocator(result).allocator_spec);
+}
+
+void test_MemAllocatorRegister_HandlesReferToAllocator(void) {
+  int data;
+  mem_allocator allocator =
+      (mem_allocator){.allocator_spec = MEM_ALLOCATOR_PLAIN.allocator_spec,
+                      .allocator_data = &data};
+  TEST_ASSERT_TRUE(mem_allocator_register(&allocator));
+  mem_handle result = mem_alloc(allocator, sizeof(int));
+  TEST_ASSERT_EQUAL_PTR(&data, mem_handle_allocator(result).allocator_data);
+  mem_free(result);
+  mem_allocator_unregister(allocator);
+}
+
+void test_MemAlloc_TooLarge_ReturnsInvalidMemHandle(void) {
+  if (MEM_HANDLE_MAX_SIZE == SIZE_MAX) TEST_IGNORE_MESSAGE("No size limit");
+  mem_handle result = mem_alloc(MEM_ALLOCATOR_PLAIN, MEM_HANDLE_MAX_SIZE + 1);
+  TEST_ASSERT_FALSE(mem_is_valid(result));
+}
+
 void test_MemHandleFromPtr_RepresentsMemory(void) {
   int foo = 0;
   mem_handle result = mem_handle_from_ptr(&foo, sizeof(int));
@@ -41,6 +96,62 @@ void test_MemAllocClear_InvalidAllocator_ReturnsInvalidMemHandle(void) {
   TEST_ASSERT_FALSE(mem_is_valid(result));
 }
 
+void test_MemAllocAligned_LargeAlignment_AlignsMemory(void) {
+  for (size_t alignment = 32; alignment <= 4096; alignment *= 2) {
+    mem_handle result = mem_alloc_aligned(MEM_ALLOCATOR_PLAIN, 10, alignment);
+    TEST_ASSERT_TRUE(mem_is_valid(result));
+    TEST_ASSERT_EQUAL(10, mem_size(result));
+    TEST_ASSERT_EQUAL(0, (uintptr_t)mem_p(result) % alignment);
+    memset(mem_p(result), 7, 10);
+    mem_free(result);
+  }
+}
+
+void test_MemAllocAligned_SmallAlignment_UsesAllocator(void) {
+  mem_handle result = mem_alloc_aligned(MEM_ALLOCATOR_PLAIN, 10, 8);
+  TEST_ASSERT_TRUE(mem_is_valid(result));
+  TEST_ASSERT_EQUAL_PTR(MEM_ALLOCATOR_PLAIN.allocator_spec,
+                        mem_handle_allocator(result).allocator_spec);
+  mem_free(result);
+}
+
+void test_MemAllocAligned_InvalidAlignment_ReturnsInvalidMemHandle(void) {
+  TEST_ASSERT_FALSE(
+      mem_is_valid(mem_alloc_aligned(MEM_ALLOCATOR_PLAIN, 10, 0)));
+  TEST_ASSERT_FALSE(
+      mem_is_valid(mem_alloc_aligned(MEM_ALLOCATOR_PLAIN, 10, 96)));
+  TEST_ASSERT_FALSE(
+      mem_is_valid(mem_alloc_aligned((mem_allocator){0}, 10, 64)));
+}
+
+void test_MemRealloc_Aligned_KeepsAlignmentAndContents(void) {
+  mem_handle result = mem_alloc_aligned(MEM_ALLOCATOR_PLAIN, 16, 64);
+  memset(mem_p(result), 'a', 16);
+  for (size_t size = 32; size <= 65536; size *= 2) {
+    result = mem_realloc(result, size);
+    TEST_ASSERT_TRUE(mem_is_valid(result));
+    TEST_ASSERT_EQUAL(size, mem_size(result));
+    TEST_ASSERT_EQUAL(0, (uintptr_t)mem_p(result) % 64);
+    TEST_ASSERT_EQUAL_MEMORY("aaaaaaaaaaaaaaaa", mem_p(result), 16);
+  }
+  result = mem_realloc(result, 8);
+  TEST_ASSERT_EQUAL(0, (uintptr_t)mem_p(result) % 64);
+  TEST_ASSERT_EQUAL_MEMORY("aaaaaaaa", mem_p(result), 8);
+  mem_free(result);
+}
+
+void test_MemDuplicate_Aligned_KeepsAlignment(void) {
+  mem_handle result = mem_alloc_aligned(MEM_ALLOCATOR_PLAIN, 10, 256);
+  memset(mem_p(result), 'a', 10);
+  mem_handle new_mem = mem_duplicate(result);
+  TEST_ASSERT_TRUE(mem_is_valid(new_mem));
+  TEST_ASSERT_EQUAL(10, mem_size(new_mem));
+  TEST_ASSERT_EQUAL(0, (uintptr_t)mem_p(new_mem) % 256);
+  TEST_ASSERT_EQUAL_MEMORY("aaaaaaaaaa", mem_p(new_mem), 10);
+  mem_free(result);
+  mem_free(new_mem);
+}
+
 void test_MemRealloc_PlainAllocator_ReallocatesMemory(void) {
   mem_handle result = mem_alloc_clear(MEM_ALLOCATOR_PLAIN, sizeof(char[10]));
   TEST_ASSERT_TRUE(mem_is_valid(result));
@@ -61,6 +172,21 @@ void test_MemP_InvalidHandle_ReturnsNullPointer(void) {
   TEST_ASSERT_EQUAL_PTR((void *)0, mem_p((mem_handle){0}));
 }
 
+void *offset_p(mem_handle handle) {
+  return (char *)handle.data + 1;
+}
+
+void test_MemP_SpecWithPFunc_CallsPFunc(void) {
+  static const mem_allocator_spec spec = {
+      .allocator_type = MEM_ALLOCATOR_TYPE_NOT_ALLOCATED, .p_func = offset_p};
+  mem_allocator allocator = {.allocator_spec = &spec};
+  TEST_ASSERT_TRUE(mem_allocator_register(&allocator));
+  char buf[4];
+  mem_handle handle = mem_handle_make(buf, 3, allocator);
+  TEST_ASSERT_EQUAL_PTR(buf + 1, mem_p(handle));
+  mem_allocator_unregister(allocator);
+}
+
 void test_MemDuplicate_PlainAllocatedHandle_ReturnsPlainDuplicate(void) {
   mem_handle result = mem_alloc(MEM_ALLOCATOR_PLAIN, sizeof(char[10]));
   TEST_ASSERT_TRUE(mem_is_valid(result));
@@ -96,3 +222,106 @@ void test_MemDuplicateWithAllocator_FromPtr_ReturnsAllocatedHandle(void) {
   new_mem = mem_free(new_mem);
   TEST_ASSERT_FALSE(mem_is_valid(new_mem));
 }
+
+void test_MemSetSigintHandler_OutsideDeferral_CallsHandler(void) {
+  TEST_ASSERT_TRUE(mem_set_sigint_handler(counting_sigint));
+  raise(SIGINT);
+  TEST_ASSERT_EQUAL(1, sigint_count);
+}
+
+void test_MemSigintDeferEnd_SigintDuringDeferral_CallsHandlerAtEnd(void) {
+  TEST_ASSERT_TRUE(mem_set_sigint_handler(counting_sigint));
+  mem_sigint_defer_begin();
+  raise(SIGINT);
+  TEST_ASSERT_EQUAL(0, sigint_count);
+  mem_sigint_defer_end();
+  TEST_ASSERT_EQUAL(1, sigint_count);
+}
+
+void test_MemSigintDeferEnd_Nested_CallsHandlerAtOutermostEnd(void) {
+  TEST_ASSERT_TRUE(mem_set_sigint_handler(counting_sigint));
+  mem_sigint_defer_begin();
+  mem_sigint_defer_begin();
+  raise(SIGINT);
+  mem_sigint_defer_end();
+  TEST_ASSERT_EQUAL(0, sigint_count);
+  mem_sigint_defer_end();
+  TEST_ASSERT_EQUAL(1, sigint_count);
+}
+
+void test_MemSigintDeferEnd_NoSigint_DoesNotCallHandler(void) {
+  TEST_ASSERT_TRUE(mem_set_sigint_handler(counting_sigint));
+  mem_sigint_defer_begin();
+  mem_sigint_defer_end();
+  TEST_ASSERT_EQUAL(0, sigint_count);
+}
+
+void test_MemAlloc_WithSigintHandler_LeavesHandlerInstalled(void) {
+  TEST_ASSERT_TRUE(mem_set_sigint_handler(counting_sigint));
+  mem_handle result = mem_alloc(MEM_ALLOCATOR_PLAIN, sizeof(int));
+  mem_free(result);
+  raise(SIGINT);
+  TEST_ASSERT_EQUAL(1, sigint_count);
+}
+
+void test_MemStats_Disabled_ReportsNothing(void) {
+  if (mem_stats_enabled()) TEST_IGNORE_MESSAGE("Stats are enabled");
+  mem_handle mh = mem_alloc(MEM_ALLOCATOR_PLAIN, 10);
+  TEST_ASSERT_EQUAL(0, mem_stats_allocator_count());
+  TEST_ASSERT_EQUAL(0, mem_stats_get(MEM_ALLOCATOR_PLAIN).alloc_count);
+  mem_free(mh);
+}
+
+void test_MemStats_AllocAndFree_TracksLiveAndPeakBytes(void) {
+  if (!mem_stats_enabled()) TEST_IGNORE_MESSAGE("Stats are disabled");
+  mem_stats_reset();
+  mem_handle first = mem_alloc(MEM_ALLOCATOR_PLAIN, 100);
+  mem_handle second = mem_alloc(MEM_ALLOCATOR_PLAIN, 28);
+  mem_free(first);
+  mem_stats stats = mem_stats_get(MEM_ALLOCATOR_PLAIN);
+  TEST_ASSERT_EQUAL(2, stats.alloc_count);
+  TEST_ASSERT_EQUAL(1, stats.free_count);
+  TEST_ASSERT_EQUAL(28, stats.live_bytes);
+  TEST_ASSERT_EQUAL(128, stats.peak_bytes);
+  TEST_ASSERT_EQUAL(1, stats.size_histogram[7]);  // 64-127
+  TEST_ASSERT_EQUAL(1, stats.size_histogram[5]);  // 16-31
+  mem_free(second);
+  TEST_ASSERT_EQUAL(0, mem_stats_get(MEM_ALLOCATOR_PLAIN).live_bytes);
+}
+
+void test_MemStats_Realloc_CountsCopies(void) {
+  if (!mem_stats_enabled()) TEST_IGNORE_MESSAGE("Stats are disabled");
+  mem_stats_reset();
+  mem_handle mh = mem_alloc(MEM_ALLOCATOR_PLAIN, 16);
+  mem_handle blocker = mem_alloc(MEM_ALLOCATOR_PLAIN, 16);
+  void *old_p = mem_p(mh);
+  mh = mem_realloc(mh, 100000);
+  mem_stats stats = mem_stats_get(MEM_ALLOCATOR_PLAIN);
+  TEST_ASSERT_EQUAL(1, stats.realloc_count);
+  TEST_ASSERT_EQUAL(old_p != mem_p(mh), stats.realloc_copy_count);
+  TEST_ASSERT_EQUAL(old_p != mem_p(mh) ? 16 : 0, stats.realloc_copy_bytes);
+  TEST_ASSERT_EQUAL(100016, stats.live_bytes);
+  mem_free(mh);
+  mem_free(blocker);
+}
+
+void test_MemStats_SeparateAllocators_TrackedSeparately(void) {
+  if (!mem_stats_enabled()) TEST_IGNORE_MESSAGE("Stats are disabled");
+  mem_stats_reset();
+  int data;
+  mem_allocator other =
+      (mem_allocator){.allocator_spec = MEM_ALLOCATOR_PLAIN.allocator_spec,
+                      .allocator_data = &data};
+  mem_handle first = mem_alloc(MEM_ALLOCATOR_PLAIN, 8);
+  mem_handle second = mem_alloc(other, 8);
+  mem_handle third = mem_alloc(other, 8);
+  TEST_ASSERT_EQUAL(2, mem_stats_allocator_count());
+  TEST_ASSERT_EQUAL(1, mem_stats_get_by_index(0).alloc_count);
+  TEST_ASSERT_EQUAL(2, mem_stats_get_by_index(1).alloc_count);
+  TEST_ASSERT_EQUAL_PTR(&data,
+                        mem_stats_get_by_index(1).allocator.allocator_data);
+  TEST_ASSERT_EQUAL(0, mem_stats_get_by_index(2).alloc_count);
+  mem_free(first);
+  mem_free(second);
+  mem_free(third);
+}
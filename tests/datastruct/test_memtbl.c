@@ -1,4 +1,7 @@
+#include <pthread.h>
 #include <signal.h>
+#include <stdint.h>
+#include <string.h>
 
 #include "datastruct/memtbl.h"
 #include "unity.h"
@@ -88,3 +91,125 @@ void test_MemDuplicate_MemtblAllocatedHandle_ReturnsMemtblDuplicate(void) {
   new_mem = mem_free(new_mem);
   TEST_ASSERT_FALSE(mem_is_valid(new_mem));
 }
+
+void test_MemRealloc_MemtblAllocator_KeepsTableLinked(void) {
+  mem_handle first = mem_alloc(ma, 16);
+  mem_handle middle = mem_alloc(ma, 16);
+  mem_handle last = mem_alloc(ma, 16);
+  memcpy(mem_p(middle), "0123456789abcdef", 16);
+  middle = mem_realloc(middle, 4096);
+  TEST_ASSERT_TRUE(mem_is_valid(middle));
+  TEST_ASSERT_EQUAL_MEMORY("0123456789abcdef", mem_p(middle), 16);
+  mem_free(first);
+  mem_free(last);
+
+  memtbl *tblp = mem_p(mth);
+  TEST_ASSERT_EQUAL_PTR(tblp->first_entry, tblp->last_entry);
+  mem_free(middle);
+  TEST_ASSERT_EQUAL_PTR((memtbl_entry *)0, tblp->first_entry);
+  TEST_ASSERT_EQUAL_PTR((memtbl_entry *)0, tblp->last_entry);
+}
+
+void test_MemAlloc_MemtblAllocatorHugeSize_Fails(void) {
+  // The size with the entry header added would wrap around.
+  TEST_ASSERT_FALSE(mem_is_valid(mem_alloc(ma, SIZE_MAX - 8)));
+  mem_handle mem = mem_alloc(ma, 16);
+  TEST_ASSERT_FALSE(mem_is_valid(mem_realloc(mem, SIZE_MAX - 8)));
+  TEST_ASSERT_TRUE(mem_is_valid(mem));
+  mem_free(mem);
+  TEST_ASSERT_EQUAL_PTR((memtbl_entry *)0, ((memtbl *)mem_p(mth))->first_entry);
+}
+
+void test_MemtblDestroy_UnfreedAllocations_FreesAll(void) {
+  memtbl_handle inner = memtbl_create(ma);
+  TEST_ASSERT_TRUE(memtbl_is_valid(inner));
+  mem_allocator inner_ma = mem_allocator_memtbl(inner);
+  for (int i = 0; i < 100; i++) {
+    TEST_ASSERT_TRUE(mem_is_valid(mem_alloc(inner_ma, i + 1)));
+  }
+  memtbl_destroy(inner);
+}
+
+void test_MemtblRewind_FreesOnlyAllocationsAfterMark(void) {
+  mem_handle before = mem_alloc(ma, 16);
+  memcpy(mem_p(before), "0123456789abcdef", 16);
+  memtbl_checkpoint cp = memtbl_mark(mth);
+  for (int i = 0; i < 10; i++) mem_alloc(ma, 32);
+  memtbl_rewind(mth, cp);
+
+  memtbl *tblp = mem_p(mth);
+  TEST_ASSERT_EQUAL_PTR(tblp->first_entry, tblp->last_entry);
+  TEST_ASSERT_EQUAL_MEMORY("0123456789abcdef", mem_p(before), 16);
+  mem_handle after = mem_alloc(ma, 16);
+  TEST_ASSERT_TRUE(mem_is_valid(after));
+  mem_free(after);
+  mem_free(before);
+  TEST_ASSERT_EQUAL_PTR((memtbl_entry *)0, tblp->first_entry);
+}
+
+void test_MemtblRewind_ReallocAfterMark_KeepsEarlierAllocation(void) {
+  mem_handle before = mem_alloc(ma, 16);
+  memtbl_checkpoint cp = memtbl_mark(mth);
+  mem_alloc(ma, 16);
+  before = mem_realloc(before, 4096);
+  memcpy(mem_p(before), "0123456789abcdef", 16);
+  mem_alloc(ma, 16);
+  memtbl_rewind(mth, cp);
+
+  memtbl *tblp = mem_p(mth);
+  TEST_ASSERT_EQUAL_PTR(tblp->first_entry, tblp->last_entry);
+  TEST_ASSERT_EQUAL_MEMORY("0123456789abcdef", mem_p(before), 16);
+}
+
+void test_MemtblRewind_NestedMarks_RewindsEachLevel(void) {
+  memtbl_checkpoint outer = memtbl_mark(mth);
+  mem_alloc(ma, 16);
+  memtbl_checkpoint inner = memtbl_mark(mth);
+  mem_alloc(ma, 16);
+  mem_alloc(ma, 16);
+  memtbl_rewind(mth, inner);
+
+  memtbl *tblp = mem_p(mth);
+  TEST_ASSERT_NOT_NULL(tblp->first_entry);
+  TEST_ASSERT_EQUAL_PTR(tblp->first_entry, tblp->last_entry);
+
+  mem_alloc(ma, 16);
+  memtbl_rewind(mth, outer);
+  TEST_ASSERT_EQUAL_PTR((memtbl_entry *)0, tblp->first_entry);
+  TEST_ASSERT_EQUAL_PTR((memtbl_entry *)0, tblp->last_entry);
+}
+
+void test_MemtblRewind_InvalidTable_DoesNothing(void) {
+  memtbl_checkpoint cp = memtbl_mark((memtbl_handle){0});
+  memtbl_rewind((memtbl_handle){0}, cp);
+}
+
+// Creates and destroys memtbls, checking that each allocation finds its own
+// table. Returns the number of allocations that did not.
+static void *create_memtbls(void *arg) {
+  (void)arg;
+  uintptr_t errors = 0;
+  for (int i = 0; i < 2000; i++) {
+    memtbl_handle own = memtbl_create(MEM_ALLOCATOR_PLAIN);
+    mem_handle mem = mem_alloc(mem_allocator_memtbl(own), 16);
+    if (!mem_is_valid(mem) ||
+        mem_handle_allocator(mem).allocator_data != mem_p(own)) {
+      ++errors;
+    }
+    memtbl_destroy(own);
+  }
+  return (void *)errors;
+}
+
+void test_MemtblCreate_ManyThreads_RegistersEachTable(void) {
+  pthread_t threads[4];
+  for (int t = 0; t < 4; t++) {
+    TEST_ASSERT_EQUAL(0,
+                      pthread_create(&threads[t], NULL, create_memtbls, NULL));
+  }
+  for (int t = 0; t < 4; t++) {
+    void *errors;
+    pthread_join(threads[t], &errors);
+    TEST_ASSERT_EQUAL(0, (uintptr_t)errors);
+  }
+}
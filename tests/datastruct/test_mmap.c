@@ -0,0 +1,204 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifndef WINDOWS
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "datastruct/mmap.h"
+#include "datastruct/str.h"
+#include "unity.h"
+
+static const char *TEST_FILE = "test_mmap_file.tmp";
+
+static void write_test_file(const char *contents, size_t size) {
+  FILE *outfile = fopen(TEST_FILE, "wb");
+  TEST_ASSERT_NOT_NULL(outfile);
+  TEST_ASSERT_EQUAL(size, fwrite(contents, 1, size, outfile));
+  fclose(outfile);
+}
+
+void tearDown(void) {
+  remove(TEST_FILE);
+}
+
+void test_MemAlloc_Small_AllocatesMemory(void) {
+  mem_handle result = mem_alloc(MEM_ALLOCATOR_MMAP, sizeof(int));
+  TEST_ASSERT_TRUE(mem_is_valid(result));
+  TEST_ASSERT_EQUAL(sizeof(int), mem_size(result));
+  int *ptr = mem_p(result);
+  *ptr = 123;
+  TEST_ASSERT_EQUAL(123, *ptr);
+  mem_free(result);
+}
+
+void test_MemAlloc_Large_MapsPages(void) {
+  mem_handle result = mem_alloc(MEM_ALLOCATOR_MMAP, MMAP_MIN_SIZE + 1);
+  TEST_ASSERT_TRUE(mem_is_valid(result));
+  TEST_ASSERT_EQUAL(MMAP_MIN_SIZE + 1, mem_size(result));
+  TEST_ASSERT_EQUAL(0, (uintptr_t)mem_p(result) % 4096);
+  memset(mem_p(result), 7, MMAP_MIN_SIZE + 1);
+  TEST_ASSERT_EQUAL(7, ((char *)mem_p(result))[MMAP_MIN_SIZE]);
+  mem_free(result);
+}
+
+void test_MemAlloc_Large_IsZeroed(void) {
+  mem_handle result = mem_alloc(MEM_ALLOCATOR_MMAP, MMAP_MIN_SIZE);
+  TEST_ASSERT_TRUE(mem_is_valid(result));
+  char *p = mem_p(result);
+  TEST_ASSERT_EQUAL(0, p[0]);
+  TEST_ASSERT_EQUAL(0, p[MMAP_MIN_SIZE - 1]);
+  mem_free(result);
+}
+
+void test_MemAlloc_Huge_MapsPages(void) {
+  mem_handle result = mem_alloc(MEM_ALLOCATOR_MMAP_HUGE, 4 * 1024 * 1024);
+  TEST_ASSERT_TRUE(mem_is_valid(result));
+  memset(mem_p(result), 7, mem_size(result));
+  TEST_ASSERT_EQUAL(MEM_ALLOCATOR_TYPE_MMAP,
+                    mem_handle_allocator(result).allocator_spec->allocator_type);
+  mem_free(result);
+}
+
+void test_MemRealloc_LargeToLarger_KeepsContents(void) {
+  mem_handle mh = mem_alloc(MEM_ALLOCATOR_MMAP, MMAP_MIN_SIZE);
+  memset(mem_p(mh), 'a', MMAP_MIN_SIZE);
+  mem_handle result = mem_realloc(mh, MMAP_MIN_SIZE * 16);
+  TEST_ASSERT_TRUE(mem_is_valid(result));
+  TEST_ASSERT_EQUAL(MMAP_MIN_SIZE * 16, mem_size(result));
+  char *p = mem_p(result);
+  TEST_ASSERT_EQUAL('a', p[0]);
+  TEST_ASSERT_EQUAL('a', p[MMAP_MIN_SIZE - 1]);
+  TEST_ASSERT_EQUAL(0, p[MMAP_MIN_SIZE]);
+  p[MMAP_MIN_SIZE * 16 - 1] = 'b';
+  mem_free(result);
+}
+
+void test_MemRealloc_WithinPage_KeepsAddress(void) {
+  mem_handle mh = mem_alloc(MEM_ALLOCATOR_MMAP, MMAP_MIN_SIZE + 1);
+  mem_handle result = mem_realloc(mh, MMAP_MIN_SIZE + 2);
+  TEST_ASSERT_TRUE(mem_is_valid(result));
+  TEST_ASSERT_EQUAL_PTR(mem_p(mh), mem_p(result));
+  TEST_ASSERT_EQUAL(MMAP_MIN_SIZE + 2, mem_size(result));
+  mem_free(result);
+}
+
+void test_MemRealloc_LargeToSmaller_KeepsContents(void) {
+  mem_handle mh = mem_alloc(MEM_ALLOCATOR_MMAP, MMAP_MIN_SIZE * 4);
+  memset(mem_p(mh), 'a', MMAP_MIN_SIZE * 4);
+  mem_handle result = mem_realloc(mh, MMAP_MIN_SIZE * 2);
+  TEST_ASSERT_TRUE(mem_is_valid(result));
+  TEST_ASSERT_EQUAL('a', ((char *)mem_p(result))[MMAP_MIN_SIZE * 2 - 1]);
+  mem_free(result);
+}
+
+void test_MemRealloc_AcrossMinSize_CopiesContents(void) {
+  mem_handle mh = mem_alloc(MEM_ALLOCATOR_MMAP_HUGE, 16);
+  memset(mem_p(mh), 'a', 16);
+  mem_handle result = mem_realloc(mh, MMAP_MIN_SIZE * 2);
+  TEST_ASSERT_TRUE(mem_is_valid(result));
+  TEST_ASSERT_EQUAL_MEMORY("aaaaaaaaaaaaaaaa", mem_p(result), 16);
+  TEST_ASSERT_EQUAL(0, (uintptr_t)mem_p(result) % 4096);
+  result = mem_realloc(result, 8);
+  TEST_ASSERT_TRUE(mem_is_valid(result));
+  TEST_ASSERT_EQUAL(8, mem_size(result));
+  TEST_ASSERT_EQUAL_MEMORY("aaaaaaaa", mem_p(result), 8);
+  mem_free(result);
+}
+
+void test_MmapAllocator_GrowsStrbuf(void) {
+  strbuf_handle buf = strbuf_create(MEM_ALLOCATOR_MMAP, 16);
+  TEST_ASSERT_TRUE(strbuf_is_valid(buf));
+  for (int i = 0; i < 100000; i++) strbuf_concatenate_cstr(buf, "abcdefgh");
+  str s = strbuf_str(buf);
+  TEST_ASSERT_EQUAL(800000, str_length(s));
+  TEST_ASSERT_EQUAL_MEMORY("abcdefgh", (char *)mem_p(s) + 799992, 8);
+  strbuf_destroy(buf);
+}
+
+void test_MemHandleFromFile_MapsContents(void) {
+  write_test_file("one two\nthree", 13);
+  mem_handle mh = mem_handle_from_file(TEST_FILE);
+  TEST_ASSERT_TRUE(mem_is_valid(mh));
+  TEST_ASSERT_EQUAL(13, mem_size(mh));
+  TEST_ASSERT_EQUAL_MEMORY("one two\nthree", mem_p(mh), 13);
+  TEST_ASSERT_EQUAL(MEM_ALLOCATOR_TYPE_FILE,
+                    mem_handle_allocator(mh).allocator_spec->allocator_type);
+  TEST_ASSERT_FALSE(mem_is_valid(mem_realloc(mh, 20)));
+  mem_free(mh);
+}
+
+void test_MemHandleFromFile_Empty_IsValid(void) {
+  write_test_file("", 0);
+  mem_handle mh = mem_handle_from_file(TEST_FILE);
+  TEST_ASSERT_TRUE(mem_is_valid(mh));
+  TEST_ASSERT_EQUAL(0, mem_size(mh));
+  mem_free(mh);
+}
+
+void test_MemHandleFromFile_Missing_IsInvalid(void) {
+  mem_handle mh = mem_handle_from_file("no_such_file.tmp");
+  TEST_ASSERT_FALSE(mem_is_valid(mh));
+}
+
+#ifndef WINDOWS
+
+void test_MemHandleFromFile_Pipe_ReadsContents(void) {
+  // Larger than the first read buffer, so that the buffer grows.
+  static const size_t SIZE = 3 * MMAP_MIN_SIZE + 100;
+  int fds[2];
+  TEST_ASSERT_EQUAL(0, pipe(fds));
+  pid_t pid = fork();
+  TEST_ASSERT_TRUE(pid >= 0);
+  if (pid == 0) {
+    close(fds[0]);
+    for (size_t i = 0; i < SIZE; i++) {
+      char c = 'a' + i % 26;
+      if (write(fds[1], &c, 1) != 1) _exit(1);
+    }
+    _exit(0);
+  }
+  close(fds[1]);
+  char path[32];
+  snprintf(path, sizeof(path), "/dev/fd/%d", fds[0]);
+  mem_handle mh = mem_handle_from_file(path);
+  close(fds[0]);
+  waitpid(pid, (int *)0, 0);
+  TEST_ASSERT_TRUE(mem_is_valid(mh));
+  TEST_ASSERT_EQUAL(SIZE, mem_size(mh));
+  const char *p = mem_p(mh);
+  for (size_t i = 0; i < SIZE; i++) TEST_ASSERT_EQUAL('a' + i % 26, p[i]);
+  mem_free(mh);
+}
+
+#endif
+
+void test_MemHandleAdviseRandom_KeepsContents(void) {
+  write_test_file("one two\nthree", 13);
+  mem_handle mh = mem_handle_from_file(TEST_FILE);
+  mem_handle_advise_random(mh);
+  TEST_ASSERT_EQUAL_MEMORY("one two\nthree", mem_p(mh), 13);
+  mem_free(mh);
+
+  // Handles that are not mapped files are left alone.
+  mem_handle plain = mem_alloc(MEM_ALLOCATOR_PLAIN, 8);
+  mem_handle_advise_random(plain);
+  mem_free(plain);
+  mem_handle_advise_random((mem_handle){0});
+}
+
+void test_StrFromFile_SplitsWithoutCopying(void) {
+  write_test_file("alpha beta\n", 11);
+  str text = str_from_file(TEST_FILE);
+  TEST_ASSERT_TRUE(str_is_valid(text));
+  str word;
+  str rest = str_split_whitespace_pop(text, &word);
+  TEST_ASSERT_EQUAL_PTR(mem_p(text), mem_p(word));
+  TEST_ASSERT_EQUAL(0, str_compare(word, str_from_cstr("alpha")));
+  str_split_whitespace_pop(rest, &word);
+  TEST_ASSERT_EQUAL(0, str_compare(word, str_from_cstr("beta")));
+  str_destroy(text);
+}
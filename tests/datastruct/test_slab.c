@@ -0,0 +1,183 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "datastruct/map.h"
+#include "datastruct/memtbl.h"
+#include "datastruct/slab.h"
+#include "datastruct/str.h"
+#include "unity.h"
+
+slab_handle sh;
+mem_allocator sa;
+
+void setUp(void) {
+  sh = slab_create(MEM_ALLOCATOR_PLAIN);
+  sa = mem_allocator_slab(sh);
+}
+
+void tearDown(void) {
+  slab_destroy(sh);
+}
+
+void test_SlabCreate_IsValid(void) {
+  TEST_ASSERT_TRUE(slab_is_valid(sh));
+}
+
+void test_SlabCreate_InvalidAllocator_IsInvalid(void) {
+  slab_handle bad = slab_create((mem_allocator){0});
+  TEST_ASSERT_FALSE(slab_is_valid(bad));
+}
+
+void test_MemAlloc_SlabAllocator_AllocatesMemory(void) {
+  mem_handle result = mem_alloc(sa, sizeof(int));
+  TEST_ASSERT_TRUE(mem_is_valid(result));
+  TEST_ASSERT_EQUAL(sizeof(int), mem_size(result));
+  int *ptr = mem_p(result);
+  *ptr = 123;
+  TEST_ASSERT_EQUAL(123, *ptr);
+}
+
+void test_MemAlloc_SameClass_AllocatesAdjacentObjects(void) {
+  mem_handle first = mem_alloc(sa, 20);
+  mem_handle second = mem_alloc(sa, 30);
+  TEST_ASSERT_EQUAL(0, (uintptr_t)mem_p(first) % 16);
+  TEST_ASSERT_EQUAL_PTR((char *)mem_p(first) + 32, mem_p(second));
+}
+
+void test_MemFree_SlabAllocator_ReusesObject(void) {
+  mem_handle first = mem_alloc(sa, 40);
+  void *first_p = mem_p(first);
+  mem_free(first);
+  mem_handle second = mem_alloc(sa, 48);
+  TEST_ASSERT_EQUAL_PTR(first_p, mem_p(second));
+}
+
+void test_MemAlloc_LargerThanMax_UsesParent(void) {
+  mem_handle result = mem_alloc(sa, SLAB_MAX_OBJECT_SIZE + 1);
+  TEST_ASSERT_TRUE(mem_is_valid(result));
+  memset(mem_p(result), 7, SLAB_MAX_OBJECT_SIZE + 1);
+  TEST_ASSERT_EQUAL(1, ((slab *)mem_p(sh))->large_in_use);
+  TEST_ASSERT_EQUAL(0.0, slab_utilization(sh));
+  mem_free(result);
+  TEST_ASSERT_EQUAL(0, ((slab *)mem_p(sh))->large_in_use);
+}
+
+void test_MemRealloc_SameClass_KeepsObject(void) {
+  mem_handle mh = mem_alloc(sa, 17);
+  memset(mem_p(mh), 'a', 17);
+  mem_handle result = mem_realloc(mh, 32);
+  TEST_ASSERT_TRUE(mem_is_valid(result));
+  TEST_ASSERT_EQUAL_PTR(mem_p(mh), mem_p(result));
+  TEST_ASSERT_EQUAL(32, mem_size(result));
+}
+
+void test_MemRealloc_NewClass_CopiesContents(void) {
+  mem_handle mh = mem_alloc(sa, 16);
+  memset(mem_p(mh), 'a', 16);
+  mem_handle result = mem_realloc(mh, 100);
+  TEST_ASSERT_TRUE(mem_is_valid(result));
+  TEST_ASSERT_EQUAL(100, mem_size(result));
+  TEST_ASSERT_EQUAL_MEMORY("aaaaaaaaaaaaaaaa", mem_p(result), 16);
+  TEST_ASSERT_EQUAL(0, slab_get_class_stats(sh, 0).objects_in_use);
+  TEST_ASSERT_EQUAL(1, slab_get_class_stats(sh, 5).objects_in_use);
+}
+
+void test_MemRealloc_SmallToLarge_CopiesContents(void) {
+  mem_handle mh = mem_alloc(sa, 16);
+  memset(mem_p(mh), 'a', 16);
+  mem_handle result = mem_realloc(mh, 1000);
+  TEST_ASSERT_TRUE(mem_is_valid(result));
+  TEST_ASSERT_EQUAL_MEMORY("aaaaaaaaaaaaaaaa", mem_p(result), 16);
+  result = mem_realloc(result, 2000);
+  TEST_ASSERT_TRUE(mem_is_valid(result));
+  TEST_ASSERT_EQUAL_MEMORY("aaaaaaaaaaaaaaaa", mem_p(result), 16);
+  result = mem_realloc(result, 8);
+  TEST_ASSERT_TRUE(mem_is_valid(result));
+  TEST_ASSERT_EQUAL_MEMORY("aaaaaaaa", mem_p(result), 8);
+  mem_free(result);
+  TEST_ASSERT_EQUAL(0, ((slab *)mem_p(sh))->large_in_use);
+}
+
+void test_MemAllocAligned_SlabAllocator_KeepsAlignment(void) {
+  mem_handle mh = mem_alloc_aligned(sa, 32, 64);
+  TEST_ASSERT_TRUE(mem_is_valid(mh));
+  TEST_ASSERT_EQUAL(0, (uintptr_t)mem_p(mh) % 64);
+  memset(mem_p(mh), 'a', 32);
+  mem_handle result = mem_realloc(mh, 500);
+  TEST_ASSERT_TRUE(mem_is_valid(result));
+  TEST_ASSERT_EQUAL(0, (uintptr_t)mem_p(result) % 64);
+  TEST_ASSERT_EQUAL_MEMORY("aaaaaaaaaaaaaaaa", mem_p(result), 16);
+  mem_free(result);
+  TEST_ASSERT_EQUAL(0, ((slab *)mem_p(sh))->large_in_use);
+  TEST_ASSERT_EQUAL(0.0, slab_utilization(sh));
+}
+
+void test_MemAlloc_ManyObjects_AllocatesPages(void) {
+  size_t per_page = slab_get_class_stats(sh, 3).object_capacity;
+  TEST_ASSERT_EQUAL(0, per_page);
+  mem_alloc(sa, 64);
+  per_page = slab_get_class_stats(sh, 3).object_capacity;
+  TEST_ASSERT_GREATER_THAN(0, per_page);
+  for (size_t i = 1; i <= per_page; i++) {
+    mem_handle mh = mem_alloc(sa, 64);
+    TEST_ASSERT_TRUE(mem_is_valid(mh));
+    memset(mem_p(mh), 1, 64);
+  }
+  slab_class_stats stats = slab_get_class_stats(sh, 3);
+  TEST_ASSERT_EQUAL(64, stats.object_size);
+  TEST_ASSERT_EQUAL(2, stats.page_count);
+  TEST_ASSERT_EQUAL(per_page + 1, stats.objects_in_use);
+  TEST_ASSERT_EQUAL(per_page * 2, stats.object_capacity);
+}
+
+void test_SlabUtilization_ReportsFractionInUse(void) {
+  TEST_ASSERT_EQUAL(0.0, slab_utilization(sh));
+  mem_handle mh = mem_alloc(sa, 16);
+  slab_class_stats stats = slab_get_class_stats(sh, 0);
+  double expected = 1.0 / stats.object_capacity;
+  TEST_ASSERT_TRUE(slab_utilization(sh) > expected * 0.99);
+  TEST_ASSERT_TRUE(slab_utilization(sh) < expected * 1.01);
+  mem_free(mh);
+  TEST_ASSERT_EQUAL(0.0, slab_utilization(sh));
+}
+
+void test_SlabGetClassStats_InvalidClass_IsZero(void) {
+  slab_class_stats stats = slab_get_class_stats(sh, SLAB_CLASS_COUNT);
+  TEST_ASSERT_EQUAL(0, stats.object_size);
+  stats = slab_get_class_stats((slab_handle){0}, 0);
+  TEST_ASSERT_EQUAL(0, stats.object_size);
+}
+
+void test_SlabAllocator_ServesMapsAndStrbufs(void) {
+  map_handle maps[100];
+  strbuf_handle bufs[100];
+  for (int i = 0; i < 100; i++) {
+    maps[i] = map_create(sa);
+    TEST_ASSERT_TRUE(map_is_valid(maps[i]));
+    map_set(maps[i], (void *)maps, mem_handle_from_ptr(maps, i));
+    bufs[i] = strbuf_create(sa, 8);
+    TEST_ASSERT_TRUE(strbuf_is_valid(bufs[i]));
+    strbuf_concatenate_cstr(bufs[i], "hello, slab world");
+  }
+  for (int i = 0; i < 100; i++) {
+    TEST_ASSERT_EQUAL(i, mem_size(map_get(maps[i], (void *)maps)));
+    TEST_ASSERT_EQUAL(0, str_compare(strbuf_str(bufs[i]),
+                                     str_from_cstr("hello, slab world")));
+    map_destroy(maps[i]);
+    strbuf_destroy(bufs[i]);
+  }
+  TEST_ASSERT_EQUAL(0, ((slab *)mem_p(sh))->large_in_use);
+  TEST_ASSERT_EQUAL(0.0, slab_utilization(sh));
+}
+
+void test_SlabDestroy_FreesPagesFromParent(void) {
+  memtbl_handle mth = memtbl_create(MEM_ALLOCATOR_PLAIN);
+  slab_handle msh = slab_create(mem_allocator_memtbl(mth));
+  mem_allocator msa = mem_allocator_slab(msh);
+  for (int i = 0; i < 2000; i++) mem_alloc(msa, 96);
+  slab_destroy(msh);
+  memtbl *mtp = mem_p(mth);
+  TEST_ASSERT_NULL(mtp->first_entry);
+  memtbl_destroy(mth);
+}
@@ -1,3 +1,7 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
 #include "datastruct/mem.h"
 #include "datastruct/memtbl.h"
 #include "datastruct/str.h"
@@ -190,6 +194,68 @@ void test_StrFind_DelimLongerThanStr_NotFound(void) {
   TEST_ASSERT_EQUAL(-1, pos);
 }
 
+void test_StrFind_EmptySubstring_FoundAtStart(void) {
+  TEST_ASSERT_EQUAL(0, str_find(str_from_cstr("one"), str_from_cstr("")));
+}
+
+// The byte-at-a-time search that str_find replaces
+static int naive_find(const char *h, size_t n, const char *needle, size_t m) {
+  for (size_t i = 0; i + m <= n; i++) {
+    if (memcmp(h + i, needle, m) == 0) return (int)i;
+  }
+  return -1;
+}
+
+void test_StrFind_LongStrings_MatchesNaiveSearch(void) {
+  // A small alphabet makes many partial matches, and needles cross every
+  // 16- and 32-byte block boundary.
+  char h[300];
+  srand(1);
+  for (size_t i = 0; i < sizeof(h); i++) h[i] = "abc"[rand() % 3];
+  for (size_t m = 1; m < 12; m++) {
+    for (size_t start = 0; start + m <= sizeof(h); start += 7) {
+      str needle = mem_handle_from_ptr(h + start, m);
+      for (size_t n = m; n <= sizeof(h); n += 37) {
+        str haystack = mem_handle_from_ptr(h, n);
+        int expected = naive_find(h, n, h + start, m);
+        TEST_ASSERT_EQUAL(expected, str_find(haystack, needle));
+        str_finder finder = str_finder_make(needle);
+        TEST_ASSERT_EQUAL(expected, str_finder_find(&finder, haystack));
+      }
+    }
+  }
+}
+
+void test_StrFind_ManyFalseCandidates_FallsBackAndFinds(void) {
+  char h[4096];
+  memset(h, 'a', sizeof(h));
+  str haystack = mem_handle_from_ptr(h, sizeof(h));
+  str needle = str_from_cstr("aaaab");
+  TEST_ASSERT_EQUAL(-1, str_find(haystack, needle));
+  h[3000] = 'b';
+  TEST_ASSERT_EQUAL(2996, str_find(haystack, needle));
+  str_finder finder = str_finder_make(needle);
+  TEST_ASSERT_EQUAL(2996, str_finder_find(&finder, haystack));
+  TEST_ASSERT_EQUAL(2999, str_find(haystack, str_from_cstr("ab")));
+}
+
+void test_StrFinderFind_ManyStrs_FindsEach(void) {
+  str_finder finder = str_finder_make(str_from_cstr("\r\n"));
+  TEST_ASSERT_EQUAL(3, str_finder_find(&finder, str_from_cstr("one\r\n")));
+  TEST_ASSERT_EQUAL(0, str_finder_find(&finder, str_from_cstr("\r\ntwo")));
+  TEST_ASSERT_EQUAL(-1, str_finder_find(&finder, str_from_cstr("three\n")));
+  TEST_ASSERT_EQUAL(-1, str_finder_find(&finder, str_from_cstr("\r")));
+}
+
+void test_StrFinderFind_InvalidInputs_NotFound(void) {
+  str_finder finder = str_finder_make((str){0});
+  TEST_ASSERT_EQUAL(-1, str_finder_find(&finder, str_from_cstr("one")));
+  finder = str_finder_make(str_from_cstr("on"));
+  TEST_ASSERT_EQUAL(-1, str_finder_find(&finder, (str){0}));
+  TEST_ASSERT_EQUAL(-1, str_finder_find((const str_finder *)0,
+                                        str_from_cstr("one")));
+}
+
 void test_StrCompare_FirstLessThanSecond_Neg1(void) {
   TEST_ASSERT_EQUAL(
       -1, str_compare(str_from_cstr("camper"), str_from_cstr("compare")));
@@ -306,6 +372,24 @@ void test_StrSplitPop_ThreeDelim_PopsFourTimes(void) {
   }
 }
 
+void test_StrSplitPopFinder_MultiByteDelim_PopsEachLine(void) {
+  char *expected[] = {"one", "", "two", "three"};
+  int expected_count = 4;
+  int expected_i = 0;
+  str val = str_from_cstr("one\r\n\r\ntwo\r\nthree");
+  str_finder finder = str_finder_make(str_from_cstr("\r\n"));
+  str part;
+
+  while (str_is_valid(val)) {
+    TEST_ASSERT_TRUE(expected_i < expected_count);
+    val = str_split_pop_finder(val, &finder, &part);
+    TEST_ASSERT_EQUAL(0,
+                      str_compare(str_from_cstr(expected[expected_i]), part));
+    ++expected_i;
+  }
+  TEST_ASSERT_EQUAL(expected_count, expected_i);
+}
+
 void assert_whitespace_pop(char *cstr, char **expected, int expected_count) {
   str val = str_from_cstr(cstr);
   int expected_i = 0;
@@ -350,6 +434,152 @@ void test_StrSplitWhitespacePop_LeadingInterTrailingSpace_ReturnsExpectedStrings
                         (char *[]){"one", "two", "three"}, 3);
 }
 
+void assert_tokenize(char *cstr, const char *delim_bytes, char **expected,
+                     size_t expected_count) {
+  str_delims delims = str_delims_make(str_from_cstr(delim_bytes));
+  str tokens[8];
+  size_t count;
+  str rest = str_tokenize(str_from_cstr(cstr), &delims, tokens, 8, &count);
+  TEST_ASSERT_FALSE(str_is_valid(rest));
+  TEST_ASSERT_EQUAL(expected_count, count);
+  for (size_t i = 0; i < count; i++) {
+    TEST_ASSERT_EQUAL(0, str_compare(str_from_cstr(expected[i]), tokens[i]));
+  }
+}
+
+void test_StrTokenize_Whitespace_SkipsRepeatedDelims(void) {
+  assert_tokenize("  one  \t\t \ntwo three\t\v \n ", STR_WHITESPACE,
+                  (char *[]){"one", "two", "three"}, 3);
+  assert_tokenize("one", STR_WHITESPACE, (char *[]){"one"}, 1);
+}
+
+void test_StrTokenize_OnlyDelims_NoTokens(void) {
+  assert_tokenize("", STR_WHITESPACE, (char *[]){""}, 0);
+  assert_tokenize(" \t \n ", STR_WHITESPACE, (char *[]){""}, 0);
+}
+
+void test_StrTokenize_CustomDelims_SplitsFields(void) {
+  assert_tokenize("loop: lda $d020,x ; border", " :,;",
+                  (char *[]){"loop", "lda", "$d020", "x", "border"}, 5);
+  // With no delimiters, the whole str is one token.
+  assert_tokenize("lda $d020", "", (char *[]){"lda $d020"}, 1);
+}
+
+void test_StrTokenize_FullArray_ReturnsRest(void) {
+  str_delims delims = str_delims_make(str_from_cstr(","));
+  str val = str_from_cstr("a,b,,c,d,");
+  str tokens[2];
+  size_t count;
+  val = str_tokenize(val, &delims, tokens, 2, &count);
+  TEST_ASSERT_EQUAL(2, count);
+  TEST_ASSERT_EQUAL(0, str_compare(str_from_cstr(",,c,d,"), val));
+  TEST_ASSERT_EQUAL(0, str_compare(str_from_cstr("b"), tokens[1]));
+  val = str_tokenize(val, &delims, tokens, 2, &count);
+  TEST_ASSERT_EQUAL(2, count);
+  TEST_ASSERT_EQUAL(0, str_compare(str_from_cstr("c"), tokens[0]));
+  TEST_ASSERT_EQUAL(0, str_compare(str_from_cstr("d"), tokens[1]));
+  // Only a delimiter is left.
+  TEST_ASSERT_TRUE(str_is_valid(val));
+  val = str_tokenize(val, &delims, tokens, 2, &count);
+  TEST_ASSERT_EQUAL(0, count);
+  TEST_ASSERT_FALSE(str_is_valid(val));
+
+  // A last token at the end of the str leaves no rest.
+  val = str_tokenize(str_from_cstr("a,b"), &delims, tokens, 2, &count);
+  TEST_ASSERT_EQUAL(2, count);
+  TEST_ASSERT_FALSE(str_is_valid(val));
+}
+
+void test_StrTokenize_LongStr_MatchesWhitespacePop(void) {
+  // Tokens of every length cross the 64-byte block boundaries.
+  char text[1000];
+  srand(2);
+  for (size_t i = 0; i < sizeof(text) - 1; i++) {
+    text[i] = rand() % 4 ? 'a' + rand() % 26 : " \t\n\v\f\r"[rand() % 6];
+  }
+  text[sizeof(text) - 1] = '\0';
+  str_delims delims = str_delims_make(str_from_cstr(STR_WHITESPACE));
+  for (size_t start = 0; start < 70; start++) {
+    str expected_val = str_from_cstr(text + start);
+    str val = expected_val;
+    while (str_is_valid(val)) {
+      str tokens[5];
+      size_t count;
+      val = str_tokenize(val, &delims, tokens, 5, &count);
+      for (size_t i = 0; i < count; i++) {
+        str expected;
+        expected_val = str_split_whitespace_pop(expected_val, &expected);
+        TEST_ASSERT_EQUAL_PTR(mem_p(expected), mem_p(tokens[i]));
+        TEST_ASSERT_EQUAL(mem_size(expected), mem_size(tokens[i]));
+      }
+    }
+    // str_split_whitespace_pop ends with an empty part after trailing space.
+    if (str_is_valid(expected_val)) {
+      str expected;
+      str_split_whitespace_pop(expected_val, &expected);
+      TEST_ASSERT_EQUAL(0, mem_size(expected));
+    }
+  }
+}
+
+void test_StrTokenize_ManyDelims_UsesBitmap(void) {
+  char delim_bytes[64];
+  for (int i = 0; i < 26; i++) delim_bytes[i] = 'A' + i;
+  delim_bytes[26] = '\0';
+  char text[200];
+  for (size_t i = 0; i < sizeof(text) - 1; i++) text[i] = i % 3 ? 'x' : 'Q';
+  text[sizeof(text) - 1] = '\0';
+  str_delims delims = str_delims_make(str_from_cstr(delim_bytes));
+  TEST_ASSERT_EQUAL(26, delims.byte_count);
+  str tokens[100];
+  size_t count;
+  str_tokenize(str_from_cstr(text), &delims, tokens, 100, &count);
+  TEST_ASSERT_EQUAL(66, count);
+  for (size_t i = 0; i < count; i++) {
+    TEST_ASSERT_EQUAL(0, str_compare(str_from_cstr("xx"), tokens[i]));
+  }
+}
+
+void test_StrTokenize_MappedFile_StopsAtEnd(void) {
+  // A file the size of a page ends in a token, with no byte after it.
+  static const char *TEST_FILE = "test_str_tokenize.tmp";
+  char contents[4096];
+  memset(contents, ' ', sizeof(contents));
+  memcpy(contents + sizeof(contents) - 4, "last", 4);
+  memcpy(contents, "first", 5);
+  FILE *outfile = fopen(TEST_FILE, "wb");
+  TEST_ASSERT_NOT_NULL(outfile);
+  TEST_ASSERT_EQUAL(sizeof(contents),
+                    fwrite(contents, 1, sizeof(contents), outfile));
+  fclose(outfile);
+
+  str text = str_from_file(TEST_FILE);
+  TEST_ASSERT_TRUE(str_is_valid(text));
+  str_delims delims = str_delims_make(str_from_cstr(STR_WHITESPACE));
+  str tokens[4];
+  size_t count;
+  str rest = str_tokenize(text, &delims, tokens, 4, &count);
+  TEST_ASSERT_FALSE(str_is_valid(rest));
+  TEST_ASSERT_EQUAL(2, count);
+  TEST_ASSERT_EQUAL(0, str_compare(str_from_cstr("first"), tokens[0]));
+  TEST_ASSERT_EQUAL(0, str_compare(str_from_cstr("last"), tokens[1]));
+  str_destroy(text);
+  remove(TEST_FILE);
+}
+
+void test_StrTokenize_InvalidInputs_NoTokens(void) {
+  str_delims delims = str_delims_make((str){0});
+  TEST_ASSERT_EQUAL(0, delims.byte_count);
+  str tokens[1];
+  size_t count = 7;
+  TEST_ASSERT_FALSE(
+      str_is_valid(str_tokenize((str){0}, &delims, tokens, 1, &count)));
+  TEST_ASSERT_EQUAL(0, count);
+  TEST_ASSERT_FALSE(str_is_valid(str_tokenize(
+      str_from_cstr("a"), (const str_delims *)0, tokens, 1, &count)));
+  TEST_ASSERT_EQUAL(0, count);
+}
+
 void test_StrbufCreate_CreatesValid_DestroyOk(void) {
   strbuf_handle bufhdl = strbuf_create(MEM_ALLOCATOR_PLAIN, 64);
   TEST_ASSERT_TRUE(strbuf_is_valid(bufhdl));
@@ -0,0 +1,132 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "datastruct/str.h"
+#include "datastruct/strarena.h"
+#include "unity.h"
+
+strarena_handle sah;
+
+void setUp(void) {
+  sah = strarena_create(MEM_ALLOCATOR_PLAIN, 256);
+}
+
+void tearDown(void) {
+  strarena_destroy(sah);
+}
+
+void test_StrarenaCreate_IsValid(void) {
+  TEST_ASSERT_TRUE(strarena_is_valid(sah));
+  TEST_ASSERT_EQUAL(0, strarena_string_bytes(sah));
+}
+
+void test_StrarenaCreate_InvalidAllocator_IsInvalid(void) {
+  strarena_handle bad = strarena_create((mem_allocator){0}, 256);
+  TEST_ASSERT_FALSE(strarena_is_valid(bad));
+}
+
+void test_StrarenaCreate_HugeChunkSize_IsInvalid(void) {
+  // The chunk size with the chunk header added would wrap around.
+  strarena_handle bad = strarena_create(MEM_ALLOCATOR_PLAIN, SIZE_MAX - 8);
+  TEST_ASSERT_FALSE(strarena_is_valid(bad));
+}
+
+void test_StrarenaAdd_CopiesWithNullTerminator(void) {
+  char buf[8] = "label";
+  str s = strarena_add(sah, str_from_cstr(buf));
+  strcpy(buf, "xxxxx");
+  TEST_ASSERT_TRUE(str_is_valid(s));
+  TEST_ASSERT_EQUAL(5, mem_size(s));
+  TEST_ASSERT_EQUAL_STRING("label", mem_p(s));
+  TEST_ASSERT_EQUAL(6, strarena_string_bytes(sah));
+}
+
+void test_StrarenaAdd_PacksStringsWithoutPadding(void) {
+  str first = strarena_add_cstr(sah, "ab");
+  str second = strarena_add_cstr(sah, "cde");
+  str empty = strarena_add_cstr(sah, "");
+  TEST_ASSERT_EQUAL_PTR((char *)mem_p(first) + 3, mem_p(second));
+  TEST_ASSERT_EQUAL_PTR((char *)mem_p(second) + 4, mem_p(empty));
+  TEST_ASSERT_EQUAL(0, mem_size(empty));
+  TEST_ASSERT_EQUAL_STRING("", mem_p(empty));
+}
+
+void test_StrarenaAdd_StrbufGrows_StrStaysValid(void) {
+  strbuf_handle buf = strbuf_create(MEM_ALLOCATOR_PLAIN, 4);
+  str saved[100];
+  char expected[100][16];
+  for (int i = 0; i < 100; i++) {
+    // Growing the strbuf moves its data, so each str is saved in the arena.
+    snprintf(expected[i], sizeof(expected[i]), "s%d", i);
+    size_t size = strlen(expected[i]);
+    strbuf_concatenate_cstr(buf, expected[i]);
+    str s = strbuf_str(buf);
+    char *end = (char *)mem_p(s) + mem_size(s);
+    saved[i] = strarena_add(sah, mem_handle_from_ptr(end - size, size));
+  }
+  strbuf_destroy(buf);
+  for (int i = 0; i < 100; i++) {
+    TEST_ASSERT_EQUAL_STRING(expected[i], mem_p(saved[i]));
+  }
+}
+
+void test_StrarenaAdd_ManyStrings_FewChunks(void) {
+  char keybuf[16];
+  str saved[1000];
+  for (int i = 0; i < 1000; i++) {
+    snprintf(keybuf, sizeof(keybuf), "sym_%d", i);
+    saved[i] = strarena_add_cstr(sah, keybuf);
+    TEST_ASSERT_TRUE(str_is_valid(saved[i]));
+  }
+  for (int i = 0; i < 1000; i++) {
+    snprintf(keybuf, sizeof(keybuf), "sym_%d", i);
+    TEST_ASSERT_EQUAL_STRING(keybuf, mem_p(saved[i]));
+  }
+  // Chunks are only as many as the strings need.
+  size_t bytes = strarena_string_bytes(sah);
+  TEST_ASSERT_TRUE(strarena_memory_use(sah) < bytes + bytes / 2);
+}
+
+void test_StrarenaAdd_LargerThanChunk_Succeeds(void) {
+  char big[1000];
+  memset(big, 'x', sizeof(big) - 1);
+  big[sizeof(big) - 1] = '\0';
+  str small = strarena_add_cstr(sah, "small");
+  str s = strarena_add_cstr(sah, big);
+  TEST_ASSERT_EQUAL(999, mem_size(s));
+  TEST_ASSERT_EQUAL_STRING(big, mem_p(s));
+  TEST_ASSERT_EQUAL_STRING("small", mem_p(small));
+}
+
+void test_StrarenaReset_ReusesChunks(void) {
+  for (int i = 0; i < 100; i++) strarena_add_cstr(sah, "0123456789");
+  size_t memory_use = strarena_memory_use(sah);
+  str first = strarena_add_cstr(sah, "first");
+  strarena_reset(sah);
+  TEST_ASSERT_EQUAL(0, strarena_string_bytes(sah));
+  str again = strarena_add_cstr(sah, "again");
+  TEST_ASSERT_NOT_EQUAL(mem_p(first), mem_p(again));
+  for (int i = 0; i < 100; i++) strarena_add_cstr(sah, "0123456789");
+  TEST_ASSERT_TRUE(strarena_memory_use(sah) <= memory_use + 256);
+}
+
+void test_MemFree_StrarenaStr_DoesNothing(void) {
+  str s = strarena_add_cstr(sah, "keep");
+  mem_free(s);
+  str next = strarena_add_cstr(sah, "next");
+  TEST_ASSERT_EQUAL_STRING("keep", (char *)mem_p(next) - 5);
+}
+
+void test_StrarenaInvalidHandle_Fails(void) {
+  strarena_handle bad = (strarena_handle){0};
+  TEST_ASSERT_FALSE(strarena_is_valid(bad));
+  TEST_ASSERT_FALSE(str_is_valid(strarena_add(bad, str_from_cstr("a"))));
+  TEST_ASSERT_FALSE(str_is_valid(strarena_add_cstr(bad, "a")));
+  TEST_ASSERT_EQUAL(0, strarena_string_bytes(bad));
+  TEST_ASSERT_EQUAL(0, strarena_memory_use(bad));
+  TEST_ASSERT_FALSE(str_is_valid(strarena_add(sah, (str){0})));
+  TEST_ASSERT_FALSE(str_is_valid(strarena_add_cstr(sah, (const char *)0)));
+  strarena_reset(bad);
+  strarena_destroy(bad);
+}
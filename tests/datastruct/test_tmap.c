@@ -0,0 +1,237 @@
+#include <stdint.h>
+#include <stdio.h>
+
+#include "datastruct/str.h"
+#include "datastruct/tmap.h"
+#include "unity.h"
+
+// A user-defined variant
+typedef struct pos {
+  uint16_t line;
+  uint16_t col;
+} pos;
+TMAP_DEFINE(map_u32_pos, U32, pos)
+
+map_str_u32_handle counts;
+map_u32_u32_handle labels;
+
+void setUp(void) {
+  counts = map_str_u32_create(MEM_ALLOCATOR_PLAIN);
+  labels = map_u32_u32_create(MEM_ALLOCATOR_PLAIN);
+}
+
+void tearDown(void) {
+  map_str_u32_destroy(counts);
+  map_u32_u32_destroy(labels);
+}
+
+void test_TmapCreate_IntKeys_PacksEntries(void) {
+  TEST_ASSERT_TRUE(map_u32_u32_is_valid(labels));
+  TEST_ASSERT_EQUAL(8, ((tmap *)mem_p(labels))->entry_size);
+
+  map_u64_u64_handle wide = map_u64_u64_create(MEM_ALLOCATOR_PLAIN);
+  TEST_ASSERT_EQUAL(16, ((tmap *)mem_p(wide))->entry_size);
+  map_u64_u64_destroy(wide);
+
+  // A uint32_t key is padded so that a pointer value is aligned.
+  map_u32_ptr_handle ptrs = map_u32_ptr_create(MEM_ALLOCATOR_PLAIN);
+  TEST_ASSERT_EQUAL(sizeof(void *), ((tmap *)mem_p(ptrs))->value_offset);
+  map_u32_ptr_destroy(ptrs);
+}
+
+void test_TmapCreate_StrKey_PacksEntries(void) {
+  // A str key is the address of the map's copy and a 32-bit size.
+  TEST_ASSERT_EQUAL(16, ((tmap *)mem_p(counts))->entry_size);
+  TEST_ASSERT_EQUAL(24, ((tmap *)mem_p(counts))->slot_size);
+}
+
+void test_TmapCreate_ValueTooLarge_ReturnsInvalidHandle(void) {
+  tmap_handle th = tmap_create(MEM_ALLOCATOR_PLAIN, TMAP_KEY_U32,
+                               TMAP_MAX_VALUE_SIZE + 1, 1);
+  TEST_ASSERT_FALSE(tmap_is_valid(th));
+  th = tmap_create(MEM_ALLOCATOR_PLAIN, TMAP_KEY_U32, 4, 3);
+  TEST_ASSERT_FALSE(tmap_is_valid(th));
+}
+
+void test_TmapGet_UnsetKey_ReturnsNull(void) {
+  TEST_ASSERT_NULL(map_str_u32_get(counts, str_from_cstr("key1")));
+  TEST_ASSERT_NULL(map_u32_u32_get(labels, 0x2000));
+}
+
+void test_TmapSet_StrKey_FindsValue(void) {
+  char buf[] = "key1";
+  TEST_ASSERT_TRUE(map_str_u32_set(counts, str_from_cstr(buf), 17));
+  // The map keeps its own copy of the key.
+  buf[0] = 'K';
+  uint32_t *value = map_str_u32_get(counts, str_from_cstr("key1"));
+  TEST_ASSERT_NOT_NULL(value);
+  TEST_ASSERT_EQUAL(17, *value);
+  TEST_ASSERT_NULL(map_str_u32_get(counts, str_from_cstr(buf)));
+
+  TEST_ASSERT_TRUE(map_str_u32_set(counts, str_from_cstr(""), 3));
+  TEST_ASSERT_EQUAL(3, *map_str_u32_get(counts, str_from_cstr("")));
+  TEST_ASSERT_EQUAL(2, map_str_u32_count(counts));
+}
+
+void test_TmapSet_ExistingKey_ReplacesValue(void) {
+  TEST_ASSERT_TRUE(map_u32_u32_set(labels, 0x2000, 1));
+  TEST_ASSERT_TRUE(map_u32_u32_set(labels, 0x2000, 2));
+  TEST_ASSERT_EQUAL(2, *map_u32_u32_get(labels, 0x2000));
+  TEST_ASSERT_EQUAL(1, map_u32_u32_count(labels));
+}
+
+void test_TmapGetOrInsert_NewKey_ZeroesValue(void) {
+  bool inserted;
+  uint32_t *count =
+      map_str_u32_get_or_insert(counts, str_from_cstr("word"), &inserted);
+  TEST_ASSERT_NOT_NULL(count);
+  TEST_ASSERT_TRUE(inserted);
+  TEST_ASSERT_EQUAL(0, *count);
+  ++*count;
+  count = map_str_u32_get_or_insert(counts, str_from_cstr("word"), &inserted);
+  TEST_ASSERT_FALSE(inserted);
+  TEST_ASSERT_EQUAL(1, *count);
+}
+
+void test_TmapGetOrInsert_CountsWords(void) {
+  static const char *WORDS[] = {"lda", "sta", "lda", "jmp", "lda", "sta"};
+  for (unsigned int i = 0; i < sizeof(WORDS) / sizeof(WORDS[0]); i++) {
+    uint32_t *count =
+        map_str_u32_get_or_insert(counts, str_from_cstr(WORDS[i]), (bool *)0);
+    TEST_ASSERT_NOT_NULL(count);
+    ++*count;
+  }
+  TEST_ASSERT_EQUAL(3, map_str_u32_count(counts));
+  TEST_ASSERT_EQUAL(3, *map_str_u32_get(counts, str_from_cstr("lda")));
+  TEST_ASSERT_EQUAL(2, *map_str_u32_get(counts, str_from_cstr("sta")));
+  TEST_ASSERT_EQUAL(1, *map_str_u32_get(counts, str_from_cstr("jmp")));
+}
+
+void test_TmapSet_28BitAddresses_FindsAll(void) {
+  // Addresses in chip RAM, and the top of the 28-bit address space.
+  static const uint32_t BASES[] = {0x0000000, 0x0ff0000, 0xfffe000};
+  for (unsigned int b = 0; b < 3; b++) {
+    for (uint32_t i = 0; i < 2000; i++) {
+      TEST_ASSERT_TRUE(map_u32_u32_set(labels, BASES[b] + i * 3, b * 2000 + i));
+    }
+  }
+  TEST_ASSERT_EQUAL(6000, map_u32_u32_count(labels));
+  for (unsigned int b = 0; b < 3; b++) {
+    for (uint32_t i = 0; i < 2000; i++) {
+      uint32_t *value = map_u32_u32_get(labels, BASES[b] + i * 3);
+      TEST_ASSERT_NOT_NULL(value);
+      TEST_ASSERT_EQUAL(b * 2000 + i, *value);
+      TEST_ASSERT_NULL(map_u32_u32_get(labels, BASES[b] + i * 3 + 1));
+    }
+  }
+}
+
+void test_TmapSet_29Keys_GrowsTable(void) {
+  tmap *tp = mem_p(labels);
+  TEST_ASSERT_EQUAL(32, tp->table_size);
+  for (uint32_t i = 0; i < 28; i++) {
+    TEST_ASSERT_TRUE(map_u32_u32_set(labels, i, i));
+  }
+  TEST_ASSERT_EQUAL(32, tp->table_size);
+  TEST_ASSERT_TRUE(map_u32_u32_set(labels, 28, 28));
+  TEST_ASSERT_EQUAL(64, tp->table_size);
+  for (uint32_t i = 0; i < 29; i++) {
+    TEST_ASSERT_EQUAL(i, *map_u32_u32_get(labels, i));
+  }
+}
+
+void test_TmapDelete_ManyKeys_KeepsOtherKeysAndShrinks(void) {
+  char word[16];
+  for (unsigned int i = 0; i < 1000; i++) {
+    snprintf(word, sizeof(word), "sym_%u", i);
+    TEST_ASSERT_TRUE(map_str_u32_set(counts, str_from_cstr(word), i));
+  }
+  TEST_ASSERT_EQUAL(2048, ((tmap *)mem_p(counts))->table_size);
+  for (unsigned int i = 0; i < 1000; i++) {
+    if (i % 10 == 0) continue;
+    snprintf(word, sizeof(word), "sym_%u", i);
+    TEST_ASSERT_TRUE(map_str_u32_delete(counts, str_from_cstr(word)));
+    TEST_ASSERT_FALSE(map_str_u32_delete(counts, str_from_cstr(word)));
+  }
+  // The table halves each time it falls below 1/8 full, as a map's does.
+  TEST_ASSERT_EQUAL(100, map_str_u32_count(counts));
+  TEST_ASSERT_EQUAL(512, ((tmap *)mem_p(counts))->table_size);
+  for (unsigned int i = 0; i < 1000; i++) {
+    snprintf(word, sizeof(word), "sym_%u", i);
+    uint32_t *value = map_str_u32_get(counts, str_from_cstr(word));
+    if (i % 10 == 0) {
+      TEST_ASSERT_NOT_NULL(value);
+      TEST_ASSERT_EQUAL(i, *value);
+    } else {
+      TEST_ASSERT_NULL(value);
+    }
+  }
+}
+
+void test_TmapIter_VisitsEachEntryOnce(void) {
+  for (uint32_t i = 1; i <= 100; i++) {
+    TEST_ASSERT_TRUE(map_u32_u32_set(labels, i << 12, i));
+  }
+  uint32_t key_total = 0, value_total = 0;
+  unsigned int visits = 0;
+  for (tmap_iter it = map_u32_u32_first_iter(labels); !tmap_iter_done(it);
+       it = tmap_next_iter(it)) {
+    key_total += map_u32_u32_iter_key(it) >> 12;
+    value_total += *map_u32_u32_iter_value(it);
+    ++visits;
+  }
+  TEST_ASSERT_EQUAL(100, visits);
+  TEST_ASSERT_EQUAL(5050, key_total);
+  TEST_ASSERT_EQUAL(5050, value_total);
+}
+
+void test_TmapIter_StrKeys_ReturnsKeys(void) {
+  TEST_ASSERT_TRUE(map_str_u32_set(counts, str_from_cstr("only"), 1));
+  tmap_iter it = map_str_u32_first_iter(counts);
+  TEST_ASSERT_FALSE(tmap_iter_done(it));
+  TEST_ASSERT_EQUAL(
+      0, str_compare(str_from_cstr("only"), map_str_u32_iter_key(it)));
+  TEST_ASSERT_TRUE(tmap_iter_done(tmap_next_iter(it)));
+}
+
+void test_TmapPtrKeys_FindsValues(void) {
+  int things[4];
+  map_ptr_ptr_handle owners = map_ptr_ptr_create(MEM_ALLOCATOR_PLAIN);
+  for (unsigned int i = 0; i < 4; i++) {
+    TEST_ASSERT_TRUE(map_ptr_ptr_set(owners, &things[i], &things[3 - i]));
+  }
+  for (unsigned int i = 0; i < 4; i++) {
+    TEST_ASSERT_EQUAL_PTR(&things[3 - i], *map_ptr_ptr_get(owners, &things[i]));
+  }
+  TEST_ASSERT_NULL(map_ptr_ptr_get(owners, &owners));
+  map_ptr_ptr_destroy(owners);
+}
+
+void test_TmapDefine_StructValue_StoresInline(void) {
+  map_u32_pos_handle positions = map_u32_pos_create(MEM_ALLOCATOR_PLAIN);
+  TEST_ASSERT_TRUE(map_u32_pos_is_valid(positions));
+  TEST_ASSERT_EQUAL(8, ((tmap *)mem_p(positions))->entry_size);
+  TEST_ASSERT_TRUE(
+      map_u32_pos_set(positions, 0xd020, (pos){.line = 12, .col = 4}));
+  pos *p = map_u32_pos_get(positions, 0xd020);
+  TEST_ASSERT_NOT_NULL(p);
+  TEST_ASSERT_EQUAL(12, p->line);
+  TEST_ASSERT_EQUAL(4, p->col);
+  map_u32_pos_destroy(positions);
+}
+
+void test_TmapGet_U32KeyOutOfRange_ReturnsNull(void) {
+  TEST_ASSERT_NULL(tmap_get_or_insert(labels, (str){0}, 1ULL << 32, NULL));
+  TEST_ASSERT_EQUAL(0, map_u32_u32_count(labels));
+}
+
+void test_TmapInvalidHandle_Fails(void) {
+  map_u32_u32_handle bad = (map_u32_u32_handle){0};
+  TEST_ASSERT_FALSE(map_u32_u32_is_valid(bad));
+  TEST_ASSERT_NULL(map_u32_u32_get(bad, 1));
+  TEST_ASSERT_FALSE(map_u32_u32_set(bad, 1, 1));
+  TEST_ASSERT_FALSE(map_u32_u32_delete(bad, 1));
+  TEST_ASSERT_EQUAL(0, map_u32_u32_count(bad));
+  TEST_ASSERT_TRUE(tmap_iter_done(map_u32_u32_first_iter(bad)));
+  map_u32_u32_destroy(bad);
+}